@@ -287,6 +287,7 @@ static char *conpty_init(const BackendVtable *vt, Seat *seat,
      * Specials are always available.
      */
     seat_update_specials_menu(conpty->seat);
+    seat_notify_session_started(conpty->seat);
 
   out:
     if (in_r != INVALID_HANDLE_VALUE)
@@ -158,6 +158,7 @@ static WinGuiFrontend *create_frontend(Conf *conf, const char *session_name) {
     wgf->caretbm = CreateBitmap(wgf->font_width, wgf->font_height, 1, 1, bits);
     sfree(bits);
 
+    wgf->last_visible = GETTICKCOUNT();
     wgf->session_id = session_counter++;
     wgf->session_name = session_name;
     wgf->remote_closed = true;
@@ -170,11 +171,14 @@ static WinGuiFrontend *create_frontend(Conf *conf, const char *session_name) {
 }
 
 static void destroy_frontend(WinGuiFrontend *wgf) {
+    bulk_launch_session_done(wgf, false);
+    expire_timer_context(wgf);
     DeleteObject(wgf->caretbm);
 
     sfree(wgf->find.pattern);
 
     log_free(wgf->logctx);
+    term_hibernation_free(&wgf->hibernation);
     term_free(wgf->term);
 
     sfree(wgf->logpal);
@@ -325,9 +329,65 @@ static void realize_palette(WinGuiFrontend *wgf) {
     }
 }
 
+/* Background sessions which have not been shown for
+   cmdline_hibernate_minutes pack their scrollback and drop the other
+   terminal buffers that can be rebuilt, see term_hibernate(). The backend
+   stays connected and its output keeps going into the terminal. The buffers
+   are restored when the session is activated again; the event log reports
+   the memory released and the time taken to wake up. */
+#define HIBERNATE_CHECK_INTERVAL (60 * TICKSPERSEC)
+
+static unsigned long hibernate_next;
+
+static void hibernate_session(WinGuiFrontend *wgf) {
+    size_t freed = term_hibernate(wgf->term, &wgf->hibernation);
+    wgf->hibernated = true;
+    lp_eventlog(&wgf->logpolicy, "Session hibernated, %d scrollback lines packed "
+                "into %d bytes, %"SIZEu" bytes released", wgf->hibernation.lines,
+                wgf->hibernation.len, freed);
+}
+
+static void wake_session(WinGuiFrontend *wgf) {
+    LARGE_INTEGER freq, start, end;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    term_wake(wgf->term, &wgf->hibernation);
+    QueryPerformanceCounter(&end);
+    wgf->hibernated = false;
+    lp_eventlog(&wgf->logpolicy, "Session woken up in %.1f ms",
+                (end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart);
+}
+
+static void hibernate_timer(void *ctx, unsigned long now) {
+    if (now != hibernate_next) {
+        return;
+    }
+    unsigned long idle = (unsigned long)cmdline_hibernate_minutes * 60 * TICKSPERSEC;
+    for (int i = 0; i < session_registry_size(); i++) {
+        WinGuiFrontend *wgf = (WinGuiFrontend *)session_registry_at(i);
+        if (wgf != wgf_active && !wgf->hibernated && now - wgf->last_visible >= idle) {
+            hibernate_session(wgf);
+        }
+    }
+    hibernate_next = schedule_timer(HIBERNATE_CHECK_INTERVAL, hibernate_timer, NULL);
+}
+
+static void start_hibernate_timer() {
+    if (cmdline_hibernate_minutes > 0) {
+        hibernate_next = schedule_timer(HIBERNATE_CHECK_INTERVAL, hibernate_timer, NULL);
+    }
+}
+
 static void activate_session(WinGuiFrontend *wgf) {
-    tab_bar_clear_tab_notified(wgf->tab_index);
-    tab_bar_select_tab(wgf->tab_index);
+    int index = frontend_tab_index(wgf);
+    tab_bar_clear_tab_notified(index);
+    tab_bar_select_tab(index);
+    if (wgf_active) {
+        wgf_active->last_visible = GETTICKCOUNT();
+    }
+    if (wgf->hibernated) {
+        wake_session(wgf);
+    }
     wgf_active = wgf;
     wgf->find.update_finddlg_pending = true;
     realize_palette(wgf);
@@ -403,34 +463,151 @@ static void add_session(Conf *conf, const char *session_name, int index) {
     }
     add_session_tab(conf_get_int(conf, CONF_protocol), session_name, index);
     WinGuiFrontend *wgf = create_frontend(conf, session_name);
-    pointer_array_insert(index, wgf);
+    wgf->registry_id = session_registry_add(wgf, index);
     activate_session(wgf);
     start_backend(wgf);
 }
 
 static void delete_session(WinGuiFrontend *wgf) {
-    int deleted_index = wgf->tab_index;
-    int index = wgf_active->tab_index;
-    if (pointer_array_size() > 1 && index == deleted_index) {
-        if (index+1 == pointer_array_size()) {
+    int deleted_index = frontend_tab_index(wgf);
+    int index = frontend_tab_index(wgf_active);
+    if (session_registry_size() > 1 && index == deleted_index) {
+        if (index+1 == session_registry_size()) {
             index--;
         } else {
             index++;
         }
-        activate_session((WinGuiFrontend *)pointer_array_get(index));
+        activate_session((WinGuiFrontend *)session_registry_at(index));
     }
     tab_bar_remove_tab(deleted_index);
-    pointer_array_remove(deleted_index);
-    if (pointer_array_size() == 0) {
+    session_registry_remove(wgf->registry_id);
+    if (session_registry_size() == 0) {
         SetFocus(NULL);
     }
     destroy_frontend(wgf);
-    if (pointer_array_size() == 0) {
+    if (session_registry_size() == 0) {
         wgf_active = NULL;
         DestroyWindow(frame_hwnd);
     }
 }
 
+/* Bulk launch of saved sessions. The tabs are created at once, but only the
+   first session is activated, the window reset, resize and repaint of the
+   others is done when they are first shown. The backends are started from
+   timers staggered by BULK_LAUNCH_STAGGER, so the name lookups and connection
+   setups are spread out while the handshakes of the sessions already started
+   proceed concurrently in the event loop. Each session logs when it got
+   connected, and the last one to finish the time taken by the whole set. */
+#define BULK_LAUNCH_STAGGER (TICKSPERSEC / 20)
+
+typedef struct BulkLaunch {
+    unsigned long start;
+    int total;
+    int pending;
+    int connected;
+} BulkLaunch;
+
+static void bulk_launch_session_done(WinGuiFrontend *wgf, bool connected) {
+    BulkLaunch *bulk = wgf->bulk_launch;
+    if (!bulk) {
+        return;
+    }
+    wgf->bulk_launch = NULL;
+    unsigned long elapsed = GETTICKCOUNT() - bulk->start;
+    if (connected) {
+        bulk->connected++;
+        lp_eventlog(&wgf->logpolicy, "Connected %lu ms after bulk launch", elapsed);
+    }
+    if (--bulk->pending == 0) {
+        lp_eventlog(&wgf->logpolicy, "Bulk launch: %d of %d sessions connected in %lu ms",
+                    bulk->connected, bulk->total, elapsed);
+        sfree(bulk);
+    }
+}
+
+static void bulk_start_backend(void *ctx, unsigned long now) {
+    WinGuiFrontend *wgf = (WinGuiFrontend *)ctx;
+    if (wgf->backend || !wgf->remote_closed) {
+        return;  /* already restarted by the user */
+    }
+    start_backend(wgf);
+    if (wgf->remote_closed) {
+        bulk_launch_session_done(wgf, false);
+    }
+}
+
+static void bulk_launch(char **names, int count, bool activate) {
+    BulkLaunch *bulk = snew(BulkLaunch);
+    memset(bulk, 0, sizeof(*bulk));
+    bulk->start = GETTICKCOUNT();
+    WinGuiFrontend *first = NULL;
+    for (int i = 0; i < count; i++) {
+        Conf *conf = conf_new();
+        conf_set_int(conf, CONF_logtype, LGTYP_NONE);
+        do_defaults(names[i], conf);
+        if (!conf_launchable(conf)) {
+            conf_free(conf);
+            continue;
+        }
+        int index = session_registry_size();
+        add_session_tab(conf_get_int(conf, CONF_protocol), names[i], index);
+        WinGuiFrontend *wgf = create_frontend(conf, dupstr(names[i]));
+        wgf->registry_id = session_registry_add(wgf, index);
+        wgf->bulk_launch = bulk;
+        schedule_timer(bulk->total * BULK_LAUNCH_STAGGER, bulk_start_backend, wgf);
+        bulk->total++;
+        if (!first) {
+            first = wgf;
+        }
+    }
+    bulk->pending = bulk->total;
+    if (!first) {
+        sfree(bulk);
+        return;
+    }
+    if (activate) {
+        activate_session(first);
+    }
+}
+
+/* Expands a comma separated list of saved session names, where an item
+   ending with '/' stands for all saved sessions starting with it. */
+char **expand_bulk_session_list(const char *list, int *count) {
+    struct sesslist sl;
+    get_sesslist(&sl, true);
+    char **names = NULL;
+    size_t size = 0;
+    *count = 0;
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        if (len > 0 && list[len-1] == '/') {
+            /* skip sl.sessions[0] == Default Settings */
+            for (int i = 1; i < sl.nsessions; i++) {
+                if (!strncmp(sl.sessions[i], list, len)) {
+                    sgrowarray(names, size, *count);
+                    names[(*count)++] = dupstr(sl.sessions[i]);
+                }
+            }
+        } else if (len > 0) {
+            sgrowarray(names, size, *count);
+            names[(*count)++] = dupprintf("%.*s", (int)len, list);
+        }
+        list += len;
+        if (*list == ',') {
+            list++;
+        }
+    }
+    get_sesslist(&sl, false);
+    return names;
+}
+
+static void free_bulk_session_list(char **names, int count) {
+    for (int i = 0; i < count; i++) {
+        sfree(names[i]);
+    }
+    sfree(names);
+}
+
 static void show_finddlg(WinGuiFrontend *wgf) {
     const int default_pattern_buffer_len = 16;
     if (!wgf->find.pattern) {
@@ -571,15 +748,15 @@ static void handle_wm_notify(LPARAM lParam) {
     int index = tab_bar_get_current_tab();
     switch (nmhdr->_hdr.code) {
       case TCN_SELCHANGE: {
-        activate_session((WinGuiFrontend *)pointer_array_get(index));
+        activate_session((WinGuiFrontend *)session_registry_at(index));
         break;
       }
       case TCN_TABEXCHANGE: {
-        pointer_array_exchange(nmhdr->_tabOrigin, index);
+        session_registry_move(session_registry_id_at(nmhdr->_tabOrigin), index);
         break;
       }
       case TCN_TABDELETE: {
-        WinGuiFrontend *wgf = (WinGuiFrontend *)pointer_array_get(nmhdr->_tabOrigin);
+        WinGuiFrontend *wgf = (WinGuiFrontend *)session_registry_at(nmhdr->_tabOrigin);
         if (!wgf->remote_closed && conf_get_bool(wgf->conf, CONF_warn_on_close)) {
             if (index != nmhdr->_tabOrigin) {
                 index = nmhdr->_tabOrigin;
@@ -15,11 +15,17 @@ static void set_scrollbar(int total, int start, int page, bool redraw);
 static bool set_frame_style(Conf *conf);
 static void realize_palette(WinGuiFrontend *wgf);
 
+static void hibernate_session(WinGuiFrontend *wgf);
+static void wake_session(WinGuiFrontend *wgf);
+static void start_hibernate_timer();
 static void activate_session(WinGuiFrontend *wgf);
 static char *create_tab_title(int id, const char *session_name);
 static void add_session_tab(int protocol, const char *session_name, int index);
 static void add_session(Conf *conf, const char *session_name, int index);
 static void delete_session(WinGuiFrontend *wgf);
+static void bulk_launch_session_done(WinGuiFrontend *wgf, bool connected);
+static void bulk_launch(char **names, int count, bool activate);
+static void free_bulk_session_list(char **names, int count);
 
 static void handle_wm_notify(LPARAM lParam);
 static void handle_wm_initmenu(WPARAM wParam);
@@ -0,0 +1,42 @@
+#include "glyphwidth.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGE_SIZE (1 << GLYPH_WIDTH_PAGE_BITS)
+#define UNKNOWN_WIDTH -1
+
+void glyph_width_table_init(GlyphWidthTable *t) {
+    memset(t, 0, sizeof(GlyphWidthTable));
+}
+
+void glyph_width_table_clear(GlyphWidthTable *t) {
+    for (int i = 0; i < GLYPH_WIDTH_PAGES; i++) {
+        free(t->pages[i]);
+    }
+    glyph_width_table_init(t);
+}
+
+int glyph_width_table_get(GlyphWidthTable *t, unsigned int cp, glyph_width_measure measure, void *ctx) {
+    if (cp >= GLYPH_WIDTH_MAX) {
+        t->misses++;
+        return measure(ctx, cp);
+    }
+    signed char *page = t->pages[cp >> GLYPH_WIDTH_PAGE_BITS];
+    if (!page) {
+        page = malloc(PAGE_SIZE);
+        memset(page, UNKNOWN_WIDTH, PAGE_SIZE);
+        t->pages[cp >> GLYPH_WIDTH_PAGE_BITS] = page;
+    }
+    signed char *width = &page[cp & (PAGE_SIZE - 1)];
+    if (*width == UNKNOWN_WIDTH) {
+        int measured = measure(ctx, cp);
+        t->misses++;
+        if (measured < 0 || measured > 127) {
+            return measured;
+        }
+        *width = measured;
+    } else {
+        t->hits++;
+    }
+    return *width;
+}
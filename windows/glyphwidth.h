@@ -0,0 +1,24 @@
+#ifndef GLYPHWIDTH_H
+#define GLYPHWIDTH_H
+
+/* Code point -> character cell width table of a font. The widths are
+   measured by a callback on the first lookup of a code point and kept in
+   pages of 256 entries allocated on demand. */
+
+#define GLYPH_WIDTH_MAX 0x110000
+#define GLYPH_WIDTH_PAGE_BITS 8
+#define GLYPH_WIDTH_PAGES (GLYPH_WIDTH_MAX >> GLYPH_WIDTH_PAGE_BITS)
+
+typedef int (*glyph_width_measure)(void *ctx, unsigned int cp);
+
+typedef struct GlyphWidthTable {
+    signed char *pages[GLYPH_WIDTH_PAGES];
+    unsigned long hits;
+    unsigned long misses;
+} GlyphWidthTable;
+
+void glyph_width_table_init(GlyphWidthTable *t);
+void glyph_width_table_clear(GlyphWidthTable *t);
+int glyph_width_table_get(GlyphWidthTable *t, unsigned int cp, glyph_width_measure measure, void *ctx);
+
+#endif
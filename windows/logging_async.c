@@ -0,0 +1,70 @@
+/*
+ * Session logging with the disk writes moved to a background thread.
+ *
+ * logging.c is compiled through this file with fwrite/fflush/fclose
+ * redirected to a LogWriter per log file, see logwriter.h. logging.c
+ * closes its file only in logfclose(), whose LogContext is ctx, so the
+ * statistics of the writer go to the event log of the session there.
+ */
+
+#include <stdio.h>
+#include "putty.h"
+#include "logging_async.h"
+#include "logwriter.h"
+
+LogAsyncPolicy log_async_policy = LOG_ASYNC_BLOCK;
+
+static size_t log_async_fwrite(const void *ptr, size_t size, size_t n, FILE *fp)
+{
+    LogWriter *w = log_writer_find(fp);
+    if (!w) {
+        w = log_writer_new(fp);
+    }
+    return log_writer_write(w, ptr, size * n, (LogWriterPolicy)log_async_policy) ? n : 0;
+}
+
+static int log_async_fflush(FILE *fp)
+{
+    LogWriter *w = log_writer_find(fp);
+    if (!w) {
+        return fflush(fp);
+    }
+    log_writer_flush(w);
+    return 0;
+}
+
+static int log_async_fclose(LogPolicy *lp, FILE *fp)
+{
+    LogWriter *w = log_writer_find(fp);
+    if (w) {
+        LogWriterStats stats;
+        bool ok = log_writer_close(w, &stats);
+        char *msg = dupprintf("Log writer: %"PRIu64" bytes in %"PRIu64" writes and %"PRIu64" flushes, "
+                              "queue up to %"PRIu64" bytes, %"PRIu64" bytes dropped, up to %"PRIu64" bytes spilled%s",
+                              stats.bytes_written, stats.writes, stats.flushes, (uint64_t)stats.max_queue_depth,
+                              stats.bytes_dropped, (uint64_t)stats.max_spilled, ok ? "" : ", a write failed");
+        lp_eventlog(lp, msg);
+        sfree(msg);
+    }
+    return fclose(fp);
+}
+
+bool log_async_set_policy(const char *name)
+{
+    if (!strcmp(name, "block")) {
+        log_async_policy = LOG_ASYNC_BLOCK;
+    } else if (!strcmp(name, "drop")) {
+        log_async_policy = LOG_ASYNC_DROP;
+    } else if (!strcmp(name, "spill")) {
+        log_async_policy = LOG_ASYNC_SPILL;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#define fwrite(ptr, size, n, fp) log_async_fwrite(ptr, size, n, fp)
+#define fflush(fp) log_async_fflush(fp)
+#define fclose(fp) log_async_fclose(ctx->lp, fp)
+
+#include "logging.c"
@@ -0,0 +1,18 @@
+#ifndef LOGGING_ASYNC_H
+#define LOGGING_ASYNC_H
+
+#include <stdbool.h>
+
+/* What a session log does when its queue is full, the values are those of
+   LogWriterPolicy. */
+typedef enum {
+    LOG_ASYNC_BLOCK,  /* wait for the writer thread to make room */
+    LOG_ASYNC_DROP,   /* discard what does not fit and count it */
+    LOG_ASYNC_SPILL   /* keep the excess in memory until the ring has room */
+} LogAsyncPolicy;
+
+extern LogAsyncPolicy log_async_policy;
+
+bool log_async_set_policy(const char *name);
+
+#endif
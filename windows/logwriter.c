@@ -0,0 +1,371 @@
+#include "logwriter.h"
+#include "logwriterthread.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_WRITER_RING_MASK (LOG_WRITER_RING_SIZE - 1)
+#define LOG_WRITER_WAKE_DEPTH (LOG_WRITER_RING_SIZE / 4)
+
+typedef struct SpillChunk SpillChunk;
+struct SpillChunk {
+    SpillChunk *next;
+    size_t len;
+    size_t pos;
+    char data[];
+};
+
+/* The fields marked with lock are shared with the writer thread and are
+   only accessed with the lock held, head and tail are the ring's indices
+   and are advanced by one side each. */
+struct LogWriter {
+    FILE *fp;
+    char *ring;
+    volatile size_t head;   /* advanced by the writer thread only */
+    volatile size_t tail;   /* advanced by the UI thread only */
+    SpillChunk *spill_head, *spill_tail;  /* UI thread only */
+    size_t spilled;
+    volatile long flush_requested;
+    volatile long closing;
+    volatile long failed;
+    LwEvent *space_event;
+    LwEvent *drained_event;
+    bool drained;           /* lock, the writer thread is done with it */
+    bool dirty;             /* writer thread only */
+    LogWriterStats stats;   /* lock */
+    LogWriter *next;        /* lock */
+};
+
+/* The list is modified only by the UI thread and only while holding the
+   lock, so the UI thread may walk it without locking. */
+static LogWriter *writers = NULL;
+static LwLock *lock = NULL;
+static LwEvent *wake_event = NULL;
+static bool writer_thread = false;
+static LogWriterStats closed_stats;
+static bool paused = false;     /* lock */
+static bool busy = false;       /* lock, the writer thread is in a pass */
+
+static size_t ring_depth(LogWriter *w)
+{
+    size_t tail = w->tail;
+    lw_barrier();
+    return tail - w->head;
+}
+
+static size_t ring_put(LogWriter *w, const char *data, size_t len)
+{
+    size_t head = w->head;
+    lw_barrier();
+    size_t tail = w->tail;
+    size_t space = LOG_WRITER_RING_SIZE - (tail - head);
+    if (len > space) {
+        len = space;
+    }
+    size_t offset = tail & LOG_WRITER_RING_MASK;
+    size_t first = LOG_WRITER_RING_SIZE - offset;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(w->ring + offset, data, first);
+    memcpy(w->ring, data + first, len - first);
+    lw_barrier();
+    w->tail = tail + len;
+    return len;
+}
+
+static void spill_add(LogWriter *w, const char *data, size_t len)
+{
+    SpillChunk *c = malloc(sizeof(SpillChunk) + len);
+    c->next = NULL;
+    c->len = len;
+    c->pos = 0;
+    memcpy(c->data, data, len);
+    if (w->spill_tail) {
+        w->spill_tail->next = c;
+    } else {
+        w->spill_head = c;
+    }
+    w->spill_tail = c;
+    w->spilled += len;
+}
+
+static void spill_clear(LogWriter *w)
+{
+    while (w->spill_head) {
+        SpillChunk *c = w->spill_head;
+        w->spill_head = c->next;
+        free(c);
+    }
+    w->spill_tail = NULL;
+    w->spilled = 0;
+}
+
+static void move_spill(LogWriter *w)
+{
+    while (w->spill_head) {
+        SpillChunk *c = w->spill_head;
+        size_t put = ring_put(w, c->data + c->pos, c->len - c->pos);
+        c->pos += put;
+        w->spilled -= put;
+        if (c->pos < c->len) {
+            break;
+        }
+        w->spill_head = c->next;
+        if (!w->spill_head) {
+            w->spill_tail = NULL;
+        }
+        free(c);
+    }
+}
+
+static void wait_for_space(LogWriter *w)
+{
+    lw_event_set(wake_event);
+    lw_event_wait(w->space_event, -1);
+}
+
+typedef struct {
+    uint64_t written;
+    uint64_t writes;
+    uint64_t flushes;
+    bool drained;
+} DrainResult;
+
+/* Writes out the ring of w, called without the lock. */
+static void drain(LogWriter *w, bool timeout, DrainResult *r)
+{
+    bool closing = w->closing;
+    size_t tail = w->tail;
+    lw_barrier();
+    size_t head = w->head;
+
+    while (head != tail && !w->failed) {
+        size_t offset = head & LOG_WRITER_RING_MASK;
+        size_t len = LOG_WRITER_RING_SIZE - offset;
+        if (len > tail - head) {
+            len = tail - head;
+        }
+        if (fwrite(w->ring + offset, 1, len, w->fp) < len) {
+            lw_exchange(&w->failed, 1);
+        }
+        head += len;
+        r->written += len;
+        r->writes++;
+        w->dirty = true;
+    }
+    lw_barrier();
+    w->head = tail;
+    lw_event_set(w->space_event);
+
+    if (lw_exchange(&w->flush_requested, 0) || timeout || closing) {
+        if (w->dirty) {
+            fflush(w->fp);
+            r->flushes++;
+            w->dirty = false;
+        }
+    }
+    r->drained = closing;
+}
+
+static LogWriter *next_writer(LogWriter *w)
+{
+    while (w && w->drained) {
+        w = w->next;
+    }
+    return w;
+}
+
+/* A writer which is not drained stays in the list, so the list can be
+   followed from it once the lock is taken again. */
+static void writer_threadfunc(void *param)
+{
+    for (;;) {
+        bool timeout = !lw_event_wait(wake_event, LOG_WRITER_FLUSH_INTERVAL);
+        lw_lock(lock);
+        busy = true;
+        LogWriter *w = (paused ? NULL : next_writer(writers));
+        while (w) {
+            lw_unlock(lock);
+            DrainResult r = {0};
+            drain(w, timeout, &r);
+            lw_lock(lock);
+            w->stats.bytes_written += r.written;
+            w->stats.writes += r.writes;
+            w->stats.flushes += r.flushes;
+            if (r.drained) {
+                w->drained = true;
+                lw_event_set(w->drained_event);
+            }
+            w = (paused ? NULL : next_writer(w->next));
+        }
+        busy = false;
+        lw_unlock(lock);
+    }
+}
+
+LogWriter *log_writer_find(FILE *fp)
+{
+    for (LogWriter *w = writers; w; w = w->next) {
+        if (w->fp == fp) {
+            return w;
+        }
+    }
+    return NULL;
+}
+
+static void start_writer_thread(void)
+{
+    if (!writer_thread) {
+        lock = lw_lock_new();
+        wake_event = lw_event_new(false);
+        lw_thread_start(writer_threadfunc, NULL);
+        writer_thread = true;
+    }
+}
+
+LogWriter *log_writer_new(FILE *fp)
+{
+    start_writer_thread();
+    LogWriter *w = malloc(sizeof(LogWriter));
+    memset(w, 0, sizeof(LogWriter));
+    w->fp = fp;
+    w->ring = malloc(LOG_WRITER_RING_SIZE);
+    w->space_event = lw_event_new(false);
+    w->drained_event = lw_event_new(true);
+    lw_lock(lock);
+    w->next = writers;
+    writers = w;
+    lw_unlock(lock);
+    return w;
+}
+
+bool log_writer_write(LogWriter *w, const void *data, size_t len, LogWriterPolicy policy)
+{
+    if (w->failed) {
+        return false;
+    }
+    const char *p = (const char *)data;
+    size_t done = 0;
+    uint64_t dropped = 0;
+
+    move_spill(w);
+    if (!w->spill_head) {
+        done = ring_put(w, p, len);
+    }
+    while (done < len) {
+        if (policy == LOG_WRITER_DROP) {
+            dropped = len - done;
+            break;
+        } else if (policy == LOG_WRITER_SPILL) {
+            spill_add(w, p + done, len - done);
+            break;
+        }
+        wait_for_space(w);
+        if (w->failed) {
+            return false;
+        }
+        done += ring_put(w, p + done, len - done);
+    }
+
+    size_t depth = ring_depth(w);
+    lw_lock(lock);
+    w->stats.bytes_queued += len;
+    w->stats.bytes_dropped += dropped;
+    if (w->stats.max_queue_depth < depth + w->spilled) {
+        w->stats.max_queue_depth = depth + w->spilled;
+    }
+    if (w->stats.max_spilled < w->spilled) {
+        w->stats.max_spilled = w->spilled;
+    }
+    lw_unlock(lock);
+    if (depth >= LOG_WRITER_WAKE_DEPTH) {
+        lw_event_set(wake_event);
+    }
+    return true;
+}
+
+void log_writer_flush(LogWriter *w)
+{
+    move_spill(w);
+    lw_exchange(&w->flush_requested, 1);
+    lw_event_set(wake_event);
+}
+
+static void add_stats(LogWriterStats *stats, const LogWriterStats *add)
+{
+    stats->bytes_queued += add->bytes_queued;
+    stats->bytes_written += add->bytes_written;
+    stats->bytes_dropped += add->bytes_dropped;
+    stats->writes += add->writes;
+    stats->flushes += add->flushes;
+    if (stats->max_queue_depth < add->max_queue_depth) {
+        stats->max_queue_depth = add->max_queue_depth;
+    }
+    if (stats->max_spilled < add->max_spilled) {
+        stats->max_spilled = add->max_spilled;
+    }
+}
+
+bool log_writer_close(LogWriter *w, LogWriterStats *stats)
+{
+    move_spill(w);
+    while (w->spill_head && !w->failed) {
+        wait_for_space(w);
+        move_spill(w);
+    }
+    lw_exchange(&w->closing, 1);
+    lw_event_set(wake_event);
+    lw_event_wait(w->drained_event, -1);
+
+    lw_lock(lock);
+    LogWriter **prev = &writers;
+    while (*prev != w) {
+        prev = &(*prev)->next;
+    }
+    *prev = w->next;
+    add_stats(&closed_stats, &w->stats);
+    if (stats) {
+        *stats = w->stats;
+    }
+    lw_unlock(lock);
+
+    bool ok = !w->failed;
+    lw_event_free(w->space_event);
+    lw_event_free(w->drained_event);
+    spill_clear(w);
+    free(w->ring);
+    free(w);
+    return ok;
+}
+
+void log_writer_get_stats(LogWriterStats *stats)
+{
+    if (!writer_thread) {
+        *stats = closed_stats;
+        return;
+    }
+    lw_lock(lock);
+    *stats = closed_stats;
+    for (LogWriter *w = writers; w; w = w->next) {
+        add_stats(stats, &w->stats);
+        stats->queue_depth += ring_depth(w);
+        stats->spilled += w->spilled;
+    }
+    lw_unlock(lock);
+}
+
+void log_writer_pause(bool pause)
+{
+    start_writer_thread();
+    for (;;) {
+        lw_lock(lock);
+        paused = pause;
+        bool idle = !busy;
+        lw_unlock(lock);
+        if (!pause || idle) {
+            break;
+        }
+        lw_sleep(1);
+    }
+    lw_event_set(wake_event);
+}
@@ -0,0 +1,56 @@
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* A log file written by a background thread. Each file gets a single
+   producer/single consumer ring of LOG_WRITER_RING_SIZE bytes; the UI
+   thread only copies into it and one writer thread for all files drains the
+   rings with large sequential writes, flushing them every
+   LOG_WRITER_FLUSH_INTERVAL ms or when asked to. The writer thread never
+   holds the list lock while it accesses the disk, so a stalled log
+   destination only ever blocks the file that is written to. */
+
+#define LOG_WRITER_RING_SIZE (1 << 20)
+#define LOG_WRITER_FLUSH_INTERVAL 500
+
+typedef enum {
+    LOG_WRITER_BLOCK,  /* wait for the writer thread to make room */
+    LOG_WRITER_DROP,   /* discard what does not fit and count it */
+    LOG_WRITER_SPILL   /* keep the excess in memory until the ring has room */
+} LogWriterPolicy;
+
+typedef struct {
+    uint64_t bytes_queued;
+    uint64_t bytes_written;
+    uint64_t bytes_dropped;
+    uint64_t writes;
+    uint64_t flushes;
+    size_t queue_depth;
+    size_t max_queue_depth;
+    size_t spilled;
+    size_t max_spilled;
+} LogWriterStats;
+
+typedef struct LogWriter LogWriter;
+
+LogWriter *log_writer_new(FILE *fp);
+/* The writer of fp, NULL if it has none. */
+LogWriter *log_writer_find(FILE *fp);
+/* Returns false once a write to the file failed. */
+bool log_writer_write(LogWriter *w, const void *data, size_t len, LogWriterPolicy policy);
+void log_writer_flush(LogWriter *w);
+/* Waits until everything queued is written and flushed, then frees the
+   writer and fills in its statistics. The file is left open. Returns false
+   if a write failed. */
+bool log_writer_close(LogWriter *w, LogWriterStats *stats);
+/* The sum over the open writers and the closed ones. */
+void log_writer_get_stats(LogWriterStats *stats);
+/* Stops the writer thread from draining the rings, for the tests. Returns
+   once a pass in progress is over. */
+void log_writer_pause(bool paused);
+
+#endif
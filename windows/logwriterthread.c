@@ -0,0 +1,88 @@
+#include "logwriterthread.h"
+#include <stdlib.h>
+#include <windows.h>
+
+struct LwLock {
+    CRITICAL_SECTION cs;
+};
+
+struct LwEvent {
+    HANDLE h;
+};
+
+typedef struct {
+    void (*func)(void *param);
+    void *param;
+} ThreadStart;
+
+LwLock *lw_lock_new(void)
+{
+    LwLock *l = malloc(sizeof(LwLock));
+    InitializeCriticalSection(&l->cs);
+    return l;
+}
+
+void lw_lock(LwLock *l)
+{
+    EnterCriticalSection(&l->cs);
+}
+
+void lw_unlock(LwLock *l)
+{
+    LeaveCriticalSection(&l->cs);
+}
+
+LwEvent *lw_event_new(bool manual_reset)
+{
+    LwEvent *e = malloc(sizeof(LwEvent));
+    e->h = CreateEvent(NULL, manual_reset, FALSE, NULL);
+    return e;
+}
+
+void lw_event_free(LwEvent *e)
+{
+    CloseHandle(e->h);
+    free(e);
+}
+
+void lw_event_set(LwEvent *e)
+{
+    SetEvent(e->h);
+}
+
+bool lw_event_wait(LwEvent *e, int timeout_ms)
+{
+    return WaitForSingleObject(e->h, timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms) != WAIT_TIMEOUT;
+}
+
+static DWORD WINAPI threadfunc(void *param)
+{
+    ThreadStart start = *(ThreadStart *)param;
+    free(param);
+    start.func(start.param);
+    return 0;
+}
+
+void lw_thread_start(void (*func)(void *param), void *param)
+{
+    ThreadStart *start = malloc(sizeof(ThreadStart));
+    start->func = func;
+    start->param = param;
+    HANDLE thread = CreateThread(NULL, 0, threadfunc, start, 0, NULL);
+    CloseHandle(thread);
+}
+
+void lw_sleep(int ms)
+{
+    Sleep(ms);
+}
+
+void lw_barrier(void)
+{
+    MemoryBarrier();
+}
+
+long lw_exchange(volatile long *p, long value)
+{
+    return InterlockedExchange((volatile LONG *)p, value);
+}
@@ -0,0 +1,34 @@
+#ifndef LOGWRITERTHREAD_H
+#define LOGWRITERTHREAD_H
+
+#include <stdbool.h>
+
+/* The threading the log writer uses. logwriterthread.c implements it with
+   the Win32 API, test/logwriterthread_posix.c with pthreads, so the tests
+   of the log writer also build with a native gcc. */
+
+typedef struct LwLock LwLock;
+typedef struct LwEvent LwEvent;
+
+LwLock *lw_lock_new(void);
+void lw_lock(LwLock *l);
+void lw_unlock(LwLock *l);
+
+/* An auto-reset event wakes a single wait and is reset by it, a manual
+   reset one stays set. */
+LwEvent *lw_event_new(bool manual_reset);
+void lw_event_free(LwEvent *e);
+void lw_event_set(LwEvent *e);
+/* Returns false if timeout_ms passed first, a negative timeout waits
+   forever. */
+bool lw_event_wait(LwEvent *e, int timeout_ms);
+
+/* Starts a detached thread. */
+void lw_thread_start(void (*func)(void *param), void *param);
+void lw_sleep(int ms);
+
+/* A full memory barrier, and an atomic exchange returning the old value. */
+void lw_barrier(void);
+long lw_exchange(volatile long *p, long value);
+
+#endif
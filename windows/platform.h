@@ -757,6 +757,7 @@ const wchar_t *get_app_user_model_id(void);
 char *handle_restrict_acl_cmdline_prefix(char *cmdline);
 bool handle_special_sessionname_cmdline(char *cmdline, Conf *conf);
 bool handle_special_filemapping_cmdline(char *cmdline, Conf *conf);
+char **expand_bulk_session_list(const char *list, int *count);
 
 /* network.c: network error reporting helpers taking OS error code */
 void plug_closing_system_error(Plug *plug, DWORD error);
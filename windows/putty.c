@@ -1,5 +1,6 @@
 #include "putty.h"
 #include "storage.h"
+#include "logging_async.h"
 
 extern bool sesslist_demo_mode;
 extern const char *dialog_box_demo_screenshot_filename;
@@ -7,6 +8,10 @@ static strbuf *demo_terminal_data = NULL;
 static const char *terminal_demo_screenshot_filename;
 
 const char *cmdline_session_name = NULL;
+extern int sftpconn_default_count;
+char **cmdline_bulk_sessions = NULL;
+int cmdline_bulk_count = 0;
+int cmdline_hibernate_minutes = 60;
 
 const unsigned cmdline_tooltype =
     TOOLTYPE_HOST_ARG |
@@ -127,6 +132,35 @@ void gui_term_process_cmdline(Conf *conf, char *cmdline)
                         put_data(demo_terminal_data, buf, retd);
                     fclose(fp);
                 }
+            } else if (!strcmp(p, "-bulk")) {
+                if (i+1 >= argc) {
+                    cmdline_error("%s expects a list of saved sessions", p);
+                } else {
+                    cmdline_bulk_sessions = expand_bulk_session_list(
+                        argv[++i], &cmdline_bulk_count);
+                }
+            } else if (!strcmp(p, "-logpolicy")) {
+                if (i+1 >= argc) {
+                    cmdline_error("%s expects block, drop or spill", p);
+                } else if (!log_async_set_policy(argv[++i])) {
+                    cmdline_error("unknown log policy \"%s\"", argv[i]);
+                }
+            } else if (!strcmp(p, "-sftpconnections")) {
+                if (i+1 >= argc) {
+                    cmdline_error("%s expects a number of connections", p);
+                } else {
+                    sftpconn_default_count = atoi(argv[++i]);
+                    if (sftpconn_default_count < 0 ||
+                        sftpconn_default_count > 8) {
+                        cmdline_error("%s expects 0 to 8", p);
+                    }
+                }
+            } else if (!strcmp(p, "-hibernate")) {
+                if (i+1 >= argc) {
+                    cmdline_error("%s expects a number of minutes", p);
+                } else {
+                    cmdline_hibernate_minutes = atoi(argv[++i]);
+                }
             } else if (*p != '-') {
                 cmdline_error("unexpected argument \"%s\"", p);
             } else {
@@ -139,6 +173,19 @@ void gui_term_process_cmdline(Conf *conf, char *cmdline)
         }
     }
 
+    /*
+     * Without another session on the command line, the first one of the
+     * bulk list becomes the initial session.
+     */
+    if (cmdline_bulk_count > 0 && !cmdline_session_name &&
+        !cmdline_host_ok(conf)) {
+        cmdline_process_param("-load", cmdline_bulk_sessions[0], 1, conf);
+        cmdline_session_name = cmdline_bulk_sessions[0];
+        cmdline_bulk_count--;
+        memmove(cmdline_bulk_sessions, cmdline_bulk_sessions + 1,
+                cmdline_bulk_count * sizeof(*cmdline_bulk_sessions));
+    }
+
     cmdline_run_saved(conf);
 
     if (demo_config_box) {
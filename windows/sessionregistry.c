@@ -0,0 +1,256 @@
+#include "sessionregistry.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define SLOT_BITS 16
+#define SLOT_MASK ((1 << SLOT_BITS) - 1)
+#define GENERATION_MASK 0x7fff
+#define NO_SLOT -1
+
+typedef struct Slot {
+    void *p;
+    int generation;
+    int prev;
+    int next;
+    int position;
+    int next_free;
+    bool removed;
+} Slot;
+
+static struct SessionRegistry {
+    Slot *slots;
+    int slot_count;
+    int slot_capacity;
+    int first_free;
+    int first_pending;
+    int head;
+    int tail;
+    int size;
+    int *order;
+    int order_capacity;
+    int iterating;
+} registry = {NULL, 0, 0, NO_SLOT, NO_SLOT, NO_SLOT, NO_SLOT, 0, NULL, 0, 0};
+
+static int make_id(int slot) {
+    return (registry.slots[slot].generation << SLOT_BITS) | slot;
+}
+
+static int slot_of(int id) {
+    int slot = id & SLOT_MASK;
+    if (id <= 0 || slot >= registry.slot_count) {
+        return NO_SLOT;
+    }
+    Slot *s = &registry.slots[slot];
+    if (!s->p || s->removed || s->generation != (id >> SLOT_BITS)) {
+        return NO_SLOT;
+    }
+    return slot;
+}
+
+/* The order array holds the slots in tab order, the positions of the
+   slots in [first, last] are set from it. */
+static void set_positions(int first, int last) {
+    for (int i = first; i <= last; i++) {
+        registry.slots[registry.order[i]].position = i;
+    }
+}
+
+static void order_insert(int index, int slot) {
+    if (registry.order_capacity == registry.size) {
+        registry.order_capacity = registry.order_capacity ? registry.order_capacity*2 : 16;
+        registry.order = realloc(registry.order, sizeof(int)*registry.order_capacity);
+    }
+    memmove(registry.order + index + 1, registry.order + index,
+            sizeof(int)*(registry.size - index));
+    registry.order[index] = slot;
+    set_positions(index, registry.size);
+}
+
+static void order_remove(int index) {
+    memmove(registry.order + index, registry.order + index + 1,
+            sizeof(int)*(registry.size - index - 1));
+    set_positions(index, registry.size - 2);
+}
+
+static void order_move(int index, int new_index) {
+    int slot = registry.order[index];
+    if (index < new_index) {
+        memmove(registry.order + index, registry.order + index + 1,
+                sizeof(int)*(new_index - index));
+        registry.order[new_index] = slot;
+        set_positions(index, new_index);
+    } else {
+        memmove(registry.order + new_index + 1, registry.order + new_index,
+                sizeof(int)*(index - new_index));
+        registry.order[new_index] = slot;
+        set_positions(new_index, index);
+    }
+}
+
+static int alloc_slot() {
+    int slot;
+    if (registry.first_free != NO_SLOT) {
+        slot = registry.first_free;
+        registry.first_free = registry.slots[slot].next_free;
+        registry.slots[slot].generation++;
+    } else {
+        assert(registry.slot_count <= SLOT_MASK);
+        if (registry.slot_count == registry.slot_capacity) {
+            registry.slot_capacity = registry.slot_capacity ? registry.slot_capacity*2 : 16;
+            registry.slots = realloc(registry.slots, sizeof(Slot)*registry.slot_capacity);
+        }
+        slot = registry.slot_count++;
+        registry.slots[slot].generation = 1;
+    }
+    registry.slots[slot].removed = false;
+    registry.slots[slot].next_free = NO_SLOT;
+    return slot;
+}
+
+/* A slot whose ids are all used up is retired, its ids are never valid
+   again. */
+static void free_slot(int slot) {
+    registry.slots[slot].p = NULL;
+    if (registry.slots[slot].generation == GENERATION_MASK) {
+        return;
+    }
+    registry.slots[slot].next_free = registry.first_free;
+    registry.first_free = slot;
+}
+
+static void link_before(int slot, int before) {
+    Slot *s = &registry.slots[slot];
+    if (before == NO_SLOT) {
+        s->prev = registry.tail;
+        s->next = NO_SLOT;
+    } else {
+        s->prev = registry.slots[before].prev;
+        s->next = before;
+    }
+    if (s->prev == NO_SLOT) {
+        registry.head = slot;
+    } else {
+        registry.slots[s->prev].next = slot;
+    }
+    if (s->next == NO_SLOT) {
+        registry.tail = slot;
+    } else {
+        registry.slots[s->next].prev = slot;
+    }
+}
+
+/* The next link of the unlinked slot is kept, so an iteration standing on
+   it can continue. */
+static void unlink_slot(int slot) {
+    Slot *s = &registry.slots[slot];
+    if (s->prev == NO_SLOT) {
+        registry.head = s->next;
+    } else {
+        registry.slots[s->prev].next = s->next;
+    }
+    if (s->next == NO_SLOT) {
+        registry.tail = s->prev;
+    } else {
+        registry.slots[s->next].prev = s->prev;
+    }
+}
+
+static int slot_at(int index) {
+    assert(index >= 0 && index < registry.size);
+    return registry.order[index];
+}
+
+void session_registry_reset() {
+    assert(registry.iterating == 0);
+    free(registry.slots);
+    free(registry.order);
+    memset(&registry, 0, sizeof(registry));
+    registry.first_free = NO_SLOT;
+    registry.first_pending = NO_SLOT;
+    registry.head = NO_SLOT;
+    registry.tail = NO_SLOT;
+}
+
+int session_registry_size() {
+    return registry.size;
+}
+
+int session_registry_add(void *p, int index) {
+    assert(p && index >= 0 && index <= registry.size);
+    int before = (index == registry.size ? NO_SLOT : slot_at(index));
+    int slot = alloc_slot();
+    registry.slots[slot].p = p;
+    link_before(slot, before);
+    order_insert(index, slot);
+    registry.size++;
+    return make_id(slot);
+}
+
+void *session_registry_remove(int id) {
+    int slot = slot_of(id);
+    assert(slot != NO_SLOT);
+    void *p = registry.slots[slot].p;
+    unlink_slot(slot);
+    order_remove(registry.slots[slot].position);
+    registry.slots[slot].removed = true;
+    registry.size--;
+    if (registry.iterating) {
+        registry.slots[slot].next_free = registry.first_pending;
+        registry.first_pending = slot;
+    } else {
+        free_slot(slot);
+    }
+    return p;
+}
+
+void *session_registry_get(int id) {
+    int slot = slot_of(id);
+    return slot == NO_SLOT ? NULL : registry.slots[slot].p;
+}
+
+void session_registry_move(int id, int new_index) {
+    int slot = slot_of(id);
+    assert(slot != NO_SLOT && new_index >= 0 && new_index < registry.size);
+    int index = registry.slots[slot].position;
+    if (index == new_index) {
+        return;
+    }
+    int target = slot_at(new_index);
+    int before = (new_index > index ? registry.slots[target].next : target);
+    unlink_slot(slot);
+    link_before(slot, before);
+    order_move(index, new_index);
+}
+
+int session_registry_index_of(int id) {
+    int slot = slot_of(id);
+    assert(slot != NO_SLOT);
+    return registry.slots[slot].position;
+}
+
+int session_registry_id_at(int index) {
+    return make_id(slot_at(index));
+}
+
+void *session_registry_at(int index) {
+    return registry.slots[slot_at(index)].p;
+}
+
+void session_registry_foreach(session_registry_callback cb, void *ctx) {
+    registry.iterating++;
+    int slot = registry.head;
+    while (slot != NO_SLOT) {
+        if (!registry.slots[slot].removed && !cb(registry.slots[slot].p, ctx)) {
+            break;
+        }
+        slot = registry.slots[slot].next;
+    }
+    if (--registry.iterating == 0) {
+        while (registry.first_pending != NO_SLOT) {
+            slot = registry.first_pending;
+            registry.first_pending = registry.slots[slot].next_free;
+            free_slot(slot);
+        }
+    }
+}
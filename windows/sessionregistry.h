@@ -0,0 +1,34 @@
+#ifndef SESSIONREGISTRY_H
+#define SESSIONREGISTRY_H
+
+#include <stdbool.h>
+
+/* Sessions are identified by ids which stay valid until the session is
+   removed, independently of the tab order. Lookup by id and by position
+   and the position of a session are O(1). Adding, removing and moving a
+   session are O(n) like with the pointer_array it replaced, they shift
+   the sessions in between in an array of slot numbers, but without a
+   callback per session. Ids of removed sessions are never returned again
+   for another session, session_registry_get() returns NULL for them: a
+   slot is retired once its generation is used up, so at most 65535 slots
+   times 32767 generations of sessions can be added. */
+
+typedef bool (*session_registry_callback)(void *p, void *ctx);
+
+void session_registry_reset();
+
+int session_registry_size();
+int session_registry_add(void *p, int index);
+void *session_registry_remove(int id);
+void *session_registry_get(int id);
+void session_registry_move(int id, int new_index);
+
+int session_registry_index_of(int id);
+int session_registry_id_at(int index);
+void *session_registry_at(int index);
+
+/* Calls cb for the sessions in tab order until it returns false. Sessions
+   may be removed (also the current one) from the callback. */
+void session_registry_foreach(session_registry_callback cb, void *ctx);
+
+#endif
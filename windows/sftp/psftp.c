@@ -1,5 +1,5 @@
 #include "putty.h"
-#include "psftp.h"
+#include "psftpext.h"
 #include <shlwapi.h>
 
 static wchar_t *utf8_to_wc(const char *utf8)
@@ -105,8 +105,10 @@ RFile *open_existing_file(const char *name, uint64_t *size,
     RFile *ret;
     wchar_t *wname = utf8_to_wc(name);
 
+    /* Files are read front to back in request sized pieces, let the cache
+       manager read ahead in large blocks. */
     h = CreateFileW(wname, GENERIC_READ, FILE_SHARE_READ, NULL,
-                    OPEN_EXISTING, 0, 0);
+                    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
     sfree(wname);
     if (h == INVALID_HANDLE_VALUE)
         return NULL;
@@ -205,6 +207,20 @@ int write_to_file(WFile *f, void *buffer, int length)
         return written;
 }
 
+/* Writes at offset, the file position is left after the data. */
+int write_to_file_at(WFile *f, uint64_t offset, void *buffer, int length)
+{
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD written;
+    if (!WriteFile(f->h, buffer, length, &written, &ov))
+        return -1;                     /* error */
+    else
+        return written;
+}
+
 void set_file_times(WFile *f, unsigned long mtime, unsigned long atime)
 {
     FILETIME actime, wrtime;
@@ -256,6 +272,69 @@ uint64_t get_file_posn(WFile *f)
     return uint64_from_words(hi, lo);
 }
 
+/* Opens an existing file for writing alongside other handles opened the
+   same way, the segments of get -P each write their own range. */
+WFile *open_shared_wfile(const char *name)
+{
+    HANDLE h;
+    WFile *ret;
+    wchar_t *wname = utf8_to_wc(name);
+
+    h = CreateFileW(wname, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                    NULL, OPEN_EXISTING, 0, 0);
+    sfree(wname);
+    if (h == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    ret = snew(WFile);
+    ret->h = h;
+
+    return ret;
+}
+
+/* Moves the end of the file to size, the file position is left there. */
+bool set_file_size(WFile *f, uint64_t size)
+{
+    return seek_file(f, size, FROM_START) == 0 && SetEndOfFile(f->h);
+}
+
+/* FILE_INFO_BY_HANDLE_CLASS and FILE_ALLOCATION_INFO need a newer
+   _WIN32_WINNT than we build with. */
+#define FILE_ALLOCATION_INFO_CLASS 5
+DECL_WINDOWS_FUNCTION(static, BOOL, SetFileInformationByHandle,
+                      (HANDLE, int, LPVOID, DWORD));
+
+/* Called from the UI thread when a session starts, so the function is
+   resolved before any write-behind thread calls reserve_file_space(). */
+void reserve_file_space_init(void)
+{
+    static bool initialised = false;
+    if (initialised)
+        return;
+    initialised = true;
+    HMODULE kernel32_module = load_system32_dll("kernel32.dll");
+    GET_WINDOWS_FUNCTION_NO_TYPECHECK(kernel32_module, SetFileInformationByHandle);
+}
+
+/* Sets the disk space allocated to the file to size, leaving its end
+   where it is, so the file system can place a download in one piece and a
+   full disk shows up before the data is fetched. Returns false only if the
+   disk or the user's quota has no room, file systems which cannot reserve
+   space grow the file as it is written. */
+bool reserve_file_space(WFile *f, uint64_t size)
+{
+    if (!p_SetFileInformationByHandle)
+        return true;
+
+    LARGE_INTEGER allocation;
+    allocation.QuadPart = size;
+    if (!p_SetFileInformationByHandle(f->h, FILE_ALLOCATION_INFO_CLASS, &allocation, sizeof(allocation))) {
+        DWORD error = GetLastError();
+        return error != ERROR_DISK_FULL && error != ERROR_DISK_QUOTA_EXCEEDED;
+    }
+    return true;
+}
+
 int file_type(const char *name)
 {
     DWORD attr;
@@ -275,6 +354,7 @@ int file_type(const char *name)
 struct DirHandle {
     HANDLE h;
     char *name;
+    WIN32_FIND_DATAW fdat; /* of the name read last */
 };
 
 DirHandle *open_directory(const char *name, const char **errmsg)
@@ -300,6 +380,7 @@ DirHandle *open_directory(const char *name, const char **errmsg)
     ret = snew(DirHandle);
     ret->h = h;
     ret->name = utf8_from_wc(fdat.cFileName);
+    ret->fdat = fdat;
     return ret;
 }
 
@@ -308,11 +389,10 @@ char *read_filename(DirHandle *dir)
     do {
 
         if (!dir->name) {
-            WIN32_FIND_DATAW fdat;
-            if (!FindNextFileW(dir->h, &fdat))
+            if (!FindNextFileW(dir->h, &dir->fdat))
                 return NULL;
             else
-                dir->name = utf8_from_wc(fdat.cFileName);
+                dir->name = utf8_from_wc(dir->fdat.cFileName);
         }
 
         assert(dir->name);
@@ -333,6 +413,18 @@ char *read_filename(DirHandle *dir)
         return NULL;
 }
 
+/*
+ * The size, modification time and type of the name read_filename()
+ * returned last, from the same directory enumeration, so no file is
+ * opened or stat'ed for them.
+ */
+void read_filename_attrs(DirHandle *dir, uint64_t *size, unsigned long *mtime, bool *is_dir)
+{
+    *size = uint64_from_words(dir->fdat.nFileSizeHigh, dir->fdat.nFileSizeLow);
+    TIME_WIN_TO_POSIX(dir->fdat.ftLastWriteTime, *mtime);
+    *is_dir = (dir->fdat.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+}
+
 void close_directory(DirHandle *dir)
 {
     FindClose(dir->h);
@@ -0,0 +1,26 @@
+#ifndef PSFTPEXT_H
+#define PSFTPEXT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "psftp.h"
+
+/*
+ * The functions psftp.c adds to the ones PuTTY's psftp.h declares, see
+ * psftp.c for what they do. PuTTY's directories come first on the include
+ * path, so this header does not take over the name psftp.h.
+ */
+
+int write_to_file_at(WFile *f, uint64_t offset, void *buffer, int length);
+WFile *open_shared_wfile(const char *name);
+bool set_file_size(WFile *f, uint64_t size);
+void reserve_file_space_init(void);
+bool reserve_file_space(WFile *f, uint64_t size);
+void read_filename_attrs(DirHandle *dir, uint64_t *size, unsigned long *mtime, bool *is_dir);
+void delete_file(const char *name);
+void delete_directory(const char *name);
+const char *get_absolute_path(const char *pwd, const char *name);
+const char *truncate_path(const char *name);
+char get_path_separator();
+
+#endif
@@ -5,6 +5,8 @@
 #include "sftpfxp.h"
 #include "sftpcompletion.h"
 #include "sftpunicode.h"
+#include "sftppktpool.h"
+#include "psftpext.h"
 
 extern const SftpCmdVtable sftpcompletion_readdir_vt;
 extern const SftpCmdVtable sftpinit_vt;
@@ -54,32 +56,48 @@ static void execute(Sftp *sftp) {
     sftp->cmd->vt = vt;
 }
 
-bool receive_pkt(Sftp *sftp, struct sftp_packet **pkt) {
-    if (!sftp->receiving_pkt) {
-        char x[4];
-        if (!bufchain_try_fetch_consume(&sftp->received_data, x, 4)) {
+/* Copies the received data straight into the packet, which comes from the
+   packet pool. Only the length of a packet can be split between two calls
+   and is kept in r->len. */
+bool sftp_receive_pkt(SftpReceiver *r, unsigned max_packet, const char **data, size_t *len, struct sftp_packet **pkt) {
+    if (!r->pkt) {
+        size_t n = 4 - r->len_fetched;
+        if (n > *len) {
+            n = *len;
+        }
+        memcpy(r->len + r->len_fetched, *data, n);
+        r->len_fetched += n;
+        *data += n;
+        *len -= n;
+        if (r->len_fetched < 4) {
             return false;
         }
-        unsigned pktlen = GET_32BIT_MSB_FIRST(x);
-        if (pktlen > (1<<20)) {
+        r->len_fetched = 0;
+        unsigned pktlen = GET_32BIT_MSB_FIRST(r->len);
+        if (pktlen > max_packet) {
             *pkt = NULL;
             return true;
         }
-        sftp->receiving_pkt = sftp_recv_prepare(pktlen);
-        sftp->receiving_pkt_fetched = 0;
+        r->pkt = sftppktpool_recv_prepare(r->pool, pktlen);
+        r->pkt_fetched = 0;
     }
 
-    struct sftp_packet *p = sftp->receiving_pkt;
-    sftp->receiving_pkt_fetched += bufchain_fetch_consume_up_to(&sftp->received_data,
-                                      p->data+sftp->receiving_pkt_fetched,
-                                      p->length-sftp->receiving_pkt_fetched);
-    if (sftp->receiving_pkt_fetched != p->length) {
+    struct sftp_packet *p = r->pkt;
+    size_t n = p->length - r->pkt_fetched;
+    if (n > *len) {
+        n = *len;
+    }
+    memcpy(p->data + r->pkt_fetched, *data, n);
+    r->pkt_fetched += n;
+    *data += n;
+    *len -= n;
+    if (r->pkt_fetched != p->length) {
         return false;
     }
-    sftp->receiving_pkt = NULL;
-    sftp->receiving_pkt_fetched = 0;
+    r->pkt = NULL;
+    r->pkt_fetched = 0;
     if (!sftp_recv_finish(p)) {
-        sftp_pkt_free(p);
+        sftpfxp_pkt_free(p);
         *pkt = NULL;
         return true;
     }
@@ -87,6 +105,16 @@ bool receive_pkt(Sftp *sftp, struct sftp_packet **pkt) {
     return true;
 }
 
+void sftp_receiver_uninit(SftpReceiver *r)
+{
+    if (r->pkt) {
+        sftpfxp_pkt_free(r->pkt);
+        r->pkt = NULL;
+    }
+    r->len_fetched = 0;
+    r->pkt_fetched = 0;
+}
+
 static void reconfig_line_codepage(Sftp *sftp) {
     assert(sftp->reconfig_line_codepage_name);
 
@@ -108,7 +136,9 @@ static void clear_command(Sftp *sftp) {
     bool is_completion = sftp->cmd->vt == &sftpcompletion_readdir_vt;
     sftpcmd_free(sftp->cmd);
     sftp->cmd = NULL;
-    sftp_free_pending_requests(sftp);
+    sftpfxp_free_pending_requests(&sftp->fxp);
+    sftpconn_clear_requests(sftp);
+    sftppktpool_clear(&sftp->pktpool);
     if (sftp->reconfig_line_codepage_name) {
         reconfig_line_codepage(sftp);
     }
@@ -118,29 +148,34 @@ static void clear_command(Sftp *sftp) {
     }
 }
 
-static size_t sshseat_output(Seat *seat, SeatOutputType type, const void *data, size_t len)
+void sftp_command_done(Sftp *sftp)
 {
-    Sftp *sftp = container_of(seat, Sftp, sshseat);
-    if (type != SEAT_OUTPUT_STDOUT) {
-        seat_output(sftp->seat, type, data, len);
-        return 0;
+    if (sftp->cmd) {
+        clear_command(sftp);
     }
+}
 
-    bufchain_add(&sftp->received_data, data, len);
+/* Replies nobody waits for any more, e.g. of a command stopped with Ctrl-C,
+   are dropped one by one, a packet which continues beyond the data stays in
+   the receiver until the next call. */
+static void process_output(Sftp *sftp, const char *received, size_t len)
+{
     struct sftp_packet *pkt;
-    while (receive_pkt(sftp, &pkt)) {
+    while (!sftp->receive_failed && sftp_receive_pkt(&sftp->receiver, sftp->max_packet, &received, &len, &pkt)) {
         if (!pkt) {
-            // connection close, malformed response
-            return 0;
+            // too long or malformed, the rest of the stream cannot be parsed
+            sftp->receive_failed = true;
+            seat_connection_fatal(sftp->seat, "malformed SFTP packet from the server");
+            return;
         }
         if (!sftp->cmd) { // unwanted response, no command is running
-            sftp_pkt_free(pkt);
-            return 0;
+            sftpfxp_pkt_free(pkt);
+            continue;
         }
         if (sftp->cmd->req) {
             if (sftp->cmd->req != sftp_find_request(pkt)) { // unwanted response, not for the current command
-                sftp_pkt_free(pkt);
-                return 0;
+                sftpfxp_pkt_free(pkt);
+                continue;
             }
         }
 
@@ -148,20 +183,41 @@ static size_t sshseat_output(Seat *seat, SeatOutputType type, const void *data,
             clear_command(sftp);
         }
     }
+}
+
+static size_t sshseat_output(Seat *seat, SeatOutputType type, const void *data, size_t len)
+{
+    Sftp *sftp = container_of(seat, Sftp, sshseat);
+    if (type != SEAT_OUTPUT_STDOUT) {
+        seat_output(sftp->seat, type, data, len);
+        return 0;
+    }
+
+    SftpFxp *prev = sftpfxp_enter(&sftp->fxp);
+    process_output(sftp, (const char *)data, len);
+    sftpfxp_leave(prev);
     return 0;
 }
 
 static SeatPromptResult sshseat_get_userpass_input(Seat *seat, prompts_t *p)
 {
     Sftp *sftp = container_of(seat, Sftp, sshseat);
-    return sftp->seat->vt->get_userpass_input(sftp->seat, p);
+    SeatPromptResult spr = sftp->seat->vt->get_userpass_input(sftp->seat, p);
+    if (spr.kind == SPRK_OK) {
+        sftpconn_pool_remember_answers(&sftp->conns, p);
+    }
+    return spr;
 }
 
 static void sshseat_notify_session_started(Seat *seat)
 {
     Sftp *sftp = container_of(seat, Sftp, sshseat);
+    SftpFxp *prev = sftpfxp_enter(&sftp->fxp);
     sftp->cmd = sftpcmd_init(&sftpinit_vt, sftp);
     sftp->cmd->vt = &sftpinit_vt;
+    sftpfxp_leave(prev);
+    sftpconn_start(sftp);
+    seat_notify_session_started(sftp->seat);
 }
 
 static void sshseat_notify_remote_exit(Seat *seat) {
@@ -179,6 +235,7 @@ static SeatPromptResult sshseat_confirm_ssh_host_key(
     char *keystr, SeatDialogText *text, HelpCtx helpctx,
     void (*callback)(void *ctx, SeatPromptResult result), void *cbctx) {
     Sftp *sftp = container_of(seat, Sftp, sshseat);
+    sftpconn_pool_remember_hostkey(&sftp->conns, keytype, keystr);
     return sftp->seat->vt->confirm_ssh_host_key(sftp->seat, host, port, keytype, keystr, text, helpctx, callback, cbctx);
 }
 
@@ -186,6 +243,7 @@ static SeatPromptResult sshseat_confirm_weak_crypto_primitive(
     Seat *seat, SeatDialogText *text,
     void (*callback)(void *ctx, SeatPromptResult result), void *ctx) {
     Sftp *sftp = container_of(seat, Sftp, sshseat);
+    sftp->conns.weak_crypto_confirmed = true;
     return sftp->seat->vt->confirm_weak_crypto_primitive(sftp->seat, text, callback, ctx);
 }
 
@@ -193,6 +251,7 @@ static SeatPromptResult sshseat_confirm_weak_cached_hostkey(
     Seat *seat, SeatDialogText *text,
     void (*callback)(void *ctx, SeatPromptResult result), void *ctx) {
     Sftp *sftp = container_of(seat, Sftp, sshseat);
+    sftp->conns.weak_hostkey_confirmed = true;
     return sftp->seat->vt->confirm_weak_cached_hostkey(sftp->seat, text, callback, ctx);
 }
 
@@ -257,9 +316,18 @@ static char *sftpbe_init(const BackendVtable *vt, Seat *seat,
     sftp = snew(Sftp);
     memset(sftp, 0, sizeof(Sftp));
 
+    reserve_file_space_init();
     sftp->cli = sftpcli_create(seat);
     sftp->completion = sftpcompletion_create(sftp);
-    sftp_init_requests(sftp);
+    sftpfxp_init(&sftp->fxp);
+    sftplistcache_init(&sftp->listcache);
+    sftp->fxp.listcache = &sftp->listcache;
+    sftppktpool_init(&sftp->pktpool);
+    sftp->fxp.pktpool = &sftp->pktpool;
+    sftp->receiver.pool = &sftp->pktpool;
+    sftpconn_pool_init(&sftp->conns, logctx, host, port, keepalive);
+    xfer_limits_init(&sftp->xfer_limits);
+    sftp->max_packet = SFTP_DEFAULT_MAX_PACKET;
 
     sftp->seat = seat;
     sftp->backend.vt = vt;
@@ -283,6 +351,7 @@ static char *sftpbe_init(const BackendVtable *vt, Seat *seat,
         return err;
     }
     sftp->backend.interactor = sftp->ssh->interactor;
+    sftp->fxp.backend = sftp->ssh;
 
     return NULL;
 }
@@ -291,9 +360,7 @@ static void sftpbe_free(Backend *be)
 {
     Sftp *sftp = container_of(be, Sftp, backend);
 
-    if (sftp->receiving_pkt) {
-        sftp_pkt_free(sftp->receiving_pkt);
-    }
+    sftp_receiver_uninit(&sftp->receiver);
     if (sftp->ssh) {
         backend_free(sftp->ssh);
     }
@@ -301,12 +368,17 @@ static void sftpbe_free(Backend *be)
         conf_free(sftp->ssh_conf);
     }
     if (sftp->cmd) {
+        SftpFxp *prev = sftpfxp_enter(&sftp->fxp);
         sftpcmd_free(sftp->cmd);
+        sftpfxp_leave(prev);
         sftpargs_free(&sftp->args);
-        sftp_free_pending_requests(sftp);
     }
-    sftp_uninit_requests(sftp);
+    sftpconn_pool_uninit(&sftp->conns);
+    sftpfxp_uninit(&sftp->fxp);
+    sftp_free_extensions(sftp);
     sftpcompletion_free(sftp->completion);
+    sftplistcache_uninit(&sftp->listcache);
+    sftppktpool_clear(&sftp->pktpool);
     sftpcli_free(sftp->cli);
     sftp_dup_utf8_free(sftp->pwd, sftp->line_pwd);
     sfree((void *)sftp->lpwd);
@@ -333,16 +405,17 @@ static void sftpbe_reconfig(Backend *be, Conf *conf)
     }
 }
 
-static void sftpbe_send(Backend *be, const char *buf, size_t len)
+static void process_input(Sftp *sftp, const char *buf, size_t len)
 {
-    Sftp *sftp = container_of(be, Sftp, backend);
-
     if (sftp->cmd) {
         for (size_t i = 0; i < len; i++) {
             if (buf[i] == 0x03) {
                 clear_command(sftp);
                 break;
             }
+            if (buf[i] == 0x09 && sftp->cmd->vt == &sftpcompletion_readdir_vt) {
+                sftpcompletion_readdir_complete_now(sftp->cmd, sftp);
+            }
         }
         return;
     }
@@ -407,6 +480,14 @@ static void sftpbe_send(Backend *be, const char *buf, size_t len)
     }
 }
 
+static void sftpbe_send(Backend *be, const char *buf, size_t len)
+{
+    Sftp *sftp = container_of(be, Sftp, backend);
+    SftpFxp *prev = sftpfxp_enter(&sftp->fxp);
+    process_input(sftp, buf, len);
+    sftpfxp_leave(prev);
+}
+
 static size_t sftpbe_sendbuffer(Backend *be)
 {
     Sftp *sftp = container_of(be, Sftp, backend);
@@ -449,6 +530,16 @@ static bool sftpbe_sendok(Backend *be)
 
 static void sftpbe_unthrottle(Backend *be, size_t backlog)
 {
+    Sftp *sftp = container_of(be, Sftp, backend);
+    sftp->output_backlog = backlog;
+    if (backlog >= SFTP_OUTPUT_BACKLOG_LIMIT || !sftp->cmd || !sftp->cmd->vt->unthrottle) {
+        return;
+    }
+    SftpFxp *prev = sftpfxp_enter(&sftp->fxp);
+    if (!sftp->cmd->vt->unthrottle(sftp->cmd, sftp)) {
+        clear_command(sftp);
+    }
+    sftpfxp_leave(prev);
 }
 
 static bool sftpbe_ldisc(Backend *be, int option)
@@ -3,16 +3,68 @@
 
 #include "putty.h"
 #include "sftpargs.h"
+#include "sftpxferwindow.h"
+#include "sftpreqtable.h"
+#include "sftplistcache.h"
+#include "sftpconn.h"
+#include "sftppktpool.h"
 
 typedef struct SftpCmd SftpCmd;
 typedef struct SftpCli SftpCli;
 typedef struct SftpCompletion SftpCompletion;
 
+/* The request state of a session, see sftpfxp.h: the backend the requests
+   are sent to, the requests waiting for a reply, the error of the last
+   reply, the listings the requests changing a path invalidate and the pool
+   the freed packets go to. */
+typedef struct SftpFxp {
+    Backend *backend;
+    SftpReqTable requests;
+    const char *error_message;
+    int errtype;
+    SftpListCache *listcache;
+    SftpPktPool *pktpool;
+    void *owner;            /* of the requests added, see sftpfxp_set_owner() */
+} SftpFxp;
+
+/* A command printing a lot of lines stops while the terminal has more than
+   this waiting to be displayed, and continues from the unthrottle function
+   of its vtable. */
+#define SFTP_OUTPUT_BACKLOG_LIMIT (64*1024)
+
+/* A longer packet from the server is a fatal error. A server announcing a
+   larger max-packet-length in limits@openssh.com raises the ceiling up to
+   SFTP_MAX_PACKET_CEILING. */
+#define SFTP_DEFAULT_MAX_PACKET (1<<20)
+#define SFTP_MAX_PACKET_CEILING (16<<20)
+
+/* An extension the server announced in its FXP_VERSION, see sftpinit.c.
+   The data is zero terminated for the extensions whose data is text. */
+typedef struct SftpExtension {
+    const char *name;
+    const char *data;
+    size_t datalen;
+} SftpExtension;
+
+/* The packet being received from an SSH channel, see sftp_receive_pkt(). */
+typedef struct SftpReceiver {
+    char len[4];
+    unsigned int len_fetched;
+    struct sftp_packet *pkt;
+    unsigned int pkt_fetched;
+    SftpPktPool *pool;
+} SftpReceiver;
+
+/* Takes the next packet out of the received data. Returns false if the
+   data ends within a packet, which is completed by the next call, and true
+   with *pkt NULL for a packet longer than max_packet or malformed. */
+bool sftp_receive_pkt(SftpReceiver *r, unsigned max_packet, const char **data, size_t *len, struct sftp_packet **pkt);
+void sftp_receiver_uninit(SftpReceiver *r);
+
 typedef struct Sftp Sftp;
 struct Sftp {
-    bufchain received_data;
-    struct sftp_packet *receiving_pkt;
-    unsigned int receiving_pkt_fetched;
+    SftpReceiver receiver;
+    bool receive_failed;
 
     const char *pwd;
     const char *lpwd;
@@ -22,6 +74,7 @@ struct Sftp {
 
     Seat *seat;
     Backend backend;
+    size_t output_backlog; /* of the seat, see SFTP_OUTPUT_BACKLOG_LIMIT */
 
     SftpCli *cli;
     int width;
@@ -39,9 +92,31 @@ struct Sftp {
     const char *line_codepage_name;
     const char *reconfig_line_codepage_name;
 
-    void *requests;
+    SftpFxp fxp;
+    SftpConnPool conns;
+    unsigned long remote_version;
+    SftpExtension *extensions;
+    size_t nextensions, extensionsize;
+    bool has_server_limits;
+    SftpServerLimits server_limits;
+    unsigned max_packet;
+
+    SftpXferLimits xfer_limits;
+    SftpXferWindow last_xfer; /* window of the last finished transfer */
+
+    SftpListCache listcache;
+    SftpPktPool pktpool;
 
     SftpCompletion *completion;
 };
 
+/* Sends FXP_INIT on the bound session, see sftpfxp.h. */
+void sftp_send_init(void);
+/* The extension the server announced under name, NULL if it did not. */
+const SftpExtension *sftp_find_extension(Sftp *sftp, const char *name);
+void sftp_free_extensions(Sftp *sftp);
+
+/* Ends the running command from a callback outside of its process_pkt. */
+void sftp_command_done(Sftp *sftp);
+
 #endif
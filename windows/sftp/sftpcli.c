@@ -1,4 +1,5 @@
 #include "sftpcli.h"
+#include "psftpext.h"
 #include "linenoise/linenoise.h"
 #include <string.h>
 
@@ -41,8 +42,6 @@ void sftpcli_free(SftpCli *cli) {
     sfree(cli);
 }
 
-const char *truncate_path(const char *name);
-
 static bool pwd_truncate_local(const char *p, size_t length, size_t *offset)
 {
     assert(*offset < length);
@@ -91,6 +91,8 @@ static SftpCmdArgInfo sftpcmdhelp_get_arg_info(int file_arg_index)
 
 extern const SftpCmdVtable sftpcmdcd_vt;
 extern const SftpCmdVtable sftpcmdchmod_vt;
+extern const SftpCmdVtable sftpcmdcp_vt;
+extern const SftpCmdVtable sftpcmdconnections_vt;
 extern const SftpCmdVtable sftpcmdget_vt;
 extern const SftpCmdVtable sftpcmdinit_vt;
 extern const SftpCmdVtable sftpcmdls_vt;
@@ -102,6 +104,9 @@ extern const SftpCmdVtable sftpcmdput_vt;
 extern const SftpCmdVtable sftpcmdreget_vt;
 extern const SftpCmdVtable sftpcmdreput_vt;
 extern const SftpCmdVtable sftpcmdrm_vt;
+extern const SftpCmdVtable sftpcmdsync_vt;
+extern const SftpCmdVtable sftpcmdversion_vt;
+extern const SftpCmdVtable sftpcmdxfer_vt;
 
 static const SftpCmdVtable sftpcmdbye_vt = {
     .init = sftpcmdbye_init,
@@ -188,6 +193,34 @@ struct SftpCmdLookup {
             "  use commas to separate different modifiers (\"u+rwx,g+s\").",
             &sftpcmdchmod_vt
     },
+    {
+        "connections", true, "open extra connections for large downloads",
+            " [ <n> ]\r\n"
+            "  Sets the number of extra SSH connections to the server, 0 to 8,\r\n"
+            "  and shows their state. \"get\" and \"sync pull\" spread the files\r\n"
+            "  of 4 MB or more, and the segments of \"get -P\", over the main\r\n"
+            "  connection and the extra ones, which helps when a single\r\n"
+            "  connection cannot fill the network. The extra connections are\r\n"
+            "  opened by the first such transfer and accept only the host key\r\n"
+            "  of the main connection. The answers given when logging in are\r\n"
+            "  reused only by the connections set before the login with the\r\n"
+            "  -sftpconnections <n> command line option, which are opened right\r\n"
+            "  after it, and are wiped once these are open. Any other connection\r\n"
+            "  needs a login which asks nothing, e.g. a key from Pageant.\r\n"
+            "  A connection which fails is opened again only after the number\r\n"
+            "  is set again. The default is 0.",
+            &sftpcmdconnections_vt
+    },
+    {
+        "cp", true, "copy a file on the remote server",
+            " [ -- ] <source> <destination>\r\n"
+            "  Copies the file <source> on the server to <destination>, also\r\n"
+            "  on the server. If <destination> is an existing directory, the\r\n"
+            "  copy is stored there under the name of <source>.\r\n"
+            "  The server copies the data itself if it supports the copy-data\r\n"
+            "  extension, otherwise the data passes through this client.",
+            &sftpcmdcp_vt
+    },
     {
         "del", true, "delete files on the remote server",
             " <filename-or-wildcard> [ <filename-or-wildcard>... ]\r\n"
@@ -199,12 +232,13 @@ struct SftpCmdLookup {
     },
     {
         "dir", true, "list remote files",
-            " [-l] [--] [ <directory-name> ]/[ <wildcard> ]\r\n"
+            " [-l] [-U] [--] [ <directory-name> ]/[ <wildcard> ]\r\n"
             "  List the contents of a specified directory on the server.\r\n"
             "  If <directory-name> is not given, the current working directory\r\n"
             "  is assumed.\r\n"
             "  If <wildcard> is given, it is treated as a set of files to\r\n"
-            "  list; otherwise, all files are listed.",
+            "  list; otherwise, all files are listed.\r\n"
+            "  -U lists the files unsorted, as the server sends them.",
             &sftpcmdls_vt
     },
     {
@@ -212,11 +246,19 @@ struct SftpCmdLookup {
     },
     {
         "get", true, "download a file from the server to your local machine",
-            " [ -r ] [ -- ] <filename> [ <local-filename> ]\r\n"
+            " [ -r ] [ -j <n> ] [ -c ] [ -P <n> ] [ -- ] <filename> [ <local-filename> ]\r\n"
             "  Downloads a file on the server and stores it locally under\r\n"
             "  the same name, or under a different one if you supply the\r\n"
             "  argument <local-filename>.\r\n"
-            "  If -r specified, recursively fetch a directory.",
+            "  If -r specified, recursively fetch a directory.\r\n"
+            "  -j <n> transfers up to <n> files at once (default 4).\r\n"
+            "  -P <n> fetches a file of 16 MB or more in up to <n> segments\r\n"
+            "  at once; \"reget\" resumes each segment.\r\n"
+            "  -c verifies each file with the SHA-256 hash of the server,\r\n"
+            "  from its check-file extension or else from sha256sum run on\r\n"
+            "  a login of its own, which needs a shell account and, with a\r\n"
+            "  password login, -sftpconnections; otherwise the files are\r\n"
+            "  reported as not verified.",
             &sftpcmdget_vt
     },
     {
@@ -227,6 +269,9 @@ struct SftpCmdLookup {
             "  those particular commands.",
             &sftpcmdhelp_vt
     },
+    {
+        "info", false, "version", NULL, &sftpcmdversion_vt
+    },
     {
         "lcd", true, "change local working directory",
             " <local-directory-name>\r\n"
@@ -246,11 +291,18 @@ struct SftpCmdLookup {
     },
     {
         "mget", true, "download multiple files at once",
-            " [ -r ] [ -- ] <filename-or-wildcard> [ <filename-or-wildcard>... ]\r\n"
+            " [ -r ] [ -j <n> ] [ -c ] [ -P <n> ] [ -- ] <filename-or-wildcard> [ <filename-or-wildcard>... ]\r\n"
             "  Downloads many files from the server, storing each one under\r\n"
             "  the same name it has on the server side. You can use wildcards\r\n"
             "  such as \"*.c\" to specify lots of files at once.\r\n"
-            "  If -r specified, recursively fetch files and directories.",
+            "  If -r specified, recursively fetch files and directories.\r\n"
+            "  -j <n> transfers up to <n> files at once (default 4).\r\n"
+            "  -P <n> fetches a file of 16 MB or more in up to <n> segments.\r\n"
+            "  -c verifies each file with the SHA-256 hash of the server,\r\n"
+            "  from its check-file extension or else from sha256sum run on\r\n"
+            "  a login of its own, which needs a shell account and, with a\r\n"
+            "  password login, -sftpconnections; otherwise the files are\r\n"
+            "  reported as not verified.",
             &sftpcmdmget_vt
     },
     {
@@ -261,11 +313,17 @@ struct SftpCmdLookup {
     },
     {
         "mput", true, "upload multiple files at once",
-            " [ -r ] [ -- ] <filename-or-wildcard> [ <filename-or-wildcard>... ]\r\n"
+            " [ -r ] [ -j <n> ] [ -c ] [ -- ] <filename-or-wildcard> [ <filename-or-wildcard>... ]\r\n"
             "  Uploads many files to the server, storing each one under the\r\n"
             "  same name it has on the client side. You can use wildcards\r\n"
             "  such as \"*.c\" to specify lots of files at once.\r\n"
-            "  If -r specified, recursively store files and directories.",
+            "  If -r specified, recursively store files and directories.\r\n"
+            "  -j <n> transfers up to <n> files at once (default 4).\r\n"
+            "  -c verifies each file with the SHA-256 hash of the server,\r\n"
+            "  from its check-file extension or else from sha256sum run on\r\n"
+            "  a login of its own, which needs a shell account and, with a\r\n"
+            "  password login, -sftpconnections; otherwise the files are\r\n"
+            "  reported as not verified.",
             &sftpcmdmput_vt
     },
     {
@@ -282,11 +340,17 @@ struct SftpCmdLookup {
     },
     {
         "put", true, "upload a file from your local machine to the server",
-            " [ -r ] [ -- ] <filename> [ <remote-filename> ]\r\n"
+            " [ -r ] [ -j <n> ] [ -c ] [ -- ] <filename> [ <remote-filename> ]\r\n"
             "  Uploads a file to the server and stores it there under\r\n"
             "  the same name, or under a different one if you supply the\r\n"
             "  argument <remote-filename>.\r\n"
-            "  If -r specified, recursively store a directory.",
+            "  If -r specified, recursively store a directory.\r\n"
+            "  -j <n> transfers up to <n> files at once (default 4).\r\n"
+            "  -c verifies each file with the SHA-256 hash of the server,\r\n"
+            "  from its check-file extension or else from sha256sum run on\r\n"
+            "  a login of its own, which needs a shell account and, with a\r\n"
+            "  password login, -sftpconnections; otherwise the files are\r\n"
+            "  reported as not verified.",
             &sftpcmdput_vt
     },
     {
@@ -300,11 +364,19 @@ struct SftpCmdLookup {
     },
     {
         "reget", true, "continue downloading files",
-            " [ -r ] [ -- ] <filename> [ <local-filename> ]\r\n"
+            " [ -r ] [ -j <n> ] [ -c ] [ -P <n> ] [ -- ] <filename> [ <local-filename> ]\r\n"
             "  Works exactly like the \"get\" command, but the local file\r\n"
             "  must already exist. The download will begin at the end of the\r\n"
             "  file. This is for resuming a download that was interrupted.\r\n"
-            "  If -r specified, resume interrupted \"get -r\".",
+            "  If -r specified, resume interrupted \"get -r\".\r\n"
+            "  A download with -P continues every segment where it stopped,\r\n"
+            "  as recorded in the file <local-filename>.psftp-segments.\r\n"
+            "  -j <n> transfers up to <n> files at once (default 4).\r\n"
+            "  -c verifies each file with the SHA-256 hash of the server,\r\n"
+            "  from its check-file extension or else from sha256sum run on\r\n"
+            "  a login of its own, which needs a shell account and, with a\r\n"
+            "  password login, -sftpconnections; otherwise the files are\r\n"
+            "  reported as not verified.",
             &sftpcmdreget_vt
     },
     {
@@ -317,11 +389,17 @@ struct SftpCmdLookup {
     },
     {
         "reput", true, "continue uploading files",
-            " [ -r ] [ -- ] <filename> [ <remote-filename> ]\r\n"
+            " [ -r ] [ -j <n> ] [ -c ] [ -- ] <filename> [ <remote-filename> ]\r\n"
             "  Works exactly like the \"put\" command, but the remote file\r\n"
             "  must already exist. The upload will begin at the end of the\r\n"
             "  file. This is for resuming an upload that was interrupted.\r\n"
-            "  If -r specified, resume interrupted \"put -r\".",
+            "  If -r specified, resume interrupted \"put -r\".\r\n"
+            "  -j <n> transfers up to <n> files at once (default 4).\r\n"
+            "  -c verifies each file with the SHA-256 hash of the server,\r\n"
+            "  from its check-file extension or else from sha256sum run on\r\n"
+            "  a login of its own, which needs a shell account and, with a\r\n"
+            "  password login, -sftpconnections; otherwise the files are\r\n"
+            "  reported as not verified.",
             &sftpcmdreput_vt
     },
     {
@@ -335,6 +413,44 @@ struct SftpCmdLookup {
             "  The directory will not be removed unless it is empty.\r\n"
             "  Wildcards may be used to specify multiple directories.",
             &sftpcmdrm_vt
+    },
+    {
+        "sync", true, "transfer the changed files of a directory tree",
+            " push|pull [ -n ] [ -j <n> ] [ -- ] <directory> [ <target-directory> ]\r\n"
+            "  \"sync push\" uploads a local directory like \"put -r\", \"sync pull\"\r\n"
+            "  downloads a remote one like \"get -r\", but only the files which\r\n"
+            "  are missing on the other side or differ in size or modification\r\n"
+            "  time are transferred, and a transferred file gets the time of its\r\n"
+            "  source. The target directory defaults to the name of <directory>\r\n"
+            "  in the current directory of the other side. Files are never\r\n"
+            "  deleted. A summary of the files sent and unchanged is printed.\r\n"
+            "  -n only prints the files which would be transferred.\r\n"
+            "  -j <n> transfers up to <n> files at once (default 4).",
+            &sftpcmdsync_vt
+    },
+    {
+        "version", true, "show the SFTP version and extensions of the server",
+            "\r\n"
+            "  Shows the SFTP protocol version and the extensions the server\r\n"
+            "  announced, the limits it reported if it supports limits@openssh.com,\r\n"
+            "  and the request and packet sizes used with it.",
+            &sftpcmdversion_vt
+    },
+    {
+        "xfer", true, "show or set the transfer window",
+            " [ auto | pin <window> <size> | max <window> <read-size> <write-size> ]\r\n"
+            "  Without arguments, shows the transfer window settings and what\r\n"
+            "  was measured during the last transfer.\r\n"
+            "  By default (\"auto\"), get and put measure the round trip time\r\n"
+            "  and the bandwidth of the connection and keep about twice their\r\n"
+            "  product of data requested, in requests of a growing size.\r\n"
+            "  \"max\" sets the ceilings of the window and of the READ and WRITE\r\n"
+            "  request sizes. Servers may not support requests over 32k, unless\r\n"
+            "  they announced larger limits (see \"version\").\r\n"
+            "  \"pin\" fixes the window and the request size, e.g. for\r\n"
+            "  reproducible benchmarks.\r\n"
+            "  Sizes are given in bytes, optionally followed by k or m.",
+            &sftpcmdxfer_vt
     }
 };
 
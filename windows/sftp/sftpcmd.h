@@ -35,6 +35,12 @@ struct SftpCmdVtable {
     void (*free)(SftpCmd *cmd);
     bool (*process_pkt)(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pkt);
     SftpCmdArgInfo (*get_arg_info)(int file_arg_index);
+    /* Optional, called when the output backlog dropped below
+       SFTP_OUTPUT_BACKLOG_LIMIT. Returns false if the command is done. */
+    bool (*unthrottle)(SftpCmd *cmd, Sftp *sftp);
+    /* Optional, called when an extra connection became ready or failed,
+       see sftpconn.h. Returns false if the command is done. */
+    bool (*conn_changed)(SftpCmd *cmd, Sftp *sftp, SftpConn *conn);
 };
 
 static inline SftpCmd *sftpcmd_init(const SftpCmdVtable *vt, Sftp *sftp) { return vt->init(sftp); }
@@ -29,7 +29,6 @@ static SftpCmd *sftpcmdcd_init(Sftp *sftp)
     cmdcd->line_pwd = line_pwd;
     cmdcd->get_realpath = get_realpath;
     sftpcmd_clear_request(&cmdcd->cmd);
-    sftp_set_sending_backend(sftp);
     sftpcmd_set_request(&cmdcd->cmd, SSH_FXP_OPENDIR, fxp_opendir_send(cmdcd->line_pwd));
     return &cmdcd->cmd;
 }
@@ -45,14 +44,12 @@ static bool sftpcmdcd_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *
             sftp_line_printf(sftp, SEAT_OUTPUT_STDERR, cmdcd->line_pwd, "cd: directory %s: %s", utf8_arg, fxp_error());
             return false;
         }
-        sftp_set_sending_backend(sftp);
         sftpcmd_set_request(cmd, SSH_FXP_CLOSE, fxp_close_send(dirh));
         return true;
     } else if (cmd->req_type == SSH_FXP_CLOSE) {
         fxp_close_recv(pktin, cmd->req);
         sftpcmd_clear_request(cmd);
         if (cmdcd->get_realpath) {
-            sftp_set_sending_backend(sftp);
             sftpcmd_set_request(cmd, SSH_FXP_REALPATH, fxp_realpath_send(cmdcd->line_pwd));
             return true;
         }
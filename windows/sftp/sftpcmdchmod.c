@@ -19,7 +19,6 @@ static void send_stat(const char *fname, Sftp *sftp, SftpCmd *cmd)
     cmdchmod->fname = fname;
     cmdchmod->oldperms = 0;
     cmdchmod->newperms = 0;
-    sftp_set_sending_backend(sftp);
     sftpcmd_set_request(cmd, SSH_FXP_STAT, fxp_stat_send(fname));
 }
 
@@ -165,7 +164,6 @@ static bool sftpcmdchmod_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packe
             return sftpwcm_iterator_next(&cmdchmod->it, sftp, cmd); /* no need to do anything! */
         }
 
-        sftp_set_sending_backend(sftp);
         sftpcmd_set_request(cmd, SSH_FXP_SETSTAT, fxp_setstat_send(cmdchmod->fname, attrs));
         return true;
     } else if (cmd->req_type == SSH_FXP_SETSTAT) {
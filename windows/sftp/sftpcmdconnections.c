@@ -0,0 +1,33 @@
+#include "sftpcmd.h"
+#include "sftputil.h"
+#include "sftpbe.h"
+#include "sftpconn.h"
+
+static SftpCmd *sftpcmdconnections_init(Sftp *sftp)
+{
+    int argc = sftp->args.argc;
+    const char *const *argv = sftp->args.argv;
+
+    if (argc > 2) {
+        sftp_print(sftp->seat, SEAT_OUTPUT_STDERR, "connections: too many arguments");
+        return NULL;
+    }
+    if (argc == 2) {
+        char *end;
+        long count = strtol(argv[1], &end, 10);
+        if (end == argv[1] || *end || count < 0 || count > SFTPCONN_MAX) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "connections: '%s' is not a number between 0 and %d", argv[1], SFTPCONN_MAX);
+            return NULL;
+        }
+        sftpconn_set_count(sftp, (int)count);
+    }
+    sftpconn_print(sftp);
+    return NULL;
+}
+
+const SftpCmdVtable sftpcmdconnections_vt = {
+    .init = sftpcmdconnections_init,
+    .free = NULL,
+    .process_pkt = NULL,
+    .get_arg_info = sftpcmd_get_arg_info
+};
@@ -0,0 +1,401 @@
+#include "sftpcmd.h"
+#include "sftputil.h"
+#include "sftpfxp.h"
+#include "sftpgetput.h"
+#include "sftpunicode.h"
+
+/*
+ * cp copies a file on the server. The source and the destination are
+ * STATed together, then both are opened together. If the server announced
+ * the copy-data extension, one request copies the whole file; otherwise,
+ * or if the server refuses it, the READs of the source feed the WRITEs of
+ * the destination on the same channel, and the data never reaches the
+ * local disk. The READs outstanding stay within the room the window of the
+ * WRITEs has left, so at most about one window of data is held. The top
+ * level SftpCmd never has a request set, the replies are routed by request
+ * id.
+ */
+
+typedef enum CpState {
+    CP_STAT,
+    CP_OPEN,
+    CP_COPY,
+    CP_CLOSE
+} CpState;
+
+typedef struct SftpCmdCp {
+    SftpCmd cmd;
+    SftpCmd src;            /* STAT and OPEN of the source */
+    SftpCmd dst;            /* of the destination */
+    SftpCmd copy;           /* copy-data */
+    CpState state;
+    bool failed;
+
+    const char *fname; //utf8
+    const char *line_fname;
+    const char *dstfname; //utf8
+    const char *line_dstfname;
+    struct fxp_attrs attrs;
+    bool dst_is_dir;
+
+    struct fxp_handle *src_handle;
+    struct fxp_handle *dst_handle;
+    struct fxp_xfer *download;
+    struct fxp_xfer *upload;
+    SftpXferWindow rwindow;
+    SftpXferWindow wwindow;
+    SftpCloseQueue closes;
+} SftpCmdCp;
+
+static bool is_dir(const struct fxp_attrs *attrs)
+{
+    return (attrs->flags & SSH_FILEXFER_ATTR_PERMISSIONS) && (attrs->permissions & 0170000) == 0040000;
+}
+
+static void set_dstfname(SftpCmdCp *cp, const char *dstfname, const char *line_dstfname)
+{
+    sftp_dup_utf8_free(cp->line_dstfname, cp->dstfname);
+    sfree((void *)cp->dstfname);
+    cp->dstfname = dstfname;
+    cp->line_dstfname = line_dstfname;
+}
+
+static SftpCmd *sftpcmdcp_init(Sftp *sftp)
+{
+    int argc = sftp->args.argc;
+    const char *const *argv = sftp->args.argv;
+    int i = 1;
+    while (i < argc && argv[i][0] == '-') {
+        if (!strcmp(argv[i], "--")) {
+            /* finish processing options */
+            i++;
+            break;
+        }
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "cp: unrecognised option '%s'", argv[i]);
+        return NULL;
+    }
+    if (argc - i != 2) {
+        sftp_print(sftp->seat, SEAT_OUTPUT_STDERR, "cp: expects a source and a destination filename");
+        return NULL;
+    }
+
+    const char *fname = sftp_get_absolute_path(sftp->pwd, argv[i]);
+    const char *line_fname = sftp_dup_utf8_to_line(sftp->line_codepage, fname, sftp->seat);
+    if (!line_fname) {
+        sfree((void *)fname);
+        return NULL;
+    }
+    const char *dstfname = sftp_get_absolute_path(sftp->pwd, argv[i+1]);
+    const char *line_dstfname = sftp_dup_utf8_to_line(sftp->line_codepage, dstfname, sftp->seat);
+    if (!line_dstfname) {
+        sftp_dup_utf8_free(line_fname, fname);
+        sfree((void *)fname);
+        sfree((void *)dstfname);
+        return NULL;
+    }
+
+    SftpCmdCp *cp = snew(SftpCmdCp);
+    sftpcmd_clear_request(&cp->cmd);
+    sftpcmd_clear_request(&cp->src);
+    sftpcmd_clear_request(&cp->dst);
+    sftpcmd_clear_request(&cp->copy);
+    cp->state = CP_STAT;
+    cp->failed = false;
+    cp->fname = fname;
+    cp->line_fname = line_fname;
+    cp->dstfname = dstfname;
+    cp->line_dstfname = line_dstfname;
+    cp->dst_is_dir = false;
+    cp->src_handle = NULL;
+    cp->dst_handle = NULL;
+    cp->download = NULL;
+    cp->upload = NULL;
+    xfer_window_init(&cp->rwindow, &sftp->xfer_limits, false);
+    xfer_window_init(&cp->wwindow, &sftp->xfer_limits, true);
+    getput_closes_init(&cp->closes);
+
+    sftpcmd_set_request(&cp->src, SSH_FXP_STAT, fxp_stat_send(cp->line_fname));
+    sftpcmd_set_request(&cp->dst, SSH_FXP_STAT, fxp_stat_send(cp->line_dstfname));
+    return &cp->cmd;
+}
+
+static void src_process_pkt(SftpCmdCp *cp, Sftp *sftp, struct sftp_packet *pktin)
+{
+    SftpCmd *cmd = &cp->src;
+    if (cmd->req_type == SSH_FXP_STAT) {
+        bool result = fxp_stat_recv(pktin, cmd->req, &cp->attrs);
+        sftpcmd_clear_request(cmd);
+        if (!result) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "cp %s: %s", cp->fname, fxp_error());
+            cp->failed = true;
+        } else if (is_dir(&cp->attrs)) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "cp: %s is a directory", cp->fname);
+            cp->failed = true;
+        }
+    } else if (cmd->req_type == SSH_FXP_OPEN) {
+        cp->src_handle = fxp_open_recv(pktin, cmd->req);
+        sftpcmd_clear_request(cmd);
+        if (!cp->src_handle) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: open for read: %s", cp->fname, fxp_error());
+            cp->failed = true;
+        }
+    }
+}
+
+static void dst_process_pkt(SftpCmdCp *cp, Sftp *sftp, struct sftp_packet *pktin)
+{
+    SftpCmd *cmd = &cp->dst;
+    if (cmd->req_type == SSH_FXP_STAT) {
+        struct fxp_attrs attrs;
+        bool result = fxp_stat_recv(pktin, cmd->req, &attrs);
+        sftpcmd_clear_request(cmd);
+        cp->dst_is_dir = (result && is_dir(&attrs));
+    } else if (cmd->req_type == SSH_FXP_OPEN) {
+        cp->dst_handle = fxp_open_recv(pktin, cmd->req);
+        sftpcmd_clear_request(cmd);
+        if (!cp->dst_handle) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: open for write: %s", cp->dstfname, fxp_error());
+            cp->failed = true;
+        }
+    }
+}
+
+static void open_files(SftpCmdCp *cp, Sftp *sftp)
+{
+    if (cp->dst_is_dir) {
+        const char *p = cp->fname + strlen(cp->fname);
+        while (p > cp->fname && p[-1] != '/') p--;
+        const char *dstfname = dupcat(cp->dstfname, "/", p);
+        const char *line_dstfname = sftp_dup_utf8_to_line(sftp->line_codepage, dstfname, sftp->seat);
+        assert(line_dstfname); // both dstfname and fname are convertible to line codepage
+        set_dstfname(cp, dstfname, line_dstfname);
+    }
+    if (!strcmp(cp->line_fname, cp->line_dstfname)) {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "cp: %s and %s are the same file", cp->fname, cp->dstfname);
+        cp->failed = true;
+        return;
+    }
+
+    struct fxp_attrs attrs;
+    attrs.flags = 0;
+    if (cp->attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) {
+        PUT_PERMISSIONS(attrs, cp->attrs.permissions & 07777);
+    }
+    sftpcmd_set_request(&cp->src, SSH_FXP_OPEN, fxp_open_send(cp->line_fname, SSH_FXF_READ, NULL));
+    sftpcmd_set_request(&cp->dst, SSH_FXP_OPEN, fxp_open_send(cp->line_dstfname, SSH_FXF_WRITE | SSH_FXF_CREAT | SSH_FXF_TRUNC, &attrs));
+}
+
+/* The READs stay within the room of the WRITE window, but one READ is
+   always allowed while no WRITE is outstanding. */
+static size_t download_space(SftpCmdCp *cp)
+{
+    size_t space = xfer_upload_space_window(cp->upload, &cp->wwindow);
+    if (xfer_done(cp->upload) && space < (size_t)cp->rwindow.chunk) {
+        space = cp->rwindow.chunk;
+    }
+    return space;
+}
+
+static void start_pipeline(SftpCmdCp *cp, Sftp *sftp)
+{
+    cp->upload = xfer_upload_init_window(cp->dst_handle, 0, &cp->wwindow);
+    cp->download = xfer_download_init_window(cp->src_handle, 0, &cp->rwindow, download_space(cp));
+}
+
+static void start_copy(SftpCmdCp *cp, Sftp *sftp)
+{
+    if (sftp_find_extension(sftp, "copy-data")) {
+        sftpcmd_set_request(&cp->copy, SSH_FXP_EXTENDED, fxp_copy_data_send(cp->src_handle, 0, 0, cp->dst_handle, 0));
+    } else {
+        start_pipeline(cp, sftp);
+    }
+}
+
+static void copy_process_pkt(SftpCmdCp *cp, Sftp *sftp, struct sftp_packet *pktin)
+{
+    bool result = fxp_copy_data_recv(pktin, cp->copy.req);
+    sftpcmd_clear_request(&cp->copy);
+    if (!result && fxp_error_type() == SSH_FX_OP_UNSUPPORTED) {
+        start_pipeline(cp, sftp);
+    } else if (!result) {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "cp %s %s: %s", cp->fname, cp->dstfname, fxp_error());
+        cp->failed = true;
+    }
+}
+
+static void download_process_pkt(SftpCmdCp *cp, Sftp *sftp, struct sftp_packet *pktin)
+{
+    int retd = xfer_download_gotpkt_window(cp->download, &cp->rwindow, pktin);
+    if (retd <= 0) {
+        if (retd == INT_MIN) {
+            sftpfxp_pkt_free(pktin);
+        }
+        if (!cp->failed) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "error while reading: %s", fxp_error());
+            cp->failed = true;
+        }
+    }
+
+    struct sftp_packet *data_pkt;
+    const void *data;
+    int len;
+    while (xfer_download_data_window(cp->download, &data_pkt, &data, &len)) {
+        for (int pos = 0; pos < len && !cp->failed;) {
+            int n = min(len - pos, cp->wwindow.chunk);
+            xfer_upload_data_window(cp->upload, &cp->wwindow, (const char *)data + pos, n);
+            pos += n;
+        }
+        sftpfxp_pkt_free(data_pkt);
+    }
+}
+
+static void upload_process_pkt(SftpCmdCp *cp, Sftp *sftp, struct sftp_packet *pktin)
+{
+    int ret = xfer_upload_gotpkt_window(cp->upload, &cp->wwindow, pktin);
+    if (ret <= 0) {
+        if (ret == INT_MIN) {        /* pktin not even freed */
+            sfree(pktin);
+        }
+        if (!cp->failed) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "error while writing: %s", fxp_error());
+            cp->failed = true;
+        }
+        xfer_set_error(cp->download);
+    }
+}
+
+static bool copy_done(SftpCmdCp *cp)
+{
+    if (cp->copy.req) {
+        return false;
+    }
+    return !cp->download || (xfer_done(cp->download) && xfer_done(cp->upload));
+}
+
+static void close_files(SftpCmdCp *cp, Sftp *sftp)
+{
+    if (cp->download) {
+        xfer_download_cleanup_window(cp->download);
+        cp->download = NULL;
+        sftp->last_xfer = cp->rwindow;
+    }
+    if (cp->upload) {
+        xfer_cleanup(cp->upload);
+        cp->upload = NULL;
+    }
+    if (cp->src_handle) {
+        getput_close_send(&cp->closes, sftp, cp->src_handle, cp->fname);
+        cp->src_handle = NULL;
+    }
+    if (cp->dst_handle) {
+        getput_close_send(&cp->closes, sftp, cp->dst_handle, cp->dstfname);
+        cp->dst_handle = NULL;
+    }
+}
+
+/* Moves on once the requests of a step are answered. Returns false when
+   the cp is complete. */
+static bool cp_continue(SftpCmdCp *cp, Sftp *sftp)
+{
+    if (cp->src.req || cp->dst.req) {
+        return true;
+    }
+    if (cp->state == CP_STAT) {
+        cp->state = CP_OPEN;
+        if (!cp->failed) {
+            open_files(cp, sftp);
+            return true;
+        }
+    }
+    if (cp->state == CP_OPEN) {
+        cp->state = CP_COPY;
+        if (!cp->failed) {
+            start_copy(cp, sftp);
+        }
+    }
+    if (cp->state == CP_COPY) {
+        if (!cp->failed) {
+            if (cp->download && !xfer_done(cp->download)) {
+                xfer_download_queue_window(cp->download, &cp->rwindow, download_space(cp));
+            }
+            if (!copy_done(cp)) {
+                return true;
+            }
+        } else if (!copy_done(cp)) {
+            return true;
+        }
+        if (!cp->failed) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "%s -> %s", cp->fname, cp->dstfname);
+        }
+        close_files(cp, sftp);
+        cp->state = CP_CLOSE;
+    }
+    return cp->closes.n > 0;
+}
+
+static bool sftpcmdcp_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin)
+{
+    SftpCmdCp *cp = container_of(cmd, SftpCmdCp, cmd);
+    struct sftp_request *req = sftp_peek_request(sftp, pktin);
+    const char *close_failed;
+
+    if (req && getput_close_recv(&cp->closes, sftp, req, pktin, &close_failed)) {
+        if (close_failed) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: close: %s", close_failed, fxp_error());
+            sfree((void *)close_failed);
+        }
+    } else if (req && req == cp->src.req) {
+        sftp_find_request(pktin);
+        src_process_pkt(cp, sftp, pktin);
+    } else if (req && req == cp->dst.req) {
+        sftp_find_request(pktin);
+        dst_process_pkt(cp, sftp, pktin);
+    } else if (req && req == cp->copy.req) {
+        sftp_find_request(pktin);
+        copy_process_pkt(cp, sftp, pktin);
+    } else if (req && cp->download && xfer_owns_request(cp->download, req)) {
+        download_process_pkt(cp, sftp, pktin);
+    } else if (req && cp->upload && xfer_owns_request(cp->upload, req)) {
+        upload_process_pkt(cp, sftp, pktin);
+    } else {
+        sftpfxp_pkt_free(pktin);
+    }
+    return cp_continue(cp, sftp);
+}
+
+static void sftpcmdcp_free(SftpCmd *cmd)
+{
+    SftpCmdCp *cp = container_of(cmd, SftpCmdCp, cmd);
+    if (cp->download) {
+        xfer_download_cleanup_window(cp->download);
+    }
+    if (cp->upload) {
+        xfer_cleanup(cp->upload);
+    }
+    if (cp->src_handle) {
+        sftp_free_fxphandle(cp->src_handle);
+    }
+    if (cp->dst_handle) {
+        sftp_free_fxphandle(cp->dst_handle);
+    }
+    getput_closes_uninit(&cp->closes);
+    sftp_dup_utf8_free(cp->line_fname, cp->fname);
+    sfree((void *)cp->fname);
+    set_dstfname(cp, NULL, NULL);
+    sfree(cp);
+}
+
+static SftpCmdArgInfo sftpcmdcp_get_arg_info(int file_arg_index)
+{
+    if (file_arg_index < 2) {
+        return (SftpCmdArgInfo){SFTPCMD_ARG_TYPE_REMOTE, false, file_arg_index == 0};
+    }
+    return sftpcmd_get_arg_info(file_arg_index);
+}
+
+const SftpCmdVtable sftpcmdcp_vt = {
+    .init = sftpcmdcp_init,
+    .free = sftpcmdcp_free,
+    .process_pkt = sftpcmdcp_process_pkt,
+    .get_arg_info = sftpcmdcp_get_arg_info
+};
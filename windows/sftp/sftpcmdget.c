@@ -3,68 +3,199 @@
 #include "sftpfxp.h"
 #include "sftpwcm.h"
 #include "sftpgetput.h"
-#include "psftp.h"
+#include "psftpext.h"
 #include "sftpprogressbar.h"
 #include "sftpunicode.h"
+#include "sftpcrawler.h"
+#include "sftpwritebehind.h"
+#include "sftpconn.h"
+#include "sftpverify.h"
 
-const char *get_absolute_path(const char *pwd, const char *name);
+/*
+ * A get runs one source and up to `jobs' file pipelines on the same SFTP
+ * channel. The source walks the arguments and directories and STATs every
+ * name serially, so the order of the walk and the restart logic are the same
+ * as with a single pipeline. Directory entries which READDIR reported as
+ * regular files or directories need no STAT. The directories are read by a
+ * crawler, which lists the subdirectories found ahead of the walk. Every
+ * regular file found is handed to a free job, which does OPEN, the READs and
+ * CLOSE on its own handle, xfer and local file. There are
+ * GETPUT_LOOKAHEAD_FILES more jobs than transfers, so the next files are
+ * already open when a transfer finishes, and CLOSEs are not waited for. The
+ * local file is only created when the transfer starts, so reget sees the
+ * same files as without lookahead. The received data is written by a
+ * write-behind thread at explicit offsets; a job keeps its READs within the
+ * space of its write-behind queue and is resumed from the writer's callback,
+ * and it is released once the writer has closed the local file. When the
+ * size is known, disk space for the rest of the file is reserved before the
+ * first READ, without moving the end of the file, so an interrupted download
+ * still has its real length for reget. A sync pull reads every local
+ * directory once and skips the files which are unchanged there before they
+ * reach a job. The top level SftpCmd never has a request set, so all replies
+ * reach sftpcmdget_process_pkt, which routes them by request id.
+ *
+ * With -P a large file is split into segments, see sftpsegments.h, which
+ * the source hands to jobs like files. Every segment job opens the remote
+ * file itself and writes through its own write-behind and its own handle
+ * of the local file, which the source has preallocated to the full size.
+ * The jobs record how far their writers got in the shared GetSegmented,
+ * which saves the state file now and then and once the last segment ends.
+ *
+ * With extra connections, see sftpconn.h, every job of a large file or
+ * segment runs on the least busy connection: its OPEN, READs and CLOSE go
+ * there and its replies come back with the SftpFxp of that connection
+ * bound. The source, the crawler and the rest of the get stay on the main
+ * connection. The first large file waits in the source until the extra
+ * connections are open or have failed.
+ *
+ * With -c every job hashes the data it hands to its write-behind and asks
+ * the server for the hash of the same range before its CLOSE, see
+ * sftpverify.h.
+ */
+
+/* Least time between two saves of the state file of a segmented file. */
+#define SEGMENTS_SAVE_INTERVAL TICKSPERSEC
+
+typedef struct GetSegmented {
+    SftpSegments segs;
+    const char *statefname; //utf8
+    int next;               /* the next segment the source hands out */
+    int refs;               /* the source and the jobs of the segments */
+    unsigned long saved;    /* tick of the last save */
+} GetSegmented;
+
+typedef struct GetJob {
+    SftpCmd cmd;
+    bool busy;
+    const char *fname;
+    const char *line_fname;
+    const char *outfname; //utf8
+    struct fxp_attrs attrs;
+    struct fxp_handle *handle;
+    struct fxp_xfer *xfer;
+    SftpXferWindow window;
+    WFile *file;
+    SftpWriteBehind *wb;
+    bool opened;
+    bool closing;
+    bool write_failed;
+    unsigned seq;
+    GetSegmented *seg;      /* NULL for a file fetched in one piece */
+    int segi;
+    uint64_t seg_offset;    /* where the write-behind started */
+    SftpConn *conn;         /* NULL for the main connection */
+    SftpVerifyHash *hash;
+} GetJob;
 
 typedef struct SftpCmdGet {
     SftpCmd cmd;
+    SftpCmd source;
     bool restart;
     bool multiple;
     bool recurse;
     bool user_outfname;
+    GetPutSync sync;
     SftpWildcardMatcherIterator it;
 
     const char *fname;
     const char *line_fname;
     const char *outfname; //utf8
     struct fxp_attrs attrs;
-    int open_req;
-    struct fxp_handle *handle;
-    struct fxp_xfer *xfer;
-    WFile *file;
     bool stop;
+    bool listing_wait;
+    bool source_waiting;
+    bool source_done;
+
+    int jobs;
+    int segments;
+    GetSegmented *split;    /* the file whose segments the source hands out */
+    int active;
+    int njobs;
+    unsigned seq;
+    GetJob *job;
+    SftpXferWindow window; /* carried from a finished transfer to the next */
+    SftpCloseQueue closes;
+    SftpCrawler crawler;
+    SftpVerify verify;
 
     SftpDirStack dirstack;
     SftpProgressBar progress;
     Seat *progress_first_seat;
+    Sftp *sftp; /* for the write-behind callback */
 } SftpCmdGet;
 
-static void send_close(SftpCmdGet *cmdget, Sftp *sftp)
+static void free_names(const char **fname, const char **line_fname, const char **outfname)
 {
-    sftp_dup_utf8_free(cmdget->fname, cmdget->line_fname);
-    sfree((void *)cmdget->line_fname);
-    sfree((void *)cmdget->outfname);
-    sftp_set_sending_backend(sftp);
-    sftpcmd_set_request(&cmdget->cmd, SSH_FXP_CLOSE, fxp_close_send(cmdget->handle));
-    cmdget->fname = NULL;
-    cmdget->line_fname = NULL;
-    cmdget->outfname = NULL;
-    cmdget->handle = NULL;
+    sftp_dup_utf8_free(*fname, *line_fname);
+    sfree((void *)*line_fname);
+    sfree((void *)*outfname);
+    *fname = NULL;
+    *line_fname = NULL;
+    *outfname = NULL;
+}
+
+static void progress_interrupt(SftpCmdGet *cmdget, Sftp *sftp)
+{
+    getput_progress_interrupt(&cmdget->progress, cmdget->jobs, sftp->seat);
+}
+
+static void segments_save(GetSegmented *gs, bool force)
+{
+    unsigned long now = GETTICKCOUNT();
+    if (force || now - gs->saved >= SEGMENTS_SAVE_INTERVAL) {
+        sftpsegments_save(&gs->segs, gs->statefname);
+        gs->saved = now;
+    }
+}
+
+/* With the last reference the state file is deleted if every segment is
+   complete, otherwise it is saved for reget. */
+static void segments_release(GetSegmented *gs)
+{
+    if (--gs->refs > 0) {
+        return;
+    }
+    if (sftpsegments_complete(&gs->segs)) {
+        delete_file(gs->statefname);
+    } else {
+        segments_save(gs, true);
+    }
+    sfree((void *)gs->statefname);
+    sfree(gs);
+}
+
+static void split_done(SftpCmdGet *cmdget)
+{
+    if (cmdget->split) {
+        segments_release(cmdget->split);
+        cmdget->split = NULL;
+    }
+}
+
+/* Records how far the write-behind of a segment job has written. */
+static void segment_progress(GetJob *job)
+{
+    if (job->seg && job->wb) {
+        job->seg->segs.seg[job->segi].done = job->seg_offset + sftpwritebehind_written(job->wb);
+    }
 }
 
-static void sftpcmdget_free(SftpCmd *cmd);
 static bool sftpcmdget_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin);
-static bool get_file_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin);
+static bool source_iterator_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin);
+static bool source_file_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin);
+
+extern const SftpCmdVtable sftpcmdget_vt;
 
 static const SftpCmdVtable getfile_vt = {
-    .init = NULL,
-    .free = sftpcmdget_free,
-    .process_pkt = get_file_process_pkt
+    .process_pkt = source_file_process_pkt
 };
 
 static const SftpCmdVtable get_vt = {
-    .init = NULL,
-    .free = sftpcmdget_free,
-    .process_pkt = sftpcmdget_process_pkt
+    .process_pkt = source_iterator_process_pkt
 };
 
-static void get_file(const char *fname, Sftp *sftp, SftpCmd *cmd)
+static void set_names(SftpCmdGet *cmdget, Sftp *sftp, const char *fname)
 {
-    SftpCmdGet *cmdget = container_of(cmd, SftpCmdGet, cmd);
-
     if (fname == cmdget->it.cname) {
       fname = dupstr(fname);
     }
@@ -74,13 +205,26 @@ static void get_file(const char *fname, Sftp *sftp, SftpCmd *cmd)
     if (!cmdget->outfname) {
         cmdget->outfname = get_absolute_path(sftp->lpwd, stripslashes(cmdget->fname, false));
     }
+}
 
+static void get_file(const char *fname, Sftp *sftp, SftpCmd *cmd)
+{
+    SftpCmdGet *cmdget = container_of(cmd, SftpCmdGet, source);
+
+    set_names(cmdget, sftp, fname);
     cmd->vt = &getfile_vt;
-    sftp_set_sending_backend(sftp);
     sftpcmd_set_request(cmd, SSH_FXP_STAT, fxp_stat_send(cmdget->line_fname));
 }
 
-static void dir_get_file(SftpDir *dir, Sftp *sftp, SftpCmdGet *cmdget)
+static bool start_job(SftpCmdGet *cmdget, Sftp *sftp);
+static bool get_dir(SftpCmdGet *cmdget, Sftp *sftp);
+
+static bool is_regular_file(const struct fxp_attrs *attrs)
+{
+    return (attrs->flags & SSH_FILEXFER_ATTR_PERMISSIONS) && (attrs->permissions & 0170000) == 0100000;
+}
+
+static bool dir_get_file(SftpDir *dir, Sftp *sftp, SftpCmdGet *cmdget)
 {
     const char *dir_fname = sftp_dup_utf8_from_line(sftp->line_codepage, dir->ournames[dir->i]);
     const char *nextfname = dupcat(dir->line_fname, "/", dir->ournames[dir->i]);
@@ -88,7 +232,73 @@ static void dir_get_file(SftpDir *dir, Sftp *sftp, SftpCmdGet *cmdget)
     sftp_dup_utf8_free(dir_fname, dir->ournames[dir->i]);
     assert(cmdget->outfname == NULL);
     cmdget->outfname = nextoutfname;
-    get_file(nextfname, sftp, &cmdget->cmd);
+
+    /* A regular file or a directory stays one when following symlinks, so
+       the attributes from READDIR can stand in for a STAT. */
+    struct fxp_attrs *attrs = &dir->ourattrs[dir->i];
+    if (is_regular_file(attrs)) {
+        set_names(cmdget, sftp, nextfname);
+        cmdget->attrs = *attrs;
+        return start_job(cmdget, sftp);
+    }
+    if ((attrs->flags & SSH_FILEXFER_ATTR_PERMISSIONS) && (attrs->permissions & 0170000) == 0040000) {
+        set_names(cmdget, sftp, nextfname);
+        cmdget->attrs = *attrs;
+        return get_dir(cmdget, sftp);
+    }
+    get_file(nextfname, sftp, &cmdget->source);
+    return true;
+}
+
+/* Whether the local directory holds the state file of an unfinished
+   segmented download of name, whose local file has the full size. */
+static bool has_state_file(SftpLocalSnapshot *local, const char *name)
+{
+    char *statename = sftpsegments_state_name(name);
+    bool exists = sftplocalsnap_exists(local, statename);
+    sfree(statename);
+    return exists;
+}
+
+/* Steps over the files which the local directory already holds, going by
+   the attributes from READDIR: the complete ones of a reget and the
+   unchanged ones of a sync. A dry run lists the other files of a sync
+   instead of fetching them. */
+static void skip_local_files(SftpCmdGet *cmdget, SftpDir *dir, Sftp *sftp)
+{
+    if (!dir->local && !cmdget->sync.enabled) {
+        return;
+    }
+    while (dir->i < dir->nnames) {
+        const struct fxp_attrs *attrs = &dir->ourattrs[dir->i];
+        if (!is_regular_file(attrs) || !(attrs->flags & SSH_FILEXFER_ATTR_SIZE)) {
+            return;
+        }
+        unsigned long mtime = (attrs->flags & SSH_FILEXFER_ATTR_ACMODTIME) ? attrs->mtime : 0;
+        const char *name = sftp_dup_utf8_from_line(sftp->line_codepage, dir->ournames[dir->i]);
+        bool skip;
+        if (!cmdget->sync.enabled) {
+            skip = sftplocalsnap_complete(dir->local, name, attrs->size, mtime) && !has_state_file(dir->local, name);
+        } else if (dir->local && sftplocalsnap_same(dir->local, name, attrs->size, mtime)) {
+            cmdget->sync.files_skipped++;
+            cmdget->sync.bytes_skipped += attrs->size;
+            skip = true;
+        } else if (cmdget->sync.dry_run) {
+            const char *outfname = dir_file_cat(dir->outfname, name);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "would get: %s/%s => %s", dir->fname, name, outfname);
+            sfree((void *)outfname);
+            cmdget->sync.files_sent++;
+            cmdget->sync.bytes_sent += attrs->size;
+            skip = true;
+        } else {
+            skip = false;
+        }
+        sftp_dup_utf8_free(name, dir->ournames[dir->i]);
+        if (!skip) {
+            return;
+        }
+        dir->i++;
+    }
 }
 
 static bool next_file(Sftp *sftp, SftpCmdGet *cmdget)
@@ -97,271 +307,823 @@ static bool next_file(Sftp *sftp, SftpCmdGet *cmdget)
         SftpDir *dir = sftpdirstack_top(&cmdget->dirstack);
         while (dir) {
             dir->i++;
+            skip_local_files(cmdget, dir, sftp);
             if (dir->i < dir->nnames) {
                 break;
             }
             dir = sftpdirstack_pop(&cmdget->dirstack);
         }
         if (dir) {
-            dir_get_file(dir, sftp, cmdget);
-            return true;
+            return dir_get_file(dir, sftp, cmdget);
         }
     }
-    cmdget->cmd.vt = &get_vt;
-    return sftpwcm_iterator_next(&cmdget->it, sftp, &cmdget->cmd);
+    cmdget->source.vt = &get_vt;
+    return sftpwcm_iterator_next(&cmdget->it, sftp, &cmdget->source);
 }
 
-static bool get_file_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin)
+static GetJob *get_free_job(SftpCmdGet *cmdget)
 {
-    SftpCmdGet *cmdget = container_of(cmd, SftpCmdGet, cmd);
+    for (int i = 0; i < cmdget->njobs; i++) {
+        if (!cmdget->job[i].busy) {
+            return &cmdget->job[i];
+        }
+    }
+    return NULL;
+}
 
-    if (cmd->req_type == SSH_FXP_STAT) {
-        bool result = fxp_stat_recv(pktin, cmd->req, &cmdget->attrs);
-        sftpcmd_clear_request(cmd);
-        if (cmdget->recurse) {
-            if (result && (cmdget->attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) && (cmdget->attrs.permissions & 0040000)) {
-                if (file_type(cmdget->outfname) != FILE_TYPE_DIRECTORY && !create_directory(cmdget->outfname)) {
-                    sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: Cannot create local directory", cmdget->outfname);
-                    return false;
-                }
-                sftp_set_sending_backend(sftp);
-                sftpcmd_set_request(cmd, SSH_FXP_OPENDIR, fxp_opendir_send(cmdget->line_fname));
-                return true;
-            }
+/* Whether a sync does not fetch the file the source has just STATed,
+   because the local file is unchanged or it is a dry run. The files listed
+   by READDIR with their type are already checked by skip_local_files(). */
+static bool sync_skip_file(SftpCmdGet *cmdget, Sftp *sftp)
+{
+    const char *outfname = cmdget->outfname;
+    const char *local_outfname = NULL;
+    if (cmdget->user_outfname && file_type(outfname) == FILE_TYPE_DIRECTORY) {
+        local_outfname = dir_file_cat(outfname, stripslashes(cmdget->fname, false));
+        outfname = local_outfname;
+    }
+    struct fxp_attrs local_attrs;
+    local_attrs.flags = SSH_FILEXFER_ATTR_SIZE | SSH_FILEXFER_ATTR_ACMODTIME;
+    RFile *file = open_existing_file(outfname, &local_attrs.size, &local_attrs.mtime, &local_attrs.atime, NULL);
+    bool unchanged = false;
+    if (file) {
+        close_rfile(file);
+        unchanged = getput_sync_unchanged(&cmdget->attrs, &local_attrs);
+    }
+    uint64_t size = (cmdget->attrs.flags & SSH_FILEXFER_ATTR_SIZE) ? cmdget->attrs.size : 0;
+    bool skip = true;
+    if (unchanged) {
+        cmdget->sync.files_skipped++;
+        cmdget->sync.bytes_skipped += size;
+    } else if (cmdget->sync.dry_run) {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "would get: %s => %s", cmdget->fname, outfname);
+        cmdget->sync.files_sent++;
+        cmdget->sync.bytes_sent += size;
+    } else {
+        skip = false;
+    }
+    sfree((void *)local_outfname);
+    return skip;
+}
+
+/* Splits the file the source has just STATed into segments, or takes
+   them from the state file a reget finds, and creates the preallocated
+   local file for a new split. Returns false if the file is fetched in one
+   piece, which a failure to create the files reports by stopping the get.
+   A reget continues a partial file without a state file at its end. */
+static bool start_segments(SftpCmdGet *cmdget, Sftp *sftp)
+{
+    if (!(cmdget->attrs.flags & SSH_FILEXFER_ATTR_SIZE)) {
+        return false;
+    }
+    uint64_t size = cmdget->attrs.size;
+    const char *outfname = cmdget->outfname;
+    const char *local_outfname = NULL;
+    if (cmdget->user_outfname && !cmdget->recurse && file_type(outfname) == FILE_TYPE_DIRECTORY) {
+        local_outfname = dir_file_cat(outfname, stripslashes(cmdget->fname, false));
+        outfname = local_outfname;
+    }
+    GetSegmented *gs = snew(GetSegmented);
+    gs->statefname = sftpsegments_state_name(outfname);
+    gs->next = 0;
+    gs->refs = 1;
+    gs->saved = GETTICKCOUNT();
+
+    bool resume = false;
+    bool split = false;
+    if (cmdget->restart && file_type(gs->statefname) == FILE_TYPE_FILE) {
+        resume = (file_type(outfname) == FILE_TYPE_FILE && sftpsegments_load(&gs->segs, gs->statefname, size));
+        if (!resume) {
+            progress_interrupt(cmdget, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "reget: %s does not match %s, fetching it again", gs->statefname, cmdget->fname);
         }
-        if (!result) {
-            cmdget->attrs.flags = 0;
+        split = true;
+    } else if (cmdget->segments > 1 && size >= 2 * (uint64_t)SFTPSEGMENTS_MIN_SIZE) {
+        split = !cmdget->restart || file_type(outfname) == FILE_TYPE_NONEXISTENT;
+    }
+    if (!split) {
+        sfree((void *)gs->statefname);
+        sfree(gs);
+        sfree((void *)local_outfname);
+        return false;
+    }
+
+    if (!resume) {
+        /* The state file comes first, so an incomplete local file always
+           has one. */
+        sftpsegments_split(&gs->segs, size, cmdget->segments);
+        WFile *file = NULL;
+        if (sftpsegments_save(&gs->segs, gs->statefname)) {
+            file = open_new_file(outfname, GET_PERMISSIONS(cmdget->attrs, -1));
         }
-        sftp_set_sending_backend(sftp);
-        sftpcmd_set_request(cmd, SSH_FXP_OPEN, fxp_open_send(cmdget->line_fname, SSH_FXF_READ, NULL));
-        return true;
-    } else if (cmd->req_type == SSH_FXP_OPENDIR) {
-        assert(!cmdget->handle);
-        cmdget->open_req = cmd->req_type;
-        cmdget->handle = fxp_opendir_recv(pktin, cmd->req);
-        sftpcmd_clear_request(cmd);
-        if (!cmdget->handle) {
-            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: unable to open directory: %s", cmdget->fname, fxp_error());
+        bool created = (file && set_file_size(file, size));
+        if (file) {
+            close_wfile(file);
+        }
+        if (!created) {
+            progress_interrupt(cmdget, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "local: unable to open %s", outfname);
+            cmdget->stop = true;
+            delete_file(gs->statefname);
+            sfree((void *)gs->statefname);
+            sfree(gs);
+            sfree((void *)local_outfname);
             return false;
         }
-        SftpDir *dir = sftpdirstack_push(&cmdget->dirstack);
-        dir->fname = cmdget->fname;
-        dir->line_fname = cmdget->line_fname;
-        dir->outfname = cmdget->outfname;
-        cmdget->fname = NULL;
-        cmdget->line_fname = NULL;
-        cmdget->outfname = NULL;
-        sftp_set_sending_backend(sftp);
-        sftpcmd_set_request(cmd, SSH_FXP_READDIR, fxp_readdir_send(cmdget->handle));
+    }
+    if (local_outfname) {
+        sfree((void *)cmdget->outfname);
+        cmdget->outfname = local_outfname;
+    }
+    cmdget->split = gs;
+
+    progress_interrupt(cmdget, sftp);
+    if (resume) {
+        uint64_t done = 0;
+        for (int i = 0; i < gs->segs.n; i++) {
+            done += gs->segs.seg[i].done - gs->segs.seg[i].start;
+        }
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "reget: restarting %d segments with %"PRIu64" of %"PRIu64" bytes done", gs->segs.n, done, size);
+    }
+    sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "remote: %s => local: %s (%d segments)", cmdget->fname, cmdget->outfname, gs->segs.n);
+    return true;
+}
+
+/* Moves the split to its next incomplete segment, false if there is none
+   left to hand out. */
+static bool next_segment(GetSegmented *gs)
+{
+    while (gs->next < gs->segs.n && gs->segs.seg[gs->next].done == gs->segs.seg[gs->next].end) {
+        gs->next++;
+    }
+    return gs->next < gs->segs.n;
+}
+
+/* The bytes the next job of the source transfers, as far as known. */
+static uint64_t next_transfer_size(SftpCmdGet *cmdget)
+{
+    if (cmdget->split) {
+        const SftpSegment *seg = &cmdget->split->segs.seg[cmdget->split->next];
+        return seg->end - seg->done;
+    }
+    return (cmdget->attrs.flags & SSH_FILEXFER_ATTR_SIZE) ? cmdget->attrs.size : 0;
+}
+
+/* Binds the connection of a job and makes it the owner of the requests
+   sent until job_leave(), so find_job() gets it from the request table. */
+static SftpFxp *job_enter(Sftp *sftp, GetJob *job, void **prev_owner)
+{
+    SftpFxp *prev = sftpconn_enter(sftp, job->conn);
+    *prev_owner = sftpfxp_set_owner(job);
+    return prev;
+}
+
+static void job_leave(SftpFxp *prev, void *prev_owner)
+{
+    sftpfxp_set_owner(prev_owner);
+    sftpfxp_leave(prev);
+}
+
+/* Sends the OPEN of a job on its connection. */
+static void job_open(GetJob *job, Sftp *sftp)
+{
+    void *prev_owner;
+    SftpFxp *prev = job_enter(sftp, job, &prev_owner);
+    sftpcmd_set_request(&job->cmd, SSH_FXP_OPEN, fxp_open_send(job->line_fname, SSH_FXF_READ, NULL));
+    job_leave(prev, prev_owner);
+}
+
+/* Hands the file the source has just STATed to a job, or each of its
+   segments to a job, or parks it in the source until a job is released or
+   the extra connections are open. Returns false when the source has
+   nothing more to do. */
+static bool start_job(SftpCmdGet *cmdget, Sftp *sftp)
+{
+    if (cmdget->stop) {
+        split_done(cmdget);
+        free_names(&cmdget->fname, &cmdget->line_fname, &cmdget->outfname);
+        return false;
+    }
+    if (cmdget->sync.enabled && sync_skip_file(cmdget, sftp)) {
+        free_names(&cmdget->fname, &cmdget->line_fname, &cmdget->outfname);
+        return next_file(sftp, cmdget);
+    }
+    if (!cmdget->split && (cmdget->segments > 1 || cmdget->restart) && !start_segments(cmdget, sftp) && cmdget->stop) {
+        free_names(&cmdget->fname, &cmdget->line_fname, &cmdget->outfname);
+        return false;
+    }
+    if (cmdget->split && !next_segment(cmdget->split)) {
+        split_done(cmdget);
+        free_names(&cmdget->fname, &cmdget->line_fname, &cmdget->outfname);
+        return next_file(sftp, cmdget);
+    }
+    uint64_t size = next_transfer_size(cmdget);
+    GetJob *job = get_free_job(cmdget);
+    if (!job || sftpconn_wait(sftp, size)) {
+        cmdget->source_waiting = true;
         return true;
-    } else if (cmd->req_type == SSH_FXP_READDIR) {
-        SftpDir *dir = sftpdirstack_top(&cmdget->dirstack);
-        struct fxp_names *names = fxp_readdir_recv(pktin, cmd->req);
-        sftpcmd_clear_request(cmd);
-        if (names == NULL) {
-            if (fxp_error_type() != SSH_FX_EOF) {
-                sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: reading directory: %s", dir->fname, fxp_error());
-                cmdget->stop = true;
-            }
-            send_close(cmdget, sftp);
-            return true;
+    }
+    job->busy = true;
+    job->conn = sftpconn_acquire(sftp, size);
+    job->opened = false;
+    job->write_failed = false;
+    job->seq = cmdget->seq++;
+    if (cmdget->split) {
+        GetSegmented *gs = cmdget->split;
+        gs->refs++;
+        job->seg = gs;
+        job->segi = gs->next++;
+        job->line_fname = dupstr(cmdget->line_fname);
+        job->fname = sftp_dup_utf8_from_line(sftp->line_codepage, job->line_fname);
+        job->outfname = dupstr(cmdget->outfname);
+        job->attrs = cmdget->attrs;
+        job_open(job, sftp);
+        return start_job(cmdget, sftp);
+    }
+    job->fname = cmdget->fname;
+    job->line_fname = cmdget->line_fname;
+    job->outfname = cmdget->outfname;
+    job->attrs = cmdget->attrs;
+    cmdget->fname = NULL;
+    cmdget->line_fname = NULL;
+    cmdget->outfname = NULL;
+    job_open(job, sftp);
+    return next_file(sftp, cmdget);
+}
+
+static void job_release(SftpCmdGet *cmdget, GetJob *job, Sftp *sftp);
+static void resume_source(SftpCmdGet *cmdget, Sftp *sftp);
+
+/* Reports a failed local write once, and stops the get. */
+static void check_write_failed(SftpCmdGet *cmdget, GetJob *job, Sftp *sftp)
+{
+    if (job->write_failed || !sftpwritebehind_failed(job->wb)) {
+        return;
+    }
+    job->write_failed = true;
+    progress_interrupt(cmdget, sftp);
+    sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: error while writing local file", job->outfname);
+    cmdget->stop = true;
+    if (job->xfer) {
+        xfer_set_error(job->xfer);
+    }
+}
+
+/* The job stays busy until the write-behind has closed the local file. */
+static void job_done(SftpCmdGet *cmdget, GetJob *job, Sftp *sftp)
+{
+    if (job->hash) {
+        if (job->handle && job->xfer && xfer_done(job->xfer) && !cmdget->stop) {
+            sftpverify_check_send(&cmdget->verify, sftp, job->hash, job->handle, job->fname, job->line_fname, !job->seg);
+        } else {
+            sftpverify_hash_free(job->hash);
         }
-        if (names->nnames == 0) {
-            fxp_free_names(names);
-            send_close(cmdget, sftp);
-            return true;
+        job->hash = NULL;
+    }
+    if (job->handle) {
+        getput_close_send(&cmdget->closes, sftp, job->handle, job->fname);
+        job->handle = NULL;
+    }
+    if (job->xfer) {
+        xfer_download_cleanup_window(job->xfer);
+        job->xfer = NULL;
+        cmdget->active--;
+        cmdget->window = job->window;
+        sftp->last_xfer = job->window;
+    }
+    if (job->file) {
+        close_wfile(job->file);
+        job->file = NULL;
+    }
+    job->opened = false;
+    if (job->wb) {
+        sftpwritebehind_close(job->wb);
+        job->closing = true;
+        return;
+    }
+    job_release(cmdget, job, sftp);
+}
+
+static void job_release(SftpCmdGet *cmdget, GetJob *job, Sftp *sftp)
+{
+    if (job->seg) {
+        const SftpSegment *seg = &job->seg->segs.seg[job->segi];
+        if (!cmdget->stop && seg->done != seg->end) {
+            progress_interrupt(cmdget, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: file ended before the segment at %"PRIu64"", job->fname, seg->start);
+            cmdget->stop = true;
         }
-        sgrowarrayn(dir->ournames, dir->namesize, dir->nnames, names->nnames);
-        for (size_t i = 0; i < names->nnames; i++) {
-            if (strcmp(names->names[i].filename, ".") && strcmp(names->names[i].filename, "..")) {
-                if (!vet_filename(names->names[i].filename)) {
-                    sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "ignoring potentially dangerous server-supplied filename '%s'", names->names[i].filename);
-                    continue;
-                }
-                dir->ournames[dir->nnames++] = names->names[i].filename;
-                names->names[i].filename = NULL;
+        segments_release(job->seg);
+        job->seg = NULL;
+    }
+    free_names(&job->fname, &job->line_fname, &job->outfname);
+    sftpconn_release(sftp, job->conn);
+    job->conn = NULL;
+    job->busy = false;
+    resume_source(cmdget, sftp);
+}
+
+/* Lets the source go on with the file it parked in start_job(), on the
+   main connection. */
+static void resume_source(SftpCmdGet *cmdget, Sftp *sftp)
+{
+    if (!cmdget->source_waiting) {
+        return;
+    }
+    cmdget->source_waiting = false;
+    SftpFxp *prev = sftpconn_enter(sftp, NULL);
+    if (cmdget->stop) {
+        split_done(cmdget);
+        free_names(&cmdget->fname, &cmdget->line_fname, &cmdget->outfname);
+        cmdget->source_done = true;
+    } else if (!start_job(cmdget, sftp)) {
+        cmdget->source_done = true;
+    }
+    sftpfxp_leave(prev);
+}
+
+/* Called when the directory on top of the stack is read completely. Its
+   CLOSE is not waited for. */
+static bool dir_listed(SftpCmdGet *cmdget, Sftp *sftp)
+{
+    if (cmdget->stop) {
+        return false;
+    }
+    SftpDir *dir = sftpdirstack_top(&cmdget->dirstack);
+    if (dir->nnames == 0) {
+      sftpdirstack_pop(&cmdget->dirstack);
+      return next_file(sftp, cmdget);
+    }
+    /*
+     * Sort the names into a clear order. This ought to
+     * make things more predictable when we're doing a
+     * reget of the same directory, just in case two
+     * readdirs on the same remote directory return a
+     * different order.
+     */
+    getput_sort_dir_names(dir);
+    /*
+     * If we're in restart mode, find the last filename on
+     * this list that already exists. We may have to do a
+     * reget on _that_ file, but shouldn't have to do
+     * anything on the previous files.
+     *
+     * If none of them exists, of course, we start at 0.
+     *
+     * With several jobs the interrupted transfer may have
+     * left up to that many partial files behind, so we step
+     * back that many names. From there on the files which
+     * are already complete locally are skipped.
+     *
+     * The local directory is read once for all of this, and
+     * for the comparisons of a sync.
+     */
+    dir->i = 0;
+    if (cmdget->restart) {
+        dir->local = sftplocalsnap_read(dir->outfname);
+        while (dir->local && dir->i < dir->nnames) {
+            const char *name = sftp_dup_utf8_from_line(sftp->line_codepage, dir->ournames[dir->i]);
+            bool exists = sftplocalsnap_exists(dir->local, name);
+            sftp_dup_utf8_free(name, dir->ournames[dir->i]);
+            if (!exists) {
+                break;
             }
+            dir->i++;
         }
-        fxp_free_names(names);
-        sftp_set_sending_backend(sftp);
-        sftpcmd_set_request(cmd, SSH_FXP_READDIR, fxp_readdir_send(cmdget->handle));
+        dir->i = (dir->i > cmdget->jobs ? dir->i - cmdget->jobs : 0);
+    } else if (cmdget->sync.enabled) {
+        dir->local = sftplocalsnap_read(dir->outfname);
+    }
+    skip_local_files(cmdget, dir, sftp);
+    if (dir->i == dir->nnames) {
+        sftpdirstack_pop(&cmdget->dirstack);
+        return next_file(sftp, cmdget);
+    }
+    /* Let the crawler read the subdirectories ahead, in the order the walk
+       will get to them. */
+    for (size_t i = dir->i; i < dir->nnames; i++) {
+        if ((dir->ourattrs[i].flags & SSH_FILEXFER_ATTR_PERMISSIONS) && (dir->ourattrs[i].permissions & 0170000) == 0040000) {
+            const char *line_subdir = dupcat(dir->line_fname, "/", dir->ournames[i]);
+            sftpcrawler_prefetch(&cmdget->crawler, sftp, line_subdir);
+            sfree((void *)line_subdir);
+        }
+    }
+    return dir_get_file(dir, sftp, cmdget);
+}
+
+/* Enters the directory the source has found, its listing is taken over from
+   the crawler by take_listing(). */
+static bool get_dir(SftpCmdGet *cmdget, Sftp *sftp)
+{
+    if (cmdget->stop) {
+        free_names(&cmdget->fname, &cmdget->line_fname, &cmdget->outfname);
+        return false;
+    }
+    if (!cmdget->sync.dry_run && file_type(cmdget->outfname) != FILE_TYPE_DIRECTORY && !create_directory(cmdget->outfname)) {
+        progress_interrupt(cmdget, sftp);
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: Cannot create local directory", cmdget->outfname);
+        cmdget->stop = true;
+        free_names(&cmdget->fname, &cmdget->line_fname, &cmdget->outfname);
+        return false;
+    }
+    SftpDir *dir = sftpdirstack_push(&cmdget->dirstack);
+    dir->fname = cmdget->fname;
+    dir->line_fname = cmdget->line_fname;
+    dir->outfname = cmdget->outfname;
+    cmdget->fname = NULL;
+    cmdget->line_fname = NULL;
+    cmdget->outfname = NULL;
+    sftpcrawler_request(&cmdget->crawler, sftp, dir->line_fname);
+    cmdget->listing_wait = true;
+    return true;
+}
+
+/* Moves the listing of the directory on top of the stack from the crawler
+   once it is complete. Returns false while it is still being read. */
+static bool take_listing(SftpCmdGet *cmdget, Sftp *sftp)
+{
+    SftpDir *dir = sftpdirstack_top(&cmdget->dirstack);
+    SftpCrawlDir *d = sftpcrawler_take(&cmdget->crawler, sftp, dir->line_fname);
+    if (!d) {
+        return false;
+    }
+    cmdget->listing_wait = false;
+    if (d->error && !cmdget->stop) {
+        progress_interrupt(cmdget, sftp);
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: %s", dir->fname, d->error);
+        cmdget->stop = true;
+    }
+    if (cmdget->stop) {
+        sftpcrawldir_free(d);
+        cmdget->source_done = true;
         return true;
-    } else if (cmd->req_type == SSH_FXP_CLOSE && cmdget->open_req == SSH_FXP_OPENDIR) {
-        fxp_close_recv(pktin, cmd->req);
+    }
+    sgrowarrayn(dir->ournames, dir->namesize, dir->nnames, d->nnames);
+    sgrowarrayn(dir->ourattrs, dir->attrsize, dir->nnames, d->nnames);
+    for (size_t i = 0; i < d->nnames; i++) {
+        if (!vet_filename(d->names[i])) {
+            progress_interrupt(cmdget, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "ignoring potentially dangerous server-supplied filename '%s'", d->names[i]);
+            continue;
+        }
+        dir->ourattrs[dir->nnames] = d->attrs[i];
+        dir->ournames[dir->nnames++] = d->names[i];
+        d->names[i] = NULL;
+    }
+    sftpcrawldir_free(d);
+    if (!dir_listed(cmdget, sftp)) {
+        cmdget->source_done = true;
+    }
+    return true;
+}
+
+static bool source_file_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin)
+{
+    SftpCmdGet *cmdget = container_of(cmd, SftpCmdGet, source);
+
+    if (cmd->req_type == SSH_FXP_STAT) {
+        bool result = fxp_stat_recv(pktin, cmd->req, &cmdget->attrs);
         sftpcmd_clear_request(cmd);
-        cmdget->open_req = 0;
         if (cmdget->stop) {
+            free_names(&cmdget->fname, &cmdget->line_fname, &cmdget->outfname);
             return false;
         }
-        SftpDir *dir = sftpdirstack_top(&cmdget->dirstack);
-        if (dir->nnames == 0) {
-          sftpdirstack_pop(&cmdget->dirstack);
-          return next_file(sftp, cmdget);
-        }
-        /*
-         * Sort the names into a clear order. This ought to
-         * make things more predictable when we're doing a
-         * reget of the same directory, just in case two
-         * readdirs on the same remote directory return a
-         * different order.
-         */
-        getput_sort_dir_names(dir);
-        /*
-         * If we're in restart mode, find the last filename on
-         * this list that already exists. We may have to do a
-         * reget on _that_ file, but shouldn't have to do
-         * anything on the previous files.
-         *
-         * If none of them exists, of course, we start at 0.
-         */
-        dir->i = 0;
-        if (cmdget->restart) {
-            while (dir->i < dir->nnames) {
-                char *nextoutfname;
-                bool nonexistent;
-                nextoutfname = dir_file_cat(dir->outfname, dir->ournames[dir->i]);
-                nonexistent = (file_type(nextoutfname) == FILE_TYPE_NONEXISTENT);
-                sfree(nextoutfname);
-                if (nonexistent) {
-                    break;
-                }
-                dir->i++;
-            }
-            if (dir->i > 0) {
-                dir->i--;
+        if (cmdget->recurse) {
+            if (result && (cmdget->attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) && (cmdget->attrs.permissions & 0040000)) {
+                return get_dir(cmdget, sftp);
             }
         }
-        dir_get_file(dir, sftp, cmdget);
-        return true;
-    } else if (cmd->req_type == SSH_FXP_OPEN) {
-        assert(!cmdget->handle);
-        cmdget->open_req = cmd->req_type;
-        cmdget->handle = fxp_open_recv(pktin, cmd->req);
-        sftpcmd_clear_request(cmd);
-        if (!cmdget->handle) {
-            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: open for read: %s", cmdget->fname, fxp_error());
-            return false;
+        if (!result) {
+            cmdget->attrs.flags = 0;
         }
+        return start_job(cmdget, sftp);
+    }
+    return false;
+}
 
-        if (cmdget->user_outfname && !cmdget->recurse && file_type(cmdget->outfname) == FILE_TYPE_DIRECTORY) {
-          const char *outfdir = cmdget->outfname;
-          cmdget->outfname = dir_file_cat(outfdir, stripslashes(cmdget->fname, false));
-          sfree((void *)outfdir);
+static bool source_iterator_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin)
+{
+    SftpCmdGet *cmdget = container_of(cmd, SftpCmdGet, source);
+    return sftpwcm_iterator_pktin(&cmdget->it, sftp, cmd, pktin);
+}
+
+static void writebehind_callback(void *ctx);
+
+/* Starts a segment job, which writes its range through its own handle of
+   the local file. */
+static void start_segment(SftpCmdGet *cmdget, GetJob *job, Sftp *sftp)
+{
+    const SftpSegment *seg = &job->seg->segs.seg[job->segi];
+    assert(!job->file);
+    job->file = open_shared_wfile(job->outfname);
+    if (!job->file) {
+        progress_interrupt(cmdget, sftp);
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "local: unable to open %s", job->outfname);
+        cmdget->stop = true;
+        job_done(cmdget, job, sftp);
+        return;
+    }
+    assert(!job->xfer);
+    getput_progress_start(&cmdget->progress, cmdget->jobs, seg->done - seg->start, seg->end - seg->start);
+    job->seg_offset = seg->done;
+    job->hash = sftpverify_hash_new(&cmdget->verify, seg->done);
+    job->wb = sftpwritebehind_new(job->file, seg->done, writebehind_callback, cmdget);
+    job->file = NULL;
+    job->window = cmdget->window;
+    job->xfer = xfer_download_range_window(job->handle, seg->done, seg->end, &job->window, sftpwritebehind_space(job->wb));
+    cmdget->active++;
+    sftpcmd_set_request(&job->cmd, SSH_FXP_READ, NULL);
+}
+
+static void start_transfer(SftpCmdGet *cmdget, GetJob *job, Sftp *sftp)
+{
+    if (job->seg) {
+        start_segment(cmdget, job, sftp);
+        return;
+    }
+    if (cmdget->user_outfname && !cmdget->recurse && file_type(job->outfname) == FILE_TYPE_DIRECTORY) {
+      const char *outfdir = job->outfname;
+      job->outfname = dir_file_cat(outfdir, stripslashes(job->fname, false));
+      sfree((void *)outfdir);
+    }
+    assert(!job->file);
+    if (cmdget->restart) {
+        job->file = open_existing_wfile(job->outfname, NULL);
+    }
+    if (!job->file) {
+        job->file = open_new_file(job->outfname, GET_PERMISSIONS(job->attrs, -1));
+    }
+    if (!job->file) {
+        progress_interrupt(cmdget, sftp);
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "local: unable to open %s", job->outfname);
+        cmdget->stop = true;
+        job_done(cmdget, job, sftp);
+        return;
+    }
+
+    uint64_t offset = 0;
+    if (cmdget->restart) {
+        if (seek_file(job->file, 0, FROM_END) == -1) {
+            progress_interrupt(cmdget, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "reget: cannot restart %s - file too large", job->outfname);
+            cmdget->stop = true;
+            job_done(cmdget, job, sftp);
+            return;
         }
-        assert(!cmdget->file);
-        if (cmdget->restart) {
-            cmdget->file = open_existing_wfile(cmdget->outfname, NULL);
+        offset = get_file_posn(job->file);
+        if (offset != 0) {
+            progress_interrupt(cmdget, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "reget: restarting at file position %"PRIu64"", offset);
+        }
+    }
+    uint64_t size = (job->attrs.flags & SSH_FILEXFER_ATTR_SIZE) ? job->attrs.size : 0;
+    if (size > offset && !reserve_file_space(job->file, size)) {
+        progress_interrupt(cmdget, sftp);
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "local: not enough disk space for %s", job->outfname);
+        cmdget->stop = true;
+        job_done(cmdget, job, sftp);
+        return;
+    }
+    progress_interrupt(cmdget, sftp);
+    sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "remote: %s => local: %s", job->fname, job->outfname);
+    assert(!job->xfer);
+    getput_progress_start(&cmdget->progress, cmdget->jobs, offset, size);
+    job->wb = sftpwritebehind_new(job->file, offset, writebehind_callback, cmdget);
+    job->file = NULL;
+    if (size > offset) {
+        sftpwritebehind_set_reserved(job->wb);
+    }
+    if (cmdget->sync.enabled && (job->attrs.flags & SSH_FILEXFER_ATTR_ACMODTIME)) {
+        sftpwritebehind_set_times(job->wb, job->attrs.mtime, job->attrs.atime);
+    }
+    cmdget->sync.files_sent++;
+    job->hash = sftpverify_hash_new(&cmdget->verify, offset);
+    job->window = cmdget->window;
+    job->xfer = xfer_download_init_window(job->handle, offset, &job->window, sftpwritebehind_space(job->wb));
+    cmdget->active++;
+    sftpcmd_set_request(&job->cmd, SSH_FXP_READ, NULL);
+}
+
+/* Starts the transfers of the opened files in the order the source found
+   them, as long as fewer than `jobs' transfers are running. */
+static void start_opened_jobs(SftpCmdGet *cmdget, Sftp *sftp)
+{
+    for (;;) {
+        GetJob *next = NULL;
+        for (int i = 0; i < cmdget->njobs; i++) {
+            GetJob *job = &cmdget->job[i];
+            if (job->busy && job->opened && !job->xfer && (!next || job->seq < next->seq)) {
+                next = job;
+            }
         }
-        if (!cmdget->file) {
-            cmdget->file = open_new_file(cmdget->outfname, GET_PERMISSIONS(cmdget->attrs, -1));
+        if (!next || (!cmdget->stop && cmdget->active >= cmdget->jobs)) {
+            return;
         }
-        if (!cmdget->file) {
-            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "local: unable to open %s", cmdget->outfname);
-            send_close(cmdget, sftp);
-            cmdget->stop = true;
-            return true;
+        void *prev_owner;
+        SftpFxp *prev = job_enter(sftp, next, &prev_owner);
+        if (cmdget->stop) {
+            job_done(cmdget, next, sftp);
+        } else {
+            start_transfer(cmdget, next, sftp);
         }
+        job_leave(prev, prev_owner);
+    }
+}
 
-        uint64_t offset = 0;
-        if (cmdget->restart) {
-            if (seek_file(cmdget->file, 0, FROM_END) == -1) {
-                sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "reget: cannot restart %s - file too large", cmdget->outfname);
-                close_wfile(cmdget->file);
-                cmdget->file = NULL;
-                send_close(cmdget, sftp);
-                cmdget->stop = true;
-                return true;
-            }
-            offset = get_file_posn(cmdget->file);
-            if (offset != 0) {
-                sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "reget: restarting at file position %"PRIu64"", offset);
-            }
+static void job_process_pkt(SftpCmdGet *cmdget, GetJob *job, Sftp *sftp, struct sftp_packet *pktin)
+{
+    SftpCmd *cmd = &job->cmd;
+
+    if (cmd->req_type == SSH_FXP_OPEN) {
+        assert(!job->handle);
+        job->handle = fxp_open_recv(pktin, cmd->req);
+        sftpcmd_clear_request(cmd);
+        if (!job->handle) {
+            progress_interrupt(cmdget, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: open for read: %s", job->fname, fxp_error());
+            cmdget->stop = true;
+            job_done(cmdget, job, sftp);
+            return;
         }
-        sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "remote: %s => local: %s", cmdget->fname, cmdget->outfname);
-        assert(!cmdget->xfer);
-        sftpprogressbar_init(&cmdget->progress, offset, (cmdget->attrs.flags & SSH_FILEXFER_ATTR_SIZE) ? cmdget->attrs.size : 0);
-        sftp_set_sending_backend(sftp);
-        cmdget->xfer = xfer_download_init(cmdget->handle, offset);
-        sftpcmd_set_request(cmd, SSH_FXP_READ, NULL);
-        return true;
+        job->opened = true;
     } else if (cmd->req_type == SSH_FXP_READ) {
-        int retd = xfer_download_gotpkt(cmdget->xfer, pktin);
+        int retd = xfer_download_gotpkt_window(job->xfer, &job->window, pktin);
         if (retd <= 0) {
-            sftpprogressbar_finish(&cmdget->progress, sftp->seat);
+            progress_interrupt(cmdget, sftp);
             sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "error while reading: %s", fxp_error());
             if (retd == INT_MIN) {
-                sfree(pktin);
+                sftpfxp_pkt_free(pktin);
             }
             cmdget->stop = true;
         }
 
-        void *vbuf;
+        struct sftp_packet *data_pkt;
+        const void *data;
         int len;
-        bool shown_err = false;
         bool got_data = false;
-        while (xfer_download_data_wrapper(cmdget->xfer, &vbuf, &len)) {
-            unsigned char *buf = (unsigned char *)vbuf;
-
-            int wpos = 0;
-            while (wpos < len) {
-                int wlen = write_to_file(cmdget->file, buf + wpos, len - wpos);
-                if (wlen <= 0) {
-                    if (!shown_err) {
-                        sftpprogressbar_finish(&cmdget->progress, sftp->seat);
-                        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "error while writing local file");
-                        shown_err = true;
-                    }
-                    cmdget->stop = true;
-                    xfer_set_error(cmdget->xfer);
-                    break;
+        while (xfer_download_data_window(job->xfer, &data_pkt, &data, &len)) {
+            if (!job->write_failed) {
+                if (job->hash) {
+                    put_data(job->hash, data, len);
                 }
-                wpos += wlen;
-            }
-            if (wpos < len) {          /* we had an error */
-                cmdget->stop = true;
-                xfer_set_error(cmdget->xfer);
-            } else if (len > 0) {
-                sftpprogressbar_update(&cmdget->progress, len);
-                got_data = true;
+                if (sftpwritebehind_write(job->wb, data, len)) {
+                    sftpprogressbar_update(&cmdget->progress, len);
+                    cmdget->sync.bytes_sent += len;
+                    got_data = true;
+                }
+                check_write_failed(cmdget, job, sftp);
             }
-            sfree(vbuf);
+            sftpfxp_pkt_free(data_pkt);
         }
-        if (got_data || xfer_done(cmdget->xfer)) {
+        if (got_data || xfer_done(job->xfer)) {
             sftpprogressbar_draw(&cmdget->progress, sftp->seat, sftp->width);
         }
-        if (xfer_done(cmdget->xfer)) {
-            sftpprogressbar_finish(&cmdget->progress, sftp->seat);
-            xfer_cleanup(cmdget->xfer);
-            cmdget->xfer = NULL;
-            close_wfile(cmdget->file);
-            cmdget->file = NULL;
-            send_close(cmdget, sftp);
+        if (xfer_done(job->xfer)) {
+            if (cmdget->jobs == 1) {
+                sftpprogressbar_finish(&cmdget->progress, sftp->seat);
+            }
+            sftpcmd_clear_request(cmd);
+            job_done(cmdget, job, sftp);
         } else {
-            sftp_set_sending_backend(sftp);
-            xfer_download_queue(cmdget->xfer);
+            xfer_download_queue_window(job->xfer, &job->window, sftpwritebehind_space(job->wb));
         }
+    }
+}
+
+/* The job a reply goes to, the owner of its request, see job_enter(). The
+   READs of a transfer are all answered before its xfer is cleaned up, and
+   the pending requests are dropped when the command ends, so an owner
+   with an xfer is still the one the request was sent for. */
+static GetJob *find_job(SftpCmdGet *cmdget, struct sftp_request *req)
+{
+    GetJob *job = (GetJob *)sftp_request_owner(req);
+    if (job && job->busy && (job->cmd.req == req || job->xfer)) {
+        assert(job >= cmdget->job && job < cmdget->job + cmdget->njobs);
+        return job;
+    }
+    return NULL;
+}
+
+/* Moves on after a reply or a write-behind callback. Returns false when the
+   get is complete. */
+static bool get_continue(SftpCmdGet *cmdget, Sftp *sftp)
+{
+    while (cmdget->listing_wait && take_listing(cmdget, sftp));
+    start_opened_jobs(cmdget, sftp);
+    if (cmdget->stop) {
+        sftpcrawler_stop(&cmdget->crawler);
+    }
+
+    if (!cmdget->source_done || cmdget->closes.n > 0 || sftpverify_busy(&cmdget->verify) || sftpcrawler_busy(&cmdget->crawler)) {
         return true;
-    } else if (cmd->req_type == SSH_FXP_CLOSE && cmdget->open_req == SSH_FXP_OPEN) {
-        fxp_close_recv(pktin, cmd->req);
-        sftpcmd_clear_request(cmd);
-        cmdget->open_req = 0;
-        if (cmdget->stop) {
-            return false;
+    }
+    for (int i = 0; i < cmdget->njobs; i++) {
+        if (cmdget->job[i].busy) {
+            return true;
         }
-        return next_file(sftp, cmdget);
+    }
+    if (sftpverify_finish(&cmdget->verify, sftp, cmdget->stop)) {
+        return true;
+    }
+    if (cmdget->sync.enabled) {
+        progress_interrupt(cmdget, sftp);
+        getput_sync_summary(&cmdget->sync, sftp->seat);
     }
     return false;
 }
 
-static SftpCmd *generic_init(Sftp *sftp, bool restart, bool multiple)
+static bool sftpcmdget_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin)
 {
-    bool recurse;
-    int i;
+    SftpCmdGet *cmdget = container_of(cmd, SftpCmdGet, cmd);
+    struct sftp_request *req = sftp_peek_request(sftp, pktin);
+    const char *close_failed;
+    GetJob *job;
 
-    if (!getput_parse_args(sftp, &i, &recurse)) {
-        return NULL;
+    if (req && getput_close_recv(&cmdget->closes, sftp, req, pktin, &close_failed)) {
+        if (close_failed) {
+            progress_interrupt(cmdget, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: close: %s", close_failed, fxp_error());
+            sfree((void *)close_failed);
+        }
+    } else if (req && sftpverify_check_recv(&cmdget->verify, sftp, req, pktin)) {
+        /* reported by the verifier */
+    } else if (req && sftpcrawler_process_pkt(&cmdget->crawler, sftp, req, pktin)) {
+        /* a listing may have become complete, taken below */
+    } else if (req && req == cmdget->source.req) {
+        sftp_find_request(pktin);
+        if (!sftpcmd_process_pkt(&cmdget->source, sftp, pktin)) {
+            cmdget->source_done = true;
+        }
+    } else if (req && (job = find_job(cmdget, req)) != NULL) {
+        if (job->cmd.req) {
+            sftp_find_request(pktin);
+        }
+        void *prev_owner = sftpfxp_set_owner(job);
+        job_process_pkt(cmdget, job, sftp, pktin);
+        sftpfxp_set_owner(prev_owner);
+    } else {
+        sftpfxp_pkt_free(pktin);
+    }
+    SftpFxp *prev = sftpconn_enter(sftp, NULL);
+    bool more = get_continue(cmdget, sftp);
+    sftpfxp_leave(prev);
+    return more;
+}
+
+/* An extra connection became ready or failed, the source may be waiting
+   for it, or the sha256sum of the verifier ended. */
+static bool sftpcmdget_conn_changed(SftpCmd *cmd, Sftp *sftp, SftpConn *conn)
+{
+    SftpCmdGet *cmdget = container_of(cmd, SftpCmdGet, cmd);
+    sftpverify_conn_changed(&cmdget->verify, sftp, conn);
+    resume_source(cmdget, sftp);
+    return get_continue(cmdget, sftp);
+}
+
+/* The write-behind of a job has written a block or closed its file. This
+   is an entry point of the session like the backend calls in sftpbe.c. */
+static void writebehind_callback(void *ctx)
+{
+    SftpCmdGet *cmdget = (SftpCmdGet *)ctx;
+    Sftp *sftp = cmdget->sftp;
+    SftpFxp *prev = sftpfxp_enter(&sftp->fxp);
+    for (int i = 0; i < cmdget->njobs; i++) {
+        GetJob *job = &cmdget->job[i];
+        if (!job->wb) {
+            continue;
+        }
+        if (job->seg) {
+            segment_progress(job);
+            segments_save(job->seg, false);
+        }
+        void *prev_owner;
+        SftpFxp *job_prev = job_enter(sftp, job, &prev_owner);
+        check_write_failed(cmdget, job, sftp);
+        if (job->closing) {
+            if (sftpwritebehind_closed(job->wb)) {
+                segment_progress(job);
+                sftpwritebehind_free(job->wb);
+                job->wb = NULL;
+                job->closing = false;
+                job_release(cmdget, job, sftp);
+            }
+        } else if (job->xfer && xfer_done(job->xfer)) {
+            /* a failed write ended a transfer waiting for space */
+            sftpcmd_clear_request(&job->cmd);
+            job_done(cmdget, job, sftp);
+        } else if (job->xfer) {
+            xfer_download_queue_window(job->xfer, &job->window, sftpwritebehind_space(job->wb));
+        }
+        job_leave(job_prev, prev_owner);
+    }
+    if (!get_continue(cmdget, sftp)) {
+        sftp_command_done(sftp);
     }
+    sftpfxp_leave(prev);
+}
 
+static SftpCmd *create(Sftp *sftp, int i, bool restart, bool multiple, bool recurse, int jobs, int segments, bool verify, const GetPutSync *sync)
+{
     SftpWildcardArgs *args = sftpwcm_args_create(sftp, i, (multiple ? sftp->args.argc : i+1), !multiple);
     if (args == NULL) {
         return NULL;
@@ -371,6 +1133,7 @@ static SftpCmd *generic_init(Sftp *sftp, bool restart, bool multiple)
     cmdget->restart = restart;
     cmdget->multiple = multiple;
     cmdget->recurse = recurse;
+    cmdget->sync = *sync;
     cmdget->user_outfname = (!multiple && i+1 < sftp->args.argc);
     sftpwcm_iterator_init(&cmdget->it, args, get_file);
     cmdget->fname = NULL;
@@ -380,19 +1143,63 @@ static SftpCmd *generic_init(Sftp *sftp, bool restart, bool multiple)
     } else {
       cmdget->outfname = NULL;
     }
-    cmdget->handle = NULL;
-    cmdget->xfer = NULL;
-    cmdget->file = NULL;
     cmdget->stop = false;
+    cmdget->listing_wait = false;
+    cmdget->source_waiting = false;
+    cmdget->source_done = false;
+    /* the segments of a file run at the same time */
+    cmdget->jobs = max(jobs, segments);
+    cmdget->segments = segments;
+    cmdget->split = NULL;
+    cmdget->active = 0;
+    cmdget->njobs = cmdget->jobs + GETPUT_LOOKAHEAD_FILES;
+    cmdget->seq = 0;
+    cmdget->job = snewn(cmdget->njobs, GetJob);
+    memset(cmdget->job, 0, cmdget->njobs * sizeof(GetJob));
+    xfer_window_init(&cmdget->window, &sftp->xfer_limits, false);
+    getput_closes_init(&cmdget->closes);
+    sftpcrawler_init(&cmdget->crawler, &cmdget->closes, GETPUT_CRAWL_STREAMS, GETPUT_CRAWL_MAX_DIRS);
+    sftpverify_init(&cmdget->verify, sftp, verify, &cmdget->progress, cmdget->jobs);
     cmdget->progress_first_seat = sftp->seat;
+    cmdget->sftp = sftp;
+    sftpprogressbar_init(&cmdget->progress, 0, 0);
     sftpdirstack_init(&cmdget->dirstack);
 
     sftpcmd_clear_request(&cmdget->cmd);
-    bool next = sftpwcm_iterator_next(&cmdget->it, sftp, &cmdget->cmd);
+    sftpcmd_clear_request(&cmdget->source);
+    cmdget->source.vt = &get_vt;
+    bool next = sftpwcm_iterator_next(&cmdget->it, sftp, &cmdget->source);
     assert(next);
     return &cmdget->cmd;
 }
 
+static SftpCmd *generic_init(Sftp *sftp, bool restart, bool multiple)
+{
+    bool recurse;
+    int i;
+    int jobs;
+    int segments;
+    bool verify;
+
+    if (!getput_parse_args(sftp, &i, &recurse, &jobs, &segments, &verify)) {
+        return NULL;
+    }
+    GetPutSync sync = {0};
+    return create(sftp, i, restart, multiple, recurse, jobs, segments, verify, &sync);
+}
+
+SftpCmd *sftpcmdget_sync_init(Sftp *sftp, int first_arg, int jobs, bool dry_run)
+{
+    GetPutSync sync = {0};
+    sync.enabled = true;
+    sync.dry_run = dry_run;
+    SftpCmd *cmd = create(sftp, first_arg, false, false, true, jobs, 1, false, &sync);
+    if (cmd) {
+        cmd->vt = &sftpcmdget_vt;
+    }
+    return cmd;
+}
+
 static SftpCmd *sftpcmdget_init(Sftp *sftp)
 {
     return generic_init(sftp, false, false);
@@ -408,29 +1215,43 @@ static SftpCmd *sftpcmdreget_init(Sftp *sftp)
     return generic_init(sftp, true, false);
 }
 
-static bool sftpcmdget_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin)
-{
-    SftpCmdGet *cmdget = container_of(cmd, SftpCmdGet, cmd);
-    return sftpwcm_iterator_pktin(&cmdget->it, sftp, cmd, pktin);
-}
-
 static void sftpcmdget_free(SftpCmd *cmd)
 {
     SftpCmdGet *cmdget = container_of(cmd, SftpCmdGet, cmd);
     sftpprogressbar_finish(&cmdget->progress, cmdget->progress_first_seat);
-    sftp_dup_utf8_free(cmdget->fname, cmdget->line_fname);
-    sfree((void *)cmdget->line_fname);
-    sfree((void *)cmdget->outfname);
+    free_names(&cmdget->fname, &cmdget->line_fname, &cmdget->outfname);
     sftpwcm_iterator_uninit(&cmdget->it);
-    if (cmdget->xfer) {
-        xfer_cleanup(cmdget->xfer);
-    }
-    if (cmdget->handle) {
-        sftp_free_fxphandle(cmdget->handle);
-    }
-    if (cmdget->file) {
-       close_wfile(cmdget->file);
+    split_done(cmdget);
+    for (int i = 0; i < cmdget->njobs; i++) {
+        GetJob *job = &cmdget->job[i];
+        segment_progress(job);
+        free_names(&job->fname, &job->line_fname, &job->outfname);
+        if (job->xfer) {
+            xfer_download_cleanup_window(job->xfer);
+        }
+        if (job->handle) {
+            sftp_free_fxphandle(job->handle);
+        }
+        if (job->file) {
+           close_wfile(job->file);
+        }
+        if (job->wb) {
+            sftpwritebehind_free(job->wb);
+        }
+        if (job->hash) {
+            sftpverify_hash_free(job->hash);
+        }
+        if (job->seg) {
+            segments_release(job->seg);
+        }
+        if (job->busy) {
+            sftpconn_release(cmdget->sftp, job->conn);
+        }
     }
+    sfree(cmdget->job);
+    sftpcrawler_uninit(&cmdget->crawler);
+    getput_closes_uninit(&cmdget->closes);
+    sftpverify_uninit(&cmdget->verify);
     sftpdirstack_uninit(&cmdget->dirstack);
     sfree(cmdget);
 }
@@ -454,19 +1275,22 @@ const SftpCmdVtable sftpcmdget_vt = {
     .init = sftpcmdget_init,
     .free = sftpcmdget_free,
     .process_pkt = sftpcmdget_process_pkt,
-    .get_arg_info = sftpcmdget_get_arg_info
+    .get_arg_info = sftpcmdget_get_arg_info,
+    .conn_changed = sftpcmdget_conn_changed
 };
 
 const SftpCmdVtable sftpcmdmget_vt = {
     .init = sftpcmdmget_init,
     .free = sftpcmdget_free,
     .process_pkt = sftpcmdget_process_pkt,
-    .get_arg_info = sftpcmdmget_get_arg_info
+    .get_arg_info = sftpcmdmget_get_arg_info,
+    .conn_changed = sftpcmdget_conn_changed
 };
 
 const SftpCmdVtable sftpcmdreget_vt = {
     .init = sftpcmdreget_init,
     .free = sftpcmdget_free,
     .process_pkt = sftpcmdget_process_pkt,
-    .get_arg_info = sftpcmdget_get_arg_info
+    .get_arg_info = sftpcmdget_get_arg_info,
+    .conn_changed = sftpcmdget_conn_changed
 };
\ No newline at end of file
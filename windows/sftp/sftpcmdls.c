@@ -2,22 +2,45 @@
 #include "sftputil.h"
 #include "sftpfxp.h"
 #include "sftpunicode.h"
+#include "sftplssort.h"
 #include "psftp.h"
 
+/* The lines printed before ls lets the session handle other events. */
+#define LS_LINES_PER_STEP 2000
+
+/*
+ * Without -U the matching names are sorted by sftplssort with bounded
+ * memory and printed after the directory was read. With -U every READDIR
+ * reply is printed as it arrives, in the order of the server. Either way
+ * the next READDIR or the next lines wait while the terminal is behind,
+ * see SFTP_OUTPUT_BACKLOG_LIMIT.
+ */
 typedef struct {
     SftpCmd cmd;
+    Sftp *sftp;
     const char *dir; //utf8
     const char *wildcard; //line codepage
+    const char *line_dir; //as given, for the listing cache
+    const char *line_cdir;
+    bool unsorted;
     struct fxp_handle *dirh;
-    struct list_directory_from_sftp_ctx *ctx;
+    SftpListing *listing; //NULL once too large to be cached
+    bool complete;
+    bool readdir_throttled;
+    SftpLsSort *sort;
+    const SftpListing *cached; //printed from the cache
+    size_t cached_pos;
+    bool printing;
+    HANDLE event;
+    HandleWait *wait;
 } SftpCmdLs;
 
 static void send_close(Sftp *sftp, SftpCmd *cmd, struct fxp_handle *dirh)
 {
-    sftp_set_sending_backend(sftp);
     sftpcmd_set_request(cmd, SSH_FXP_CLOSE, fxp_close_send(dirh));
 }
 
+/* psftpcommon.c refers to these, ls prints the lines itself. */
 static Sftp *list_directory_from_sftp = NULL;
 
 void list_directory_from_sftp_warn_unsorted(void)
@@ -32,19 +55,143 @@ void list_directory_from_sftp_print(struct fxp_name *name)
     sftp_dup_utf8_free(name_utf8, name->longname);
 }
 
+static void print_line(Sftp *sftp, const char *longname)
+{
+    const char *longname_utf8 = sftp_dup_utf8_from_line(sftp->line_codepage, longname);
+    sftp->output_backlog = sftp_print(sftp->seat, SEAT_OUTPUT_STDOUT, longname_utf8);
+    sftp_dup_utf8_free(longname_utf8, longname);
+}
+
+static bool matches(SftpCmdLs *cmdls, const struct fxp_name *name)
+{
+    return !cmdls->wildcard || wc_match(cmdls->wildcard, name->filename);
+}
+
+/* Adds the names of a READDIR reply or of a cached listing. */
+static void add_names(SftpCmdLs *cmdls, Sftp *sftp, const struct fxp_name *names, size_t nnames)
+{
+    for (size_t i = 0; i < nnames; i++) {
+        if (!matches(cmdls, &names[i])) {
+            continue;
+        }
+        if (cmdls->unsorted) {
+            print_line(sftp, names[i].longname);
+        } else if (!sftplssort_add(cmdls->sort, names[i].filename, names[i].longname ? names[i].longname : "")) {
+            return;
+        }
+    }
+}
+
+static const char *next_line(SftpCmdLs *cmdls)
+{
+    if (cmdls->sort) {
+        return sftplssort_next(cmdls->sort);
+    }
+    while (cmdls->cached_pos < cmdls->cached->nnames) {
+        const struct fxp_name *name = &cmdls->cached->names[cmdls->cached_pos++];
+        if (matches(cmdls, name)) {
+            return name->longname;
+        }
+    }
+    return NULL;
+}
+
+static void print_step_callback(void *ctx);
+
+/* Prints up to LS_LINES_PER_STEP lines. Returns false once all lines are
+   printed, otherwise the rest follows from the unthrottle function or from
+   the event. */
+static bool print_lines(SftpCmdLs *cmdls, Sftp *sftp)
+{
+    for (int n = 0; n < LS_LINES_PER_STEP; n++) {
+        if (sftp->output_backlog >= SFTP_OUTPUT_BACKLOG_LIMIT) {
+            return true;
+        }
+        const char *longname = next_line(cmdls);
+        if (!longname) {
+            if (cmdls->sort && sftplssort_failed(cmdls->sort)) {
+                sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "ls: unable to sort %s: %s", cmdls->dir, win_strerror(GetLastError()));
+            }
+            return false;
+        }
+        print_line(sftp, longname);
+    }
+    if (!cmdls->event) {
+        cmdls->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+        cmdls->wait = add_handle_wait(cmdls->event, print_step_callback, cmdls);
+    }
+    SetEvent(cmdls->event);
+    return true;
+}
+
+/* Starts printing the sorted or the cached lines, returns false if all
+   lines were printed already. */
+static bool start_printing(SftpCmdLs *cmdls, Sftp *sftp)
+{
+    if (cmdls->sort && !sftplssort_finish(cmdls->sort)) {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "ls: unable to sort %s: %s", cmdls->dir, win_strerror(GetLastError()));
+        return false;
+    }
+    cmdls->printing = true;
+    return print_lines(cmdls, sftp);
+}
+
+/* An entry point of the session like the backend calls in sftpbe.c. */
+static void print_step_callback(void *ctx)
+{
+    SftpCmdLs *cmdls = (SftpCmdLs *)ctx;
+    Sftp *sftp = cmdls->sftp;
+    SftpFxp *prev = sftpfxp_enter(&sftp->fxp);
+    if (!print_lines(cmdls, sftp)) {
+        sftp_command_done(sftp);
+    }
+    sftpfxp_leave(prev);
+}
+
+static SftpCmdLs *cmdls_new(Sftp *sftp, const char *dir, const char *line_wildcard, bool unsorted)
+{
+    SftpCmdLs *cmdls = snew(SftpCmdLs);
+    memset(cmdls, 0, sizeof(SftpCmdLs));
+    cmdls->sftp = sftp;
+    cmdls->dir = dir;
+    cmdls->wildcard = line_wildcard;
+    cmdls->unsorted = unsorted;
+    if (!unsorted) {
+        cmdls->sort = sftplssort_new(SFTPLSSORT_RUN_BYTES);
+    }
+    sftpcmd_clear_request(&cmdls->cmd);
+    return cmdls;
+}
+
+/* Prints a cached listing, returns false if it is printed already. */
+static bool list_cached(SftpCmdLs *cmdls, Sftp *sftp, const SftpListing *listing)
+{
+    cmdls->cached = listing;
+    if (cmdls->sort) {
+        add_names(cmdls, sftp, listing->names, listing->nnames);
+    }
+    return start_printing(cmdls, sftp);
+}
+
+static void sftpcmdls_free(SftpCmd *cmd);
+
 static SftpCmd *sftpcmdls_init(Sftp *sftp)
 {
     const char *dir;
     const char *wildcard;
     char *unwcdir;
     int i = 1;
+    bool unsorted = false;
 
     while (i < sftp->args.argc && sftp->args.argv[i][0] == '-') {
         if (strcmp(sftp->args.argv[i], "--") == 0) {
             i++;
             break;
         }
-        if (sftp->args.argv[i][1] == 'l') {
+        if (strspn(sftp->args.argv[i] + 1, "lU") == strlen(sftp->args.argv[i] + 1)) {
+            if (strchr(sftp->args.argv[i], 'U')) {
+                unsorted = true;
+            }
             i++;
             continue;
         }
@@ -94,15 +241,18 @@ static SftpCmd *sftpcmdls_init(Sftp *sftp)
         return NULL;
     }
 
-    SftpCmdLs *cmdls = snew(SftpCmdLs);
-    cmdls->dir = dir;
-    cmdls->wildcard = line_wildcard;
-    cmdls->dirh = NULL;
-    cmdls->ctx = NULL;
-
     list_directory_from_sftp = sftp;
-    sftpcmd_clear_request(&cmdls->cmd);
-    sftp_set_sending_backend(sftp);
+    SftpCmdLs *cmdls = cmdls_new(sftp, dir, line_wildcard, unsorted);
+    const SftpListing *listing = sftplistcache_get(&sftp->listcache, line_dir);
+    if (listing) {
+        sftp_dup_utf8_free(line_dir, dir);
+        if (!list_cached(cmdls, sftp, listing)) {
+            sftpcmdls_free(&cmdls->cmd);
+            return NULL;
+        }
+        return &cmdls->cmd;
+    }
+    cmdls->line_dir = dupstr(line_dir);
     sftpcmd_set_request(&cmdls->cmd, SSH_FXP_REALPATH, fxp_realpath_send(line_dir));
     sftp_dup_utf8_free(line_dir, dir);
     return &cmdls->cmd;
@@ -119,7 +269,12 @@ static bool sftpcmdls_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *
             sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "ls: unable to open %s: %s", cmdls->dir, fxp_error());
             return false;
         }
-        sftp_set_sending_backend(sftp);
+        const SftpListing *listing = sftplistcache_get(&sftp->listcache, line_dir);
+        if (listing) {
+            sfree((void *)line_dir);
+            return list_cached(cmdls, sftp, listing);
+        }
+        cmdls->line_cdir = dupstr(line_dir);
         sftpcmd_set_request(cmd, SSH_FXP_OPENDIR, fxp_opendir_send(line_dir));
         sfree((void *)cmdls->dir);
         cmdls->dir = sftp_utf8_from_line(sftp->line_codepage, line_dir);
@@ -131,8 +286,7 @@ static bool sftpcmdls_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *
             sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "ls: unable to open %s: %s", cmdls->dir, fxp_error());
             return false;
         }
-        cmdls->ctx = list_directory_from_sftp_new();
-        sftp_set_sending_backend(sftp);
+        cmdls->listing = sftplistcache_begin(&sftp->listcache);
         sftpcmd_set_request(cmd, SSH_FXP_READDIR, fxp_readdir_send(cmdls->dirh));
         return true;
     } else if (cmd->req_type == SSH_FXP_READDIR) {
@@ -141,6 +295,7 @@ static bool sftpcmdls_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *
 
         if (names == NULL) {
             if (fxp_error_type() == SSH_FX_EOF) {
+                cmdls->complete = true;
                 send_close(sftp, cmd, cmdls->dirh);
                 return true;
             }
@@ -150,38 +305,81 @@ static bool sftpcmdls_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *
         }
         if (names->nnames == 0) {
             fxp_free_names(names);
+            cmdls->complete = true;
             send_close(sftp, cmd, cmdls->dirh);
             return true;
         }
 
-        for (size_t i = 0; i < names->nnames; i++) {
-            if (!cmdls->wildcard || wc_match(cmdls->wildcard, names->names[i].filename)) {
-                list_directory_from_sftp_feed(cmdls->ctx, &names->names[i]);
+        for (size_t i = 0; i < names->nnames && cmdls->listing; i++) {
+            if (!sftplistcache_add(cmdls->listing, &names->names[i])) {
+                sftplistcache_release(cmdls->listing);
+                cmdls->listing = NULL;
             }
         }
+        add_names(cmdls, sftp, names->names, names->nnames);
         fxp_free_names(names);
-        sftp_set_sending_backend(sftp);
+        if (cmdls->sort && sftplssort_failed(cmdls->sort)) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "ls: unable to sort %s: %s", cmdls->dir, win_strerror(GetLastError()));
+            send_close(sftp, cmd, cmdls->dirh);
+            return true;
+        }
+        if (sftp->output_backlog >= SFTP_OUTPUT_BACKLOG_LIMIT) {
+            cmdls->readdir_throttled = true;
+            return true;
+        }
         sftpcmd_set_request(cmd, SSH_FXP_READDIR, fxp_readdir_send(cmdls->dirh));
         return true;
     } else if (cmd->req_type == SSH_FXP_CLOSE) {
         fxp_close_recv(pktin, cmd->req);
         sftpcmd_clear_request(cmd);
         cmdls->dirh = NULL;
-        list_directory_from_sftp_finish(cmdls->ctx);
+        if (cmdls->complete && cmdls->listing) {
+            sftplistcache_release(sftplistcache_end(&sftp->listcache, cmdls->listing, cmdls->line_cdir, cmdls->line_dir));
+            cmdls->listing = NULL;
+        }
+        if (cmdls->sort && !sftplssort_failed(cmdls->sort)) {
+            return start_printing(cmdls, sftp);
+        }
     }
     return false;
 }
 
+static bool sftpcmdls_unthrottle(SftpCmd *cmd, Sftp *sftp)
+{
+    SftpCmdLs *cmdls = container_of(cmd, SftpCmdLs, cmd);
+    if (cmdls->readdir_throttled) {
+        cmdls->readdir_throttled = false;
+        sftpcmd_set_request(cmd, SSH_FXP_READDIR, fxp_readdir_send(cmdls->dirh));
+        return true;
+    }
+    if (cmdls->printing) {
+        return print_lines(cmdls, sftp);
+    }
+    return true;
+}
+
 static void sftpcmdls_free(SftpCmd *cmd)
 {
     SftpCmdLs *cmdls = container_of(cmd, SftpCmdLs, cmd);
     sfree((void *)cmdls->dir);
     sfree((void *)cmdls->wildcard);
+    sfree((void *)cmdls->line_dir);
+    sfree((void *)cmdls->line_cdir);
+    if (cmdls->listing) {
+        sftplistcache_release(cmdls->listing);
+    }
     if (cmdls->dirh) {
         sftp_free_fxphandle(cmdls->dirh);
     }
-    if (cmdls->ctx) {
-        list_directory_from_sftp_free(cmdls->ctx);
+    if (cmdls->sort) {
+        sftplssort_free(cmdls->sort);
+    }
+    if (cmdls->cached) {
+        sftplistcache_release(cmdls->cached);
+    }
+    if (cmdls->wait) {
+        delete_handle_wait(cmdls->wait);
+        CloseHandle(cmdls->event);
     }
     sfree(cmdls);
 }
@@ -198,5 +396,6 @@ const SftpCmdVtable sftpcmdls_vt = {
     .init = sftpcmdls_init,
     .free = sftpcmdls_free,
     .process_pkt = sftpcmdls_process_pkt,
-    .get_arg_info = sftpcmdls_get_arg_info
+    .get_arg_info = sftpcmdls_get_arg_info,
+    .unthrottle = sftpcmdls_unthrottle
 };
@@ -19,7 +19,6 @@ static void sftpcmdmkdir_free(SftpCmd *cmd);
 
 static void send_mkdir(SftpCmdMkdir *cmdmkdir, Sftp *sftp)
 {
-    sftp_set_sending_backend(sftp);
     sftpcmd_set_request(&cmdmkdir->cmd, SSH_FXP_MKDIR, fxp_mkdir_send(cmdmkdir->argv[cmdmkdir->current_arg].line_dir, NULL));
 }
 
@@ -32,7 +32,6 @@ static void send_rename(const char *fname, Sftp *sftp, SftpCmd *cmd)
     const char *line_final_dstfname = sftp_dup_utf8_to_line(sftp->line_codepage, cmdmv->final_dstfname, sftp->seat);
     assert(line_final_dstfname); // both dstfname and fname are convertible to line codepage
 
-    sftp_set_sending_backend(sftp);
     sftpcmd_set_request(&cmdmv->cmd, SSH_FXP_RENAME, fxp_rename_send(fname, line_final_dstfname));
     sftp_dup_utf8_free(line_final_dstfname, cmdmv->final_dstfname);
 }
@@ -58,7 +57,6 @@ static SftpCmd *sftpcmdmv_init(Sftp *sftp)
     sftpwcm_iterator_init(&cmdmv->it, NULL, NULL);
 
     sftpcmd_clear_request(&cmdmv->cmd);
-    sftp_set_sending_backend(sftp);
     sftpcmd_set_request(&cmdmv->cmd, SSH_FXP_STAT, fxp_stat_send(line_dstfname));
     sftp_dup_utf8_free(line_dstfname, dstfname);
     return &cmdmv->cmd;
@@ -2,11 +2,11 @@
 #include "sftputil.h"
 #include "sftpfxp.h"
 #include "sftpgetput.h"
-#include "psftp.h"
+#include "psftpext.h"
 #include "sftpprogressbar.h"
 #include "sftpunicode.h"
-
-const char *get_absolute_path(const char *pwd, const char *name);
+#include "sftpcrawler.h"
+#include "sftpverify.h"
 
 typedef struct WildcardMatcherIterator {
     int current_arg;
@@ -84,55 +84,224 @@ static bool wcm_iterator_next(WildcardMatcherIterator* it, Sftp *sftp, SftpCmd *
 typedef enum {
     SR_RECURSE_CHECK_IF_DIR,
     SR_RECURSE_CHECK_IF_PRESENT,
-    SR_RESTART_GET_OFFSET,
     SR_CHECK_IF_DIR
 } StatReason;
 
+/*
+ * Like get, a put runs one source, which walks the local arguments and
+ * directories and does the remote STATs and MKDIRs, and up to `jobs' file
+ * pipelines doing OPEN, FSTAT for a restart, the WRITEs and CLOSE. The OPEN
+ * and FSTAT of the next GETPUT_LOOKAHEAD_FILES files are sent while the
+ * running transfers stream, and CLOSEs are not waited for. The OPEN sent
+ * ahead neither creates nor truncates the remote file: a missing file is
+ * created, an existing one truncated by FSETSTAT, when its transfer starts.
+ *
+ * A sync push lists the remote directory of every local directory through
+ * a crawler instead of STATing the names, which also reads the remote
+ * subdirectories ahead of the walk, and skips the unchanged files before
+ * they reach a job. A job sets the modification time of its remote file
+ * before it is closed.
+ *
+ * With -c every job hashes the data it reads and asks the server for the
+ * hash of what it wrote before its CLOSE, see sftpverify.h.
+ */
+
+typedef struct PutJob {
+    SftpCmd cmd;
+    bool busy;
+    const char *fname; //utf8
+    const char *outfname; //utf8
+    const char *line_outfname; //line codepage
+    struct fxp_handle *handle;
+    struct fxp_xfer *xfer;
+    SftpXferWindow window;
+    RFile *file;
+    uint64_t file_size;
+    unsigned long mtime, atime;
+    long permissions;
+    uint64_t offset;
+    bool opened;
+    bool create;            /* the OPEN sent ahead found no remote file */
+    bool truncate;          /* the OPEN sent ahead found a remote file */
+    bool started;           /* counted in the active transfers */
+    unsigned seq;
+    bool failed;
+    bool xfer_err;
+    bool uploaded;          /* every WRITE succeeded */
+    SftpVerifyHash *hash;
+} PutJob;
+
 typedef struct SftpCmdPut {
     SftpCmd cmd;
+    SftpCmd source;
     bool restart;
     bool multiple;
     bool recurse;
     bool user_outfname;
+    GetPutSync sync;
     WildcardMatcherIterator it;
     const char *fname; //utf8
     const char *outfname; //utf8
     const char *line_outfname; //line codepage
-    struct fxp_handle *handle;
-    struct fxp_xfer *xfer;
-    RFile *file;
     bool stop;
-    bool xfer_err;
+    bool source_waiting;
+    bool source_done;
+    bool listing_wait;
+    bool listing_remote;
     StatReason stat_reason;
 
+    int jobs;
+    int active;
+    int njobs;
+    unsigned seq;
+    PutJob *job;
+    SftpXferWindow window; /* carried from a finished transfer to the next */
+    SftpCloseQueue closes;
+    SftpCrawler crawler;
+    SftpVerify verify;
+
     SftpDirStack dirstack;
     SftpProgressBar progress;
     Seat *progress_first_seat;
-    uint64_t file_size;
 } SftpCmdPut;
 
+static void free_names(const char **fname, const char **outfname, const char **line_outfname)
+{
+    sfree((void *)*fname);
+    sftp_dup_utf8_free(*line_outfname, *outfname);
+    sfree((void *)*outfname);
+    *fname = NULL;
+    *outfname = NULL;
+    *line_outfname = NULL;
+}
 
-static bool open_files(Sftp *sftp, SftpCmdPut *cmdput)
+static void progress_interrupt(SftpCmdPut *cmdput, Sftp *sftp)
 {
-    long permissions;
+    getput_progress_interrupt(&cmdput->progress, cmdput->jobs, sftp->seat);
+}
+
+static bool next_file(Sftp *sftp, SftpCmdPut *cmdput);
+
+static PutJob *get_free_job(SftpCmdPut *cmdput)
+{
+    for (int i = 0; i < cmdput->njobs; i++) {
+        if (!cmdput->job[i].busy) {
+            return &cmdput->job[i];
+        }
+    }
+    return NULL;
+}
+
+/* Hands the current file of the source to a job, or parks it until a job is
+   released. Returns false when the source has nothing more to do. */
+static bool start_job(Sftp *sftp, SftpCmdPut *cmdput)
+{
+    if (cmdput->stop) {
+        free_names(&cmdput->fname, &cmdput->outfname, &cmdput->line_outfname);
+        return false;
+    }
+    if (cmdput->sync.dry_run) {
+        uint64_t size = 0;
+        RFile *file = open_existing_file(cmdput->fname, &size, NULL, NULL, NULL);
+        if (file) {
+            close_rfile(file);
+        }
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "would put: %s => %s", cmdput->fname, cmdput->outfname);
+        cmdput->sync.files_sent++;
+        cmdput->sync.bytes_sent += size;
+        free_names(&cmdput->fname, &cmdput->outfname, &cmdput->line_outfname);
+        return next_file(sftp, cmdput);
+    }
+    PutJob *job = get_free_job(cmdput);
+    if (!job) {
+        cmdput->source_waiting = true;
+        return true;
+    }
+
     struct fxp_attrs attrs;
 
-    assert(!cmdput->file);
-    cmdput->file = open_existing_file(cmdput->fname, &cmdput->file_size, NULL, NULL, &permissions);
-    if (!cmdput->file) {
+    assert(!job->file);
+    job->file = open_existing_file(cmdput->fname, &job->file_size, &job->mtime, &job->atime, &job->permissions);
+    if (!job->file) {
+        progress_interrupt(cmdput, sftp);
         sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "local: unable to open %s", cmdput->fname);
+        cmdput->stop = true;
+        free_names(&cmdput->fname, &cmdput->outfname, &cmdput->line_outfname);
         return false;
     }
+    job->busy = true;
+    job->opened = false;
+    job->create = false;
+    job->truncate = false;
+    job->offset = 0;
+    job->seq = cmdput->seq++;
+    job->failed = false;
+    job->fname = cmdput->fname;
+    job->outfname = cmdput->outfname;
+    job->line_outfname = cmdput->line_outfname;
+    cmdput->fname = NULL;
+    cmdput->outfname = NULL;
+    cmdput->line_outfname = NULL;
     attrs.flags = 0;
-    PUT_PERMISSIONS(attrs, permissions);
-    sftp_set_sending_backend(sftp);
-    sftpcmd_set_request(&cmdput->cmd, SSH_FXP_OPEN, fxp_open_send(cmdput->line_outfname, SSH_FXF_WRITE | SSH_FXF_CREAT | (cmdput->restart ? 0 : SSH_FXF_TRUNC), &attrs));
-    return true;
+    PUT_PERMISSIONS(attrs, job->permissions);
+    void *prev_owner = sftpfxp_set_owner(job);
+    sftpcmd_set_request(&job->cmd, SSH_FXP_OPEN, fxp_open_send(job->line_outfname, SSH_FXF_WRITE, &attrs));
+    sftpfxp_set_owner(prev_owner);
+    return next_file(sftp, cmdput);
+}
+
+static void end_xfer(SftpCmdPut *cmdput, PutJob *job, Sftp *sftp)
+{
+    if (job->xfer) {
+        xfer_cleanup(job->xfer);
+        job->xfer = NULL;
+        cmdput->window = job->window;
+        sftp->last_xfer = job->window;
+    }
+    if (job->started) {
+        job->started = false;
+        cmdput->active--;
+    }
+}
+
+static void job_done(SftpCmdPut *cmdput, PutJob *job, Sftp *sftp)
+{
+    if (job->hash) {
+        if (job->handle && job->uploaded && !cmdput->stop) {
+            sftpverify_check_send(&cmdput->verify, sftp, job->hash, job->handle, job->outfname, job->line_outfname, true);
+        } else {
+            sftpverify_hash_free(job->hash);
+        }
+        job->hash = NULL;
+    }
+    if (job->handle) {
+        getput_close_send(&cmdput->closes, sftp, job->handle, job->outfname);
+        job->handle = NULL;
+    }
+    end_xfer(cmdput, job, sftp);
+    if (job->file) {
+        close_rfile(job->file);
+        job->file = NULL;
+        job->file_size = 0;
+    }
+    free_names(&job->fname, &job->outfname, &job->line_outfname);
+    job->busy = false;
+    job->opened = false;
+    if (!cmdput->source_waiting) {
+        return;
+    }
+    cmdput->source_waiting = false;
+    if (cmdput->stop) {
+        free_names(&cmdput->fname, &cmdput->outfname, &cmdput->line_outfname);
+        cmdput->source_done = true;
+    } else if (!start_job(sftp, cmdput)) {
+        cmdput->source_done = true;
+    }
 }
 
 static bool put_file(const char *fname, Sftp *sftp, SftpCmd *cmd)
 {
-    SftpCmdPut *cmdput = container_of(cmd, SftpCmdPut, cmd);
+    SftpCmdPut *cmdput = container_of(cmd, SftpCmdPut, source);
 
     if (fname == cmdput->it.cname) {
       fname = dupstr(fname);
@@ -151,19 +320,36 @@ static bool put_file(const char *fname, Sftp *sftp, SftpCmd *cmd)
     }
 
     if (cmdput->recurse && file_type(fname) == FILE_TYPE_DIRECTORY) {
-        sftp_set_sending_backend(sftp);
         sftpcmd_set_request(cmd, SSH_FXP_STAT, fxp_stat_send(cmdput->line_outfname));
         cmdput->stat_reason = SR_RECURSE_CHECK_IF_DIR;
         return true;
     }
 
     if (cmdput->user_outfname && !cmdput->recurse) {
-        sftp_set_sending_backend(sftp);
-        sftpcmd_set_request(&cmdput->cmd, SSH_FXP_STAT, fxp_stat_send(cmdput->line_outfname));
+        sftpcmd_set_request(cmd, SSH_FXP_STAT, fxp_stat_send(cmdput->line_outfname));
         cmdput->stat_reason = SR_CHECK_IF_DIR;
         return true;
     }
-    return open_files(sftp, cmdput);
+    return start_job(sftp, cmdput);
+}
+
+static bool read_dir(Sftp *sftp, SftpCmdPut *cmdput, bool remote_exists);
+
+/* Creates the remote directory of the current local one, which a dry run
+   only pretends. */
+static bool make_dir(Sftp *sftp, SftpCmdPut *cmdput)
+{
+    if (cmdput->sync.dry_run) {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "would create: %s", cmdput->outfname);
+        return read_dir(sftp, cmdput, false);
+    }
+    sftpcmd_set_request(&cmdput->source, SSH_FXP_MKDIR, fxp_mkdir_send(cmdput->line_outfname, NULL));
+    return true;
+}
+
+static bool is_dir(const struct fxp_attrs *attrs)
+{
+    return (attrs->flags & SSH_FILEXFER_ATTR_PERMISSIONS) && (attrs->permissions & 0170000) == 0040000;
 }
 
 static bool dir_put_file(SftpDir *dir, Sftp *sftp, SftpCmdPut *cmdput)
@@ -172,7 +358,48 @@ static bool dir_put_file(SftpDir *dir, Sftp *sftp, SftpCmdPut *cmdput)
     const char *nextoutfname = dupcat(dir->outfname, "/", dir->ournames[dir->i]);
     assert(cmdput->outfname == NULL && cmdput->line_outfname == NULL);
     cmdput->outfname = nextoutfname;
-    return put_file(nextfname, sftp, &cmdput->cmd);
+    if (cmdput->sync.enabled && is_dir(&dir->ourattrs[dir->i])) {
+        /* the remote listing of the parent stands in for a STAT */
+        const struct fxp_attrs *remote = getput_find_remote(dir, dir->ournames[dir->i]);
+        cmdput->fname = nextfname;
+        cmdput->line_outfname = sftp_dup_utf8_to_line(sftp->line_codepage, cmdput->outfname, sftp->seat);
+        if (!cmdput->line_outfname) {
+            return false;
+        }
+        if (remote && is_dir(remote)) {
+            return read_dir(sftp, cmdput, true);
+        }
+        return make_dir(sftp, cmdput);
+    }
+    return put_file(nextfname, sftp, &cmdput->source);
+}
+
+/* Steps over the files of a sync push which are unchanged on the server.
+   A dry run lists the other files instead of sending them. */
+static void skip_unchanged_files(SftpCmdPut *cmdput, SftpDir *dir, Sftp *sftp)
+{
+    if (!cmdput->sync.enabled) {
+        return;
+    }
+    while (dir->i < dir->nnames) {
+        const struct fxp_attrs *attrs = &dir->ourattrs[dir->i];
+        if ((attrs->permissions & 0170000) != 0100000) {
+            return;
+        }
+        if (getput_sync_unchanged(attrs, getput_find_remote(dir, dir->ournames[dir->i]))) {
+            cmdput->sync.files_skipped++;
+            cmdput->sync.bytes_skipped += attrs->size;
+        } else if (cmdput->sync.dry_run) {
+            const char *fname = dir_file_cat(dir->fname, dir->ournames[dir->i]);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "would put: %s => %s/%s", fname, dir->outfname, dir->ournames[dir->i]);
+            sfree((void *)fname);
+            cmdput->sync.files_sent++;
+            cmdput->sync.bytes_sent += attrs->size;
+        } else {
+            return;
+        }
+        dir->i++;
+    }
 }
 
 static bool check_dir_file_remote(SftpDir *dir, Sftp *sftp, SftpCmdPut *cmdput)
@@ -181,8 +408,7 @@ static bool check_dir_file_remote(SftpDir *dir, Sftp *sftp, SftpCmdPut *cmdput)
     if (!nextoutfname) {
         return false;
     }
-    sftp_set_sending_backend(sftp);
-    sftpcmd_set_request(&cmdput->cmd, SSH_FXP_STAT, fxp_stat_send(nextoutfname));
+    sftpcmd_set_request(&cmdput->source, SSH_FXP_STAT, fxp_stat_send(nextoutfname));
     cmdput->stat_reason = SR_RECURSE_CHECK_IF_PRESENT;
     sfree((void *)nextoutfname);
     return true;
@@ -194,6 +420,7 @@ static bool next_file(Sftp *sftp, SftpCmdPut *cmdput)
         SftpDir *dir = sftpdirstack_top(&cmdput->dirstack);
         while (dir) {
             dir->i++;
+            skip_unchanged_files(cmdput, dir, sftp);
             if (dir->i < dir->nnames) {
                 break;
             }
@@ -203,26 +430,103 @@ static bool next_file(Sftp *sftp, SftpCmdPut *cmdput)
             return dir_put_file(dir, sftp, cmdput);
         }
     }
-    return wcm_iterator_next(&cmdput->it, sftp, &cmdput->cmd);
+    return wcm_iterator_next(&cmdput->it, sftp, &cmdput->source);
+}
+
+static void read_local_attrs(DirHandle *dh, struct fxp_attrs *attrs)
+{
+    bool is_dir;
+    attrs->flags = SSH_FILEXFER_ATTR_SIZE | SSH_FILEXFER_ATTR_PERMISSIONS | SSH_FILEXFER_ATTR_ACMODTIME;
+    read_filename_attrs(dh, &attrs->size, &attrs->mtime, &is_dir);
+    attrs->atime = attrs->mtime;
+    attrs->permissions = (is_dir ? 0040000 : 0100000);
+}
+
+/* Goes on with the directory on top of the stack of a sync push once its
+   remote names are known. */
+static bool dir_listed(Sftp *sftp, SftpCmdPut *cmdput)
+{
+    if (cmdput->stop) {
+        return false;
+    }
+    SftpDir *dir = sftpdirstack_top(&cmdput->dirstack);
+    /* Let the crawler read the remote subdirectories ahead, in the order
+       the walk will get to them. */
+    for (size_t i = 0; i < dir->nnames; i++) {
+        const struct fxp_attrs *remote;
+        if (is_dir(&dir->ourattrs[i]) && (remote = getput_find_remote(dir, dir->ournames[i])) != NULL && is_dir(remote)) {
+            const char *line_subdir = sftp_utf8_to_line(sftp->line_codepage, dupcat(dir->outfname, "/", dir->ournames[i]), sftp->seat);
+            if (line_subdir) {
+                sftpcrawler_prefetch(&cmdput->crawler, sftp, line_subdir);
+                sfree((void *)line_subdir);
+            }
+        }
+    }
+    skip_unchanged_files(cmdput, dir, sftp);
+    if (dir->i == dir->nnames) {
+        sftpdirstack_pop(&cmdput->dirstack);
+        return next_file(sftp, cmdput);
+    }
+    return dir_put_file(dir, sftp, cmdput);
+}
+
+/* Moves the remote listing of the directory on top of the stack from the
+   crawler once it is complete. Returns false while it is still being
+   read. A directory with nothing to read is continued from here as well,
+   so a walk over such directories does not recurse. */
+static bool take_listing(SftpCmdPut *cmdput, Sftp *sftp)
+{
+    SftpDir *dir = sftpdirstack_top(&cmdput->dirstack);
+    if (!cmdput->listing_remote) {
+        cmdput->listing_wait = false;
+        if (!dir_listed(sftp, cmdput)) {
+            cmdput->source_done = true;
+        }
+        return true;
+    }
+    SftpCrawlDir *d = sftpcrawler_take(&cmdput->crawler, sftp, dir->line_outfname);
+    if (!d) {
+        return false;
+    }
+    cmdput->listing_wait = false;
+    if (d->error && !cmdput->stop) {
+        progress_interrupt(cmdput, sftp);
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: %s", dir->outfname, d->error);
+        cmdput->stop = true;
+    }
+    if (cmdput->stop) {
+        sftpcrawldir_free(d);
+        cmdput->source_done = true;
+        return true;
+    }
+    sgrowarrayn(dir->remotenames, dir->remotesize, dir->nremote, d->nnames);
+    sgrowarrayn(dir->remoteattrs, dir->remoteattrsize, dir->nremote, d->nnames);
+    for (size_t i = 0; i < d->nnames; i++) {
+        dir->remoteattrs[dir->nremote] = d->attrs[i];
+        dir->remotenames[dir->nremote++] = sftp_utf8_from_line(sftp->line_codepage, d->names[i]);
+        d->names[i] = NULL;
+    }
+    sftpcrawldir_free(d);
+    getput_sort_remote_names(dir);
+    if (!dir_listed(sftp, cmdput)) {
+        cmdput->source_done = true;
+    }
+    return true;
 }
 
-static bool read_dir(Sftp *sftp, SftpCmdPut *cmdput)
+static bool read_dir(Sftp *sftp, SftpCmdPut *cmdput, bool remote_exists)
 {
     const char *opendir_err;
     DirHandle *dh = open_directory(cmdput->fname, &opendir_err);
     if (!dh) {
+        progress_interrupt(cmdput, sftp);
         sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: unable to open directory: %s\n", cmdput->fname, opendir_err);
         return false;
     }
     const char *name = read_filename(dh);
-    if (!name) {
+    if (!name && !cmdput->sync.enabled) {
         close_directory(dh);
-        sfree((void *)cmdput->fname);
-        sftp_dup_utf8_free(cmdput->line_outfname, cmdput->outfname);
-        sfree((void *)cmdput->outfname);
-        cmdput->fname = NULL;
-        cmdput->outfname = NULL;
-        cmdput->line_outfname = NULL;
+        free_names(&cmdput->fname, &cmdput->outfname, &cmdput->line_outfname);
         return next_file(sftp, cmdput);
     }
     SftpDir *dir = sftpdirstack_push(&cmdput->dirstack);
@@ -230,12 +534,21 @@ static bool read_dir(Sftp *sftp, SftpCmdPut *cmdput)
     dir->outfname = cmdput->outfname;
     cmdput->fname = NULL;
     cmdput->outfname = NULL;
-    sftp_dup_utf8_free(cmdput->line_outfname, dir->outfname);
+    if (cmdput->sync.enabled) {
+        dir->line_outfname = cmdput->line_outfname;
+    } else {
+        sftp_dup_utf8_free(cmdput->line_outfname, dir->outfname);
+    }
     cmdput->line_outfname = NULL;
-    do {
+    while (name) {
         sgrowarray(dir->ournames, dir->namesize, dir->nnames);
+        if (cmdput->sync.enabled) {
+            sgrowarray(dir->ourattrs, dir->attrsize, dir->nnames);
+            read_local_attrs(dh, &dir->ourattrs[dir->nnames]);
+        }
         dir->ournames[dir->nnames++] = name;
-    } while ((name = read_filename(dh)) != NULL);
+        name = read_filename(dh);
+    }
     close_directory(dh);
 
     getput_sort_dir_names(dir);
@@ -244,81 +557,320 @@ static bool read_dir(Sftp *sftp, SftpCmdPut *cmdput)
     if (cmdput->restart) {
         return check_dir_file_remote(dir, sftp, cmdput);
     }
+    if (cmdput->sync.enabled) {
+        cmdput->listing_remote = (remote_exists && dir->nnames > 0);
+        if (cmdput->listing_remote) {
+            sftpcrawler_request(&cmdput->crawler, sftp, dir->line_outfname);
+        }
+        cmdput->listing_wait = true;
+        return true;
+    }
     return dir_put_file(dir, sftp, cmdput);
 }
 
-static void send_close(SftpCmdPut *cmdput, Sftp *sftp)
-{
-    sfree((void *)cmdput->fname);
-    sftp_dup_utf8_free(cmdput->line_outfname, cmdput->outfname);
-    sfree((void *)cmdput->outfname);
-    sftp_set_sending_backend(sftp);
-    sftpcmd_set_request(&cmdput->cmd, SSH_FXP_CLOSE, fxp_close_send(cmdput->handle));
-    cmdput->fname = NULL;
-    cmdput->outfname = NULL;
-    cmdput->line_outfname = NULL;
-    cmdput->handle = NULL;
-}
-
-static void transfer(Sftp *sftp, SftpCmdPut *cmdput)
+static void transfer(Sftp *sftp, SftpCmdPut *cmdput, PutJob *job)
 {
     bool uploaded = false;
 
-    if (!cmdput->stop) {
-        char buffer[4096];
+    if (!job->failed) {
         int len;
-        sftp_set_sending_backend(sftp);
-        sftpcmd_set_request(&cmdput->cmd, SSH_FXP_WRITE, NULL);
-        while (xfer_upload_ready(cmdput->xfer) && !cmdput->xfer_err) {
-            len = read_from_file(cmdput->file, buffer, sizeof(buffer));
+        sftpcmd_set_request(&job->cmd, SSH_FXP_WRITE, NULL);
+        while (xfer_upload_ready_window(job->xfer, &job->window) && !job->xfer_err) {
+            len = xfer_upload_file_window(job->xfer, &job->window, job->file, job->hash ? BinarySink_UPCAST(job->hash) : NULL);
             if (len == -1) {
-                sftpprogressbar_finish(&cmdput->progress, sftp->seat);
+                progress_interrupt(cmdput, sftp);
                 sftp_print(sftp->seat, SEAT_OUTPUT_STDERR, "error while reading local file");
-                cmdput->xfer_err = true;
+                job->xfer_err = true;
+                job->failed = true;
                 cmdput->stop = true;
                 break;
             } else if (len == 0) {
-                cmdput->xfer_err = true;
+                job->xfer_err = true;
                 break;
             } else {
-                xfer_upload_data(cmdput->xfer, buffer, len);
                 sftpprogressbar_update(&cmdput->progress, len);
+                cmdput->sync.bytes_sent += len;
                 uploaded = true;
             }
         }
     }
-    if (uploaded || xfer_done(cmdput->xfer)) {
+    if (uploaded || xfer_done(job->xfer)) {
         sftpprogressbar_draw(&cmdput->progress, sftp->seat, sftp->width);
     }
-    if (xfer_done(cmdput->xfer)) {
-        sftpprogressbar_finish(&cmdput->progress, sftp->seat);
-        xfer_cleanup(cmdput->xfer);
-        cmdput->xfer = NULL;
-        close_rfile(cmdput->file);
-        cmdput->file = NULL;
-        cmdput->file_size = 0;
-        send_close(cmdput, sftp);
+    if (xfer_done(job->xfer)) {
+        if (cmdput->jobs == 1) {
+            sftpprogressbar_finish(&cmdput->progress, sftp->seat);
+        }
+        sftpcmd_clear_request(&job->cmd);
+        job->uploaded = !job->failed;
+        if (cmdput->sync.enabled && !job->failed) {
+            /* a sync compares the times, the file stays open meanwhile */
+            end_xfer(cmdput, job, sftp);
+            job->opened = false;
+            struct fxp_attrs attrs;
+            attrs.flags = SSH_FILEXFER_ATTR_ACMODTIME;
+            attrs.mtime = job->mtime;
+            attrs.atime = job->atime;
+            sftpcmd_set_request(&job->cmd, SSH_FXP_SETSTAT, fxp_setstat_send(job->line_outfname, attrs));
+            return;
+        }
+        job_done(cmdput, job, sftp);
     }
 }
 
-static void start_transfer(Sftp *sftp, SftpCmdPut *cmdput, uint64_t offset)
+static void start_transfer(Sftp *sftp, SftpCmdPut *cmdput, PutJob *job)
 {
-    sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "local: %s => remote: %s", cmdput->fname, cmdput->outfname);
-    sftpprogressbar_init(&cmdput->progress, offset, cmdput->file_size);
-    cmdput->xfer = xfer_upload_init(cmdput->handle, offset);
-    cmdput->xfer_err = false;
-    transfer(sftp, cmdput);
+    progress_interrupt(cmdput, sftp);
+    if (job->offset != 0) {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "reput: restarting at file position %"PRIu64, job->offset);
+    }
+    sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "local: %s => remote: %s", job->fname, job->outfname);
+    getput_progress_start(&cmdput->progress, cmdput->jobs, job->offset, job->file_size);
+    cmdput->sync.files_sent++;
+    job->window = cmdput->window;
+    job->xfer = xfer_upload_init_window(job->handle, job->offset, &job->window);
+    job->xfer_err = false;
+    job->uploaded = false;
+    job->hash = sftpverify_hash_new(&cmdput->verify, job->offset);
+    transfer(sftp, cmdput, job);
 }
 
-static SftpCmd *generic_init(Sftp *sftp, bool restart, bool multiple)
+/* Takes one of the `jobs' transfer slots for a job, creating or truncating
+   its remote file first if the OPEN sent ahead left that to it. */
+static void begin_job(Sftp *sftp, SftpCmdPut *cmdput, PutJob *job)
 {
-    bool recurse;
-    int i;
+    job->started = true;
+    cmdput->active++;
+    if (job->create) {
+        job->create = false;
+        job->opened = false;
+        struct fxp_attrs attrs;
+        attrs.flags = 0;
+        PUT_PERMISSIONS(attrs, job->permissions);
+        sftpcmd_set_request(&job->cmd, SSH_FXP_OPEN, fxp_open_send(job->line_outfname, SSH_FXF_WRITE | SSH_FXF_CREAT | (cmdput->restart ? 0 : SSH_FXF_TRUNC), &attrs));
+    } else if (job->truncate) {
+        job->truncate = false;
+        job->opened = false;
+        struct fxp_attrs attrs;
+        attrs.flags = SSH_FILEXFER_ATTR_SIZE;
+        attrs.size = 0;
+        sftpcmd_set_request(&job->cmd, SSH_FXP_FSETSTAT, fxp_fsetstat_send(job->handle, attrs));
+    } else {
+        start_transfer(sftp, cmdput, job);
+    }
+}
 
-    if (!getput_parse_args(sftp, &i, &recurse)) {
-        return NULL;
+/* Starts the transfers of the opened files in the order the source found
+   them, as long as fewer than `jobs' transfers are running. */
+static void start_opened_jobs(SftpCmdPut *cmdput, Sftp *sftp)
+{
+    for (;;) {
+        PutJob *next = NULL;
+        for (int i = 0; i < cmdput->njobs; i++) {
+            PutJob *job = &cmdput->job[i];
+            if (job->busy && job->opened && !job->started && (!next || job->seq < next->seq)) {
+                next = job;
+            }
+        }
+        if (!next || (!cmdput->stop && cmdput->active >= cmdput->jobs)) {
+            return;
+        }
+        void *prev_owner = sftpfxp_set_owner(next);
+        if (cmdput->stop) {
+            job_done(cmdput, next, sftp);
+        } else {
+            begin_job(sftp, cmdput, next);
+        }
+        sftpfxp_set_owner(prev_owner);
     }
+}
+
+static void job_process_pkt(SftpCmdPut *cmdput, PutJob *job, Sftp *sftp, struct sftp_packet *pktin)
+{
+    SftpCmd *cmd = &job->cmd;
 
+    if (cmd->req_type == SSH_FXP_OPEN) {
+        job->handle = fxp_open_recv(pktin, cmd->req);
+        sftpcmd_clear_request(cmd);
+        if (!job->handle && !job->started && fxp_error_type() == SSH_FX_NO_SUCH_FILE) {
+            job->create = true;
+            job->opened = true;
+            return;
+        }
+        if (!job->handle) {
+            progress_interrupt(cmdput, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: open for write: %s", job->outfname, fxp_error());
+            cmdput->stop = true;
+            job_done(cmdput, job, sftp);
+            return;
+        }
+
+        if (cmdput->restart) {
+            sftpcmd_set_request(cmd, SSH_FXP_FSTAT, fxp_fstat_send(job->handle));
+            return;
+        }
+        if (job->started) {
+            start_transfer(sftp, cmdput, job);
+            return;
+        }
+        job->truncate = true;
+        job->opened = true;
+    } else if (cmd->req_type == SSH_FXP_FSETSTAT) {
+        bool result = fxp_fsetstat_recv(pktin, cmd->req);
+        sftpcmd_clear_request(cmd);
+        if (!result) {
+            progress_interrupt(cmdput, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: truncate: %s", job->outfname, fxp_error());
+            cmdput->stop = true;
+            job_done(cmdput, job, sftp);
+            return;
+        }
+        start_transfer(sftp, cmdput, job);
+    } else if (cmd->req_type == SSH_FXP_FSTAT) {
+        struct fxp_attrs attrs;
+        bool retd = fxp_fstat_recv(pktin, cmd->req, &attrs);
+        sftpcmd_clear_request(cmd);
+        if (!retd || !(attrs.flags & SSH_FILEXFER_ATTR_SIZE)) {
+            progress_interrupt(cmdput, sftp);
+            if (!retd) {
+                sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "read size of %s: %s", job->outfname, fxp_error());
+            } else {
+                sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "read size of %s: size was not given", job->outfname);
+            }
+            cmdput->stop = true;
+            job_done(cmdput, job, sftp);
+            return;
+        }
+        job->offset = attrs.size;
+        if (job->offset != 0 && seek_file((WFile *)job->file, job->offset, FROM_START) != 0) {
+            progress_interrupt(cmdput, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "reput: failed to seek to file position %"PRIu64, job->offset);
+            cmdput->stop = true;
+            job_done(cmdput, job, sftp);
+            return;
+        }
+        if (job->started) {
+            start_transfer(sftp, cmdput, job);
+            return;
+        }
+        job->opened = true;
+    } else if (cmd->req_type == SSH_FXP_WRITE) {
+        int ret = xfer_upload_gotpkt_window(job->xfer, &job->window, pktin);
+        if (ret <= 0) {
+            if (ret == INT_MIN) {        /* pktin not even freed */
+                sfree(pktin);
+            }
+            if (!job->failed) {
+                progress_interrupt(cmdput, sftp);
+                sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "error while writing: %s", fxp_error());
+                job->xfer_err = true;
+                job->failed = true;
+                cmdput->stop = true;
+            }
+        }
+        transfer(sftp, cmdput, job);
+    } else if (cmd->req_type == SSH_FXP_SETSTAT) {
+        bool result = fxp_setstat_recv(pktin, cmd->req);
+        sftpcmd_clear_request(cmd);
+        if (!result) {
+            progress_interrupt(cmdput, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: set times: %s", job->outfname, fxp_error());
+        }
+        job_done(cmdput, job, sftp);
+    }
+}
+
+static bool source_process_pkt(SftpCmdPut *cmdput, Sftp *sftp, struct sftp_packet *pktin)
+{
+    SftpCmd *cmd = &cmdput->source;
+
+    if (cmd->req_type == SSH_FXP_STAT && cmdput->stat_reason == SR_RECURSE_CHECK_IF_DIR) {
+        struct fxp_attrs attrs;
+        bool result = fxp_stat_recv(pktin, cmd->req, &attrs);
+        sftpcmd_clear_request(cmd);
+        if (cmdput->stop) {
+            return false;
+        }
+        if (!result || !(attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) || !(attrs.permissions & 0040000)) {
+            return make_dir(sftp, cmdput);
+        }
+        return read_dir(sftp, cmdput, true);
+    } else if (cmd->req_type == SSH_FXP_STAT && cmdput->stat_reason == SR_RECURSE_CHECK_IF_PRESENT) {
+        struct fxp_attrs attrs;
+        bool result = fxp_stat_recv(pktin, cmd->req, &attrs);
+        sftpcmd_clear_request(cmd);
+        if (cmdput->stop) {
+            return false;
+        }
+        SftpDir *dir = sftpdirstack_top(&cmdput->dirstack);
+        if (result) {
+            dir->i++;
+            if (dir->i < dir->nnames) {
+                return check_dir_file_remote(dir, sftp, cmdput);
+            }
+       }
+       /* Step back over as many files as may have been opened when the
+          previous transfer was interrupted, lookahead included. */
+       dir->i = (dir->i > cmdput->njobs ? dir->i - cmdput->njobs : 0);
+       return dir_put_file(dir, sftp, cmdput);
+    } else if (cmd->req_type == SSH_FXP_STAT && cmdput->stat_reason == SR_CHECK_IF_DIR) {
+        struct fxp_attrs attrs;
+        bool result = fxp_stat_recv(pktin, cmd->req, &attrs);
+        sftpcmd_clear_request(cmd);
+        if (result && (attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) && (attrs.permissions & 0040000)) {
+            const char *outfdir = cmdput->outfname;
+            cmdput->outfname = dupcat(outfdir, "/", stripslashes(cmdput->fname, true));
+            sftp_dup_utf8_free(cmdput->line_outfname, outfdir);
+            cmdput->line_outfname = sftp_dup_utf8_to_line(sftp->line_codepage, cmdput->outfname, sftp->seat);
+            sfree((void *)outfdir);
+            if (!cmdput->line_outfname) {
+                return false;
+            }
+        }
+        return start_job(sftp, cmdput);
+    } else if (cmd->req_type == SSH_FXP_MKDIR) {
+        bool result = fxp_mkdir_recv(pktin, cmd->req);
+        sftpcmd_clear_request(cmd);
+        if (!result) {
+            progress_interrupt(cmdput, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: create directory: %s\n", cmdput->outfname, fxp_error());
+            cmdput->stop = true;
+            return false;
+        }
+        if (cmdput->stop) {
+            return false;
+        }
+        return read_dir(sftp, cmdput, false);
+    }
+    return false;
+}
+
+/* The job a reply goes to, the owner of its request, like in get. */
+static PutJob *find_job(SftpCmdPut *cmdput, struct sftp_request *req)
+{
+    PutJob *job = (PutJob *)sftp_request_owner(req);
+    if (job && job->busy && (job->cmd.req == req || job->xfer)) {
+        assert(job >= cmdput->job && job < cmdput->job + cmdput->njobs);
+        return job;
+    }
+    return NULL;
+}
+
+static bool jobs_busy(SftpCmdPut *cmdput)
+{
+    for (int i = 0; i < cmdput->njobs; i++) {
+        if (cmdput->job[i].busy) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void sftpcmdput_free(SftpCmd *cmd);
+extern const SftpCmdVtable sftpcmdput_vt;
+
+static SftpCmd *create(Sftp *sftp, int i, bool restart, bool multiple, bool recurse, int jobs, bool verify, const GetPutSync *sync)
+{
     bool user_outfname = (!multiple && i+1 < sftp->args.argc);
     const char *outfname = NULL;
     const char *line_outfname = NULL;
@@ -335,6 +887,7 @@ static SftpCmd *generic_init(Sftp *sftp, bool restart, bool multiple)
     cmdput->restart = restart;
     cmdput->multiple = multiple;
     cmdput->recurse = recurse;
+    cmdput->sync = *sync;
     cmdput->user_outfname = user_outfname;
     wcm_iterator_init(&cmdput->it);
     cmdput->it.current_arg = i-1;
@@ -343,26 +896,63 @@ static SftpCmd *generic_init(Sftp *sftp, bool restart, bool multiple)
     cmdput->fname = NULL;
     cmdput->outfname = outfname;
     cmdput->line_outfname = line_outfname;
-    cmdput->handle = NULL;
-    cmdput->xfer = NULL;
-    cmdput->file = NULL;
-    cmdput->file_size = 0;
     cmdput->stop = false;
+    cmdput->source_waiting = false;
+    cmdput->source_done = false;
+    cmdput->listing_wait = false;
+    cmdput->listing_remote = false;
+    cmdput->jobs = jobs;
+    cmdput->active = 0;
+    cmdput->njobs = jobs + GETPUT_LOOKAHEAD_FILES;
+    cmdput->seq = 0;
+    cmdput->job = snewn(cmdput->njobs, PutJob);
+    memset(cmdput->job, 0, cmdput->njobs * sizeof(PutJob));
+    xfer_window_init(&cmdput->window, &sftp->xfer_limits, true);
+    getput_closes_init(&cmdput->closes);
+    sftpcrawler_init(&cmdput->crawler, &cmdput->closes, GETPUT_CRAWL_STREAMS, GETPUT_CRAWL_MAX_DIRS);
+    sftpverify_init(&cmdput->verify, sftp, verify, &cmdput->progress, jobs);
     cmdput->progress_first_seat = sftp->seat;
+    sftpprogressbar_init(&cmdput->progress, 0, 0);
     sftpdirstack_init(&cmdput->dirstack);
 
     sftpcmd_clear_request(&cmdput->cmd);
-    if (!wcm_iterator_next(&cmdput->it, sftp, &cmdput->cmd)) {
-        sfree((void *)cmdput->fname);
-        sftp_dup_utf8_free(cmdput->line_outfname, cmdput->outfname);
-        sfree((void *)cmdput->outfname);
-        wcm_iterator_uninit(&cmdput->it);
-        sfree(cmdput);
-        return NULL;
+    sftpcmd_clear_request(&cmdput->source);
+    if (!wcm_iterator_next(&cmdput->it, sftp, &cmdput->source)) {
+        cmdput->source_done = true;
+        if (!jobs_busy(cmdput)) {
+            sftpcmdput_free(&cmdput->cmd);
+            return NULL;
+        }
     }
     return &cmdput->cmd;
 }
 
+static SftpCmd *generic_init(Sftp *sftp, bool restart, bool multiple)
+{
+    bool recurse;
+    int i;
+    int jobs;
+    bool verify;
+
+    if (!getput_parse_args(sftp, &i, &recurse, &jobs, NULL, &verify)) {
+        return NULL;
+    }
+    GetPutSync sync = {0};
+    return create(sftp, i, restart, multiple, recurse, jobs, verify, &sync);
+}
+
+SftpCmd *sftpcmdput_sync_init(Sftp *sftp, int first_arg, int jobs, bool dry_run)
+{
+    GetPutSync sync = {0};
+    sync.enabled = true;
+    sync.dry_run = dry_run;
+    SftpCmd *cmd = create(sftp, first_arg, false, false, true, jobs, false, &sync);
+    if (cmd) {
+        cmd->vt = &sftpcmdput_vt;
+    }
+    return cmd;
+}
+
 static SftpCmd *sftpcmdput_init(Sftp *sftp)
 {
     return generic_init(sftp, false, false);
@@ -378,144 +968,97 @@ static SftpCmd *sftpcmdreput_init(Sftp *sftp)
     return generic_init(sftp, true, false);
 }
 
+/* Moves on after a reply. Returns false when the put is complete. */
+static bool put_continue(SftpCmdPut *cmdput, Sftp *sftp)
+{
+    while (cmdput->listing_wait && take_listing(cmdput, sftp));
+    start_opened_jobs(cmdput, sftp);
+    if (cmdput->stop) {
+        sftpcrawler_stop(&cmdput->crawler);
+    }
+    if (!cmdput->source_done || cmdput->closes.n > 0 || sftpverify_busy(&cmdput->verify) || jobs_busy(cmdput) || sftpcrawler_busy(&cmdput->crawler)) {
+        return true;
+    }
+    if (sftpverify_finish(&cmdput->verify, sftp, cmdput->stop)) {
+        return true;
+    }
+    if (cmdput->sync.enabled) {
+        progress_interrupt(cmdput, sftp);
+        getput_sync_summary(&cmdput->sync, sftp->seat);
+    }
+    return false;
+}
+
 static bool sftpcmdput_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin)
 {
     SftpCmdPut *cmdput = container_of(cmd, SftpCmdPut, cmd);
+    struct sftp_request *req = sftp_peek_request(sftp, pktin);
+    const char *close_failed;
+    PutJob *job;
 
-    if (cmd->req_type == SSH_FXP_STAT && cmdput->stat_reason == SR_RECURSE_CHECK_IF_DIR) {
-        struct fxp_attrs attrs;
-        bool result = fxp_stat_recv(pktin, cmd->req, &attrs);
-        sftpcmd_clear_request(cmd);
-        if (!result || !(attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) || !(attrs.permissions & 0040000)) {
-            sftp_set_sending_backend(sftp);
-            sftpcmd_set_request(cmd, SSH_FXP_MKDIR, fxp_mkdir_send(cmdput->line_outfname, NULL));
-            return true;
-        }
-        return read_dir(sftp, cmdput);
-    } else if (cmd->req_type == SSH_FXP_STAT && cmdput->stat_reason == SR_RESTART_GET_OFFSET) {
-        struct fxp_attrs attrs;
-        bool retd = fxp_fstat_recv(pktin, cmd->req, &attrs);
-        sftpcmd_clear_request(cmd);
-        if (!retd) {
-            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "read size of %s: %s", cmdput->outfname, fxp_error());
+    if (req && getput_close_recv(&cmdput->closes, sftp, req, pktin, &close_failed)) {
+        if (close_failed) {
+            progress_interrupt(cmdput, sftp);
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: close: %s", close_failed, fxp_error());
+            sfree((void *)close_failed);
             cmdput->stop = true;
-            send_close(cmdput, sftp);
-            return true;
-        }
-        if (!(attrs.flags & SSH_FILEXFER_ATTR_SIZE)) {
-            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "read size of %s: size was not given", cmdput->outfname);
-            cmdput->stop = true;
-            send_close(cmdput, sftp);
-            return true;
-        }
-        uint64_t offset = attrs.size;
-        if (offset != 0) {
-            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "reput: restarting at file position %"PRIu64, offset);
-            if (seek_file((WFile *)cmdput->file, offset, FROM_START) != 0) {
-                sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "reput: failed to seek to file position %"PRIu64, offset);
-                return false;
-            }
-        }
-        start_transfer(sftp, cmdput, offset);
-        return true;
-    } else if (cmd->req_type == SSH_FXP_STAT && cmdput->stat_reason == SR_RECURSE_CHECK_IF_PRESENT) {
-        struct fxp_attrs attrs;
-        bool result = fxp_stat_recv(pktin, cmd->req, &attrs);
-        sftpcmd_clear_request(cmd);
-        SftpDir *dir = sftpdirstack_top(&cmdput->dirstack);
-        if (result) {
-            dir->i++;
-            if (dir->i < dir->nnames) {
-                return check_dir_file_remote(dir, sftp, cmdput);
-            }
-       }
-       if (dir->i > 0) {
-          dir->i--;
-       }
-       return dir_put_file(dir, sftp, cmdput);
-    } else if (cmd->req_type == SSH_FXP_STAT && cmdput->stat_reason == SR_CHECK_IF_DIR) {
-        struct fxp_attrs attrs;
-        bool result = fxp_stat_recv(pktin, cmd->req, &attrs);
-        sftpcmd_clear_request(cmd);
-        if (result && (attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) && (attrs.permissions & 0040000)) {
-            const char *outfdir = cmdput->outfname;
-            cmdput->outfname = dupcat(outfdir, "/", stripslashes(cmdput->fname, true));
-            sftp_dup_utf8_free(cmdput->line_outfname, outfdir);
-            cmdput->line_outfname = NULL;
-            sfree((void *)outfdir);
-        }
-        return open_files(sftp, cmdput);
-    } else if (cmd->req_type == SSH_FXP_MKDIR) {
-        bool result = fxp_mkdir_recv(pktin, cmd->req);
-        sftpcmd_clear_request(cmd);
-        if (!result) {
-            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: create directory: %s\n", cmdput->outfname, fxp_error());
-            return false;
         }
-        return read_dir(sftp, cmdput);
-    } else if (cmd->req_type == SSH_FXP_OPEN) {
-        cmdput->handle = fxp_open_recv(pktin, cmd->req);
-        sftpcmd_clear_request(cmd);
-        if (!cmdput->handle) {
-            close_rfile(cmdput->file);
-            cmdput->file = NULL;
-            cmdput->file_size = 0;
-            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: open for write: %s", cmdput->outfname, fxp_error());
-            return false;
-        }
-
-        if (cmdput->restart) {
-            sftp_set_sending_backend(sftp);
-            sftpcmd_set_request(cmd, SSH_FXP_STAT, fxp_fstat_send(cmdput->handle));
-            cmdput->stat_reason = SR_RESTART_GET_OFFSET;
-            return true;
-        }
-
-        start_transfer(sftp, cmdput, 0);
-        return true;
-    } else if (cmd->req_type == SSH_FXP_WRITE) {
-        int ret = xfer_upload_gotpkt(cmdput->xfer, pktin);
-        if (ret <= 0) {
-            if (ret == INT_MIN) {        /* pktin not even freed */
-                sfree(pktin);
-            }
-            if (!cmdput->stop) {
-                sftpprogressbar_finish(&cmdput->progress, sftp->seat);
-                sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "error while writing: %s", fxp_error());
-                cmdput->xfer_err = true;
-                cmdput->stop = true;
-            }
+    } else if (req && sftpverify_check_recv(&cmdput->verify, sftp, req, pktin)) {
+        /* reported by the verifier */
+    } else if (req && sftpcrawler_process_pkt(&cmdput->crawler, sftp, req, pktin)) {
+        /* a listing may have become complete, taken below */
+    } else if (req && req == cmdput->source.req) {
+        sftp_find_request(pktin);
+        if (!source_process_pkt(cmdput, sftp, pktin)) {
+            cmdput->source_done = true;
         }
-        transfer(sftp, cmdput);
-        return true;
-    } else if (cmd->req_type == SSH_FXP_CLOSE) {
-        fxp_close_recv(pktin, cmd->req);
-        sftpcmd_clear_request(cmd);
-        if (cmdput->stop) {
-            return false;
+    } else if (req && (job = find_job(cmdput, req)) != NULL) {
+        if (job->cmd.req) {
+            sftp_find_request(pktin);
         }
-        return next_file(sftp, cmdput);
+        void *prev_owner = sftpfxp_set_owner(job);
+        job_process_pkt(cmdput, job, sftp, pktin);
+        sftpfxp_set_owner(prev_owner);
+    } else {
+        sftpfxp_pkt_free(pktin);
     }
-    return false;
+    return put_continue(cmdput, sftp);
+}
+
+/* The sha256sum of the verifier ended. */
+static bool sftpcmdput_conn_changed(SftpCmd *cmd, Sftp *sftp, SftpConn *conn)
+{
+    SftpCmdPut *cmdput = container_of(cmd, SftpCmdPut, cmd);
+    sftpverify_conn_changed(&cmdput->verify, sftp, conn);
+    return put_continue(cmdput, sftp);
 }
 
 static void sftpcmdput_free(SftpCmd *cmd)
 {
     SftpCmdPut *cmdput = container_of(cmd, SftpCmdPut, cmd);
     sftpprogressbar_finish(&cmdput->progress, cmdput->progress_first_seat);
-    sfree((void *)cmdput->fname);
-    sftp_dup_utf8_free(cmdput->line_outfname, cmdput->outfname);
-    sfree((void *)cmdput->outfname);
+    free_names(&cmdput->fname, &cmdput->outfname, &cmdput->line_outfname);
     wcm_iterator_uninit(&cmdput->it);
-    if (cmdput->xfer) {
-        xfer_cleanup(cmdput->xfer);
-    }
-    if (cmdput->handle) {
-        sftp_free_fxphandle(cmdput->handle);
-    }
-    if (cmdput->file) {
-       close_rfile(cmdput->file);
+    for (int i = 0; i < cmdput->njobs; i++) {
+        PutJob *job = &cmdput->job[i];
+        free_names(&job->fname, &job->outfname, &job->line_outfname);
+        if (job->xfer) {
+            xfer_cleanup(job->xfer);
+        }
+        if (job->handle) {
+            sftp_free_fxphandle(job->handle);
+        }
+        if (job->file) {
+           close_rfile(job->file);
+        }
+        if (job->hash) {
+            sftpverify_hash_free(job->hash);
+        }
     }
+    sfree(cmdput->job);
+    sftpcrawler_uninit(&cmdput->crawler);
+    getput_closes_uninit(&cmdput->closes);
+    sftpverify_uninit(&cmdput->verify);
     sftpdirstack_uninit(&cmdput->dirstack);
     sfree(cmdput);
 }
@@ -539,19 +1082,22 @@ const SftpCmdVtable sftpcmdput_vt = {
     .init = sftpcmdput_init,
     .free = sftpcmdput_free,
     .process_pkt = sftpcmdput_process_pkt,
-    .get_arg_info = sftpcmdput_get_arg_info
+    .get_arg_info = sftpcmdput_get_arg_info,
+    .conn_changed = sftpcmdput_conn_changed
 };
 
 const SftpCmdVtable sftpcmdmput_vt = {
     .init = sftpcmdmput_init,
     .free = sftpcmdput_free,
     .process_pkt = sftpcmdput_process_pkt,
-    .get_arg_info = sftpcmdmput_get_arg_info
+    .get_arg_info = sftpcmdmput_get_arg_info,
+    .conn_changed = sftpcmdput_conn_changed
 };
 
 const SftpCmdVtable sftpcmdreput_vt = {
     .init = sftpcmdreput_init,
     .free = sftpcmdput_free,
     .process_pkt = sftpcmdput_process_pkt,
-    .get_arg_info = sftpcmdput_get_arg_info
+    .get_arg_info = sftpcmdput_get_arg_info,
+    .conn_changed = sftpcmdput_conn_changed
 };
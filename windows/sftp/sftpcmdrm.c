@@ -14,7 +14,6 @@ static void send_remove(const char *fname, Sftp *sftp, SftpCmd *cmd)
 {
     SftpCmdRm *cmdrm = container_of(cmd, SftpCmdRm, cmd);
 
-    sftp_set_sending_backend(sftp);
     if (cmdrm->rmdir) {
         sftpcmd_set_request(cmd, SSH_FXP_RMDIR, fxp_rmdir_send(fname));
     } else {
@@ -0,0 +1,97 @@
+#include "sftpcmd.h"
+#include "sftputil.h"
+#include "sftpgetput.h"
+
+/*
+ * sync runs a get or a put in its sync mode, see GetPutSync. The command
+ * is only a shell around it, since the vtable of a command is chosen by
+ * its name before the arguments are parsed.
+ */
+
+typedef struct SftpCmdSync {
+    SftpCmd cmd;
+    SftpCmd *transfer;
+} SftpCmdSync;
+
+static SftpCmd *sftpcmdsync_init(Sftp *sftp)
+{
+    int argc = sftp->args.argc;
+    const char *const *argv = sftp->args.argv;
+    bool push;
+
+    if (argc >= 2 && !strcmp(argv[1], "push")) {
+        push = true;
+    } else if (argc >= 2 && !strcmp(argv[1], "pull")) {
+        push = false;
+    } else {
+        sftp_print(sftp->seat, SEAT_OUTPUT_STDERR, "sync: expects push or pull");
+        return NULL;
+    }
+
+    bool dry_run = false;
+    int jobs = GETPUT_DEFAULT_JOBS;
+    int i = 2;
+    while (i < argc && argv[i][0] == '-') {
+        if (!strcmp(argv[i], "--")) {
+            /* finish processing options */
+            i++;
+            break;
+        } else if (!strcmp(argv[i], "-n")) {
+            dry_run = true;
+        } else if (!strcmp(argv[i], "-j")) {
+            if (!getput_parse_jobs(sftp, i, &jobs)) {
+                return NULL;
+            }
+            i++;
+        } else {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "sync: unrecognised option '%s'", argv[i]);
+            return NULL;
+        }
+        i++;
+    }
+    if (i >= argc) {
+        sftp_print(sftp->seat, SEAT_OUTPUT_STDERR, "sync: expects a directory");
+        return NULL;
+    }
+    if (i + 2 < argc) {
+        sftp_print(sftp->seat, SEAT_OUTPUT_STDERR, "sync: too many arguments");
+        return NULL;
+    }
+
+    SftpCmd *transfer = (push ? sftpcmdput_sync_init(sftp, i, jobs, dry_run) : sftpcmdget_sync_init(sftp, i, jobs, dry_run));
+    if (!transfer) {
+        return NULL;
+    }
+    SftpCmdSync *cmdsync = snew(SftpCmdSync);
+    sftpcmd_clear_request(&cmdsync->cmd);
+    cmdsync->transfer = transfer;
+    return &cmdsync->cmd;
+}
+
+static void sftpcmdsync_free(SftpCmd *cmd)
+{
+    SftpCmdSync *cmdsync = container_of(cmd, SftpCmdSync, cmd);
+    sftpcmd_free(cmdsync->transfer);
+    sfree(cmdsync);
+}
+
+static bool sftpcmdsync_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin)
+{
+    SftpCmdSync *cmdsync = container_of(cmd, SftpCmdSync, cmd);
+    return sftpcmd_process_pkt(cmdsync->transfer, sftp, pktin);
+}
+
+static bool sftpcmdsync_conn_changed(SftpCmd *cmd, Sftp *sftp, SftpConn *conn)
+{
+    SftpCmdSync *cmdsync = container_of(cmd, SftpCmdSync, cmd);
+    SftpCmd *transfer = cmdsync->transfer;
+    return !transfer->vt->conn_changed || transfer->vt->conn_changed(transfer, sftp, conn);
+}
+
+const SftpCmdVtable sftpcmdsync_vt = {
+    .init = sftpcmdsync_init,
+    .free = sftpcmdsync_free,
+    .process_pkt = sftpcmdsync_process_pkt,
+    .get_arg_info = sftpcmd_get_arg_info,
+    .conn_changed = sftpcmdsync_conn_changed
+};
@@ -0,0 +1,55 @@
+#include "sftpcmd.h"
+#include "sftputil.h"
+#include "sftpbe.h"
+#include <inttypes.h>
+
+static bool is_text(const SftpExtension *ext)
+{
+    for (size_t i = 0; i < ext->datalen; i++) {
+        unsigned char c = ext->data[i];
+        if (c < 0x20 || c == 0x7f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const char *limit_str(char *buf, uint64_t value)
+{
+    if (value == 0) {
+        return "no limit";
+    }
+    sprintf(buf, "%"PRIu64, value);
+    return buf;
+}
+
+static SftpCmd *sftpcmdversion_init(Sftp *sftp)
+{
+    sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "SFTP protocol version %lu", sftp->remote_version);
+    for (size_t i = 0; i < sftp->nextensions; i++) {
+        const SftpExtension *ext = &sftp->extensions[i];
+        if (is_text(ext)) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "extension: %s \"%s\"", ext->name, ext->data);
+        } else {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "extension: %s", ext->name);
+        }
+    }
+
+    if (sftp->has_server_limits) {
+        const SftpServerLimits *limits = &sftp->server_limits;
+        char packet[24], read[24], write[24], handles[24];
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "server limits: packet %s, read %s, write %s, open handles %s",
+                    limit_str(packet, limits->max_packet), limit_str(read, limits->max_read),
+                    limit_str(write, limits->max_write), limit_str(handles, limits->max_handles));
+    }
+    sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "request size up to %d bytes for reads and %d bytes for writes, packets up to %u bytes received",
+                sftp->xfer_limits.ceiling_read, sftp->xfer_limits.ceiling_write, sftp->max_packet);
+    return NULL;
+}
+
+const SftpCmdVtable sftpcmdversion_vt = {
+    .init = sftpcmdversion_init,
+    .free = NULL,
+    .process_pkt = NULL,
+    .get_arg_info = sftpcmd_get_arg_info
+};
@@ -0,0 +1,94 @@
+#include "sftpcmd.h"
+#include "sftputil.h"
+#include "sftpbe.h"
+#include <inttypes.h>
+
+static bool parse_size(Sftp *sftp, const char *arg, int min, int max, int *size)
+{
+    char *end;
+    uint64_t value = strtoul(arg, &end, 10);
+    if (end != arg && (*end == 'k' || *end == 'K')) {
+        value *= 1024;
+        end++;
+    } else if (end != arg && (*end == 'm' || *end == 'M')) {
+        value *= 1024*1024;
+        end++;
+    }
+    if (end == arg || *end || arg[0] == '-' || value < (uint64_t)min || value > (uint64_t)max) {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "xfer: size '%s' is not between %d and %d", arg, min, max);
+        return false;
+    }
+    *size = (int)value;
+    return true;
+}
+
+static void print_settings(Sftp *sftp)
+{
+    SftpXferLimits *limits = &sftp->xfer_limits;
+    if (limits->pin_window) {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "window: pinned to %d bytes, request size %d bytes", limits->pin_window, limits->pin_chunk);
+    } else {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "window: adaptive up to %d bytes, request size up to %d bytes for reads and %d bytes for writes", limits->max_window, limits->max_read, limits->max_write);
+    }
+
+    SftpXferWindow *w = &sftp->last_xfer;
+    if (w->window == 0) {
+        return;
+    }
+    if (w->min_rtt == 0) {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "last transfer: window %d bytes, request size %d bytes", w->window, w->chunk);
+    } else {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "last transfer: window %d bytes, request size %d bytes, round trip %.1f ms (lowest %.1f ms), %"PRIu64" bytes/s",
+                    w->window, w->chunk, w->srtt / 1000.0, w->min_rtt / 1000.0, w->rate);
+    }
+}
+
+static SftpCmd *sftpcmdxfer_init(Sftp *sftp)
+{
+    SftpXferLimits *limits = &sftp->xfer_limits;
+    int argc = sftp->args.argc;
+    const char *const *argv = sftp->args.argv;
+
+    if (argc == 1) {
+        print_settings(sftp);
+    } else if (!strcmp(argv[1], "auto") && argc == 2) {
+        limits->pin_window = 0;
+        limits->pin_chunk = 0;
+        print_settings(sftp);
+    } else if (!strcmp(argv[1], "pin") && argc == 4) {
+        int window, chunk;
+        int ceiling = min(limits->ceiling_read, limits->ceiling_write);
+        if (!parse_size(sftp, argv[2], XFER_MIN_CHUNK, XFER_MAX_WINDOW, &window) ||
+            !parse_size(sftp, argv[3], XFER_MIN_CHUNK, ceiling, &chunk)) {
+            return NULL;
+        }
+        if (window < chunk) {
+            sftp_print(sftp->seat, SEAT_OUTPUT_STDERR, "xfer: the window is smaller than the request size");
+            return NULL;
+        }
+        limits->pin_window = window;
+        limits->pin_chunk = chunk;
+        print_settings(sftp);
+    } else if (!strcmp(argv[1], "max") && argc == 5) {
+        int window, read, write;
+        if (!parse_size(sftp, argv[2], XFER_MIN_WINDOW, XFER_MAX_WINDOW, &window) ||
+            !parse_size(sftp, argv[3], XFER_MIN_CHUNK, limits->ceiling_read, &read) ||
+            !parse_size(sftp, argv[4], XFER_MIN_CHUNK, limits->ceiling_write, &write)) {
+            return NULL;
+        }
+        limits->max_window = window;
+        limits->max_read = read;
+        limits->max_write = write;
+        print_settings(sftp);
+    } else {
+        sftp_print(sftp->seat, SEAT_OUTPUT_STDERR, "xfer: expects 'auto', 'pin <window> <size>' or 'max <window> <read-size> <write-size>'");
+    }
+    return NULL;
+}
+
+const SftpCmdVtable sftpcmdxfer_vt = {
+    .init = sftpcmdxfer_init,
+    .free = NULL,
+    .process_pkt = NULL,
+    .get_arg_info = sftpcmd_get_arg_info
+};
@@ -2,7 +2,11 @@
 #include "sftputil.h"
 #include "sftpcli.h"
 #include "sftpcompletion.h"
-#include "psftp.h"
+#include "sftpfxp.h"
+#include "sftpbe.h"
+#include "sftpunicode.h"
+#include "psftpext.h"
+#include "tree234.h"
 
 #include <assert.h>
 #include <stdbool.h>
@@ -26,8 +30,12 @@ typedef struct SftpCompletion {
     size_t command_cache_size;
     char local_path_separator;
     char remote_path_separator;
-    const SftpCompletionName *remote_cache;
+    const SftpCompletionName *remote_cache; /* names starting with remote_prefix */
     size_t remote_cache_size;
+    const char *remote_prefix;
+    const char *remote_line_prefix; /* NULL if not in the line codepage */
+    tree234 *remote_matches; /* while the names are added */
+    const SftpListing *remote_listing;
     const char *remote_path;
     const char *remote_ctx_filename;
     SftpCmdArgInfo remote_ctx_arg_info;
@@ -38,8 +46,6 @@ typedef struct SftpCompletion {
 } SftpCompletion;
 
 extern const SftpCmdVtable sftpcompletion_readdir_vt;
-const char *get_absolute_path(const char *pwd, const char *name);
-char get_path_separator();
 
 static void free_name_array(const SftpCompletionName *names, size_t nnames)
 {
@@ -49,15 +55,118 @@ static void free_name_array(const SftpCompletionName *names, size_t nnames)
     sfree((void *)names);
 }
 
-static void free_remote_cache(SftpCompletion *completion)
+static void free_remote_names(SftpCompletion *completion)
 {
     free_name_array(completion->remote_cache, completion->remote_cache_size);
     completion->remote_cache = NULL;
     completion->remote_cache_size = 0;
+    if (completion->remote_matches) {
+        SftpCompletionName *n;
+        while ((n = delpos234(completion->remote_matches, 0)) != NULL) {
+            sfree((void *)n->name);
+            sfree(n);
+        }
+        freetree234(completion->remote_matches);
+        completion->remote_matches = NULL;
+    }
+    sfree((void *)completion->remote_prefix);
+    completion->remote_prefix = NULL;
+    sfree((void *)completion->remote_line_prefix);
+    completion->remote_line_prefix = NULL;
+}
+
+static void free_remote_cache(SftpCompletion *completion)
+{
+    free_remote_names(completion);
+    if (completion->remote_listing) {
+        sftplistcache_release(completion->remote_listing);
+        completion->remote_listing = NULL;
+    }
     sfree((void *)completion->remote_path);
     completion->remote_path = NULL;
 }
 
+static int completion_name_compare(const void *av, const void *bv)
+{
+    const SftpCompletionName *a = av;
+    const SftpCompletionName *b = bv;
+    return strcmp(a->name, b->name);
+}
+
+static int completion_name_cmp234(void *av, void *bv)
+{
+    return completion_name_compare(av, bv);
+}
+
+/*
+ * The remote names are filtered by the prefix being completed while they
+ * are added, in the line codepage, and only the matching names are kept
+ * sorted. A huge directory then costs a string compare per name, not a
+ * conversion and a sort of every name.
+ */
+static void begin_remote_names(SftpCompletion *completion, const char *prefix)
+{
+    Sftp *sftp = completion->sftp;
+    free_remote_names(completion);
+    completion->remote_prefix = dupstr(prefix);
+    completion->remote_line_prefix = sftp_utf8_to_line(sftp->line_codepage, dupstr(prefix), sftp->seat);
+    completion->remote_matches = newtree234(completion_name_cmp234);
+}
+
+static void add_remote_names(SftpCompletion *completion, const struct fxp_name *names, size_t nnames)
+{
+    Sftp *sftp = completion->sftp;
+    const char *prefix = completion->remote_line_prefix;
+    if (!prefix) {
+        return;
+    }
+    size_t plen = strlen(prefix);
+    for (size_t i = 0; i < nnames; i++) {
+        const struct fxp_name *fn = &names[i];
+        if (strncmp(fn->filename, prefix, plen) != 0) {
+            continue;
+        }
+        bool is_dir = (fn->attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) &&
+                      ((fn->attrs.permissions & PERMS_DIRECTORY) == PERMS_DIRECTORY);
+        if (is_dir && (strcmp(fn->filename, ".") == 0 || strcmp(fn->filename, "..") == 0)) {
+            continue;
+        }
+        SftpCompletionName *n = snew(SftpCompletionName);
+        n->name = sftp_utf8_from_line(sftp->line_codepage, dupstr(fn->filename));
+        n->is_dir = is_dir;
+        if (add234(completion->remote_matches, n) != n) {
+            sfree((void *)n->name);
+            sfree(n);
+        }
+    }
+}
+
+/* Moves the matching names into the remote cache. */
+static void end_remote_names(SftpCompletion *completion)
+{
+    size_t nnames = count234(completion->remote_matches);
+    SftpCompletionName *cache = snewn(nnames ? nnames : 1, SftpCompletionName);
+    for (size_t i = 0; i < nnames; i++) {
+        SftpCompletionName *n = index234(completion->remote_matches, i);
+        cache[i] = *n;
+        sfree(n);
+    }
+    freetree234(completion->remote_matches);
+    completion->remote_matches = NULL;
+    completion->remote_cache = cache;
+    completion->remote_cache_size = nnames;
+}
+
+/* Takes over the listing and sets the remote cache to its names starting
+   with prefix. */
+static void set_remote_listing(SftpCompletion *completion, const SftpListing *listing, const char *prefix)
+{
+    begin_remote_names(completion, prefix);
+    add_remote_names(completion, listing->names, listing->nnames);
+    end_remote_names(completion);
+    completion->remote_listing = listing;
+}
+
 /*
  * Bsearch a[from .. n) by strncmp(name, prefix, plen).
  * If first_mismatch is false: return smallest i with c >= 0, or n if all c < 0.
@@ -320,23 +429,44 @@ static void remote_completion_continue(SftpCompletion *completion, const char *f
 
 static const SftpCmdVtable *remote_completion(SftpCompletion *completion, const char *arg, SftpCmdArgInfo arg_info, bool has_open_quote)
 {
-    const char *path = sftp_get_absolute_path(completion->sftp->pwd, arg);
+    Sftp *sftp = completion->sftp;
+    const char *path = sftp_get_absolute_path(sftp->pwd, arg);
     char *filename = stripslashes(path, false);
     size_t parent_length = filename - path;
+    char *parent = mkstr(make_ptrlen(path, parent_length));
+    const char *line_parent = sftp_dup_utf8_to_line(sftp->line_codepage, parent, sftp->seat);
+    if (!line_parent) {
+        sfree(parent);
+        sfree((void *)path);
+        return NULL;
+    }
+    const SftpListing *listing = sftplistcache_get(&sftp->listcache, line_parent);
+    sftp_dup_utf8_free(line_parent, parent);
 
-    if (completion->remote_path == NULL ||
-        strncmp(path, completion->remote_path, parent_length) != 0 || completion->remote_path[parent_length] != 0) {
+    if (!listing) {
         free_remote_cache(completion);
-        completion->remote_path = mkstr(make_ptrlen(path, parent_length));
+        completion->remote_path = parent;
         if (completion->remote_ctx_filename) {
             sfree((void *)completion->remote_ctx_filename);
         }
         completion->remote_ctx_filename = dupstr(filename);
         completion->remote_ctx_arg_info = arg_info;
         completion->remote_has_open_quote = has_open_quote;
+        begin_remote_names(completion, filename);
         sfree((void *)path);
         return &sftpcompletion_readdir_vt;
     }
+    if (listing == completion->remote_listing) {
+        sftplistcache_release(listing);
+        sfree(parent);
+        if (strncmp(filename, completion->remote_prefix, strlen(completion->remote_prefix)) != 0) {
+            set_remote_listing(completion, listing, filename);
+        }
+    } else {
+        free_remote_cache(completion);
+        completion->remote_path = parent;
+        set_remote_listing(completion, listing, filename);
+    }
     remote_completion_continue(completion, filename, arg_info, has_open_quote);
     sfree((void *)path);
     return NULL;
@@ -349,6 +479,10 @@ SftpCompletion *sftpcompletion_create(Sftp *sftp)
     completion->remote_path = NULL;
     completion->remote_cache = NULL;
     completion->remote_cache_size = 0;
+    completion->remote_prefix = NULL;
+    completion->remote_line_prefix = NULL;
+    completion->remote_matches = NULL;
+    completion->remote_listing = NULL;
     completion->remote_ctx_filename = NULL;
 
     size_t command_count = sftpcmd_get_command_count();
@@ -450,11 +584,16 @@ const SftpCmdVtable *sftpcompletion_start_completion(SftpCompletion *completion)
     return NULL;
 }
 
-void sftpcompletion_continue_completion(SftpCompletion *completion, const SftpCompletionName *names, size_t nnames)
+void sftpcompletion_add_remote_names(SftpCompletion *completion, const struct fxp_name *names, size_t nnames)
 {
-    assert(completion->remote_cache == NULL);
-    completion->remote_cache = names;
-    completion->remote_cache_size = nnames;
+    add_remote_names(completion, names, nnames);
+}
+
+void sftpcompletion_continue_completion(SftpCompletion *completion, const SftpListing *listing)
+{
+    assert(completion->remote_listing == NULL);
+    end_remote_names(completion);
+    completion->remote_listing = listing;
     remote_completion_continue(completion, completion->remote_ctx_filename,
                                completion->remote_ctx_arg_info, completion->remote_has_open_quote);
 }
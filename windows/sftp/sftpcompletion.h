@@ -1,11 +1,15 @@
 #ifndef SFTPCOMPLETION_H
 #define SFTPCOMPLETION_H
 
+#include <stddef.h>
 #include <stdbool.h>
 
 typedef struct SftpCompletion SftpCompletion;
 typedef struct Sftp Sftp;
 typedef struct SftpCmdVtable SftpCmdVtable;
+typedef struct SftpListing SftpListing;
+typedef struct SftpCmd SftpCmd;
+struct fxp_name;
 
 typedef struct SftpCompletionName {
     const char *name;
@@ -15,7 +19,15 @@ typedef struct SftpCompletionName {
 SftpCompletion *sftpcompletion_create(Sftp *sftp);
 void sftpcompletion_free(SftpCompletion *completion);
 const SftpCmdVtable *sftpcompletion_start_completion(SftpCompletion *completion);
-void sftpcompletion_continue_completion(SftpCompletion *completion, const SftpCompletionName *names, size_t nnames);
+/* The names of a READDIR reply of sftpcompletion_readdir_vt, only the
+   names starting with the prefix being completed are kept. */
+void sftpcompletion_add_remote_names(SftpCompletion *completion, const struct fxp_name *names, size_t nnames);
+/* Completes from the names added, takes over the listing of the directory
+   or NULL if it was not read to the end. */
+void sftpcompletion_continue_completion(SftpCompletion *completion, const SftpListing *listing);
+/* TAB pressed again while sftpcompletion_readdir_vt reads the directory:
+   completes from the names read so far and reads no further. */
+void sftpcompletion_readdir_complete_now(SftpCmd *cmd, Sftp *sftp);
 const char *sftpcompletion_get_remote_path(SftpCompletion *completion);
 
 void sftpcompletion_continue_paging(SftpCompletion *completion, int max_lines);
@@ -3,48 +3,44 @@
 #include "sftpfxp.h"
 #include "sftpcompletion.h"
 #include "sftpunicode.h"
+#include "sftpbe.h"
 
 typedef struct CompletionReaddir {
     SftpCmd cmd;
     struct fxp_handle *dirh;
-    SftpCompletionName *names;
-    size_t nnames;
-    size_t namesize;
+    const char *line_dir;
+    SftpListing *listing; //NULL once too large to be cached
+    bool completed;
 } CompletionReaddir;
 
 static void send_close(Sftp *sftp, SftpCmd *cmd, struct fxp_handle *dirh)
 {
-    sftp_set_sending_backend(sftp);
     sftpcmd_set_request(cmd, SSH_FXP_CLOSE, fxp_close_send(dirh));
 }
 
-static void free_name_list(CompletionReaddir *cmdreaddir)
+static void continue_completion(Sftp *sftp, CompletionReaddir *cmdreaddir)
 {
-    for (size_t i = 0; i < cmdreaddir->nnames; i++) {
-        sfree((void *)cmdreaddir->names[i].name);
+    const SftpListing *listing = NULL;
+    if (cmdreaddir->listing) {
+        listing = sftplistcache_end(&sftp->listcache, cmdreaddir->listing, NULL, cmdreaddir->line_dir);
+        cmdreaddir->listing = NULL;
     }
-    sfree(cmdreaddir->names);
-    cmdreaddir->names = NULL;
-    cmdreaddir->nnames = 0;
-    cmdreaddir->namesize = 0;
+    cmdreaddir->completed = true;
+    sftpcompletion_continue_completion(sftp->completion, listing);
 }
 
-static int completion_name_compare(const void *av, const void *bv)
-{
-    const SftpCompletionName *a = av;
-    const SftpCompletionName *b = bv;
-    return strcmp(a->name, b->name);
-}
-
-static void continue_completion(Sftp *sftp, CompletionReaddir *cmdreaddir)
+void sftpcompletion_readdir_complete_now(SftpCmd *cmd, Sftp *sftp)
 {
-    if (cmdreaddir->nnames > 0) {
-        qsort(cmdreaddir->names, cmdreaddir->nnames, sizeof(*cmdreaddir->names), completion_name_compare);
-        sftpcompletion_continue_completion(sftp->completion, cmdreaddir->names, cmdreaddir->nnames);
-        cmdreaddir->names = NULL;
-        cmdreaddir->nnames = 0;
-        cmdreaddir->namesize = 0;
+    CompletionReaddir *cmdreaddir = container_of(cmd, CompletionReaddir, cmd);
+    if (cmdreaddir->completed) {
+        return;
+    }
+    if (cmdreaddir->listing) {
+        sftplistcache_release(cmdreaddir->listing);
+        cmdreaddir->listing = NULL;
     }
+    cmdreaddir->completed = true;
+    sftpcompletion_continue_completion(sftp->completion, NULL);
 }
 
 static SftpCmd *completion_readdir_init(Sftp *sftp)
@@ -57,12 +53,11 @@ static SftpCmd *completion_readdir_init(Sftp *sftp)
 
     CompletionReaddir *cmdreaddir = snew(CompletionReaddir);
     cmdreaddir->dirh = NULL;
-    cmdreaddir->names = NULL;
-    cmdreaddir->nnames = 0;
-    cmdreaddir->namesize = 0;
+    cmdreaddir->line_dir = dupstr(line_dir);
+    cmdreaddir->listing = NULL;
+    cmdreaddir->completed = false;
 
     sftpcmd_clear_request(&cmdreaddir->cmd);
-    sftp_set_sending_backend(sftp);
     sftpcmd_set_request(&cmdreaddir->cmd, SSH_FXP_OPENDIR, fxp_opendir_send(line_dir));
     sftp_dup_utf8_free(line_dir, dir);
     return &cmdreaddir->cmd;
@@ -78,7 +73,11 @@ static bool completion_readdir_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp
         if (cmdreaddir->dirh == NULL) {
             return false;
         }
-        sftp_set_sending_backend(sftp);
+        if (cmdreaddir->completed) {
+            send_close(sftp, cmd, cmdreaddir->dirh);
+            return true;
+        }
+        cmdreaddir->listing = sftplistcache_begin(&sftp->listcache);
         sftpcmd_set_request(cmd, SSH_FXP_READDIR, fxp_readdir_send(cmdreaddir->dirh));
         return true;
     } else if (cmd->req_type == SSH_FXP_READDIR) {
@@ -87,7 +86,14 @@ static bool completion_readdir_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp
 
         if (names == NULL) {
             send_close(sftp, cmd, cmdreaddir->dirh);
-            continue_completion(sftp, cmdreaddir);
+            if (fxp_error_type() == SSH_FX_EOF && !cmdreaddir->completed) {
+                continue_completion(sftp, cmdreaddir);
+            }
+            return true;
+        }
+        if (cmdreaddir->completed) {
+            fxp_free_names(names);
+            send_close(sftp, cmd, cmdreaddir->dirh);
             return true;
         }
         if (names->nnames == 0) {
@@ -97,21 +103,14 @@ static bool completion_readdir_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp
             return true;
         }
 
-        sgrowarrayn(cmdreaddir->names, cmdreaddir->namesize, cmdreaddir->nnames, names->nnames);
-        for (size_t i = 0; i < (size_t)names->nnames; i++) {
-            struct fxp_name *fn = &names->names[i];
-            bool is_dir = (fn->attrs.flags & SSH_FILEXFER_ATTR_PERMISSIONS) &&
-                          ((fn->attrs.permissions & PERMS_DIRECTORY) == PERMS_DIRECTORY);
-            if (is_dir && (strcmp(fn->filename, ".") == 0 || strcmp(fn->filename, "..") == 0)) {
-                continue;
+        for (size_t i = 0; i < (size_t)names->nnames && cmdreaddir->listing; i++) {
+            if (!sftplistcache_add(cmdreaddir->listing, &names->names[i])) {
+                sftplistcache_release(cmdreaddir->listing);
+                cmdreaddir->listing = NULL;
             }
-            cmdreaddir->names[cmdreaddir->nnames].name = sftp_utf8_from_line(sftp->line_codepage, fn->filename);
-            cmdreaddir->names[cmdreaddir->nnames].is_dir = is_dir;
-            fn->filename = NULL;
-            cmdreaddir->nnames++;
         }
+        sftpcompletion_add_remote_names(sftp->completion, names->names, names->nnames);
         fxp_free_names(names);
-        sftp_set_sending_backend(sftp);
         sftpcmd_set_request(cmd, SSH_FXP_READDIR, fxp_readdir_send(cmdreaddir->dirh));
         return true;
     } else if (cmd->req_type == SSH_FXP_CLOSE) {
@@ -128,7 +127,10 @@ static void completion_readdir_free(SftpCmd *cmd)
     if (cmdreaddir->dirh) {
         sftp_free_fxphandle(cmdreaddir->dirh);
     }
-    free_name_list(cmdreaddir);
+    sfree((void *)cmdreaddir->line_dir);
+    if (cmdreaddir->listing) {
+        sftplistcache_release(cmdreaddir->listing);
+    }
     sfree(cmdreaddir);
 }
 
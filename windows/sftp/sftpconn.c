@@ -0,0 +1,574 @@
+#include "sftpconn.h"
+#include "sftpbe.h"
+#include "sftpcmd.h"
+#include "sftpfxp.h"
+#include "sftputil.h"
+#include "sftppktpool.h"
+
+typedef enum SftpConnState {
+    SFTPCONN_CONNECTING,    /* logging in, or waiting for FXP_VERSION, or
+                               running the command of sftpconn_exec() */
+    SFTPCONN_READY,         /* or the command has ended */
+    SFTPCONN_FAILED
+} SftpConnState;
+
+struct SftpConn {
+    Sftp *sftp;
+    int index;
+    SftpConnState state;
+    Seat seat;
+    Backend *ssh;
+    SftpFxp fxp;
+    SftpReceiver receiver;
+    int users;
+    const char *error;
+    bool exec;              /* of sftpconn_exec() */
+    strbuf *output;
+    int exitcode;
+};
+
+int sftpconn_default_count = 0;
+
+void sftpconn_pool_init(SftpConnPool *pool, LogContext *logctx, const char *host, int port, bool keepalive)
+{
+    memset(pool, 0, sizeof(SftpConnPool));
+    pool->count = sftpconn_default_count;
+    pool->logctx = logctx;
+    pool->host = dupstr(host);
+    pool->port = port;
+    pool->keepalive = keepalive;
+}
+
+static void free_answer(SftpConnAnswer *a)
+{
+    sfree((void *)a->prompt);
+    smemclr((void *)a->result, strlen(a->result));
+    sfree((void *)a->result);
+}
+
+static void conn_free(SftpConn *conn)
+{
+    if (conn->ssh) {
+        backend_free(conn->ssh);
+    }
+    sftp_receiver_uninit(&conn->receiver);
+    sftpfxp_uninit(&conn->fxp);
+    sfree((void *)conn->error);
+    if (conn->output) {
+        strbuf_free(conn->output);
+    }
+    sfree(conn);
+}
+
+static void forget_answers(SftpConnPool *pool)
+{
+    for (size_t i = 0; i < pool->nanswers; i++) {
+        free_answer(&pool->answers[i]);
+    }
+    sfree(pool->answers);
+    pool->answers = NULL;
+    pool->nanswers = pool->answersize = 0;
+}
+
+/* Wipes the answers once every extra connection is logged in or failed. */
+static void check_answers(SftpConnPool *pool)
+{
+    if (pool->nanswers == 0 || pool->n < pool->count) {
+        return;
+    }
+    for (int i = 0; i < pool->n; i++) {
+        if (pool->conns[i]->state == SFTPCONN_CONNECTING) {
+            return;
+        }
+    }
+    forget_answers(pool);
+}
+
+void sftpconn_pool_uninit(SftpConnPool *pool)
+{
+    for (int i = 0; i < pool->n; i++) {
+        conn_free(pool->conns[i]);
+    }
+    for (size_t i = 0; i < pool->nexecs; i++) {
+        delete_callbacks_for_context(pool->execs[i]);
+        conn_free(pool->execs[i]);
+    }
+    sfree(pool->execs);
+    forget_answers(pool);
+    sfree((void *)pool->hostkey);
+    sfree((void *)pool->host);
+    memset(pool, 0, sizeof(SftpConnPool));
+}
+
+static const char *find_answer(SftpConnPool *pool, const char *prompt)
+{
+    for (size_t i = 0; i < pool->nanswers; i++) {
+        if (strcmp(pool->answers[i].prompt, prompt) == 0) {
+            return pool->answers[i].result;
+        }
+    }
+    return NULL;
+}
+
+void sftpconn_pool_remember_answers(SftpConnPool *pool, prompts_t *p)
+{
+    if (pool->count == 0) {
+        return;
+    }
+    for (size_t i = 0; i < p->n_prompts; i++) {
+        prompt_t *pr = p->prompts[i];
+        SftpConnAnswer *a = NULL;
+        for (size_t j = 0; j < pool->nanswers && !a; j++) {
+            if (strcmp(pool->answers[j].prompt, pr->prompt) == 0) {
+                a = &pool->answers[j];
+                free_answer(a);
+            }
+        }
+        if (!a) {
+            sgrowarray(pool->answers, pool->answersize, pool->nanswers);
+            a = &pool->answers[pool->nanswers++];
+        }
+        a->prompt = dupstr(pr->prompt);
+        a->result = dupstr(prompt_get_result_ref(pr));
+    }
+}
+
+void sftpconn_pool_remember_hostkey(SftpConnPool *pool, const char *keytype, const char *keystr)
+{
+    sfree((void *)pool->hostkey);
+    pool->hostkey = dupcat(keytype, " ", keystr);
+}
+
+/* Lets the running command know, see conn_changed of SftpCmdVtable. */
+static void notify_command(SftpConn *conn)
+{
+    Sftp *sftp = conn->sftp;
+    if (!sftp->cmd || !sftp->cmd->vt->conn_changed) {
+        return;
+    }
+    SftpFxp *prev = sftpfxp_enter(&sftp->fxp);
+    if (!sftp->cmd->vt->conn_changed(sftp->cmd, sftp, conn)) {
+        sftp_command_done(sftp);
+    }
+    sftpfxp_leave(prev);
+}
+
+/* Hands a reply to the running command if it has one of the requests
+   pending on this connection. Only a command which spreads its requests
+   over the connections has no request of its own set. */
+static void deliver(SftpConn *conn, struct sftp_packet *pkt)
+{
+    Sftp *sftp = conn->sftp;
+    SftpFxp *prev = sftpfxp_enter(&conn->fxp);
+    bool done = false;
+    if (!sftp->cmd || sftp->cmd->req || !sftp_peek_request(sftp, pkt)) {
+        sftpfxp_pkt_free(pkt);
+    } else {
+        done = !sftpcmd_process_pkt(sftp->cmd, sftp, pkt);
+    }
+    sftpfxp_leave(prev);
+    if (done) {
+        prev = sftpfxp_enter(&sftp->fxp);
+        sftp_command_done(sftp);
+        sftpfxp_leave(prev);
+    }
+}
+
+/* The reply the server sends when it lost its connection, "connection
+   lost" with an empty language tag. */
+static struct sftp_packet *lost_reply(SftpPktPool *pool, unsigned id)
+{
+    static const char message[] = "connection lost";
+    size_t msglen = sizeof(message) - 1;
+    struct sftp_packet *pkt = sftppktpool_recv_prepare(pool, 1 + 4 + 4 + 4 + msglen + 4);
+    unsigned char *p = (unsigned char *)pkt->data;
+    p[0] = SSH_FXP_STATUS;
+    PUT_32BIT_MSB_FIRST(p + 1, id);
+    PUT_32BIT_MSB_FIRST(p + 5, SSH_FX_CONNECTION_LOST);
+    PUT_32BIT_MSB_FIRST(p + 9, msglen);
+    memcpy(p + 13, message, msglen);
+    PUT_32BIT_MSB_FIRST(p + 13 + msglen, 0);
+    sftp_recv_finish(pkt);
+    return pkt;
+}
+
+/* Answers every request pending on a failed connection, so the command
+   fails them like any other failed request. A request the command does not
+   take is freed; the requests it sends meanwhile, like the CLOSE of a
+   failed transfer, are answered in turn. */
+static void fail_requests(SftpConn *conn)
+{
+    unsigned id;
+    while (sftpreqtable_any(&conn->fxp.requests, &id)) {
+        deliver(conn, lost_reply(&conn->sftp->pktpool, id));
+        sfree(sftpreqtable_del(&conn->fxp.requests, id));
+    }
+}
+
+static void conn_failed(SftpConn *conn, const char *error, bool notify)
+{
+    if (conn->state == SFTPCONN_FAILED || (conn->exec && conn->state == SFTPCONN_READY)) {
+        return;
+    }
+    conn->state = SFTPCONN_FAILED;
+    conn->error = dupstr(error);
+    sftp_receiver_uninit(&conn->receiver);
+    check_answers(&conn->sftp->conns);
+    if (notify) {
+        fail_requests(conn);
+        notify_command(conn);
+    }
+}
+
+static size_t connseat_output(Seat *seat, SeatOutputType type, const void *data, size_t len)
+{
+    SftpConn *conn = container_of(seat, SftpConn, seat);
+    const char *received = (const char *)data;
+    struct sftp_packet *pkt;
+    if (type != SEAT_OUTPUT_STDOUT) {
+        return 0;
+    }
+    if (conn->exec) {
+        if (conn->state == SFTPCONN_CONNECTING) {
+            put_data(conn->output, data, min(len, SFTPCONN_EXEC_MAX_OUTPUT - conn->output->len));
+        }
+        return 0;
+    }
+    while (conn->state != SFTPCONN_FAILED && sftp_receive_pkt(&conn->receiver, conn->sftp->max_packet, &received, &len, &pkt)) {
+        if (!pkt) {
+            conn_failed(conn, "malformed packet", true);
+        } else if (conn->state == SFTPCONN_CONNECTING) {
+            bool version = (pkt->type == SSH_FXP_VERSION);
+            sftpfxp_pkt_free(pkt);
+            if (!version) {
+                conn_failed(conn, "did not receive FXP_VERSION", true);
+            } else {
+                conn->state = SFTPCONN_READY;
+                check_answers(&conn->sftp->conns);
+                notify_command(conn);
+            }
+        } else {
+            deliver(conn, pkt);
+        }
+    }
+    return 0;
+}
+
+static void connseat_notify_session_started(Seat *seat)
+{
+    SftpConn *conn = container_of(seat, SftpConn, seat);
+    if (conn->exec) {
+        return;
+    }
+    SftpFxp *prev = sftpfxp_enter(&conn->fxp);
+    sftp_send_init();
+    sftpfxp_leave(prev);
+}
+
+static void connseat_notify_remote_exit(Seat *seat)
+{
+    SftpConn *conn = container_of(seat, SftpConn, seat);
+    if (conn->exec && conn->state == SFTPCONN_CONNECTING) {
+        conn->exitcode = backend_exitcode(conn->ssh);
+        if (conn->exitcode < 0) {
+            conn_failed(conn, "the command ended without an exit code", true);
+            return;
+        }
+        conn->state = SFTPCONN_READY;
+        notify_command(conn);
+        return;
+    }
+    conn_failed(conn, "the server closed the connection", true);
+}
+
+static void connseat_connection_fatal(Seat *seat, const char *msg)
+{
+    SftpConn *conn = container_of(seat, SftpConn, seat);
+    conn_failed(conn, msg, true);
+}
+
+/* Every prompt gets the answer the user gave to the main connection, if
+   it is still kept. */
+static SeatPromptResult connseat_get_userpass_input(Seat *seat, prompts_t *p)
+{
+    SftpConn *conn = container_of(seat, SftpConn, seat);
+    SftpConnPool *pool = &conn->sftp->conns;
+    for (size_t i = 0; i < p->n_prompts; i++) {
+        if (pool->nanswers == 0) {
+            return SPR_SW_ABORT("the login asks for input, which extra connections get only if set with -sftpconnections");
+        }
+        const char *answer = find_answer(pool, p->prompts[i]->prompt);
+        if (!answer) {
+            return SPR_SW_ABORT("a prompt the main connection did not have");
+        }
+        prompt_set_result(p->prompts[i], answer);
+    }
+    return SPR_OK;
+}
+
+static SeatPromptResult connseat_confirm_ssh_host_key(
+    Seat *seat, const char *host, int port, const char *keytype,
+    char *keystr, SeatDialogText *text, HelpCtx helpctx,
+    void (*callback)(void *ctx, SeatPromptResult result), void *cbctx) {
+    SftpConn *conn = container_of(seat, SftpConn, seat);
+    const char *hostkey = conn->sftp->conns.hostkey;
+    size_t typelen = strlen(keytype);
+    if (hostkey && !strncmp(hostkey, keytype, typelen) && hostkey[typelen] == ' ' && !strcmp(hostkey + typelen + 1, keystr)) {
+        return SPR_OK;
+    }
+    return SPR_SW_ABORT("the host key differs from the one of the main connection");
+}
+
+static SeatPromptResult connseat_confirm_weak_crypto_primitive(
+    Seat *seat, SeatDialogText *text,
+    void (*callback)(void *ctx, SeatPromptResult result), void *ctx) {
+    SftpConn *conn = container_of(seat, SftpConn, seat);
+    if (conn->sftp->conns.weak_crypto_confirmed) {
+        return SPR_OK;
+    }
+    return SPR_SW_ABORT("a weak cryptographic primitive the main connection did not use");
+}
+
+static SeatPromptResult connseat_confirm_weak_cached_hostkey(
+    Seat *seat, SeatDialogText *text,
+    void (*callback)(void *ctx, SeatPromptResult result), void *ctx) {
+    SftpConn *conn = container_of(seat, SftpConn, seat);
+    if (conn->sftp->conns.weak_hostkey_confirmed) {
+        return SPR_OK;
+    }
+    return SPR_SW_ABORT("a weak host key the main connection did not use");
+}
+
+static const SeatVtable connseat_vt = {
+    .output = connseat_output,
+    .eof = nullseat_eof,
+    .sent = nullseat_sent,
+    .banner = nullseat_banner,
+    .get_userpass_input = connseat_get_userpass_input,
+    .notify_session_started = connseat_notify_session_started,
+    .notify_remote_exit = connseat_notify_remote_exit,
+    .notify_remote_disconnect = nullseat_notify_remote_disconnect,
+    .connection_fatal = connseat_connection_fatal,
+    .update_specials_menu = nullseat_update_specials_menu,
+    .get_ttymode = nullseat_get_ttymode,
+    .set_busy_status = nullseat_set_busy_status,
+    .confirm_ssh_host_key = connseat_confirm_ssh_host_key,
+    .confirm_weak_crypto_primitive = connseat_confirm_weak_crypto_primitive,
+    .confirm_weak_cached_hostkey = connseat_confirm_weak_cached_hostkey,
+    .prompt_descriptions = nullseat_prompt_descriptions,
+    .is_utf8 = nullseat_is_never_utf8,
+    .echoedit_update = nullseat_echoedit_update,
+    .get_x_display = nullseat_get_x_display,
+    .get_windowid = nullseat_get_windowid,
+    .get_window_pixel_size = nullseat_get_window_pixel_size,
+    .stripctrl_new = nullseat_stripctrl_new,
+    .set_trust_status = nullseat_set_trust_status,
+    .can_set_trust_status = nullseat_can_set_trust_status_no,
+    .has_mixed_input_stream = nullseat_has_mixed_input_stream_no,
+    .verbose = nullseat_verbose_no,
+    .interactive = nullseat_interactive_no,
+    .get_cursor_position = nullseat_get_cursor_position,
+};
+
+static SftpConn *conn_new(Sftp *sftp)
+{
+    SftpConn *conn = snew(SftpConn);
+    memset(conn, 0, sizeof(SftpConn));
+    conn->sftp = sftp;
+    conn->state = SFTPCONN_CONNECTING;
+    conn->seat.vt = &connseat_vt;
+    sftpfxp_init(&conn->fxp);
+    conn->fxp.listcache = &sftp->listcache;
+    conn->fxp.pktpool = &sftp->pktpool;
+    conn->receiver.pool = &sftp->pktpool;
+    return conn;
+}
+
+/* Connects with conf, which is freed. A connection sharing the main one's
+   SSH connection would gain nothing, so sharing is off. */
+static void conn_open(SftpConn *conn, Conf *conf)
+{
+    SftpConnPool *pool = &conn->sftp->conns;
+    conf_set_bool(conf, CONF_ssh_connection_sharing, false);
+    char *realhost = NULL;
+    char *err = backend_init(&ssh_backend, &conn->seat, &conn->ssh, pool->logctx, conf,
+                             pool->host, pool->port, &realhost, 0, pool->keepalive);
+    conf_free(conf);
+    sfree(realhost);
+    if (err) {
+        conn_failed(conn, err, false);
+        sfree(err);
+        return;
+    }
+    conn->fxp.backend = conn->ssh;
+}
+
+/* Opens the missing connections up to the count. */
+static void open_conns(Sftp *sftp)
+{
+    SftpConnPool *pool = &sftp->conns;
+    while (pool->n < pool->count) {
+        SftpConn *conn = conn_new(sftp);
+        conn->index = pool->n + 1;
+        pool->conns[pool->n++] = conn;
+        conn_open(conn, conf_copy(sftp->ssh_conf));
+    }
+}
+
+void sftpconn_start(Sftp *sftp)
+{
+    open_conns(sftp);
+    check_answers(&sftp->conns);
+}
+
+void sftpconn_set_count(Sftp *sftp, int count)
+{
+    SftpConnPool *pool = &sftp->conns;
+    int n = 0;
+    for (int i = 0; i < pool->n; i++) {
+        SftpConn *conn = pool->conns[i];
+        if (i >= count || conn->state == SFTPCONN_FAILED) {
+            conn_free(conn);
+        } else {
+            conn->index = n + 1;
+            pool->conns[n++] = conn;
+        }
+    }
+    pool->n = n;
+    pool->count = count;
+    check_answers(pool);
+}
+
+void sftpconn_print(Sftp *sftp)
+{
+    SftpConnPool *pool = &sftp->conns;
+    if (pool->count == 0) {
+        sftp_print(sftp->seat, SEAT_OUTPUT_STDOUT, "connections: no extra connections, transfers use the main connection");
+        return;
+    }
+    sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "connections: %d extra for transfers of %d MB or more", pool->count, SFTPCONN_MIN_SIZE / (1024*1024));
+    for (int i = 0; i < pool->count; i++) {
+        SftpConn *conn = (i < pool->n ? pool->conns[i] : NULL);
+        if (!conn) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "connection %d: not opened yet", i + 1);
+        } else if (conn->state == SFTPCONN_CONNECTING) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "connection %d: connecting", conn->index);
+        } else if (conn->state == SFTPCONN_READY) {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "connection %d: ready", conn->index);
+        } else {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "connection %d: failed: %s", conn->index, conn->error);
+        }
+    }
+}
+
+bool sftpconn_wait(Sftp *sftp, uint64_t size)
+{
+    SftpConnPool *pool = &sftp->conns;
+    if (size < SFTPCONN_MIN_SIZE) {
+        return false;
+    }
+    open_conns(sftp);
+    for (int i = 0; i < pool->n; i++) {
+        if (pool->conns[i]->state == SFTPCONN_CONNECTING) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SftpConn *sftpconn_acquire(Sftp *sftp, uint64_t size)
+{
+    SftpConnPool *pool = &sftp->conns;
+    SftpConn *best = NULL;
+    int users = pool->main_users;
+    for (int i = 0; i < pool->n && size >= SFTPCONN_MIN_SIZE; i++) {
+        SftpConn *conn = pool->conns[i];
+        if (conn->state == SFTPCONN_READY && conn->users < users) {
+            best = conn;
+            users = conn->users;
+        }
+    }
+    if (best) {
+        best->users++;
+    } else {
+        pool->main_users++;
+    }
+    return best;
+}
+
+void sftpconn_release(Sftp *sftp, SftpConn *conn)
+{
+    if (conn) {
+        conn->users--;
+    } else {
+        sftp->conns.main_users--;
+    }
+}
+
+SftpFxp *sftpconn_enter(Sftp *sftp, SftpConn *conn)
+{
+    return sftpfxp_enter(conn ? &conn->fxp : &sftp->fxp);
+}
+
+void sftpconn_clear_requests(Sftp *sftp)
+{
+    SftpConnPool *pool = &sftp->conns;
+    for (int i = 0; i < pool->n; i++) {
+        sftpfxp_free_pending_requests(&pool->conns[i]->fxp);
+    }
+}
+
+SftpConn *sftpconn_exec(Sftp *sftp, const char *command)
+{
+    SftpConnPool *pool = &sftp->conns;
+    SftpConn *conn = conn_new(sftp);
+    conn->exec = true;
+    conn->output = strbuf_new();
+    sgrowarray(pool->execs, pool->execsize, pool->nexecs);
+    pool->execs[pool->nexecs++] = conn;
+
+    Conf *conf = conf_copy(sftp->ssh_conf);
+    conf_set_str(conf, CONF_remote_cmd, command);
+    conf_set_bool(conf, CONF_ssh_subsys, false);
+    conf_set_str(conf, CONF_remote_cmd2, "");
+    conf_set_bool(conf, CONF_ssh_subsys2, false);
+    conn_open(conn, conf);
+    return conn;
+}
+
+bool sftpconn_exec_result(SftpConn *conn, const char **output, int *exitcode, const char **error)
+{
+    if (conn->state == SFTPCONN_CONNECTING) {
+        return false;
+    }
+    if (conn->state == SFTPCONN_FAILED) {
+        *output = NULL;
+        *exitcode = -1;
+        *error = conn->error;
+    } else {
+        *output = conn->output->s;
+        *exitcode = conn->exitcode;
+        *error = NULL;
+    }
+    return true;
+}
+
+static void exec_free_callback(void *ctx)
+{
+    SftpConn *conn = (SftpConn *)ctx;
+    SftpConnPool *pool = &conn->sftp->conns;
+    for (size_t i = 0; i < pool->nexecs; i++) {
+        if (pool->execs[i] == conn) {
+            pool->execs[i] = pool->execs[--pool->nexecs];
+            break;
+        }
+    }
+    conn_free(conn);
+}
+
+void sftpconn_exec_free(Sftp *sftp, SftpConn *conn)
+{
+    /* no more output or notifications meanwhile */
+    conn->state = SFTPCONN_FAILED;
+    queue_toplevel_callback(exec_free_callback, conn);
+}
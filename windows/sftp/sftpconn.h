@@ -0,0 +1,122 @@
+#ifndef SFTPCONN_H
+#define SFTPCONN_H
+
+#include "putty.h"
+
+/*
+ * Extra SSH connections for the bulk transfers, set with the "connections"
+ * command. A single SSH connection is often limited by its channel window
+ * or by its cipher running on one core, so get spreads its large files and
+ * segments over the main connection and up to SFTPCONN_MAX extra ones to
+ * the same server. They are opened when the first large transfer starts
+ * and stay open for the next ones. They accept only the host key the user
+ * accepted for the main connection. A connection which fails fails the
+ * requests pending on it and is not opened again until the count is set
+ * again. Every other command runs on the main connection.
+ *
+ * The answers the user gave to the login prompts of the main connection,
+ * passwords and passphrases among them, are kept only if extra connections
+ * are set before the login, with -sftpconnections, and those are opened
+ * right after it. The answers are wiped once every one of them is logged
+ * in or has failed. An extra connection which is asked anything it has no
+ * answer for fails and says so, which is all a login with a key from
+ * Pageant or without a passphrase needs.
+ *
+ * Every extra connection has its own SftpFxp. Its replies are handed to
+ * the running command with that SftpFxp bound, see sftpfxp.h, if the
+ * command has no request of its own set, and the command binds it with
+ * sftpconn_enter() to send requests there.
+ *
+ * A command can also run a shell command on the server, see
+ * sftpconn_exec(), over a connection of its own which logs in the same way
+ * but carries no SFTP session.
+ */
+
+#define SFTPCONN_MAX 8
+/* Smaller transfers stay on the main connection. */
+#define SFTPCONN_MIN_SIZE (4*1024*1024)
+/* The output of sftpconn_exec() kept, the rest is dropped. */
+#define SFTPCONN_EXEC_MAX_OUTPUT (1024*1024)
+
+/* The extra connections of a new session, -sftpconnections. */
+extern int sftpconn_default_count;
+
+typedef struct Sftp Sftp;
+typedef struct SftpFxp SftpFxp;
+typedef struct SftpConn SftpConn;
+
+typedef struct SftpConnAnswer {
+    const char *prompt;
+    const char *result;
+} SftpConnAnswer;
+
+typedef struct SftpConnPool {
+    int count;                  /* extra connections set by the user */
+    int n;                      /* opened so far, failed ones included */
+    SftpConn *conns[SFTPCONN_MAX];
+    int main_users;             /* transfers on the main connection */
+    SftpConn **execs;           /* of sftpconn_exec(), until freed */
+    size_t nexecs, execsize;
+
+    /* the target of the main connection */
+    LogContext *logctx;
+    const char *host;
+    int port;
+    bool keepalive;
+
+    /* what the main connection was asked, the session exists only if the
+       user accepted it; answers only until the extra connections are open */
+    SftpConnAnswer *answers;
+    size_t nanswers, answersize;
+    const char *hostkey;        /* "keytype keystr" */
+    bool weak_crypto_confirmed;
+    bool weak_hostkey_confirmed;
+} SftpConnPool;
+
+void sftpconn_pool_init(SftpConnPool *pool, LogContext *logctx, const char *host, int port, bool keepalive);
+void sftpconn_pool_uninit(SftpConnPool *pool);
+/* Keeps the answers to prompts of the main connection if extra
+   connections are set, the last answer to a prompt replacing an earlier
+   one. */
+void sftpconn_pool_remember_answers(SftpConnPool *pool, prompts_t *p);
+void sftpconn_pool_remember_hostkey(SftpConnPool *pool, const char *keytype, const char *keystr);
+
+/* Opens the extra connections set before the login, once the main
+   connection is logged in. */
+void sftpconn_start(Sftp *sftp);
+/* Sets the number of extra connections. The ones beyond it and the failed
+   ones are closed. Called while no command has a transfer running. */
+void sftpconn_set_count(Sftp *sftp, int count);
+/* Prints the count and the state of every extra connection. */
+void sftpconn_print(Sftp *sftp);
+
+/* Opens the extra connections if a transfer of size bytes would use them
+   and they are not open yet. Returns true while one is still connecting,
+   so the transfer can wait for it; the command learns about the outcome
+   from the conn_changed function of its vtable. */
+bool sftpconn_wait(Sftp *sftp, uint64_t size);
+/* The least busy connection for a transfer of size bytes, NULL for the
+   main connection, which has the transfer counted until
+   sftpconn_release(). */
+SftpConn *sftpconn_acquire(Sftp *sftp, uint64_t size);
+void sftpconn_release(Sftp *sftp, SftpConn *conn);
+/* Binds the SftpFxp of conn, or of the main connection if conn is NULL.
+   Returns the previous binding for sftpfxp_leave(). */
+SftpFxp *sftpconn_enter(Sftp *sftp, SftpConn *conn);
+/* Frees the requests pending on the extra connections, like the ones of
+   the main connection when a command ends. */
+void sftpconn_clear_requests(Sftp *sftp);
+
+/* Runs command on the server over a new connection. The running command
+   learns that it ended or failed from conn_changed, and then reads the
+   result with sftpconn_exec_result(). */
+SftpConn *sftpconn_exec(Sftp *sftp, const char *command);
+/* Returns false while the command runs. Once it ended, *output holds its
+   standard output, zero terminated, and *exitcode its exit code, or
+   *output is NULL and *error says why it did not run. */
+bool sftpconn_exec_result(SftpConn *conn, const char **output, int *exitcode, const char **error);
+/* Closes the connection, which is freed from a toplevel callback since
+   this may be called from one of its own callbacks. */
+void sftpconn_exec_free(Sftp *sftp, SftpConn *conn);
+
+#endif
@@ -0,0 +1,216 @@
+#include "sftpcrawler.h"
+#include "sftpfxp.h"
+#include "sftputil.h"
+
+static SftpCrawlDir *find_dir(SftpCrawler *c, const char *line_fname)
+{
+    for (size_t i = 0; i < c->ndirs; i++) {
+        if (!strcmp(c->dirs[i]->line_fname, line_fname)) {
+            return c->dirs[i];
+        }
+    }
+    return NULL;
+}
+
+static SftpCrawlDir *add_dir(SftpCrawler *c, const char *line_fname)
+{
+    SftpCrawlDir *d = snew(SftpCrawlDir);
+    memset(d, 0, sizeof(SftpCrawlDir));
+    sftpcmd_clear_request(&d->cmd);
+    d->line_fname = dupstr(line_fname);
+    sgrowarray(c->dirs, c->dirsize, c->ndirs);
+    c->dirs[c->ndirs++] = d;
+    return d;
+}
+
+static void remove_dir(SftpCrawler *c, size_t i)
+{
+    memmove(&c->dirs[i], &c->dirs[i+1], (c->ndirs - i - 1) * sizeof(*c->dirs));
+    c->ndirs--;
+}
+
+static int running_streams(SftpCrawler *c)
+{
+    int n = 0;
+    for (size_t i = 0; i < c->ndirs; i++) {
+        if (c->dirs[i]->started && !c->dirs[i]->done) {
+            n++;
+        }
+    }
+    return n;
+}
+
+static void start_dir(SftpCrawlDir *d, Sftp *sftp)
+{
+    d->started = true;
+    sftpcmd_set_request(&d->cmd, SSH_FXP_OPENDIR, fxp_opendir_send(d->line_fname));
+}
+
+static void start_queued(SftpCrawler *c, Sftp *sftp)
+{
+    if (c->stop) {
+        return;
+    }
+    int running = running_streams(c);
+    for (size_t i = 0; i < c->ndirs && running < c->max_streams; i++) {
+        if (!c->dirs[i]->started) {
+            start_dir(c->dirs[i], sftp);
+            running++;
+        }
+    }
+}
+
+static void finish_dir(SftpCrawler *c, SftpCrawlDir *d, Sftp *sftp, const char *error)
+{
+    d->done = true;
+    d->error = error;
+    if (d->handle) {
+        getput_close_send(c->closes, sftp, d->handle, d->line_fname);
+        d->handle = NULL;
+    }
+    start_queued(c, sftp);
+}
+
+void sftpcrawler_init(SftpCrawler *c, SftpCloseQueue *closes, int max_streams, size_t max_dirs)
+{
+    c->max_streams = max_streams;
+    c->max_dirs = max_dirs;
+    c->stop = false;
+    c->ndirs = 0;
+    c->dirsize = 0;
+    c->dirs = NULL;
+    c->closes = closes;
+}
+
+void sftpcrawler_uninit(SftpCrawler *c)
+{
+    for (size_t i = 0; i < c->ndirs; i++) {
+        sftpcrawldir_free(c->dirs[i]);
+    }
+    sfree(c->dirs);
+    c->dirs = NULL;
+    c->ndirs = 0;
+    c->dirsize = 0;
+}
+
+void sftpcrawler_prefetch(SftpCrawler *c, Sftp *sftp, const char *line_fname)
+{
+    if (c->stop || c->ndirs >= c->max_dirs || find_dir(c, line_fname)) {
+        return;
+    }
+    add_dir(c, line_fname);
+    start_queued(c, sftp);
+}
+
+void sftpcrawler_request(SftpCrawler *c, Sftp *sftp, const char *line_fname)
+{
+    SftpCrawlDir *d = find_dir(c, line_fname);
+    if (!d) {
+        d = add_dir(c, line_fname);
+    }
+    if (!d->started) {
+        start_dir(d, sftp);
+    }
+}
+
+SftpCrawlDir *sftpcrawler_take(SftpCrawler *c, Sftp *sftp, const char *line_fname)
+{
+    for (size_t i = 0; i < c->ndirs; i++) {
+        SftpCrawlDir *d = c->dirs[i];
+        if (!strcmp(d->line_fname, line_fname)) {
+            if (!d->done) {
+                return NULL;
+            }
+            remove_dir(c, i);
+            start_queued(c, sftp);
+            return d;
+        }
+    }
+    return NULL;
+}
+
+void sftpcrawldir_free(SftpCrawlDir *d)
+{
+    for (size_t i = 0; i < d->nnames; i++) {
+        sfree((void *)d->names[i]);
+    }
+    sfree(d->names);
+    sfree(d->attrs);
+    sfree((void *)d->error);
+    if (d->handle) {
+        sftp_free_fxphandle(d->handle);
+    }
+    sfree((void *)d->line_fname);
+    sfree(d);
+}
+
+bool sftpcrawler_process_pkt(SftpCrawler *c, Sftp *sftp, struct sftp_request *req, struct sftp_packet *pktin)
+{
+    SftpCrawlDir *d = NULL;
+    for (size_t i = 0; i < c->ndirs; i++) {
+        if (c->dirs[i]->cmd.req == req) {
+            d = c->dirs[i];
+            break;
+        }
+    }
+    if (!d) {
+        return false;
+    }
+    SftpCmd *cmd = &d->cmd;
+    sftp_find_request(pktin);
+
+    if (cmd->req_type == SSH_FXP_OPENDIR) {
+        d->handle = fxp_opendir_recv(pktin, cmd->req);
+        sftpcmd_clear_request(cmd);
+        if (!d->handle) {
+            finish_dir(c, d, sftp, dupprintf("unable to open directory: %s", fxp_error()));
+        } else if (c->stop) {
+            finish_dir(c, d, sftp, NULL);
+        } else {
+            sftpcmd_set_request(cmd, SSH_FXP_READDIR, fxp_readdir_send(d->handle));
+        }
+    } else if (cmd->req_type == SSH_FXP_READDIR) {
+        struct fxp_names *names = fxp_readdir_recv(pktin, cmd->req);
+        sftpcmd_clear_request(cmd);
+        if (names == NULL) {
+            finish_dir(c, d, sftp, (fxp_error_type() != SSH_FX_EOF ? dupprintf("reading directory: %s", fxp_error()) : NULL));
+            return true;
+        }
+        if (names->nnames == 0 || c->stop) {
+            fxp_free_names(names);
+            finish_dir(c, d, sftp, NULL);
+            return true;
+        }
+        sgrowarrayn(d->names, d->namesize, d->nnames, names->nnames);
+        sgrowarrayn(d->attrs, d->attrsize, d->nnames, names->nnames);
+        for (size_t i = 0; i < names->nnames; i++) {
+            if (strcmp(names->names[i].filename, ".") && strcmp(names->names[i].filename, "..")) {
+                d->attrs[d->nnames] = names->names[i].attrs;
+                d->names[d->nnames++] = names->names[i].filename;
+                names->names[i].filename = NULL;
+            }
+        }
+        fxp_free_names(names);
+        sftpcmd_set_request(cmd, SSH_FXP_READDIR, fxp_readdir_send(d->handle));
+    }
+    return true;
+}
+
+void sftpcrawler_stop(SftpCrawler *c)
+{
+    c->stop = true;
+    size_t j = 0;
+    for (size_t i = 0; i < c->ndirs; i++) {
+        if (c->dirs[i]->started) {
+            c->dirs[j++] = c->dirs[i];
+        } else {
+            sftpcrawldir_free(c->dirs[i]);
+        }
+    }
+    c->ndirs = j;
+}
+
+bool sftpcrawler_busy(SftpCrawler *c)
+{
+    return running_streams(c) > 0;
+}
@@ -0,0 +1,59 @@
+#ifndef SFTPCRAWLER_H
+#define SFTPCRAWLER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "sftpcmd.h"
+#include "sftpgetput.h"
+
+/*
+ * Reads remote directories ahead of a recursive get. Directories are queued
+ * in the order they are found and up to max_streams of them are read
+ * concurrently, so a tree is listed breadth first while the files found
+ * earlier are transferred. The consumer takes the listings in its own
+ * order, so the order of the transfer does not depend on which listing
+ * completes first.
+ */
+
+typedef struct SftpCrawlDir {
+    SftpCmd cmd;
+    const char *line_fname; //line codepage
+    struct fxp_handle *handle;
+    bool started;
+    bool done;
+    const char *error;
+    size_t nnames, namesize, attrsize;
+    const char **names; //line codepage
+    struct fxp_attrs *attrs;
+} SftpCrawlDir;
+
+typedef struct SftpCrawler {
+    int max_streams;
+    size_t max_dirs;
+    bool stop;
+    size_t ndirs, dirsize;
+    SftpCrawlDir **dirs;
+    SftpCloseQueue *closes;
+} SftpCrawler;
+
+void sftpcrawler_init(SftpCrawler *c, SftpCloseQueue *closes, int max_streams, size_t max_dirs);
+void sftpcrawler_uninit(SftpCrawler *c);
+
+/* Queues a directory to be read ahead, if there is room for it. */
+void sftpcrawler_prefetch(SftpCrawler *c, Sftp *sftp, const char *line_fname);
+/* Starts reading a directory now, ahead of the queue and the limits. */
+void sftpcrawler_request(SftpCrawler *c, Sftp *sftp, const char *line_fname);
+/* Returns the listing of a requested directory once it is complete and
+   removes it from the crawler, NULL while it is still being read. The
+   listing has to be freed with sftpcrawldir_free(). */
+SftpCrawlDir *sftpcrawler_take(SftpCrawler *c, Sftp *sftp, const char *line_fname);
+void sftpcrawldir_free(SftpCrawlDir *d);
+
+/* Returns true if req belongs to the crawler, pktin is consumed then. */
+bool sftpcrawler_process_pkt(SftpCrawler *c, Sftp *sftp, struct sftp_request *req, struct sftp_packet *pktin);
+/* Drops the queued directories and ends the running streams at their next
+   reply. */
+void sftpcrawler_stop(SftpCrawler *c);
+bool sftpcrawler_busy(SftpCrawler *c);
+
+#endif
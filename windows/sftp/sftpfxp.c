@@ -1,8 +1,130 @@
+#include "sftpbe.h"
+#include "tree234.h"
+
+static SftpFxp *current();
+static const char **current_error_message();
+static int *current_errtype();
+static void *add_request(unsigned *id, void *req);
+
+/* sftp_requests is the only tree of sftp.c, so its tree calls go to the
+   request table of the bound session instead. The table assigns the id in
+   add234(), count234() returning 0 skips the first fit id search of
+   sftp_alloc_request(). */
+static char requests_tree;
+#define newtree234(cmp) ((void)(cmp), (tree234 *)&requests_tree)
+#define freetree234(t) ((void)(t))
+#define count234(t) ((void)(t), 0)
+#define index234(t, i) ((void)(t), (void)(i), NULL)
+#define add234(t, e) add_request(&(e)->id, (e))
+#define find234(t, e, cmp) ((void)(cmp), sftpreqtable_find(&current()->requests, *(unsigned *)(e)))
+#define del234(t, e) sftpreqtable_del(&current()->requests, (e)->id)
+
+/* The requests changing a path invalidate the cached listings first, see
+   the wrappers below. */
+#define fxp_open_send fxp_open_send_original
+#define fxp_mkdir_send fxp_mkdir_send_original
+#define fxp_rmdir_send fxp_rmdir_send_original
+#define fxp_remove_send fxp_remove_send_original
+#define fxp_rename_send fxp_rename_send_original
+#define fxp_setstat_send fxp_setstat_send_original
+
+#define fxp_error_message (*current_error_message())
+#define fxp_errtype (*current_errtype())
 #include "ssh/sftp.c"
+#undef fxp_open_send
+#undef fxp_mkdir_send
+#undef fxp_rmdir_send
+#undef fxp_remove_send
+#undef fxp_rename_send
+#undef fxp_setstat_send
+#undef newtree234
+#undef freetree234
+#undef count234
+#undef index234
+#undef add234
+#undef find234
+#undef del234
 
-#include "sftpbe.h"
+#include "sftppktpool.h"
+#include "psftp.h"
 
-static Backend *sending_backend = NULL;
+/* The session bound to the calling thread. The pending requests and the
+   last error of PuTTY's sftp.c are redirected to it by the defines above. */
+static __thread SftpFxp *current_fxp = NULL;
+
+void sftpfxp_pkt_free(struct sftp_packet *pkt)
+{
+    sftppktpool_free(current_fxp ? current_fxp->pktpool : NULL, pkt);
+}
+
+static SftpFxp *current()
+{
+    assert(current_fxp);
+    return current_fxp;
+}
+
+static const char **current_error_message()
+{
+    return &current()->error_message;
+}
+
+static int *current_errtype()
+{
+    return &current()->errtype;
+}
+
+static void *add_request(unsigned *id, void *req)
+{
+    *id = sftpreqtable_add(&current()->requests, req);
+    sftpreqtable_set_owner(&current()->requests, *id, current()->owner);
+    return req;
+}
+
+static void invalidate(const char *path)
+{
+    if (current()->listcache) {
+        sftplistcache_invalidate(current()->listcache, path);
+    }
+}
+
+struct sftp_request *fxp_open_send(const char *path, int type, const struct fxp_attrs *attrs)
+{
+    if (type & (SSH_FXF_WRITE | SSH_FXF_CREAT | SSH_FXF_TRUNC)) {
+        invalidate(path);
+    }
+    return fxp_open_send_original(path, type, attrs);
+}
+
+struct sftp_request *fxp_mkdir_send(const char *path, const struct fxp_attrs *attrs)
+{
+    invalidate(path);
+    return fxp_mkdir_send_original(path, attrs);
+}
+
+struct sftp_request *fxp_rmdir_send(const char *path)
+{
+    invalidate(path);
+    return fxp_rmdir_send_original(path);
+}
+
+struct sftp_request *fxp_remove_send(const char *fname)
+{
+    invalidate(fname);
+    return fxp_remove_send_original(fname);
+}
+
+struct sftp_request *fxp_rename_send(const char *srcfname, const char *dstfname)
+{
+    invalidate(srcfname);
+    invalidate(dstfname);
+    return fxp_rename_send_original(srcfname, dstfname);
+}
+
+struct sftp_request *fxp_setstat_send(const char *fname, struct fxp_attrs attrs)
+{
+    invalidate(fname);
+    return fxp_setstat_send_original(fname, attrs);
+}
 
 bool sftp_recvdata(char *buf, size_t len)
 {
@@ -11,52 +133,448 @@ bool sftp_recvdata(char *buf, size_t len)
 
 bool sftp_senddata(const char *buf, size_t len)
 {
-    backend_send(sending_backend, buf, len);
+    backend_send(current()->backend, buf, len);
     return true;
 }
 
 size_t sftp_sendbuffer(void)
 {
-    return backend_sendbuffer(sending_backend);
+    return backend_sendbuffer(current()->backend);
+}
+
+void sftpfxp_init(SftpFxp *fxp)
+{
+    fxp->backend = NULL;
+    sftpreqtable_init(&fxp->requests);
+    fxp->error_message = NULL;
+    fxp->errtype = 0;
+    fxp->listcache = NULL;
+    fxp->pktpool = NULL;
+    fxp->owner = NULL;
+}
+
+static void free_request(void *req)
+{
+    sfree(req);
+}
+
+void sftpfxp_free_pending_requests(SftpFxp *fxp)
+{
+    sftpreqtable_clear(&fxp->requests, free_request);
+}
+
+void sftpfxp_uninit(SftpFxp *fxp)
+{
+    sftpfxp_free_pending_requests(fxp);
+    sftpreqtable_uninit(&fxp->requests);
+}
+
+SftpFxp *sftpfxp_enter(SftpFxp *fxp)
+{
+    SftpFxp *prev = current_fxp;
+    current_fxp = fxp;
+    return prev;
+}
+
+void sftpfxp_leave(SftpFxp *prev)
+{
+    current_fxp = prev;
+}
+
+/* Finds the pending request a reply belongs to without consuming it, so
+   commands with several requests in flight can route the packet before
+   sftp_find_request() or xfer_*_gotpkt() takes it. */
+static struct sftp_request *peek_request(SftpReqTable *requests, struct sftp_packet *pktin)
+{
+    if (pktin->length < 5) {
+        return NULL;
+    }
+    unsigned id = GET_32BIT_MSB_FIRST(pktin->data + 1);
+    struct sftp_request *req = sftpreqtable_find(requests, id);
+    if (!req || !req->registered) {
+        return NULL;
+    }
+    return req;
+}
+
+struct sftp_request *sftp_peek_request(Sftp *sftp, struct sftp_packet *pktin)
+{
+    return peek_request(&current()->requests, pktin);
+}
+
+bool xfer_owns_request(struct fxp_xfer *xfer, struct sftp_request *req)
+{
+    struct req *rr = (struct req *)fxp_get_userdata(req);
+    for (struct req *r = xfer->head; r; r = r->next) {
+        if (r == rr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void *sftpfxp_set_owner(void *owner)
+{
+    void *prev = current()->owner;
+    current()->owner = owner;
+    return prev;
 }
 
-void sftp_set_sending_backend(Sftp *sftp)
+void *sftp_request_owner(struct sftp_request *req)
 {
-    sending_backend = sftp->ssh;
-    sftp_requests = sftp->requests;
+    return sftpreqtable_owner(&current()->requests, req->id);
 }
 
-void sftp_clear_sending_backend()
+/* The READ reply is kept with its request and the data is handed out in
+   place, rr.buffer is not used. */
+typedef struct WindowReq {
+    struct req rr;
+    struct sftp_packet *pkt;
+    const char *data;
+} WindowReq;
+
+/* PuTTY's xfer_download_queue() with the window and request size taken
+   from w. The requests outstanding or not consumed yet stay within space,
+   the room the consumer has for the data. */
+void xfer_download_queue_window(struct fxp_xfer *xfer, SftpXferWindow *w, size_t space)
 {
-    sending_backend = NULL;
+    xfer->req_maxsize = w->window;
+    while (xfer->req_totalsize < xfer->req_maxsize && (size_t)xfer->req_totalsize + w->chunk <= space &&
+           !xfer->eof && !xfer->err) {
+        if (xfer->offset >= xfer->filesize) {
+            xfer->eof = true;
+            break;
+        }
+        WindowReq *wr = snew(WindowReq);
+        wr->pkt = NULL;
+        wr->data = NULL;
+        struct req *rr = &wr->rr;
+        rr->offset = xfer->offset;
+        rr->complete = 0;
+        if (xfer->tail) {
+            xfer->tail->next = rr;
+            rr->prev = xfer->tail;
+        } else {
+            xfer->head = rr;
+            rr->prev = NULL;
+        }
+        xfer->tail = rr;
+        rr->next = NULL;
+
+        rr->len = w->chunk;
+        if ((uint64_t)rr->len > xfer->filesize - rr->offset) {
+            rr->len = xfer->filesize - rr->offset;
+        }
+        rr->buffer = NULL;
+        struct sftp_request *req = fxp_read_send(xfer->fh, rr->offset, rr->len);
+        sftp_register(req);
+        fxp_set_userdata(req, rr);
+        xfer_window_sent(w, rr->offset);
+
+        xfer->offset += rr->len;
+        xfer->req_totalsize += rr->len;
+    }
 }
 
-void sftp_init_requests(Sftp *sftp)
+struct fxp_xfer *xfer_download_init_window(struct fxp_handle *fh, uint64_t offset, SftpXferWindow *w, size_t space)
 {
-    sftp->requests = newtree234(sftp_reqcmp);
+    struct fxp_xfer *xfer = xfer_init(fh, offset);
+    xfer->eof = false;
+    xfer_window_start(w);
+    xfer_download_queue_window(xfer, w, space);
+    return xfer;
 }
 
-void sftp_uninit_requests(Sftp *sftp)
+struct fxp_xfer *xfer_download_range_window(struct fxp_handle *fh, uint64_t offset, uint64_t end, SftpXferWindow *w, size_t space)
 {
-    freetree234(sftp->requests);
+    struct fxp_xfer *xfer = xfer_init(fh, offset);
+    xfer->eof = false;
+    xfer->filesize = end;
+    xfer_window_start(w);
+    xfer_download_queue_window(xfer, w, space);
+    return xfer;
 }
 
-void sftp_free_pending_requests(Sftp *sftp)
+/* PuTTY's xfer_download_gotpkt() without copying the data out of the DATA
+   reply, the packet is kept until xfer_download_data_window() hands it
+   out. */
+int xfer_download_gotpkt_window(struct fxp_xfer *xfer, SftpXferWindow *w, struct sftp_packet *pktin)
 {
-    void *req;
-    while ((req = delpos234(sftp->requests, 0))) {
-        sfree(req);
+    struct sftp_request *rreq = sftp_find_request(pktin);
+    if (!rreq) {
+        return INT_MIN;
+    }
+    struct req *rr = (struct req *)fxp_get_userdata(rreq);
+    if (!rr) {
+        fxp_internal_error("request ID is not part of the current download");
+        return INT_MIN;
     }
+    WindowReq *wr = container_of(rr, WindowReq, rr);
+    sfree(rreq);
+
+    rr->retlen = -1;
+    if (pktin->type == SSH_FXP_DATA) {
+        ptrlen data = get_string(pktin);
+        if (get_err(pktin)) {
+            fxp_internal_error("READ returned malformed SSH_FXP_DATA packet");
+        } else if (data.len > (size_t)rr->len) {
+            fxp_internal_error("READ returned more bytes than requested");
+        } else {
+            rr->retlen = data.len;
+        }
+        if (rr->retlen > 0) {
+            wr->pkt = pktin;
+            wr->data = data.ptr;
+        } else {
+            sftpfxp_pkt_free(pktin);
+        }
+    } else {
+        fxp_got_status(pktin);
+        sftpfxp_pkt_free(pktin);
+    }
+
+    rr->complete = 1;
+    if ((rr->retlen < 0 && fxp_error_type() == SSH_FX_EOF) || rr->retlen == 0) {
+        xfer->eof = true;
+        rr->retlen = 0;
+    } else if (rr->retlen < 0) {
+        xfer_set_error(xfer);
+        rr->complete = -1;
+        return -1;
+    }
+    xfer_window_acked(w, rr->offset, rr->retlen);
+
+    if (rr->retlen > 0 && xfer->furthestdata < rr->offset) {
+        xfer->furthestdata = rr->offset;
+    }
+    if (rr->retlen < rr->len) {
+        uint64_t filesize = rr->offset + rr->retlen;
+        if (xfer->filesize > filesize) {
+            xfer->filesize = filesize;
+        }
+    }
+    if (xfer->furthestdata > xfer->filesize) {
+        fxp_error_message = "received a short buffer from FXP_READ, but not at EOF";
+        fxp_errtype = -1;
+        xfer_set_error(xfer);
+        return -1;
+    }
+    return 1;
 }
 
-bool xfer_download_data_wrapper(struct fxp_xfer *xfer, void **buf, int *len)
+bool xfer_download_data_window(struct fxp_xfer *xfer, struct sftp_packet **pkt, const void **data, int *len)
 {
-    // The rr->buffer is not freed by xfer_download_data when rr->complete < 0
-    // Here we pre-free such rr->buffer-s.
-    struct req *rr = xfer->head;
-    while (rr && rr->complete < 0) {
-        sfree(rr->buffer);
-        rr = rr->next;
+    while (xfer->head && xfer->head->complete) {
+        struct req *rr = xfer->head;
+        WindowReq *wr = container_of(rr, WindowReq, rr);
+        xfer->head = rr->next;
+        if (xfer->head) {
+            xfer->head->prev = NULL;
+        } else {
+            xfer->tail = NULL;
+        }
+        xfer->req_totalsize -= rr->len;
+        *pkt = wr->pkt;
+        *data = wr->data;
+        *len = rr->retlen;
+        sfree(wr);
+        if (*pkt) {
+            return true;
+        }
     }
-    return xfer_download_data(xfer, buf, len);
+    return false;
+}
+
+void xfer_download_cleanup_window(struct fxp_xfer *xfer)
+{
+    for (struct req *rr = xfer->head; rr; rr = rr->next) {
+        WindowReq *wr = container_of(rr, WindowReq, rr);
+        if (wr->pkt) {
+            sftpfxp_pkt_free(wr->pkt);
+            wr->pkt = NULL;
+        }
+    }
+    xfer_cleanup(xfer);
+}
+
+struct fxp_xfer *xfer_upload_init_window(struct fxp_handle *fh, uint64_t offset, SftpXferWindow *w)
+{
+    xfer_window_start(w);
+    return xfer_upload_init(fh, offset);
+}
+
+bool xfer_upload_ready_window(struct fxp_xfer *xfer, SftpXferWindow *w)
+{
+    return xfer_upload_ready(xfer) && xfer->req_totalsize < w->window;
+}
+
+/* xfer_upload_data() reading the data straight into the WRITE packet, so
+   the data is copied only once before the SSH layer. The packet is sized
+   for the data first and the header is written in front of it once the
+   read succeeded. Returns the length read, 0 at the end of the file or -1
+   on a read error. */
+int xfer_upload_file_window(struct fxp_xfer *xfer, SftpXferWindow *w, RFile *file, BinarySink *hash)
+{
+    struct sftp_packet *pktout = sftp_pkt_init(SSH_FXP_WRITE);
+    size_t datapos = pktout->length + 4 + 4 + xfer->fh->hlen + 8 + 4;
+    if (pktout->maxlen < datapos + w->chunk) {
+        pktout->maxlen = datapos + w->chunk;
+        pktout->data = sresize(pktout->data, pktout->maxlen, char);
+    }
+    int len = read_from_file(file, pktout->data + datapos, w->chunk);
+    if (len <= 0) {
+        sftpfxp_pkt_free(pktout);
+        return len;
+    }
+    if (hash) {
+        BinarySink_put_data(hash, pktout->data + datapos, len);
+    }
+
+    struct sftp_request *req = sftp_alloc_request();
+    put_uint32(pktout, req->id);
+    put_string(pktout, xfer->fh->hstring, xfer->fh->hlen);
+    put_uint64(pktout, xfer->offset);
+    put_uint32(pktout, len);
+    assert(pktout->length == datapos);
+    pktout->length += len;
+
+    struct req *rr = snew(struct req);
+    rr->offset = xfer->offset;
+    rr->complete = 0;
+    if (xfer->tail) {
+        xfer->tail->next = rr;
+        rr->prev = xfer->tail;
+    } else {
+        xfer->head = rr;
+        rr->prev = NULL;
+    }
+    xfer->tail = rr;
+    rr->next = NULL;
+    rr->len = len;
+    rr->buffer = NULL;
+    sftp_register(req);
+    fxp_set_userdata(req, rr);
+    xfer_window_sent(w, rr->offset);
+    sftp_send(pktout);
+
+    xfer->offset += rr->len;
+    xfer->req_totalsize += rr->len;
+    return len;
+}
+
+int xfer_upload_gotpkt_window(struct fxp_xfer *xfer, SftpXferWindow *w, struct sftp_packet *pktin)
+{
+    struct sftp_request *req = peek_request(&current()->requests, pktin);
+    struct req *rr = (req ? (struct req *)fxp_get_userdata(req) : NULL);
+    uint64_t offset = (rr ? rr->offset : 0);
+    int len = (rr ? rr->len : 0);
+    int ret = xfer_upload_gotpkt(xfer, pktin);
+    if (rr && ret > 0) {
+        xfer_window_acked(w, offset, len);
+    }
+    return ret;
+}
+
+void xfer_upload_data_window(struct fxp_xfer *xfer, SftpXferWindow *w, const void *data, int len)
+{
+    xfer_window_sent(w, xfer->offset);
+    xfer_upload_data(xfer, (char *)data, len);
+}
+
+size_t xfer_upload_space_window(struct fxp_xfer *xfer, SftpXferWindow *w)
+{
+    return (xfer->req_totalsize < w->window ? w->window - xfer->req_totalsize : 0);
+}
+
+struct sftp_request *fxp_copy_data_send(struct fxp_handle *from, uint64_t from_offset, uint64_t length,
+                                        struct fxp_handle *to, uint64_t to_offset)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "copy-data");
+    put_string(pktout, from->hstring, from->hlen);
+    put_uint64(pktout, from_offset);
+    put_uint64(pktout, length);
+    put_string(pktout, to->hstring, to->hlen);
+    put_uint64(pktout, to_offset);
+    sftp_send(pktout);
+    return req;
+}
+
+bool fxp_copy_data_recv(struct sftp_packet *pktin, struct sftp_request *req)
+{
+    sfree(req);
+    fxp_got_status(pktin);
+    sftpfxp_pkt_free(pktin);
+    return fxp_errtype == SSH_FX_OK;
+}
+
+struct sftp_request *fxp_check_file_send(struct fxp_handle *fh, const char *algs, uint64_t offset, uint64_t length)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "check-file-handle");
+    put_string(pktout, fh->hstring, fh->hlen);
+    put_stringz(pktout, algs);
+    put_uint64(pktout, offset);
+    put_uint64(pktout, length);
+    put_uint32(pktout, 0);      /* block size: one hash of the range */
+    sftp_send(pktout);
+    return req;
+}
+
+/* The reply is the string "check-file", the algorithm and the hash up to
+   the end of the packet. */
+bool fxp_check_file_recv(struct sftp_packet *pktin, struct sftp_request *req, char **alg, strbuf *hash)
+{
+    sfree(req);
+    if (pktin->type != SSH_FXP_EXTENDED_REPLY) {
+        fxp_got_status(pktin);
+        sftpfxp_pkt_free(pktin);
+        return false;
+    }
+    get_string(pktin);
+    ptrlen name = get_string(pktin);
+    if (get_err(pktin)) {
+        fxp_internal_error("malformed check-file reply");
+        sftpfxp_pkt_free(pktin);
+        return false;
+    }
+    *alg = mkstr(name);
+    put_datapl(hash, get_data(pktin, get_avail(pktin)));
+    sftpfxp_pkt_free(pktin);
+    return true;
+}
+
+struct sftp_request *fxp_limits_send(void)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "limits@openssh.com");
+    sftp_send(pktout);
+    return req;
+}
+
+bool fxp_limits_recv(struct sftp_packet *pktin, struct sftp_request *req, SftpServerLimits *limits)
+{
+    sfree(req);
+    if (pktin->type != SSH_FXP_EXTENDED_REPLY) {
+        fxp_got_status(pktin);
+        sftpfxp_pkt_free(pktin);
+        return false;
+    }
+    limits->max_packet = get_uint64(pktin);
+    limits->max_read = get_uint64(pktin);
+    limits->max_write = get_uint64(pktin);
+    limits->max_handles = get_uint64(pktin);
+    if (get_err(pktin)) {
+        fxp_internal_error("malformed limits@openssh.com reply");
+        sftpfxp_pkt_free(pktin);
+        return false;
+    }
+    sftpfxp_pkt_free(pktin);
+    return true;
 }
@@ -1,15 +1,77 @@
 #ifndef SFTPFXP_H
 #define SFTPFXP_H
 
+#include "sftpxferwindow.h"
+
 typedef struct Sftp Sftp;
 struct fxp_xfer;
 
-void sftp_set_sending_backend(Sftp *sftp);
+/* The fxp_* functions of PuTTY work on the SftpFxp bound to the calling
+   thread. The entry points of a session bind its state with
+   sftpfxp_enter() and restore the previous binding with sftpfxp_leave(). */
+typedef struct SftpFxp SftpFxp;
+void sftpfxp_init(SftpFxp *fxp);
+void sftpfxp_uninit(SftpFxp *fxp);
+void sftpfxp_free_pending_requests(SftpFxp *fxp);
+SftpFxp *sftpfxp_enter(SftpFxp *fxp);
+void sftpfxp_leave(SftpFxp *prev);
+
+struct sftp_packet;
+struct sftp_request;
+/* Frees a packet into the packet pool of the bound session, or at once
+   without a bound session, see sftppktpool.h. */
+void sftpfxp_pkt_free(struct sftp_packet *pkt);
+/* Looks the reply up in the bound SftpFxp, which is the one of the
+   connection the reply came from, see sftpconn.h. */
+struct sftp_request *sftp_peek_request(Sftp *sftp, struct sftp_packet *pktin);
+bool xfer_owns_request(struct fxp_xfer *xfer, struct sftp_request *req);
+/* The requests the bound SftpFxp sends from now on carry owner, so a
+   command with many requests in flight finds where a reply goes from its
+   request alone. Returns the previous owner to restore. */
+void *sftpfxp_set_owner(void *owner);
+void *sftp_request_owner(struct sftp_request *req);
+
+/* The xfer functions with the outstanding requests sized by an adaptive
+   window, see sftpxferwindow.h. */
+struct fxp_handle;
+struct fxp_xfer *xfer_download_init_window(struct fxp_handle *fh, uint64_t offset, SftpXferWindow *w, size_t space);
+/* A download which stops at end, the READs are not sent beyond it. */
+struct fxp_xfer *xfer_download_range_window(struct fxp_handle *fh, uint64_t offset, uint64_t end, SftpXferWindow *w, size_t space);
+void xfer_download_queue_window(struct fxp_xfer *xfer, SftpXferWindow *w, size_t space);
+int xfer_download_gotpkt_window(struct fxp_xfer *xfer, SftpXferWindow *w, struct sftp_packet *pktin);
+/* Hands out the data of the next READ reply in order. The data points into
+   *pkt, which the caller frees with sftpfxp_pkt_free(). */
+bool xfer_download_data_window(struct fxp_xfer *xfer, struct sftp_packet **pkt, const void **data, int *len);
+void xfer_download_cleanup_window(struct fxp_xfer *xfer);
+struct fxp_xfer *xfer_upload_init_window(struct fxp_handle *fh, uint64_t offset, SftpXferWindow *w);
+bool xfer_upload_ready_window(struct fxp_xfer *xfer, SftpXferWindow *w);
+typedef struct RFile RFile;
+struct BinarySink;
+/* Sends a WRITE of the next data of file, which also goes to hash unless
+   it is NULL. */
+int xfer_upload_file_window(struct fxp_xfer *xfer, SftpXferWindow *w, RFile *file, struct BinarySink *hash);
+int xfer_upload_gotpkt_window(struct fxp_xfer *xfer, SftpXferWindow *w, struct sftp_packet *pktin);
+/* Uploads data which came from elsewhere, a download on the same channel
+   say, whose queue is kept within the space the window has left. */
+void xfer_upload_data_window(struct fxp_xfer *xfer, SftpXferWindow *w, const void *data, int len);
+size_t xfer_upload_space_window(struct fxp_xfer *xfer, SftpXferWindow *w);
+
+/* The copy-data extension: the server copies length bytes, up to the end
+   of the file if 0, from one handle to the other. */
+struct sftp_request *fxp_copy_data_send(struct fxp_handle *from, uint64_t from_offset, uint64_t length,
+                                        struct fxp_handle *to, uint64_t to_offset);
+bool fxp_copy_data_recv(struct sftp_packet *pktin, struct sftp_request *req);
+
+/* The check-file-handle request of the check-file extension: the server
+   hashes length bytes from offset, up to the end of the file if 0, with
+   the first algorithm of the comma separated list it supports. */
+struct sftp_request *fxp_check_file_send(struct fxp_handle *fh, const char *algs, uint64_t offset, uint64_t length);
+/* Returns the algorithm the server used, to be freed, and the hash. */
+bool fxp_check_file_recv(struct sftp_packet *pktin, struct sftp_request *req, char **alg, struct strbuf *hash);
 
-void sftp_init_requests(Sftp *sftp);
-void sftp_uninit_requests(Sftp *sftp);
-void sftp_free_pending_requests(Sftp *sftp);
-bool xfer_download_data_wrapper(struct fxp_xfer *xfer, void **buf, int *len);
+/* The limits@openssh.com extension. */
+struct sftp_request *fxp_limits_send(void);
+bool fxp_limits_recv(struct sftp_packet *pktin, struct sftp_request *req, SftpServerLimits *limits);
 
 #include "ssh/sftp.h"
 
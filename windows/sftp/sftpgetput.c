@@ -2,6 +2,7 @@
 #include "sftpcmd.h"
 #include "sftputil.h"
 #include "sftpunicode.h"
+#include "sftpfxp.h"
 
 SftpDir *sftpdirstack_top(SftpDirStack *dirstack)
 {
@@ -23,11 +24,23 @@ SftpDir *sftpdirstack_pop(SftpDirStack *dirstack)
     } else {
         sfree((void *)dir->fname);
     }
-    sfree((void *)dir->outfname);
     for (int i = 0; i < dir->nnames; i++) {
         sfree((void *)dir->ournames[i]);
     }
     sfree(dir->ournames);
+    sfree(dir->ourattrs);
+    if (dir->local) {
+        sftplocalsnap_free(dir->local);
+    }
+    if (dir->line_outfname) {
+        sftp_dup_utf8_free(dir->line_outfname, dir->outfname);
+    }
+    sfree((void *)dir->outfname);
+    for (size_t i = 0; i < dir->nremote; i++) {
+        sfree((void *)dir->remotenames[i]);
+    }
+    sfree(dir->remotenames);
+    sfree(dir->remoteattrs);
     dirstack->top--;
     return sftpdirstack_top(dirstack);
 }
@@ -54,9 +67,32 @@ void sftpdirstack_uninit(SftpDirStack *dirstack)
     sfree(dirstack->stack);
 }
 
-bool getput_parse_args(Sftp *sftp, int *first_file, bool *recurse)
+/* Parses the number of the option at argument i, between 1 and max. */
+static bool parse_count(Sftp *sftp, int i, int max, int *count)
+{
+    char *end = NULL;
+    long n = (i+1 < sftp->args.argc ? strtol(sftp->args.argv[i+1], &end, 10) : 0);
+    if (!end || *end || n < 1 || n > max) {
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: option '%s' expects a number between 1 and %d", sftp->args.argv[0], sftp->args.argv[i], max);
+        return false;
+    }
+    *count = (int)n;
+    return true;
+}
+
+bool getput_parse_jobs(Sftp *sftp, int i, int *jobs)
+{
+    return parse_count(sftp, i, GETPUT_MAX_JOBS, jobs);
+}
+
+bool getput_parse_args(Sftp *sftp, int *first_file, bool *recurse, int *jobs, int *segments, bool *verify)
 {
     *recurse = false;
+    *verify = false;
+    *jobs = GETPUT_DEFAULT_JOBS;
+    if (segments) {
+        *segments = 1;
+    }
     int i = 1;
     while (i < sftp->args.argc && sftp->args.argv[i][0] == '-') {
         if (!strcmp(sftp->args.argv[i], "--")) {
@@ -65,6 +101,18 @@ bool getput_parse_args(Sftp *sftp, int *first_file, bool *recurse)
             break;
         } else if (!strcmp(sftp->args.argv[i], "-r")) {
             *recurse = true;
+        } else if (!strcmp(sftp->args.argv[i], "-c")) {
+            *verify = true;
+        } else if (!strcmp(sftp->args.argv[i], "-j")) {
+            if (!getput_parse_jobs(sftp, i, jobs)) {
+                return NULL;
+            }
+            i++;
+        } else if (segments && !strcmp(sftp->args.argv[i], "-P")) {
+            if (!parse_count(sftp, i, SFTPSEGMENTS_MAX, segments)) {
+                return NULL;
+            }
+            i++;
         } else {
             sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: unrecognised option '%s'", sftp->args.argv[0], sftp->args.argv[i]);
             return NULL;
@@ -87,7 +135,147 @@ static int bare_name_compare(const void *av, const void *bv)
     return strcmp(*a, *b);
 }
 
+typedef struct SftpDirEntry {
+    const char *name;
+    struct fxp_attrs attrs;
+} SftpDirEntry;
+
+static int entry_name_compare(const void *av, const void *bv)
+{
+    const SftpDirEntry *a = (const SftpDirEntry *) av;
+    const SftpDirEntry *b = (const SftpDirEntry *) bv;
+    return strcmp(a->name, b->name);
+}
+
+static void sort_names(const char **names, struct fxp_attrs *attrs, size_t n)
+{
+    if (!attrs) {
+        qsort(names, n, sizeof(*names), bare_name_compare);
+        return;
+    }
+    SftpDirEntry *entries = snewn(n, SftpDirEntry);
+    for (size_t i = 0; i < n; i++) {
+        entries[i].name = names[i];
+        entries[i].attrs = attrs[i];
+    }
+    qsort(entries, n, sizeof(*entries), entry_name_compare);
+    for (size_t i = 0; i < n; i++) {
+        names[i] = entries[i].name;
+        attrs[i] = entries[i].attrs;
+    }
+    sfree(entries);
+}
+
 void getput_sort_dir_names(SftpDir *dir)
 {
-    qsort(dir->ournames, dir->nnames, sizeof(*dir->ournames), bare_name_compare);
+    sort_names(dir->ournames, dir->ourattrs, dir->nnames);
+}
+
+void getput_sort_remote_names(SftpDir *dir)
+{
+    sort_names(dir->remotenames, dir->remoteattrs, dir->nremote);
+}
+
+const struct fxp_attrs *getput_find_remote(SftpDir *dir, const char *name)
+{
+    size_t low = 0, high = dir->nremote;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        int cmp = strcmp(name, dir->remotenames[mid]);
+        if (cmp == 0) {
+            return &dir->remoteattrs[mid];
+        } else if (cmp < 0) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+bool getput_sync_unchanged(const struct fxp_attrs *attrs, const struct fxp_attrs *copy_attrs)
+{
+    if (!copy_attrs || !(attrs->flags & SSH_FILEXFER_ATTR_SIZE) || !(copy_attrs->flags & SSH_FILEXFER_ATTR_SIZE)) {
+        return false;
+    }
+    if ((copy_attrs->flags & SSH_FILEXFER_ATTR_PERMISSIONS) && (copy_attrs->permissions & 0170000) != 0100000) {
+        return false;
+    }
+    if (attrs->size != copy_attrs->size) {
+        return false;
+    }
+    if ((attrs->flags & SSH_FILEXFER_ATTR_ACMODTIME) && (copy_attrs->flags & SSH_FILEXFER_ATTR_ACMODTIME)) {
+        return attrs->mtime == copy_attrs->mtime;
+    }
+    return true;
+}
+
+void getput_sync_summary(const GetPutSync *sync, Seat *seat)
+{
+    sftp_printf(seat, SEAT_OUTPUT_STDOUT, "sync: %"PRIu64" %s (%"PRIu64" bytes), %"PRIu64" unchanged (%"PRIu64" bytes)",
+                sync->files_sent, (sync->dry_run ? "to send" : "sent"), sync->bytes_sent,
+                sync->files_skipped, sync->bytes_skipped);
+}
+
+void getput_progress_start(SftpProgressBar *pb, int jobs, uint64_t offset, uint64_t size)
+{
+    if (jobs == 1) {
+        sftpprogressbar_init(pb, offset, size);
+    } else {
+        sftpprogressbar_add(pb, offset, size);
+    }
+}
+
+void getput_progress_interrupt(SftpProgressBar *pb, int jobs, Seat *seat)
+{
+    if (jobs == 1) {
+        sftpprogressbar_finish(pb, seat);
+    } else {
+        sftpprogressbar_clear(pb, seat);
+    }
+}
+
+void getput_closes_init(SftpCloseQueue *q)
+{
+    q->n = 0;
+    q->size = 0;
+    q->closes = NULL;
+}
+
+void getput_closes_uninit(SftpCloseQueue *q)
+{
+    for (size_t i = 0; i < q->n; i++) {
+        sfree((void *)q->closes[i].name);
+    }
+    sfree(q->closes);
+    getput_closes_init(q);
+}
+
+void getput_close_send(SftpCloseQueue *q, Sftp *sftp, struct fxp_handle *handle, const char *name)
+{
+    sgrowarray(q->closes, q->size, q->n);
+    SftpPendingClose *c = &q->closes[q->n++];
+    sftpcmd_clear_request(&c->cmd);
+    c->name = dupstr(name);
+    sftpcmd_set_request(&c->cmd, SSH_FXP_CLOSE, fxp_close_send(handle));
+}
+
+bool getput_close_recv(SftpCloseQueue *q, Sftp *sftp, struct sftp_request *req, struct sftp_packet *pktin, const char **failed_name)
+{
+    for (size_t i = 0; i < q->n; i++) {
+        SftpPendingClose *c = &q->closes[i];
+        if (c->cmd.req == req) {
+            sftp_find_request(pktin);
+            bool result = fxp_close_recv(pktin, req);
+            if (result) {
+                sfree((void *)c->name);
+                *failed_name = NULL;
+            } else {
+                *failed_name = c->name;
+            }
+            q->closes[i] = q->closes[--q->n];
+            return true;
+        }
+    }
+    return false;
 }
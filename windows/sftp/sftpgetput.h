@@ -2,9 +2,15 @@
 #define GETPUT_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include "sftpprogressbar.h"
+#include "sftpcmd.h"
+#include "sftplocalsnap.h"
+#include "sftpsegments.h"
 
-typedef struct Sftp Sftp;
+struct fxp_attrs;
+struct fxp_handle;
 
 typedef struct SftpDir {
     const char *fname; //utf8
@@ -12,6 +18,13 @@ typedef struct SftpDir {
     const char *outfname; //utf8
     size_t nnames, namesize;
     const char **ournames; //line codepage for get, utf8 for put
+    struct fxp_attrs *ourattrs; //attributes from READDIR for get, local ones for sync push
+    size_t attrsize;
+    SftpLocalSnapshot *local; //the local directory, reget and sync pull
+    const char *line_outfname; //line codepage, sync push only
+    const char **remotenames; //the remote directory of a sync push, utf8
+    struct fxp_attrs *remoteattrs;
+    size_t nremote, remotesize, remoteattrsize;
     size_t i;
 } SftpDir;
 
@@ -28,7 +41,76 @@ SftpDir *sftpdirstack_push(SftpDirStack *dirstack);
 void sftpdirstack_init(SftpDirStack *dirstack);
 void sftpdirstack_uninit(SftpDirStack *dirstack);
 
-bool getput_parse_args(Sftp *sftp, int *i, bool *recurse);
+/* Number of files transferred concurrently by default, enough to hide a few
+   round trips per file on a high latency link. */
+#define GETPUT_DEFAULT_JOBS 4
+#define GETPUT_MAX_JOBS 64
+
+/* Number of files beyond the running transfers which are already opened
+   on the server, so the next file can start streaming without a round
+   trip. */
+#define GETPUT_LOOKAHEAD_FILES 4
+
+/* Number of directories a recursive get reads concurrently, and the most
+   listings it keeps ahead of the walk. */
+#define GETPUT_CRAWL_STREAMS 4
+#define GETPUT_CRAWL_MAX_DIRS 64
+
+/* Parses the options of get and put, segments is NULL for the commands
+without '-P', see sftpsegments.h. '-c' sets verify, see sftpverify.h. */
+bool getput_parse_args(Sftp *sftp, int *i, bool *recurse, int *jobs, int *segments, bool *verify);
+/* Parses the number of the option '-j' at argument i. */
+bool getput_parse_jobs(Sftp *sftp, int i, int *jobs);
 void getput_sort_dir_names(SftpDir *dir);
+/* Sorts the remote listing of a sync push, which can then be searched by
+   getput_find_remote(). NULL if name is not in it. */
+void getput_sort_remote_names(SftpDir *dir);
+const struct fxp_attrs *getput_find_remote(SftpDir *dir, const char *name);
+
+/* A sync is a recursive get or put which transfers only the files whose
+   size or modification time differ from the existing copy, and sets the
+   modification time of the copy it writes, so an unchanged tree is not
+   sent again. A dry run prints the files it would send. */
+typedef struct GetPutSync {
+    bool enabled;
+    bool dry_run;
+    uint64_t files_sent, bytes_sent;
+    uint64_t files_skipped, bytes_skipped;
+} GetPutSync;
+
+/* Whether a regular file of attrs has an unchanged copy of copy_attrs,
+   which may be NULL. The times are only compared if both are known. */
+bool getput_sync_unchanged(const struct fxp_attrs *attrs, const struct fxp_attrs *copy_attrs);
+void getput_sync_summary(const GetPutSync *sync, Seat *seat);
+
+/* sync pull and sync push, see sftpcmdsync.c. The directory arguments
+   start at first_arg. */
+SftpCmd *sftpcmdget_sync_init(Sftp *sftp, int first_arg, int jobs, bool dry_run);
+SftpCmd *sftpcmdput_sync_init(Sftp *sftp, int first_arg, int jobs, bool dry_run);
+
+/* With one job every file has its own progress bar, otherwise a single bar
+   shows the total of the files started so far. */
+void getput_progress_start(SftpProgressBar *pb, int jobs, uint64_t offset, uint64_t size);
+void getput_progress_interrupt(SftpProgressBar *pb, int jobs, Seat *seat);
+
+/* CLOSE requests which are not waited for. The transfer goes on with the
+   next file and a failing CLOSE is reported when its reply arrives. */
+typedef struct SftpPendingClose {
+    SftpCmd cmd;
+    const char *name;
+} SftpPendingClose;
+
+typedef struct SftpCloseQueue {
+    size_t n, size;
+    SftpPendingClose *closes;
+} SftpCloseQueue;
+
+void getput_closes_init(SftpCloseQueue *q);
+void getput_closes_uninit(SftpCloseQueue *q);
+void getput_close_send(SftpCloseQueue *q, Sftp *sftp, struct fxp_handle *handle, const char *name);
+/* Returns true if req is one of the queued CLOSEs. If the CLOSE failed,
+   *failed_name is set to the name given to getput_close_send(), to be freed
+   by the caller. */
+bool getput_close_recv(SftpCloseQueue *q, Sftp *sftp, struct sftp_request *req, struct sftp_packet *pktin, const char **failed_name);
 
 #endif
@@ -4,14 +4,18 @@
 #include "sftpunicode.h"
 #include "psftp.h"
 
-static SftpCmd *sftpinit_init(Sftp *sftp)
+void sftp_send_init(void)
 {
     struct sftp_packet *pktout = sftp_pkt_init(SSH_FXP_INIT);
     put_uint32(pktout, SFTP_PROTO_VERSION);
-    sftp_set_sending_backend(sftp);
     sftp_send_prepare(pktout);
     sftp_senddata(pktout->data, pktout->length);
-    sftp_pkt_free(pktout);
+    sftpfxp_pkt_free(pktout);
+}
+
+static SftpCmd *sftpinit_init(Sftp *sftp)
+{
+    sftp_send_init();
 
     SftpCmd *cmd = snew(SftpCmd);
     sftpcmd_clear_request(cmd);
@@ -21,25 +25,57 @@ static SftpCmd *sftpinit_init(Sftp *sftp)
 
 static bool sftpinit_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *pktin)
 {
-    if (!cmd->req) {
+    if (cmd->req_type == SSH_FXP_INIT) {
         if (pktin->type != SSH_FXP_VERSION) {
             seat_connection_fatal(sftp->seat, "Fatal: unable to initialise SFTP: did not receive FXP_VERSION");
-            sftp_pkt_free(pktin);
+            sftpfxp_pkt_free(pktin);
             return false;
         }
         unsigned long remotever = get_uint32(pktin);
         if (get_err(pktin)) {
             seat_connection_fatal(sftp->seat, "Fatal: unable to initialise SFTP: malformed FXP_VERSION packet");
-            sftp_pkt_free(pktin);
+            sftpfxp_pkt_free(pktin);
             return false;
         }
         if (remotever > SFTP_PROTO_VERSION) {
             seat_connection_fatal(sftp->seat, "Fatal: unable to initialise SFTP: remote protocol is more advanced than we support");
-            sftp_pkt_free(pktin);
+            sftpfxp_pkt_free(pktin);
             return false;
         }
-        sftp_pkt_free(pktin);
-        sftp_set_sending_backend(sftp);
+        sftp->remote_version = remotever;
+        while (get_avail(pktin) > 0) {
+            ptrlen name = get_string(pktin);
+            ptrlen data = get_string(pktin);
+            if (get_err(pktin)) {
+                break;          /* the extensions read so far are kept */
+            }
+            sgrowarray(sftp->extensions, sftp->extensionsize, sftp->nextensions);
+            SftpExtension *ext = &sftp->extensions[sftp->nextensions++];
+            ext->name = mkstr(name);
+            ext->data = mkstr(data);
+            ext->datalen = data.len;
+        }
+        sftpfxp_pkt_free(pktin);
+        if (sftp_find_extension(sftp, "limits@openssh.com")) {
+            sftpcmd_set_request(cmd, SSH_FXP_EXTENDED, fxp_limits_send());
+        } else {
+            sftpcmd_set_request(cmd, SSH_FXP_REALPATH, fxp_realpath_send("."));
+        }
+        return true;
+    }
+
+    if (cmd->req_type == SSH_FXP_EXTENDED) {
+        sftp->has_server_limits = fxp_limits_recv(pktin, cmd->req, &sftp->server_limits);
+        sftpcmd_clear_request(cmd);
+        if (sftp->has_server_limits) {
+            SftpServerLimits *limits = &sftp->server_limits;
+            xfer_limits_set_server(&sftp->xfer_limits, limits);
+            if (limits->max_packet > sftp->max_packet) {
+                sftp->max_packet = (limits->max_packet < SFTP_MAX_PACKET_CEILING ? (unsigned)limits->max_packet : SFTP_MAX_PACKET_CEILING);
+            }
+        } else {
+            sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "Warning: failed to read the server limits: %s", fxp_error());
+        }
         sftpcmd_set_request(cmd, SSH_FXP_REALPATH, fxp_realpath_send("."));
         return true;
     }
@@ -65,6 +101,28 @@ static bool sftpinit_process_pkt(SftpCmd *cmd, Sftp *sftp, struct sftp_packet *p
     return false;
 }
 
+const SftpExtension *sftp_find_extension(Sftp *sftp, const char *name)
+{
+    for (size_t i = 0; i < sftp->nextensions; i++) {
+        if (strcmp(sftp->extensions[i].name, name) == 0) {
+            return &sftp->extensions[i];
+        }
+    }
+    return NULL;
+}
+
+void sftp_free_extensions(Sftp *sftp)
+{
+    for (size_t i = 0; i < sftp->nextensions; i++) {
+        sfree((void *)sftp->extensions[i].name);
+        sfree((void *)sftp->extensions[i].data);
+    }
+    sfree(sftp->extensions);
+    sftp->extensions = NULL;
+    sftp->nextensions = 0;
+    sftp->extensionsize = 0;
+}
+
 static void sftpinit_free(SftpCmd *cmd)
 {
     sfree(cmd);
@@ -0,0 +1,236 @@
+#include "sftplistcache.h"
+#include "putty.h"
+#include "sftpfxp.h"
+
+/* The positions of the strings of a name in the arena. */
+struct SftpListOffsets {
+    size_t filename, longname;
+};
+
+void sftplistcache_init(SftpListCache *c)
+{
+    c->head = NULL;
+    c->count = 0;
+    c->bytes = 0;
+    c->generation = 0;
+}
+
+static size_t listing_bytes(const SftpListing *l)
+{
+    return sizeof(SftpListing) + l->namesize * sizeof(struct fxp_name) + l->arenasize;
+}
+
+void sftplistcache_release(const SftpListing *cl)
+{
+    SftpListing *l = (SftpListing *)cl;
+    if (--l->refs > 0) {
+        return;
+    }
+    sfree((void *)l->path);
+    sfree((void *)l->alias);
+    sfree(l->names);
+    sfree(l->arena);
+    sfree(l->offsets);
+    sfree(l);
+}
+
+static void drop(SftpListCache *c, SftpListing **p)
+{
+    SftpListing *l = *p;
+    *p = l->next;
+    l->next = NULL;
+    l->cached = false;
+    c->count--;
+    c->bytes -= listing_bytes(l);
+    sftplistcache_release(l);
+}
+
+void sftplistcache_uninit(SftpListCache *c)
+{
+    while (c->head) {
+        drop(c, &c->head);
+    }
+}
+
+/* The length of path without trailing slashes, the root keeps its slash. */
+static size_t trimmed_len(const char *path)
+{
+    size_t len = strlen(path);
+    while (len > 1 && path[len-1] == '/') {
+        len--;
+    }
+    return len;
+}
+
+static bool key_is(const char *key, const char *path, size_t len)
+{
+    return key && strlen(key) == len && memcmp(key, path, len) == 0;
+}
+
+/* A path without empty, "." or ".." components, so the paths of a
+   directory and its parent compare as strings. */
+static bool is_clean(const char *path, size_t len)
+{
+    if (len == 0 || path[0] != '/') {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (path[i] != '/' || i + 1 == len) {
+            continue;
+        }
+        size_t n = 1;
+        while (i + n < len && path[i+n] != '/') {
+            n++;
+        }
+        if (n == 1 || (n == 2 && path[i+1] == '.') || (n == 3 && path[i+1] == '.' && path[i+2] == '.')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool expired(const SftpListing *l, unsigned long now)
+{
+    return now - l->tick > SFTPLISTCACHE_TTL;
+}
+
+const SftpListing *sftplistcache_get(SftpListCache *c, const char *path)
+{
+    size_t len = trimmed_len(path);
+    unsigned long now = GETTICKCOUNT();
+    SftpListing **p = &c->head;
+    while (*p) {
+        SftpListing *l = *p;
+        if (expired(l, now)) {
+            drop(c, p);
+            continue;
+        }
+        if (key_is(l->path, path, len) || key_is(l->alias, path, len)) {
+            *p = l->next;
+            l->next = c->head;
+            c->head = l;
+            l->refs++;
+            return l;
+        }
+        p = &l->next;
+    }
+    return NULL;
+}
+
+SftpListing *sftplistcache_begin(SftpListCache *c)
+{
+    SftpListing *l = snew(SftpListing);
+    memset(l, 0, sizeof(SftpListing));
+    l->generation = c->generation;
+    l->refs = 1;
+    return l;
+}
+
+static size_t add_string(SftpListing *l, const char *s)
+{
+    if (!s) {
+        s = "";
+    }
+    size_t len = strlen(s) + 1;
+    size_t pos = l->arenalen;
+    sgrowarrayn(l->arena, l->arenasize, l->arenalen, len);
+    memcpy(l->arena + pos, s, len);
+    l->arenalen += len;
+    return pos;
+}
+
+bool sftplistcache_add(SftpListing *l, const struct fxp_name *name)
+{
+    if (l->nnames >= l->namesize) {
+        sgrowarray(l->names, l->namesize, l->nnames);
+        l->offsets = sresize(l->offsets, l->namesize, SftpListOffsets);
+    }
+    l->offsets[l->nnames].filename = add_string(l, name->filename);
+    l->offsets[l->nnames].longname = add_string(l, name->longname);
+    l->names[l->nnames].filename = NULL;
+    l->names[l->nnames].longname = NULL;
+    l->names[l->nnames].attrs = name->attrs;
+    l->nnames++;
+    return listing_bytes(l) <= SFTPLISTCACHE_MAX_BYTES;
+}
+
+const SftpListing *sftplistcache_end(SftpListCache *c, SftpListing *l, const char *path, const char *alias)
+{
+    for (size_t i = 0; i < l->nnames; i++) {
+        l->names[i].filename = l->arena + l->offsets[i].filename;
+        l->names[i].longname = l->arena + l->offsets[i].longname;
+    }
+    sfree(l->offsets);
+    l->offsets = NULL;
+    if (path) {
+        l->path = mkstr(make_ptrlen(path, trimmed_len(path)));
+    }
+    if (alias && !key_is(l->path, alias, trimmed_len(alias))) {
+        l->alias = mkstr(make_ptrlen(alias, trimmed_len(alias)));
+    }
+    l->tick = GETTICKCOUNT();
+
+    /* The directory may have changed while it was read. */
+    if (l->generation != c->generation || listing_bytes(l) > SFTPLISTCACHE_MAX_BYTES) {
+        return l;
+    }
+    l->refs++;
+    l->cached = true;
+    l->next = c->head;
+    c->head = l;
+    c->count++;
+    c->bytes += listing_bytes(l);
+
+    while (c->count > SFTPLISTCACHE_MAX_ENTRIES || c->bytes > SFTPLISTCACHE_MAX_BYTES) {
+        SftpListing **p = &c->head;
+        while ((*p)->next) {
+            p = &(*p)->next;
+        }
+        drop(c, p);
+    }
+    return l;
+}
+
+/* Whether a change of path, with the given length, and its parent of
+   parent_len can change the listing with key. */
+static bool affects(const char *key, const char *path, size_t len, size_t parent_len)
+{
+    if (!key) {
+        return false;
+    }
+    size_t key_len = strlen(key);
+    if (!is_clean(key, key_len)) {
+        return true;
+    }
+    if (key_len == parent_len && memcmp(key, path, parent_len) == 0) {
+        return true;
+    }
+    return key_len >= len && memcmp(key, path, len) == 0 && (key[len] == 0 || key[len] == '/');
+}
+
+void sftplistcache_invalidate(SftpListCache *c, const char *path)
+{
+    c->generation++;
+    size_t len = trimmed_len(path);
+    if (!is_clean(path, len) || len == 1) {
+        sftplistcache_uninit(c);
+        return;
+    }
+    size_t parent_len = len;
+    while (path[parent_len-1] != '/') {
+        parent_len--;
+    }
+    if (parent_len > 1) {
+        parent_len--;
+    }
+
+    SftpListing **p = &c->head;
+    while (*p) {
+        SftpListing *l = *p;
+        if (affects(l->path, path, len, parent_len) || affects(l->alias, path, len, parent_len)) {
+            drop(c, p);
+        } else {
+            p = &l->next;
+        }
+    }
+}
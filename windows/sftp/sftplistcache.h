@@ -0,0 +1,72 @@
+#ifndef SFTPLISTCACHE_H
+#define SFTPLISTCACHE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * The remote directories listed recently, shared by ls, the completion and
+ * the wildcards of a session. A listing is kept under the canonical path
+ * REALPATH returned and under the absolute path the user gave, if it
+ * differs, both in the line codepage. The names and the long names of a
+ * listing are stored in one arena.
+ *
+ * A listing expires SFTPLISTCACHE_TTL ticks after it was read, the oldest
+ * listings are dropped beyond SFTPLISTCACHE_MAX_ENTRIES listings or
+ * SFTPLISTCACHE_MAX_BYTES bytes. sftplistcache_invalidate() is called for
+ * every path our own requests change, see sftpfxp.c; a change made through
+ * a symbolic link or by someone else shows once the listing expired.
+ */
+
+#define SFTPLISTCACHE_TTL (30 * TICKSPERSEC)
+#define SFTPLISTCACHE_MAX_ENTRIES 16
+#define SFTPLISTCACHE_MAX_BYTES (16*1024*1024)
+
+struct fxp_name;
+typedef struct SftpListOffsets SftpListOffsets;
+
+/* A directory listing, only path, names and nnames are for the users. */
+typedef struct SftpListing SftpListing;
+struct SftpListing {
+    const char *path;           /* canonical path, NULL if not known */
+    const char *alias;          /* path given by the user or NULL */
+    struct fxp_name *names;
+    size_t nnames, namesize;
+    char *arena;
+    size_t arenalen, arenasize;
+    SftpListOffsets *offsets;   /* while reading, arena may move */
+    unsigned long tick;
+    unsigned long generation;
+    int refs;
+    bool cached;
+    SftpListing *next;
+};
+
+typedef struct SftpListCache {
+    SftpListing *head;          /* most recently used first */
+    size_t count;
+    size_t bytes;
+    unsigned long generation;   /* counts the invalidations */
+} SftpListCache;
+
+void sftplistcache_init(SftpListCache *c);
+void sftplistcache_uninit(SftpListCache *c);
+
+/* The listing of path if it is cached and not expired, otherwise NULL. */
+const SftpListing *sftplistcache_get(SftpListCache *c, const char *path);
+void sftplistcache_release(const SftpListing *l);
+
+/* Reading a directory: the names of the READDIR replies are added to a
+   new listing, which sftplistcache_end() caches unless a path was
+   invalidated since sftplistcache_begin(). Both hand the listing to the
+   caller, who releases it. */
+SftpListing *sftplistcache_begin(SftpListCache *c);
+/* Returns false once the listing is too large to be cached, a caller
+   which only reads for the cache releases it then. */
+bool sftplistcache_add(SftpListing *l, const struct fxp_name *name);
+const SftpListing *sftplistcache_end(SftpListCache *c, SftpListing *l, const char *path, const char *alias);
+
+/* Drops the listings of path, of its parent directory and below path. */
+void sftplistcache_invalidate(SftpListCache *c, const char *path);
+
+#endif
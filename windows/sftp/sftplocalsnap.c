@@ -0,0 +1,121 @@
+#include "sftplocalsnap.h"
+#include "putty.h"
+#include "psftpext.h"
+
+#define NO_ENTRY ((size_t)-1)
+
+typedef struct LocalEntry {
+    char *name;
+    uint64_t size;
+    unsigned long mtime;
+    bool is_dir;
+} LocalEntry;
+
+struct SftpLocalSnapshot {
+    LocalEntry *entries;
+    size_t nentries, entrysize;
+    size_t *slots;          /* open addressing, indexes into entries */
+    size_t nslots;          /* a power of two */
+};
+
+static unsigned char fold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+/* FNV-1a of the folded name. */
+static size_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h ^= fold(*p);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool name_equal(const char *a, const char *b)
+{
+    for (; *a && fold(*a) == fold(*b); a++, b++);
+    return *a == *b;
+}
+
+static size_t *find_slot(SftpLocalSnapshot *s, const char *name)
+{
+    size_t mask = s->nslots - 1;
+    size_t i = name_hash(name) & mask;
+    while (s->slots[i] != NO_ENTRY && !name_equal(s->entries[s->slots[i]].name, name)) {
+        i = (i + 1) & mask;
+    }
+    return &s->slots[i];
+}
+
+SftpLocalSnapshot *sftplocalsnap_read(const char *dir)
+{
+    const char *errmsg;
+    DirHandle *dh = open_directory(dir, &errmsg);
+    if (!dh) {
+        return NULL;
+    }
+    SftpLocalSnapshot *s = snew(SftpLocalSnapshot);
+    s->entries = NULL;
+    s->nentries = 0;
+    s->entrysize = 0;
+    char *name;
+    while ((name = read_filename(dh)) != NULL) {
+        sgrowarray(s->entries, s->entrysize, s->nentries);
+        LocalEntry *e = &s->entries[s->nentries++];
+        e->name = name;
+        read_filename_attrs(dh, &e->size, &e->mtime, &e->is_dir);
+    }
+    close_directory(dh);
+
+    s->nslots = 16;
+    while (s->nslots < 2 * s->nentries) {
+        s->nslots *= 2;
+    }
+    s->slots = snewn(s->nslots, size_t);
+    for (size_t i = 0; i < s->nslots; i++) {
+        s->slots[i] = NO_ENTRY;
+    }
+    for (size_t i = 0; i < s->nentries; i++) {
+        size_t *slot = find_slot(s, s->entries[i].name);
+        if (*slot == NO_ENTRY) {
+            *slot = i;
+        }
+    }
+    return s;
+}
+
+static LocalEntry *find(SftpLocalSnapshot *s, const char *name)
+{
+    size_t *slot = find_slot(s, name);
+    return *slot == NO_ENTRY ? NULL : &s->entries[*slot];
+}
+
+bool sftplocalsnap_exists(SftpLocalSnapshot *s, const char *name)
+{
+    return find(s, name) != NULL;
+}
+
+bool sftplocalsnap_complete(SftpLocalSnapshot *s, const char *name, uint64_t size, unsigned long mtime)
+{
+    LocalEntry *e = find(s, name);
+    return e && !e->is_dir && e->size == size && e->mtime >= mtime;
+}
+
+bool sftplocalsnap_same(SftpLocalSnapshot *s, const char *name, uint64_t size, unsigned long mtime)
+{
+    LocalEntry *e = find(s, name);
+    return e && !e->is_dir && e->size == size && (mtime == 0 || e->mtime == mtime);
+}
+
+void sftplocalsnap_free(SftpLocalSnapshot *s)
+{
+    for (size_t i = 0; i < s->nentries; i++) {
+        sfree(s->entries[i].name);
+    }
+    sfree(s->entries);
+    sfree(s->slots);
+    sfree(s);
+}
@@ -0,0 +1,30 @@
+#ifndef SFTPLOCALSNAP_H
+#define SFTPLOCALSNAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The entries of a local directory with their size and modification time,
+ * read with one enumeration of the directory and kept in a hash set by
+ * name. reget decides where to resume and which files are complete from
+ * it instead of a file_type() per name, and sync pull which files are
+ * unchanged. Names compare ignoring the case of
+ * ASCII letters, like the local file system; a name differing in the case
+ * of other letters is not found, and the file is then fetched again.
+ */
+
+typedef struct SftpLocalSnapshot SftpLocalSnapshot;
+
+/* NULL if the directory cannot be read. dir is utf8, like the names. */
+SftpLocalSnapshot *sftplocalsnap_read(const char *dir);
+bool sftplocalsnap_exists(SftpLocalSnapshot *s, const char *name);
+/* Whether name is a file of the size which was not modified before mtime,
+   zero if the time is not known. */
+bool sftplocalsnap_complete(SftpLocalSnapshot *s, const char *name, uint64_t size, unsigned long mtime);
+/* Whether name is a file of the size and, unless mtime is zero, of the
+   modification time. */
+bool sftplocalsnap_same(SftpLocalSnapshot *s, const char *name, uint64_t size, unsigned long mtime);
+void sftplocalsnap_free(SftpLocalSnapshot *s);
+
+#endif
@@ -0,0 +1,330 @@
+#include "sftplssort.h"
+#include "putty.h"
+
+/* A record is the file name and the long name, both zero terminated. In
+   the temporary file a record is preceded by its length. */
+
+typedef struct Run {
+    uint64_t pos, end;      /* the part of the file not read yet */
+    char *buf;
+    size_t bufsize, start, len;
+    const char *rec;        /* current record, NULL at the end */
+} Run;
+
+struct SftpLsSort {
+    size_t run_bytes;
+    char *arena;            /* records of the run being collected */
+    size_t arenalen, arenasize;
+    size_t *offsets;
+    size_t noffsets, offsetsize;
+    const char **sorted;    /* the in-memory run after finish */
+    size_t nsorted, sortedpos;
+
+    HANDLE file;
+    uint64_t filesize;
+    char *wbuf;
+    size_t wlen;
+    Run *runs;
+    size_t nruns, runsize;
+    Run **heap;             /* the runs with a record, least first */
+    size_t nheap;
+    Run *advance;           /* run whose record was handed out last */
+    bool failed;
+};
+
+static int record_compare(const void *av, const void *bv)
+{
+    return strcmp(*(const char *const *)av, *(const char *const *)bv);
+}
+
+static const char *longname_of(const char *rec)
+{
+    return rec + strlen(rec) + 1;
+}
+
+SftpLsSort *sftplssort_new(size_t run_bytes)
+{
+    SftpLsSort *s = snew(SftpLsSort);
+    memset(s, 0, sizeof(SftpLsSort));
+    s->run_bytes = run_bytes;
+    s->file = INVALID_HANDLE_VALUE;
+    return s;
+}
+
+/* Sorts the records of the run being collected into s->sorted. */
+static void sort_run(SftpLsSort *s)
+{
+    s->sorted = sresize(s->sorted, s->noffsets ? s->noffsets : 1, const char *);
+    for (size_t i = 0; i < s->noffsets; i++) {
+        s->sorted[i] = s->arena + s->offsets[i];
+    }
+    s->nsorted = s->noffsets;
+    qsort(s->sorted, s->nsorted, sizeof(const char *), record_compare);
+}
+
+static bool open_file(SftpLsSort *s)
+{
+    wchar_t dir[MAX_PATH+1], path[MAX_PATH+1];
+    DWORD len = GetTempPathW(lenof(dir), dir);
+    if (len == 0 || len > lenof(dir) || !GetTempFileNameW(dir, L"pls", 0, path)) {
+        return false;
+    }
+    s->file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                          FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (s->file == INVALID_HANDLE_VALUE) {
+        DeleteFileW(path);
+        return false;
+    }
+    s->wbuf = snewn(SFTPLSSORT_READ_BUFFER, char);
+    return true;
+}
+
+static bool flush_wbuf(SftpLsSort *s)
+{
+    DWORD written;
+    if (s->wlen > 0 && (!WriteFile(s->file, s->wbuf, s->wlen, &written, NULL) || written != s->wlen)) {
+        return false;
+    }
+    s->filesize += s->wlen;
+    s->wlen = 0;
+    return true;
+}
+
+static bool write_bytes(SftpLsSort *s, const void *data, size_t len)
+{
+    const char *p = (const char *)data;
+    while (len > 0) {
+        if (s->wlen == SFTPLSSORT_READ_BUFFER && !flush_wbuf(s)) {
+            return false;
+        }
+        size_t n = SFTPLSSORT_READ_BUFFER - s->wlen;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(s->wbuf + s->wlen, p, n);
+        s->wlen += n;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Sorts the run being collected and appends it to the file. */
+static bool write_run(SftpLsSort *s)
+{
+    if (s->file == INVALID_HANDLE_VALUE && !open_file(s)) {
+        return false;
+    }
+    sort_run(s);
+    sgrowarray(s->runs, s->runsize, s->nruns);
+    Run *run = &s->runs[s->nruns++];
+    memset(run, 0, sizeof(Run));
+    run->pos = s->filesize + s->wlen;
+    for (size_t i = 0; i < s->nsorted; i++) {
+        const char *rec = s->sorted[i];
+        size_t len = strlen(rec) + 1;
+        len += strlen(rec + len) + 1;
+        unsigned char header[4];
+        PUT_32BIT_MSB_FIRST(header, len);
+        if (!write_bytes(s, header, 4) || !write_bytes(s, rec, len)) {
+            return false;
+        }
+    }
+    if (!flush_wbuf(s)) {
+        return false;
+    }
+    run->end = s->filesize;
+    s->nsorted = 0;
+    s->arenalen = 0;
+    s->noffsets = 0;
+    return true;
+}
+
+bool sftplssort_add(SftpLsSort *s, const char *filename, const char *longname)
+{
+    if (s->failed) {
+        return false;
+    }
+    size_t flen = strlen(filename) + 1;
+    size_t llen = strlen(longname) + 1;
+    size_t used = s->arenalen + s->noffsets * sizeof(size_t);
+    if (s->noffsets > 0 && used + flen + llen + sizeof(size_t) > s->run_bytes && !write_run(s)) {
+        s->failed = true;
+        return false;
+    }
+    sgrowarray(s->offsets, s->offsetsize, s->noffsets);
+    s->offsets[s->noffsets++] = s->arenalen;
+    sgrowarrayn(s->arena, s->arenasize, s->arenalen, flen + llen);
+    memcpy(s->arena + s->arenalen, filename, flen);
+    memcpy(s->arena + s->arenalen + flen, longname, llen);
+    s->arenalen += flen + llen;
+    return true;
+}
+
+/* Makes the next need bytes of the run available from run->start. */
+static bool run_fill(SftpLsSort *s, Run *run, size_t need)
+{
+    if (run->len - run->start >= need) {
+        return true;
+    }
+    memmove(run->buf, run->buf + run->start, run->len - run->start);
+    run->len -= run->start;
+    run->start = 0;
+    if (need > run->bufsize) {
+        run->bufsize = need;
+        run->buf = sresize(run->buf, run->bufsize, char);
+    }
+    size_t want = run->bufsize - run->len;
+    if (want > run->end - run->pos) {
+        want = run->end - run->pos;
+    }
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)run->pos;
+    ov.OffsetHigh = (DWORD)(run->pos >> 32);
+    DWORD got;
+    if (want > 0 && (!ReadFile(s->file, run->buf + run->len, want, &got, &ov) || got != want)) {
+        return false;
+    }
+    run->pos += want;
+    run->len += want;
+    return run->len - run->start >= need;
+}
+
+static bool run_next(SftpLsSort *s, Run *run)
+{
+    run->rec = NULL;
+    if (run->start == run->len && run->pos == run->end) {
+        return true;
+    }
+    if (!run_fill(s, run, 4)) {
+        return false;
+    }
+    size_t len = GET_32BIT_MSB_FIRST(run->buf + run->start);
+    run->start += 4;
+    if (!run_fill(s, run, len)) {
+        return false;
+    }
+    run->rec = run->buf + run->start;
+    run->start += len;
+    return true;
+}
+
+static bool heap_less(Run *a, Run *b)
+{
+    return strcmp(a->rec, b->rec) < 0;
+}
+
+static void heap_down(SftpLsSort *s, size_t i)
+{
+    for (;;) {
+        size_t least = i, l = 2*i + 1, r = 2*i + 2;
+        if (l < s->nheap && heap_less(s->heap[l], s->heap[least])) {
+            least = l;
+        }
+        if (r < s->nheap && heap_less(s->heap[r], s->heap[least])) {
+            least = r;
+        }
+        if (least == i) {
+            return;
+        }
+        Run *t = s->heap[i];
+        s->heap[i] = s->heap[least];
+        s->heap[least] = t;
+        i = least;
+    }
+}
+
+bool sftplssort_finish(SftpLsSort *s)
+{
+    if (s->failed) {
+        return false;
+    }
+    if (s->nruns == 0) {
+        sort_run(s);
+        return true;
+    }
+    if (s->noffsets > 0 && !write_run(s)) {
+        s->failed = true;
+        return false;
+    }
+    sfree(s->arena);
+    s->arena = NULL;
+    s->arenasize = 0;
+    sfree(s->offsets);
+    s->offsets = NULL;
+    s->offsetsize = 0;
+    sfree(s->sorted);
+    s->sorted = NULL;
+    sfree(s->wbuf);
+    s->wbuf = NULL;
+
+    s->heap = snewn(s->nruns, Run *);
+    for (size_t i = 0; i < s->nruns; i++) {
+        Run *run = &s->runs[i];
+        run->bufsize = SFTPLSSORT_READ_BUFFER;
+        run->buf = snewn(run->bufsize, char);
+        if (!run_next(s, run)) {
+            s->failed = true;
+            return false;
+        }
+        if (run->rec) {
+            s->heap[s->nheap++] = run;
+        }
+    }
+    for (size_t i = s->nheap; i-- > 0;) {
+        heap_down(s, i);
+    }
+    return true;
+}
+
+const char *sftplssort_next(SftpLsSort *s)
+{
+    if (s->failed) {
+        return NULL;
+    }
+    if (s->nruns == 0) {
+        if (s->sortedpos == s->nsorted) {
+            return NULL;
+        }
+        return longname_of(s->sorted[s->sortedpos++]);
+    }
+    if (s->advance) {
+        if (!run_next(s, s->advance)) {
+            s->failed = true;
+            return NULL;
+        }
+        if (!s->advance->rec) {
+            s->heap[0] = s->heap[--s->nheap];
+        }
+        s->advance = NULL;
+        heap_down(s, 0);
+    }
+    if (s->nheap == 0) {
+        return NULL;
+    }
+    s->advance = s->heap[0];
+    return longname_of(s->advance->rec);
+}
+
+bool sftplssort_failed(SftpLsSort *s)
+{
+    return s->failed;
+}
+
+void sftplssort_free(SftpLsSort *s)
+{
+    if (s->file != INVALID_HANDLE_VALUE) {
+        CloseHandle(s->file);
+    }
+    for (size_t i = 0; i < s->nruns; i++) {
+        sfree(s->runs[i].buf);
+    }
+    sfree(s->runs);
+    sfree(s->heap);
+    sfree(s->wbuf);
+    sfree(s->arena);
+    sfree(s->offsets);
+    sfree(s->sorted);
+    sfree(s);
+}
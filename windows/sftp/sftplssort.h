@@ -0,0 +1,31 @@
+#ifndef SFTPLSSORT_H
+#define SFTPLSSORT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Sorts the lines of ls by file name with bounded memory. The names are
+ * collected into runs of at most run_bytes, a full run is sorted and
+ * appended to a temporary file, and the output merges the runs read back
+ * through a buffer each. A listing fitting into one run is sorted in
+ * memory and never touches the disk.
+ */
+
+#define SFTPLSSORT_RUN_BYTES (8*1024*1024)
+#define SFTPLSSORT_READ_BUFFER (64*1024)
+
+typedef struct SftpLsSort SftpLsSort;
+
+SftpLsSort *sftplssort_new(size_t run_bytes);
+/* Returns false if a run could not be written. */
+bool sftplssort_add(SftpLsSort *s, const char *filename, const char *longname);
+/* Ends the input, the lines can be taken with sftplssort_next(). */
+bool sftplssort_finish(SftpLsSort *s);
+/* The long name of the next line in order, valid until the next call.
+   NULL at the end or if a run could not be read. */
+const char *sftplssort_next(SftpLsSort *s);
+bool sftplssort_failed(SftpLsSort *s);
+void sftplssort_free(SftpLsSort *s);
+
+#endif
@@ -0,0 +1,76 @@
+#include "sftppktpool.h"
+#include "putty.h"
+#include "ssh/sftp.h"
+
+static size_t class_size(int c)
+{
+    return (size_t)SFTPPKTPOOL_MIN_SIZE << (2 * c);
+}
+
+/* The smallest class holding length bytes, -1 if none. */
+static int class_of(size_t length)
+{
+    for (int c = 0; c < SFTPPKTPOOL_CLASSES; c++) {
+        if (length <= class_size(c)) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+static int class_max(int c)
+{
+    size_t max = SFTPPKTPOOL_CLASS_BYTES / class_size(c);
+    if (max < 1) {
+        return 1;
+    }
+    return (max > SFTPPKTPOOL_CLASS_MAX ? SFTPPKTPOOL_CLASS_MAX : (int)max);
+}
+
+void sftppktpool_init(SftpPktPool *pool)
+{
+    memset(pool, 0, sizeof(SftpPktPool));
+}
+
+struct sftp_packet *sftppktpool_recv_prepare(SftpPktPool *pool, unsigned length)
+{
+    int c = (pool ? class_of(length) : -1);
+    if (c < 0) {
+        return sftp_recv_prepare(length);
+    }
+    SftpPktPoolClass *pc = &pool->classes[c];
+    struct sftp_packet *pkt;
+    if (pc->n > 0) {
+        pkt = pc->pkts[--pc->n];
+    } else {
+        pkt = snew(struct sftp_packet);
+        pkt->data = snewn(class_size(c), char);
+    }
+    pkt->savedpos = 0;
+    pkt->length = length;
+    pkt->maxlen = class_size(c);
+    return pkt;
+}
+
+void sftppktpool_free(SftpPktPool *pool, struct sftp_packet *pkt)
+{
+    int c = (pool && pkt->data ? class_of(pkt->maxlen) : -1);
+    if (c >= 0 && pkt->maxlen == class_size(c) && pool->classes[c].n < class_max(c)) {
+        pool->classes[c].pkts[pool->classes[c].n++] = pkt;
+        return;
+    }
+    sfree(pkt->data);
+    sfree(pkt);
+}
+
+void sftppktpool_clear(SftpPktPool *pool)
+{
+    for (int c = 0; c < SFTPPKTPOOL_CLASSES; c++) {
+        SftpPktPoolClass *pc = &pool->classes[c];
+        while (pc->n > 0) {
+            struct sftp_packet *pkt = pc->pkts[--pc->n];
+            sfree(pkt->data);
+            sfree(pkt);
+        }
+    }
+}
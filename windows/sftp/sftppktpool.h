@@ -0,0 +1,43 @@
+#ifndef SFTPPKTPOOL_H
+#define SFTPPKTPOOL_H
+
+/*
+ * Free lists of received SFTP packets by size class, so the receive path
+ * does not allocate a packet and its data for every reply. The classes are
+ * SFTPPKTPOOL_MIN_SIZE bytes times the powers of 4 up to the largest packet
+ * accepted, a class keeps SFTPPKTPOOL_CLASS_BYTES worth of packets, but at
+ * most SFTPPKTPOOL_CLASS_MAX. Each session has its own pool, which its
+ * connections share and which is cleared when a command finishes, so the
+ * packets are kept only while a transfer may reuse them. The code of the
+ * backend frees the packets it receives with sftpfxp_pkt_free(), which
+ * returns them to the pool of the bound session, see sftpfxp.h. PuTTY's
+ * sftp_pkt_free() of sftpcommon.c, which sftp.c calls for the replies it
+ * parses, frees a pooled packet like any other.
+ */
+
+#define SFTPPKTPOOL_MIN_SIZE 256
+#define SFTPPKTPOOL_CLASSES 7
+#define SFTPPKTPOOL_CLASS_BYTES (4*1024*1024)
+#define SFTPPKTPOOL_CLASS_MAX 64
+
+struct sftp_packet;
+
+typedef struct SftpPktPoolClass {
+    struct sftp_packet *pkts[SFTPPKTPOOL_CLASS_MAX];
+    int n;
+} SftpPktPoolClass;
+
+typedef struct SftpPktPool {
+    SftpPktPoolClass classes[SFTPPKTPOOL_CLASSES];
+} SftpPktPool;
+
+void sftppktpool_init(SftpPktPool *pool);
+/* sftp_recv_prepare() taking the packet from the pool, pool may be NULL. */
+struct sftp_packet *sftppktpool_recv_prepare(SftpPktPool *pool, unsigned length);
+/* Keeps a packet with the capacity of a class if the class has room,
+   otherwise frees it, as it does without a pool. */
+void sftppktpool_free(SftpPktPool *pool, struct sftp_packet *pkt);
+/* Frees the kept packets. */
+void sftppktpool_clear(SftpPktPool *pool);
+
+#endif
@@ -53,6 +53,17 @@ void sftpprogressbar_init(SftpProgressBar *pb, uint64_t start_offset, uint64_t t
     pb->finished = false;
 }
 
+/* Adds a file to a bar showing the aggregate of several transfers. */
+void sftpprogressbar_add(SftpProgressBar *pb, uint64_t start_offset, uint64_t size)
+{
+    if (size > 0 && start_offset > size) {
+        start_offset = size;
+    }
+    pb->got += start_offset;
+    pb->goal += size;
+    pb->window_start_got += start_offset;
+}
+
 void sftpprogressbar_update(SftpProgressBar *pb, uint64_t got)
 {
     pb->got += got;
@@ -122,6 +133,16 @@ void sftpprogressbar_draw(SftpProgressBar *pb, Seat *seat, int term_cols)
     return;
 }
 
+/* Erases the bar so that a message can be printed; the next draw brings it
+   back. */
+void sftpprogressbar_clear(SftpProgressBar *pb, Seat *seat)
+{
+    if (pb->drawn) {
+        seat_output(seat, SEAT_OUTPUT_STDOUT, "\r\x1b[0K", 5);
+        pb->drawn = false;
+    }
+}
+
 void sftpprogressbar_finish(SftpProgressBar *pb, Seat *seat)
 {
     if (pb->drawn) {
@@ -1,5 +1,5 @@
 #ifndef SFTPPROGRESSBAR_H
-#define SFTPROGRESSBAR_H
+#define SFTPPROGRESSBAR_H
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -17,8 +17,10 @@ typedef struct SftpProgressBar {
 } SftpProgressBar;
 
 void sftpprogressbar_init(SftpProgressBar *pb, uint64_t start_offset, uint64_t total_size);
+void sftpprogressbar_add(SftpProgressBar *pb, uint64_t start_offset, uint64_t size);
 void sftpprogressbar_update(SftpProgressBar *pb, uint64_t got);
 void sftpprogressbar_draw(SftpProgressBar *pb, Seat *seat, int term_cols);
+void sftpprogressbar_clear(SftpProgressBar *pb, Seat *seat);
 void sftpprogressbar_finish(SftpProgressBar *pb, Seat *seat);
 
 #endif
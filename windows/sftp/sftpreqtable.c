@@ -0,0 +1,124 @@
+#include "sftpreqtable.h"
+#include "putty.h"
+
+#define INDEX_MASK (SFTPREQTABLE_MAX_SLOTS - 1)
+#define GENERATION_MASK ((unsigned)-1 >> SFTPREQTABLE_INDEX_BITS)
+#define NO_SLOT ((unsigned)-1)
+
+struct SftpReqSlot {
+    void *req;              /* NULL if the slot is free */
+    void *owner;
+    unsigned generation;
+    unsigned next_free;
+};
+
+void sftpreqtable_init(SftpReqTable *t)
+{
+    t->slots = NULL;
+    t->nslots = 0;
+    t->size = 0;
+    t->free_head = NO_SLOT;
+    t->count = 0;
+}
+
+void sftpreqtable_uninit(SftpReqTable *t)
+{
+    sfree(t->slots);
+    sftpreqtable_init(t);
+}
+
+unsigned sftpreqtable_add(SftpReqTable *t, void *req)
+{
+    unsigned index;
+    if (t->free_head != NO_SLOT) {
+        index = t->free_head;
+        t->free_head = t->slots[index].next_free;
+    } else {
+        assert(t->nslots < SFTPREQTABLE_MAX_SLOTS);
+        sgrowarray(t->slots, t->size, t->nslots);
+        index = t->nslots++;
+        t->slots[index].generation = 0;
+    }
+    SftpReqSlot *s = &t->slots[index];
+    s->req = req;
+    s->owner = NULL;
+    t->count++;
+    return (s->generation << SFTPREQTABLE_INDEX_BITS) | index;
+}
+
+static SftpReqSlot *find_slot(SftpReqTable *t, unsigned id)
+{
+    unsigned index = id & INDEX_MASK;
+    if (index >= t->nslots) {
+        return NULL;
+    }
+    SftpReqSlot *s = &t->slots[index];
+    if (!s->req || s->generation != id >> SFTPREQTABLE_INDEX_BITS) {
+        return NULL;
+    }
+    return s;
+}
+
+void *sftpreqtable_find(SftpReqTable *t, unsigned id)
+{
+    SftpReqSlot *s = find_slot(t, id);
+    return (s ? s->req : NULL);
+}
+
+void sftpreqtable_set_owner(SftpReqTable *t, unsigned id, void *owner)
+{
+    SftpReqSlot *s = find_slot(t, id);
+    if (s) {
+        s->owner = owner;
+    }
+}
+
+void *sftpreqtable_owner(SftpReqTable *t, unsigned id)
+{
+    SftpReqSlot *s = find_slot(t, id);
+    return (s ? s->owner : NULL);
+}
+
+static void free_slot(SftpReqTable *t, SftpReqSlot *s)
+{
+    s->req = NULL;
+    s->generation = (s->generation + 1) & GENERATION_MASK;
+    s->next_free = t->free_head;
+    t->free_head = s - t->slots;
+    t->count--;
+}
+
+void *sftpreqtable_del(SftpReqTable *t, unsigned id)
+{
+    SftpReqSlot *s = find_slot(t, id);
+    if (!s) {
+        return NULL;
+    }
+    void *req = s->req;
+    free_slot(t, s);
+    return req;
+}
+
+bool sftpreqtable_any(SftpReqTable *t, unsigned *id)
+{
+    for (size_t i = 0; i < t->nslots && t->count > 0; i++) {
+        SftpReqSlot *s = &t->slots[i];
+        if (s->req) {
+            *id = (s->generation << SFTPREQTABLE_INDEX_BITS) | i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void sftpreqtable_clear(SftpReqTable *t, void (*free_req)(void *req))
+{
+    for (size_t i = 0; i < t->nslots && t->count > 0; i++) {
+        SftpReqSlot *s = &t->slots[i];
+        if (s->req) {
+            void *req = s->req;
+            free_slot(t, s);
+            free_req(req);
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef SFTPREQTABLE_H
+#define SFTPREQTABLE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * The requests waiting for a reply, indexed by their id. The low
+ * SFTPREQTABLE_INDEX_BITS bits of an id are the index of its slot and the
+ * bits above are the generation of the slot, so a reply is found by an
+ * array index, and a late or bogus id does not match the request reusing
+ * the slot. Freed slots are reused last in first out, the array grows by
+ * doubling when all slots are taken.
+ */
+
+#define SFTPREQTABLE_INDEX_BITS 20
+#define SFTPREQTABLE_MAX_SLOTS (1u << SFTPREQTABLE_INDEX_BITS)
+
+typedef struct SftpReqSlot SftpReqSlot;
+
+typedef struct SftpReqTable {
+    SftpReqSlot *slots;
+    size_t nslots, size;
+    unsigned free_head;
+    size_t count;
+} SftpReqTable;
+
+void sftpreqtable_init(SftpReqTable *t);
+void sftpreqtable_uninit(SftpReqTable *t);
+/* Stores req and returns its id. */
+unsigned sftpreqtable_add(SftpReqTable *t, void *req);
+/* The request with the id, NULL if there is none. */
+void *sftpreqtable_find(SftpReqTable *t, unsigned id);
+/* Whoever the reply of the request with the id goes to, NULL until set. */
+void sftpreqtable_set_owner(SftpReqTable *t, unsigned id, void *owner);
+void *sftpreqtable_owner(SftpReqTable *t, unsigned id);
+/* Removes the request with the id and returns it, NULL if there is none. */
+void *sftpreqtable_del(SftpReqTable *t, unsigned id);
+/* The id of one of the requests, false if there is none. */
+bool sftpreqtable_any(SftpReqTable *t, unsigned *id);
+/* Removes all requests, calling free_req for each. */
+void sftpreqtable_clear(SftpReqTable *t, void (*free_req)(void *req));
+
+#endif
@@ -0,0 +1,122 @@
+#include "sftpsegments.h"
+#include "putty.h"
+#include "psftp.h"
+
+/* The state file is text: the magic line, the size of the file and a line
+   "start end done" per segment. */
+#define STATE_MAGIC "psftp segments 1"
+#define STATE_MAX_LEN (64 + SFTPSEGMENTS_MAX * 64)
+
+void sftpsegments_split(SftpSegments *s, uint64_t size, int n)
+{
+    uint64_t most = size / SFTPSEGMENTS_MIN_SIZE;
+    if (most < 1) {
+        most = 1;
+    }
+    if ((uint64_t)n > most) {
+        n = (int)most;
+    }
+    if (n > SFTPSEGMENTS_MAX) {
+        n = SFTPSEGMENTS_MAX;
+    }
+    s->size = size;
+    s->n = n;
+    uint64_t start = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t end = (i == n - 1 ? size : size / n * (i + 1));
+        s->seg[i].start = start;
+        s->seg[i].end = end;
+        s->seg[i].done = start;
+        start = end;
+    }
+}
+
+bool sftpsegments_complete(const SftpSegments *s)
+{
+    for (int i = 0; i < s->n; i++) {
+        if (s->seg[i].done != s->seg[i].end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+char *sftpsegments_state_name(const char *outfname)
+{
+    return dupcat(outfname, SFTPSEGMENTS_SUFFIX);
+}
+
+/* The segments must cover the file in order. */
+static bool valid(const SftpSegments *s)
+{
+    if (s->n < 1 || s->n > SFTPSEGMENTS_MAX) {
+        return false;
+    }
+    uint64_t start = 0;
+    for (int i = 0; i < s->n; i++) {
+        const SftpSegment *seg = &s->seg[i];
+        if (seg->start != start || seg->end < seg->start || seg->done < seg->start || seg->done > seg->end) {
+            return false;
+        }
+        start = seg->end;
+    }
+    return start == s->size;
+}
+
+bool sftpsegments_load(SftpSegments *s, const char *statefname, uint64_t size)
+{
+    uint64_t len;
+    RFile *f = open_existing_file(statefname, &len, NULL, NULL, NULL);
+    if (!f) {
+        return false;
+    }
+    char buf[STATE_MAX_LEN];
+    int got = (len < sizeof(buf) ? read_from_file(f, buf, (int)len) : -1);
+    close_rfile(f);
+    if (got < 0 || (uint64_t)got != len) {
+        return false;
+    }
+    buf[got] = '\0';
+
+    const char *p = buf;
+    size_t magic_len = strlen(STATE_MAGIC);
+    if (strncmp(p, STATE_MAGIC "\n", magic_len + 1)) {
+        return false;
+    }
+    p += magic_len + 1;
+    int n;
+    if (sscanf(p, "%"SCNu64"\n%n", &s->size, &n) != 1) {
+        return false;
+    }
+    p += n;
+    s->n = 0;
+    while (*p) {
+        if (s->n == SFTPSEGMENTS_MAX) {
+            return false;
+        }
+        SftpSegment *seg = &s->seg[s->n];
+        if (sscanf(p, "%"SCNu64" %"SCNu64" %"SCNu64"\n%n", &seg->start, &seg->end, &seg->done, &n) != 3) {
+            return false;
+        }
+        p += n;
+        s->n++;
+    }
+    return s->size == size && valid(s);
+}
+
+bool sftpsegments_save(const SftpSegments *s, const char *statefname)
+{
+    char buf[STATE_MAX_LEN];
+    int len = snprintf(buf, sizeof(buf), "%s\n%"PRIu64"\n", STATE_MAGIC, s->size);
+    for (int i = 0; i < s->n; i++) {
+        const SftpSegment *seg = &s->seg[i];
+        len += snprintf(buf + len, sizeof(buf) - len, "%"PRIu64" %"PRIu64" %"PRIu64"\n", seg->start, seg->end, seg->done);
+    }
+    WFile *f = open_new_file(statefname, 0644);
+    if (!f) {
+        return false;
+    }
+    bool ok = (write_to_file(f, buf, len) == len);
+    close_wfile(f);
+    return ok;
+}
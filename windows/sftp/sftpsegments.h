@@ -0,0 +1,46 @@
+#ifndef SFTPSEGMENTS_H
+#define SFTPSEGMENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The byte ranges of a file which get -P downloads concurrently, each into
+ * its own part of the preallocated local file. How far every segment is
+ * written is kept in a small state file next to the local file, named by
+ * sftpsegments_state_name(), so reget resumes each segment where it
+ * stopped. The state file exists as long as the local file is incomplete;
+ * it is written before the local file is created and deleted once every
+ * segment is complete. A recorded position is never ahead of the data on
+ * disk, it only lags by the blocks written since the last save.
+ */
+
+#define SFTPSEGMENTS_MAX 16
+/* Smaller files are split into fewer segments. */
+#define SFTPSEGMENTS_MIN_SIZE (8*1024*1024)
+#define SFTPSEGMENTS_SUFFIX ".psftp-segments"
+
+typedef struct SftpSegment {
+    uint64_t start, end;    /* the range, end excluded */
+    uint64_t done;          /* written from start up to here */
+} SftpSegment;
+
+typedef struct SftpSegments {
+    uint64_t size;
+    int n;
+    SftpSegment seg[SFTPSEGMENTS_MAX];
+} SftpSegments;
+
+/* Splits size bytes into at most n segments of at least
+   SFTPSEGMENTS_MIN_SIZE bytes, a single one for a smaller file. */
+void sftpsegments_split(SftpSegments *s, uint64_t size, int n);
+bool sftpsegments_complete(const SftpSegments *s);
+
+/* The name of the state file of outfname, freed by the caller. */
+char *sftpsegments_state_name(const char *outfname);
+/* Reads a state file, false if it cannot be read or it is not for a file
+   of size bytes. */
+bool sftpsegments_load(SftpSegments *s, const char *statefname, uint64_t size);
+bool sftpsegments_save(const SftpSegments *s, const char *statefname);
+
+#endif
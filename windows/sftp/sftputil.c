@@ -1,10 +1,10 @@
 #include "putty.h"
 #include "ssh/sftp.h"
 
-void sftp_print(Seat *seat, SeatOutputType type, const char *text)
+size_t sftp_print(Seat *seat, SeatOutputType type, const char *text)
 {
     seat_output(seat, type, text, strlen(text));
-    seat_output(seat, type, "\r\n", 2);
+    return seat_output(seat, type, "\r\n", 2);
 }
 
 void sftp_printf(Seat *seat, SeatOutputType type, const char *format, ...)
@@ -1,10 +1,13 @@
 #ifndef SFTPUTIL_H
 #define SFTPUTIL_H
 
+#include <stddef.h>
+
 typedef struct Seat Seat;
 typedef enum SeatOutputType SeatOutputType;
 
-void sftp_print(Seat *seat, SeatOutputType type, const char *text);
+/* Returns the output backlog of the seat. */
+size_t sftp_print(Seat *seat, SeatOutputType type, const char *text);
 void sftp_printf(Seat *seat, SeatOutputType type, const char *format, ...);
 void sftp_print_pwd(Seat *seat, const char *pwd);
 
@@ -0,0 +1,349 @@
+#include "sftpverify.h"
+#include "sftpbe.h"
+#include "sftpfxp.h"
+#include "sftputil.h"
+#include "sftpgetput.h"
+#include "sftpconn.h"
+
+void sftpverify_init(SftpVerify *v, Sftp *sftp, bool enabled, SftpProgressBar *progress, int jobs)
+{
+    memset(v, 0, sizeof(SftpVerify));
+    v->enabled = enabled;
+    v->sftp = sftp;
+    v->progress = progress;
+    v->jobs = jobs;
+}
+
+static void remove_check(SftpVerify *v, size_t i)
+{
+    SftpVerifyCheck *c = &v->checks[i];
+    sfree((void *)c->name);
+    sfree((void *)c->line_name);
+    v->checks[i] = v->checks[--v->n];
+}
+
+/* The requests still pending are freed with the others of the command. */
+void sftpverify_uninit(SftpVerify *v)
+{
+    while (v->n > 0) {
+        remove_check(v, v->n - 1);
+    }
+    sfree(v->checks);
+    if (v->exec) {
+        sftpconn_exec_free(v->sftp, v->exec);
+    }
+    memset(v, 0, sizeof(SftpVerify));
+}
+
+static void hash_write(BinarySink *bs, const void *data, size_t len)
+{
+    SftpVerifyHash *hash = BinarySink_DOWNCAST(bs, SftpVerifyHash);
+    LARGE_INTEGER start, end;
+    QueryPerformanceCounter(&start);
+    put_data(hash->h, data, len);
+    QueryPerformanceCounter(&end);
+    hash->v->hash_counts += end.QuadPart - start.QuadPart;
+    hash->v->bytes_hashed += len;
+    hash->length += len;
+}
+
+SftpVerifyHash *sftpverify_hash_new(SftpVerify *v, uint64_t offset)
+{
+    if (!v->enabled) {
+        return NULL;
+    }
+    SftpVerifyHash *hash = snew(SftpVerifyHash);
+    hash->v = v;
+    hash->h = ssh_hash_new(&ssh_sha256);
+    hash->offset = offset;
+    hash->length = 0;
+    BinarySink_INIT(hash, hash_write);
+    return hash;
+}
+
+void sftpverify_hash_free(SftpVerifyHash *hash)
+{
+    ssh_hash_free(hash->h);
+    sfree(hash);
+}
+
+static void interrupt(SftpVerify *v, Sftp *sftp)
+{
+    getput_progress_interrupt(v->progress, v->jobs, sftp->seat);
+}
+
+static void unchecked(SftpVerify *v, Sftp *sftp, const char *name, const char *reason)
+{
+    interrupt(v, sftp);
+    sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "%s: not verified: %s", name, reason);
+    v->files_unchecked++;
+}
+
+static void compare(SftpVerify *v, Sftp *sftp, SftpVerifyCheck *c, const unsigned char *digest)
+{
+    if (memcmp(c->digest, digest, SFTPVERIFY_HASH_LEN) == 0) {
+        v->files_ok++;
+    } else {
+        interrupt(v, sftp);
+        sftp_printf(sftp->seat, SEAT_OUTPUT_STDERR, "%s: SHA-256 differs from the server's", c->name);
+        v->files_differ++;
+    }
+}
+
+void sftpverify_check_send(SftpVerify *v, Sftp *sftp, SftpVerifyHash *hash, struct fxp_handle *handle,
+                           const char *name, const char *line_name, bool whole)
+{
+    whole = whole && hash->offset == 0;
+    if (!whole && hash->length == 0) {
+        /* nothing was transferred */
+        sftpverify_hash_free(hash);
+        return;
+    }
+    sgrowarray(v->checks, v->size, v->n);
+    SftpVerifyCheck *c = &v->checks[v->n++];
+    memset(c, 0, sizeof(SftpVerifyCheck));
+    if (whole) {
+        c->name = dupstr(name);
+        c->line_name = dupstr(line_name);
+    } else {
+        c->name = dupprintf("%s, bytes %"PRIu64" to %"PRIu64"", name, hash->offset, hash->offset + hash->length);
+    }
+    assert(ssh_sha256.hlen == SFTPVERIFY_HASH_LEN);
+    ssh_hash_final(hash->h, c->digest);
+    uint64_t offset = hash->offset, length = hash->length;
+    sfree(hash);
+
+    if (sftp_find_extension(sftp, "check-file")) {
+        c->sent = GETTICKCOUNT();
+        c->req = fxp_check_file_send(handle, "sha256", offset, length);
+    } else if (!whole) {
+        unchecked(v, sftp, c->name, "the server cannot hash a part of a file");
+        remove_check(v, v->n - 1);
+    }
+}
+
+bool sftpverify_check_recv(SftpVerify *v, Sftp *sftp, struct sftp_request *req, struct sftp_packet *pktin)
+{
+    size_t i = 0;
+    while (i < v->n && v->checks[i].req != req) {
+        i++;
+    }
+    if (i == v->n) {
+        return false;
+    }
+    SftpVerifyCheck *c = &v->checks[i];
+    sftp_find_request(pktin);
+    c->req = NULL;
+    char *alg = NULL;
+    strbuf *digest = strbuf_new();
+    bool result = fxp_check_file_recv(pktin, req, &alg, digest);
+    v->server_ticks += GETTICKCOUNT() - c->sent;
+    if (result && (strcmp(alg, "sha256") != 0 || digest->len != SFTPVERIFY_HASH_LEN)) {
+        char *reason = dupprintf("the server hashed with %s", alg);
+        unchecked(v, sftp, c->name, reason);
+        sfree(reason);
+        remove_check(v, i);
+    } else if (result) {
+        v->server_hashes++;
+        compare(v, sftp, c, digest->u);
+        remove_check(v, i);
+    } else if (!c->line_name) {
+        char *reason = dupprintf("check-file: %s", fxp_error());
+        unchecked(v, sftp, c->name, reason);
+        sfree(reason);
+        remove_check(v, i);
+    }
+    /* otherwise the whole file is left to sha256sum */
+    sfree(alg);
+    strbuf_free(digest);
+    return true;
+}
+
+bool sftpverify_busy(SftpVerify *v)
+{
+    for (size_t i = 0; i < v->n; i++) {
+        if (v->checks[i].req) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Quotes s for the POSIX shell. */
+static void put_quoted(strbuf *buf, const char *s)
+{
+    put_byte(buf, '\'');
+    for (; *s; s++) {
+        if (*s == '\'') {
+            put_datapl(buf, PTRLEN_LITERAL("'\\''"));
+        } else {
+            put_byte(buf, *s);
+        }
+    }
+    put_byte(buf, '\'');
+}
+
+/* Starts sha256sum for the files waiting for it, as many as fit into
+   SFTPVERIFY_MAX_COMMAND. */
+static void run_sha256sum(SftpVerify *v, Sftp *sftp)
+{
+    strbuf *command = strbuf_new();
+    put_datapl(command, PTRLEN_LITERAL("sha256sum -b --"));
+    size_t first_len = 0;
+    for (size_t i = 0; i < v->n; i++) {
+        SftpVerifyCheck *c = &v->checks[i];
+        if (c->req) {
+            continue;
+        }
+        size_t len = command->len;
+        put_byte(command, ' ');
+        put_quoted(command, c->line_name);
+        if (first_len > 0 && command->len > SFTPVERIFY_MAX_COMMAND) {
+            strbuf_shrink_to(command, len);
+            break;
+        }
+        first_len = command->len;
+        c->running = true;
+    }
+    v->exec = sftpconn_exec(sftp, command->s);
+    v->exec_started = GETTICKCOUNT();
+    strbuf_free(command);
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* A line of sha256sum -b is the hash in hex, " *" and the name. A name with
+   a backslash or a newline has them escaped, and the line starts with a
+   backslash then. */
+static void sha256sum_line(SftpVerify *v, Sftp *sftp, const char *line, size_t len)
+{
+    bool escaped = (len > 0 && line[0] == '\\');
+    if (escaped) {
+        line++;
+        len--;
+    }
+    unsigned char digest[SFTPVERIFY_HASH_LEN];
+    if (len < 2 * SFTPVERIFY_HASH_LEN + 2) {
+        return;
+    }
+    for (size_t i = 0; i < SFTPVERIFY_HASH_LEN; i++) {
+        int high = hex_digit(line[2*i]), low = hex_digit(line[2*i+1]);
+        if (high < 0 || low < 0) {
+            return;
+        }
+        digest[i] = (unsigned char)(high << 4 | low);
+    }
+    line += 2 * SFTPVERIFY_HASH_LEN;
+    len -= 2 * SFTPVERIFY_HASH_LEN;
+    if (line[0] != ' ' || (line[1] != '*' && line[1] != ' ')) {
+        return;
+    }
+    strbuf *name = strbuf_new();
+    for (size_t i = 2; i < len; i++) {
+        if (escaped && line[i] == '\\' && i + 1 < len) {
+            i++;
+            put_byte(name, line[i] == 'n' ? '\n' : line[i] == 'r' ? '\r' : line[i]);
+        } else {
+            put_byte(name, line[i]);
+        }
+    }
+    for (size_t i = 0; i < v->n; i++) {
+        SftpVerifyCheck *c = &v->checks[i];
+        if (c->running && !strcmp(c->line_name, name->s)) {
+            v->server_hashes++;
+            compare(v, sftp, c, digest);
+            remove_check(v, i);
+            break;
+        }
+    }
+    strbuf_free(name);
+}
+
+void sftpverify_conn_changed(SftpVerify *v, Sftp *sftp, SftpConn *conn)
+{
+    const char *output, *error;
+    int exitcode;
+    if (!v->exec || conn != v->exec || !sftpconn_exec_result(conn, &output, &exitcode, &error)) {
+        return;
+    }
+    v->server_ticks += GETTICKCOUNT() - v->exec_started;
+    while (output && *output) {
+        const char *eol = strchr(output, '\n');
+        size_t len = (eol ? eol - output : strlen(output));
+        sha256sum_line(v, sftp, output, len);
+        output += len + (eol ? 1 : 0);
+    }
+    char *reason;
+    if (error) {
+        reason = dupprintf("sha256sum: %s", error);
+    } else if (exitcode == 127) {
+        reason = dupstr("the server has no sha256sum");
+    } else {
+        reason = dupprintf("sha256sum ended with exit code %d", exitcode);
+    }
+    size_t i = 0;
+    while (i < v->n) {
+        SftpVerifyCheck *c = &v->checks[i];
+        if (c->running) {
+            unchecked(v, sftp, c->name, reason);
+            remove_check(v, i);
+        } else {
+            i++;
+        }
+    }
+    sfree(reason);
+    sftpconn_exec_free(sftp, v->exec);
+    v->exec = NULL;
+}
+
+bool sftpverify_finish(SftpVerify *v, Sftp *sftp, bool stop)
+{
+    if (!v->enabled) {
+        return false;
+    }
+    if (stop) {
+        if (v->exec) {
+            sftpconn_exec_free(sftp, v->exec);
+            v->exec = NULL;
+        }
+        while (v->n > 0) {
+            remove_check(v, v->n - 1);
+        }
+    }
+    for (;;) {
+        if (v->exec) {
+            const char *output, *error;
+            int exitcode;
+            if (!sftpconn_exec_result(v->exec, &output, &exitcode, &error)) {
+                return true;
+            }
+            /* it failed to start, which is not notified */
+            sftpverify_conn_changed(v, sftp, v->exec);
+        }
+        if (v->n == 0) {
+            break;
+        }
+        run_sha256sum(v, sftp);
+    }
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    interrupt(v, sftp);
+    sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "verify: %"PRIu64" verified, %"PRIu64" differ, %"PRIu64" not verified",
+                v->files_ok, v->files_differ, v->files_unchecked);
+    sftp_printf(sftp->seat, SEAT_OUTPUT_STDOUT, "verify: SHA-256 of %"PRIu64" bytes took %.2f s here, %"PRIu64" server hashes %.2f s",
+                v->bytes_hashed, (double)v->hash_counts / (double)freq.QuadPart,
+                v->server_hashes, (double)v->server_ticks / TICKSPERSEC);
+    v->enabled = false;
+    return false;
+}
@@ -0,0 +1,98 @@
+#ifndef SFTPVERIFY_H
+#define SFTPVERIFY_H
+
+#include "putty.h"
+#include "ssh.h"
+#include "sftpprogressbar.h"
+
+/*
+ * The -c option of get and put: every transfer hashes its data with SHA-256
+ * as it is written to the local file or read from it, and the hash is
+ * compared with the one the server computes of the same range of the
+ * remote file. A download hands out the data of its READs in file order
+ * however the replies arrive, and an upload reads its file in order, so
+ * the running hash needs no reordering of its own.
+ *
+ * The server hashes with the check-file extension: a check-file-handle
+ * request on the open handle, sent right before its CLOSE. Without it a
+ * whole file is hashed by sha256sum, which runs on a connection of its own,
+ * see sftpconn_exec(), for a batch of files once the rest of the command
+ * is done. That login needs a shell with sha256sum, so it fails on SFTP-only
+ * or chrooted accounts, and it reuses the login answers, which are wiped
+ * unless extra connections were set before the login. The files are
+ * reported as not verified then. A part of a file, a segment or the rest
+ * of a resumed transfer, can only be checked with check-file.
+ */
+
+#define SFTPVERIFY_HASH_LEN 32
+/* The longest sha256sum command line of a batch of files. */
+#define SFTPVERIFY_MAX_COMMAND (16*1024)
+
+typedef struct Sftp Sftp;
+typedef struct SftpConn SftpConn;
+typedef struct SftpVerify SftpVerify;
+struct fxp_handle;
+struct sftp_request;
+struct sftp_packet;
+
+/* The running hash of a transfer, the data goes in with put_data(). */
+typedef struct SftpVerifyHash {
+    SftpVerify *v;
+    ssh_hash *h;
+    uint64_t offset;            /* of the data in the remote file */
+    uint64_t length;
+    BinarySink_IMPLEMENTATION;
+} SftpVerifyHash;
+
+typedef struct SftpVerifyCheck {
+    struct sftp_request *req;   /* NULL while waiting for sha256sum */
+    const char *name;           //utf8, with the range of a part
+    const char *line_name;      //line codepage, NULL for a part
+    unsigned char digest[SFTPVERIFY_HASH_LEN];
+    unsigned long sent;         /* tick */
+    bool running;               /* in the running sha256sum */
+} SftpVerifyCheck;
+
+struct SftpVerify {
+    bool enabled;
+    Sftp *sftp;
+    SftpProgressBar *progress;  /* interrupted by the messages */
+    int jobs;
+
+    size_t n, size;
+    SftpVerifyCheck *checks;
+    SftpConn *exec;             /* the running sha256sum */
+    unsigned long exec_started;
+
+    uint64_t files_ok, files_differ, files_unchecked;
+    uint64_t bytes_hashed;
+    int64_t hash_counts;        /* of QueryPerformanceCounter() */
+    uint64_t server_hashes;
+    unsigned long server_ticks;
+};
+
+void sftpverify_init(SftpVerify *v, Sftp *sftp, bool enabled, SftpProgressBar *progress, int jobs);
+void sftpverify_uninit(SftpVerify *v);
+
+/* A hash of the data a transfer starts at offset of the remote file, NULL
+   unless enabled. */
+SftpVerifyHash *sftpverify_hash_new(SftpVerify *v, uint64_t offset);
+void sftpverify_hash_free(SftpVerifyHash *hash);
+/* Takes the hash of a complete transfer and asks the server for its own of
+   the same range on handle, which must still be open and is bound, see
+   sftpfxp.h. A whole file is one which the transfer read from its start
+   up to its end. */
+void sftpverify_check_send(SftpVerify *v, Sftp *sftp, SftpVerifyHash *hash, struct fxp_handle *handle,
+                           const char *name, const char *line_name, bool whole);
+/* Returns true if req is one of the check-file requests. */
+bool sftpverify_check_recv(SftpVerify *v, Sftp *sftp, struct sftp_request *req, struct sftp_packet *pktin);
+/* Whether check-file requests are waiting for their replies. */
+bool sftpverify_busy(SftpVerify *v);
+/* Called once the rest of the command is done. Runs sha256sum for the
+   files left to it unless stop, returns true while it runs and prints the
+   summary once everything is checked. */
+bool sftpverify_finish(SftpVerify *v, Sftp *sftp, bool stop);
+/* Takes the result of sha256sum, see conn_changed of SftpCmdVtable. */
+void sftpverify_conn_changed(SftpVerify *v, Sftp *sftp, SftpConn *conn);
+
+#endif
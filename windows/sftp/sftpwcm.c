@@ -2,6 +2,7 @@
 #include "sftpcmd.h"
 #include "sftputil.h"
 #include "sftpfxp.h"
+#include "sftpbe.h"
 #include "sftpunicode.h"
 #include "psftp.h"
 
@@ -19,10 +20,13 @@ typedef struct SftpWildcardMatcher {
     Sftp *sftp;
     SftpCmd *cmd;
     const char *cdir; //line codepage
+    const char *dir; //line codepage, as given
     struct fxp_handle *dirh;
     struct fxp_names *names;
     int namepos;
     const char *wildcard; //line codepage
+    SftpListing *reading; //the names read so far, for the listing cache
+    const SftpListing *cached; //no directory requests if set
 } SftpWildcardMatcher;
 
 static void sftpwcm_free(SftpWildcardMatcher *swcm);
@@ -35,11 +39,14 @@ static SftpWildcardMatcher *sftpwcm_begin(const char *dir, const char *wildcard,
     swcm->sftp = sftp;
     swcm->cmd = cmd;
     swcm->cdir = dir;
+    swcm->dir = dupstr(dir);
     swcm->dirh = NULL;
     swcm->names = NULL;
+    swcm->namepos = 0;
     swcm->wildcard = wildcard;
+    swcm->reading = NULL;
+    swcm->cached = NULL;
 
-    sftp_set_sending_backend(sftp);
     sftpcmd_set_request(cmd, SSH_FXP_REALPATH, fxp_realpath_send(swcm->cdir));
     return swcm;
 }
@@ -54,8 +61,10 @@ static bool sftpwcm_realpath_recv(SftpWildcardMatcher *swcm, struct sftp_packet
     }
     sfree((void *)swcm->cdir);
     swcm->cdir = cdir;
-    sftp_set_sending_backend(swcm->sftp);
-    sftpcmd_set_request(swcm->cmd, SSH_FXP_OPENDIR, fxp_opendir_send(swcm->cdir));
+    swcm->cached = sftplistcache_get(&swcm->sftp->listcache, swcm->cdir);
+    if (!swcm->cached) {
+        sftpcmd_set_request(swcm->cmd, SSH_FXP_OPENDIR, fxp_opendir_send(swcm->cdir));
+    }
     return true;
 }
 
@@ -67,29 +76,41 @@ static bool sftpwcm_opendir_recv(SftpWildcardMatcher *swcm, struct sftp_packet *
         sftp_line_printf(swcm->sftp, SEAT_OUTPUT_STDERR, swcm->cdir, "unable to open %s: %s", utf8_arg, fxp_error());
         return false;
     }
+    swcm->reading = sftplistcache_begin(&swcm->sftp->listcache);
     return true;
 }
 
-static const char *sftpwcm_get_filename(SftpWildcardMatcher *swcm)
+/* The next name read, NULL when the names read so far are used up and the
+   next READDIR was sent, or at the end of a cached listing. */
+static struct fxp_name *sftpwcm_next_name(SftpWildcardMatcher *swcm)
 {
-    struct fxp_name *name;
-
-    while (1) {
-        if (swcm->names && swcm->namepos >= swcm->names->nnames) {
-            fxp_free_names(swcm->names);
-            swcm->names = NULL;
-        }
-
-        if (!swcm->names) {
-            sftp_set_sending_backend(swcm->sftp);
-            sftpcmd_set_request(swcm->cmd, SSH_FXP_READDIR, fxp_readdir_send(swcm->dirh));
+    if (swcm->cached) {
+        if (swcm->namepos >= swcm->cached->nnames) {
             return NULL;
         }
+        return &swcm->cached->names[swcm->namepos++];
+    }
+
+    if (swcm->names && swcm->namepos >= swcm->names->nnames) {
+        fxp_free_names(swcm->names);
+        swcm->names = NULL;
+    }
+
+    if (!swcm->names) {
+        sftpcmd_set_request(swcm->cmd, SSH_FXP_READDIR, fxp_readdir_send(swcm->dirh));
+        return NULL;
+    }
 
-        assert(swcm->names && swcm->namepos < swcm->names->nnames);
+    assert(swcm->names && swcm->namepos < swcm->names->nnames);
 
-        name = &swcm->names->names[swcm->namepos++];
+    return &swcm->names->names[swcm->namepos++];
+}
+
+static const char *sftpwcm_get_filename(SftpWildcardMatcher *swcm)
+{
+    struct fxp_name *name;
 
+    while ((name = sftpwcm_next_name(swcm)) != NULL) {
         if (!strcmp(name->filename, ".") || !strcmp(name->filename, ".."))
             continue;                  /* expected bad filenames */
 
@@ -105,6 +126,15 @@ static const char *sftpwcm_get_filename(SftpWildcardMatcher *swcm)
          */
         return dupprintf("%s/%s", swcm->cdir, name->filename);
     }
+    return NULL;
+}
+
+static void sftpwcm_cache_listing(SftpWildcardMatcher *swcm)
+{
+    if (swcm->reading) {
+        sftplistcache_release(sftplistcache_end(&swcm->sftp->listcache, swcm->reading, swcm->cdir, swcm->dir));
+        swcm->reading = NULL;
+    }
 }
 
 static bool sftpwcm_readdir_recv(SftpWildcardMatcher *swcm, struct sftp_packet *pktin)
@@ -116,6 +146,8 @@ static bool sftpwcm_readdir_recv(SftpWildcardMatcher *swcm, struct sftp_packet *
     if (!swcm->names) {
         if (fxp_error_type() != SSH_FX_EOF) {
             sftp_line_printf(swcm->sftp, SEAT_OUTPUT_STDERR, swcm->cdir, "%s: reading directory: %s", utf8_arg, fxp_error());
+        } else {
+            sftpwcm_cache_listing(swcm);
         }
         return false;
     } else if (swcm->names->nnames == 0) {
@@ -127,16 +159,22 @@ static bool sftpwcm_readdir_recv(SftpWildcardMatcher *swcm, struct sftp_packet *
          * "..", but there's nothing forbidding a server from
          * omitting those if it wants to.
          */
+        sftpwcm_cache_listing(swcm);
         return false;
     }
 
+    for (int i = 0; i < swcm->names->nnames && swcm->reading; i++) {
+        if (!sftplistcache_add(swcm->reading, &swcm->names->names[i])) {
+            sftplistcache_release(swcm->reading);
+            swcm->reading = NULL;
+        }
+    }
     swcm->namepos = 0;
     return true;
 }
 
 static void sftpwcm_finish(SftpWildcardMatcher *swcm)
 {
-    sftp_set_sending_backend(swcm->sftp);
     sftpcmd_set_request(swcm->cmd, SSH_FXP_CLOSE, fxp_close_send(swcm->dirh));
     swcm->dirh = NULL;
 }
@@ -158,6 +196,13 @@ static void sftpwcm_free(SftpWildcardMatcher *swcm)
         fxp_free_names(swcm->names);
     }
     sfree((void *)swcm->wildcard);
+    sfree((void *)swcm->dir);
+    if (swcm->reading) {
+        sftplistcache_release(swcm->reading);
+    }
+    if (swcm->cached) {
+        sftplistcache_release(swcm->cached);
+    }
     sfree(swcm);
 }
 
@@ -246,7 +291,6 @@ static bool sftpwcm_iterator_next_arg(SftpWildcardMatcherIterator* it, Sftp *sft
             it->swcm = sftpwcm_begin(arg->name, arg->wildcard, sftp, cmd);
         } else {
             it->cname = arg->name;
-            sftp_set_sending_backend(sftp);
             sftpcmd_set_request(cmd, SSH_FXP_REALPATH, fxp_realpath_send(it->cname));
         }
         arg->name = NULL;
@@ -257,18 +301,28 @@ static bool sftpwcm_iterator_next_arg(SftpWildcardMatcherIterator* it, Sftp *sft
     return false;
 }
 
+static bool sftpwcm_iterator_next_name(SftpWildcardMatcherIterator* it, Sftp *sftp, SftpCmd *cmd)
+{
+    it->cname = sftpwcm_get_filename(it->swcm);
+    if (it->cname) {
+        it->func(it->cname, sftp, cmd);
+        return true;
+    }
+    if (it->swcm->cached) { // cached listing done
+        sftpwcm_free(it->swcm);
+        it->swcm = NULL;
+        return sftpwcm_iterator_next_arg(it, sftp, cmd);
+    }
+    return true; // all fetched names processed, next readdir sent
+}
+
 bool sftpwcm_iterator_next(SftpWildcardMatcherIterator* it, Sftp *sftp, SftpCmd *cmd)
 {
     sfree((void *)it->cname);
     it->cname = NULL;
 
     if (it->swcm) {
-        it->cname = sftpwcm_get_filename(it->swcm);
-        if (!it->cname) { // all names processed, next readdir sent
-            return true;
-        }
-        it->func(it->cname, sftp, cmd);
-        return true;
+        return sftpwcm_iterator_next_name(it, sftp, cmd);
     }
     return sftpwcm_iterator_next_arg(it, sftp, cmd); // next argument
 }
@@ -278,6 +332,9 @@ bool sftpwcm_iterator_pktin(SftpWildcardMatcherIterator* it, Sftp *sftp, SftpCmd
     if (cmd->req_type == SSH_FXP_REALPATH) {
         if (it->swcm) {
             if (sftpwcm_realpath_recv(it->swcm, pktin)) {
+                if (it->swcm->cached) {
+                    return sftpwcm_iterator_next_name(it, sftp, cmd);
+                }
                 return true;
             }
             sftpwcm_free(it->swcm);
@@ -307,12 +364,7 @@ bool sftpwcm_iterator_pktin(SftpWildcardMatcherIterator* it, Sftp *sftp, SftpCmd
             sftpwcm_finish(it->swcm);
             return true;
         }
-        it->cname = sftpwcm_get_filename(it->swcm);
-        if (!it->cname) { // all fetched names processed, next readdir sent
-            return true;
-        }
-        it->func(it->cname, sftp, cmd);
-        return true;
+        return sftpwcm_iterator_next_name(it, sftp, cmd);
     } else if (cmd->req_type == SSH_FXP_CLOSE) {
         sftpwcm_close_recv(it->swcm, pktin);
         it->swcm = NULL;
@@ -0,0 +1,304 @@
+#include "sftpwritebehind.h"
+#include "putty.h"
+#include "psftpext.h"
+
+typedef struct Block Block;
+struct Block {
+    Block *next;
+    uint64_t offset;
+    size_t len;
+    char *data;
+};
+
+/* The fields marked with lock are shared with the writer thread. */
+struct SftpWriteBehind {
+    WFile *file;
+    Block *fill;            /* UI thread only */
+    uint64_t offset;        /* UI thread only, of the next block */
+    uint64_t start;
+    Block *head, *tail;     /* lock, full blocks waiting to be written */
+    int nblocks;            /* lock, blocks owned including fill */
+    uint64_t written;       /* lock, bytes on disk */
+    bool closing;           /* lock */
+    bool closed;            /* lock */
+    bool abandoned;         /* lock */
+    bool set_times;         /* set before closing */
+    bool reserved;          /* set before closing */
+    unsigned long mtime, atime;
+    volatile LONG failed;
+    HANDLE event;           /* signals the callback through the handle wait */
+    HANDLE space_event;     /* signals get_block() waiting for a block */
+    HandleWait *wait;
+    SftpWriteBehind *next;  /* lock */
+};
+
+/* Writers which are not closed yet. */
+static SftpWriteBehind *writers = NULL;
+static Block *pool = NULL;
+static int pool_size = 0;
+static CRITICAL_SECTION lock;
+static HANDLE wake_event = NULL;
+static HANDLE writer_thread = NULL;
+
+/* Called with the lock held. */
+static void release_block(SftpWriteBehind *wb, Block *b)
+{
+    wb->nblocks--;
+    if (pool_size < SFTPWRITEBEHIND_POOL_BLOCKS) {
+        b->next = pool;
+        pool = b;
+        pool_size++;
+    } else {
+        sfree(b->data);
+        sfree(b);
+    }
+}
+
+static bool write_block(SftpWriteBehind *wb, Block *b)
+{
+    size_t pos = 0;
+    while (pos < b->len) {
+        int len = write_to_file_at(wb->file, b->offset + pos, b->data + pos, b->len - pos);
+        if (len <= 0) {
+            InterlockedExchange(&wb->failed, 1);
+            return false;
+        }
+        pos += len;
+    }
+    return true;
+}
+
+/* Does one piece of work, returns false if there was none. Called with the
+   lock held, which is released while the disk is accessed. */
+static bool writer_step()
+{
+    for (SftpWriteBehind **p = &writers; *p; p = &(*p)->next) {
+        SftpWriteBehind *wb = *p;
+        if (wb->head) {
+            Block *b = wb->head;
+            wb->head = b->next;
+            if (!wb->head) {
+                wb->tail = NULL;
+            }
+            bool skip = wb->abandoned || wb->failed;
+            LeaveCriticalSection(&lock);
+            bool written = !skip && write_block(wb, b);
+            EnterCriticalSection(&lock);
+            if (written) {
+                wb->written += b->len;
+            }
+            release_block(wb, b);
+            SetEvent(wb->event);
+            SetEvent(wb->space_event);
+            return true;
+        }
+        if (wb->closing || wb->abandoned) {
+            *p = wb->next;
+            bool set_times = wb->set_times && !wb->abandoned && !wb->failed;
+            uint64_t end = wb->start + wb->written;
+            LeaveCriticalSection(&lock);
+            if (wb->reserved) {
+                reserve_file_space(wb->file, end);
+            }
+            if (set_times) {
+                set_file_times(wb->file, wb->mtime, wb->atime);
+            }
+            close_wfile(wb->file);
+            EnterCriticalSection(&lock);
+            if (wb->abandoned) {
+                CloseHandle(wb->event);
+                CloseHandle(wb->space_event);
+                sfree(wb);
+            } else {
+                wb->closed = true;
+                SetEvent(wb->event);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static DWORD WINAPI writer_threadfunc(void *param)
+{
+    for (;;) {
+        WaitForSingleObject(wake_event, INFINITE);
+        EnterCriticalSection(&lock);
+        while (writer_step());
+        LeaveCriticalSection(&lock);
+    }
+    return 0;
+}
+
+SftpWriteBehind *sftpwritebehind_new(WFile *file, uint64_t offset, SftpWriteBehindCallback callback, void *ctx)
+{
+    if (!writer_thread) {
+        InitializeCriticalSection(&lock);
+        wake_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+        writer_thread = CreateThread(NULL, 0, writer_threadfunc, NULL, 0, NULL);
+    }
+    SftpWriteBehind *wb = snew(SftpWriteBehind);
+    memset(wb, 0, sizeof(SftpWriteBehind));
+    wb->file = file;
+    wb->offset = offset;
+    wb->start = offset;
+    wb->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    wb->space_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    wb->wait = add_handle_wait(wb->event, callback, ctx);
+    EnterCriticalSection(&lock);
+    wb->next = writers;
+    writers = wb;
+    LeaveCriticalSection(&lock);
+    return wb;
+}
+
+size_t sftpwritebehind_space(SftpWriteBehind *wb)
+{
+    EnterCriticalSection(&lock);
+    size_t space = (size_t)(SFTPWRITEBEHIND_MAX_BLOCKS - wb->nblocks) * SFTPWRITEBEHIND_BLOCK_SIZE;
+    LeaveCriticalSection(&lock);
+    if (wb->fill) {
+        space += SFTPWRITEBEHIND_BLOCK_SIZE - wb->fill->len;
+    }
+    return space;
+}
+
+/* Waits on its own event when the file has all its blocks, the main loop
+   waits on wb->event and would take a signal meant for the other waiter. */
+static Block *get_block(SftpWriteBehind *wb)
+{
+    for (;;) {
+        EnterCriticalSection(&lock);
+        if (wb->nblocks < SFTPWRITEBEHIND_MAX_BLOCKS) {
+            wb->nblocks++;
+            Block *b = pool;
+            if (b) {
+                pool = b->next;
+                pool_size--;
+            }
+            LeaveCriticalSection(&lock);
+            if (!b) {
+                b = snew(Block);
+                b->data = snewn(SFTPWRITEBEHIND_BLOCK_SIZE, char);
+            }
+            b->next = NULL;
+            b->len = 0;
+            return b;
+        }
+        LeaveCriticalSection(&lock);
+        WaitForSingleObject(wb->space_event, INFINITE);
+    }
+}
+
+static void queue_fill(SftpWriteBehind *wb)
+{
+    Block *b = wb->fill;
+    wb->fill = NULL;
+    b->offset = wb->offset;
+    wb->offset += b->len;
+    EnterCriticalSection(&lock);
+    if (wb->tail) {
+        wb->tail->next = b;
+    } else {
+        wb->head = b;
+    }
+    wb->tail = b;
+    LeaveCriticalSection(&lock);
+    SetEvent(wake_event);
+}
+
+bool sftpwritebehind_write(SftpWriteBehind *wb, const void *data, size_t len)
+{
+    const char *p = (const char *)data;
+    while (len > 0 && !wb->failed) {
+        if (!wb->fill) {
+            wb->fill = get_block(wb);
+        }
+        size_t n = SFTPWRITEBEHIND_BLOCK_SIZE - wb->fill->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(wb->fill->data + wb->fill->len, p, n);
+        wb->fill->len += n;
+        p += n;
+        len -= n;
+        if (wb->fill->len == SFTPWRITEBEHIND_BLOCK_SIZE) {
+            queue_fill(wb);
+        }
+    }
+    return !wb->failed;
+}
+
+void sftpwritebehind_set_times(SftpWriteBehind *wb, unsigned long mtime, unsigned long atime)
+{
+    wb->set_times = true;
+    wb->mtime = mtime;
+    wb->atime = atime;
+}
+
+void sftpwritebehind_set_reserved(SftpWriteBehind *wb)
+{
+    wb->reserved = true;
+}
+
+void sftpwritebehind_close(SftpWriteBehind *wb)
+{
+    if (wb->fill && wb->fill->len > 0) {
+        queue_fill(wb);
+    }
+    EnterCriticalSection(&lock);
+    if (wb->fill) {
+        release_block(wb, wb->fill);
+        wb->fill = NULL;
+    }
+    wb->closing = true;
+    LeaveCriticalSection(&lock);
+    SetEvent(wake_event);
+}
+
+bool sftpwritebehind_closed(SftpWriteBehind *wb)
+{
+    EnterCriticalSection(&lock);
+    bool closed = wb->closed;
+    LeaveCriticalSection(&lock);
+    return closed;
+}
+
+uint64_t sftpwritebehind_written(SftpWriteBehind *wb)
+{
+    EnterCriticalSection(&lock);
+    uint64_t written = wb->written;
+    LeaveCriticalSection(&lock);
+    return written;
+}
+
+bool sftpwritebehind_failed(SftpWriteBehind *wb)
+{
+    return wb->failed;
+}
+
+void sftpwritebehind_free(SftpWriteBehind *wb)
+{
+    delete_handle_wait(wb->wait);
+    EnterCriticalSection(&lock);
+    if (wb->fill) {
+        release_block(wb, wb->fill);
+        wb->fill = NULL;
+    }
+    while (wb->head) {
+        Block *b = wb->head;
+        wb->head = b->next;
+        release_block(wb, b);
+    }
+    wb->tail = NULL;
+    if (wb->closed) {
+        LeaveCriticalSection(&lock);
+        CloseHandle(wb->event);
+        CloseHandle(wb->space_event);
+        sfree(wb);
+        return;
+    }
+    wb->abandoned = true;
+    LeaveCriticalSection(&lock);
+    SetEvent(wake_event);
+}
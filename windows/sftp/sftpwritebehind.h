@@ -0,0 +1,56 @@
+#ifndef SFTPWRITEBEHIND_H
+#define SFTPWRITEBEHIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Writes a downloaded file on a background thread, so a slow local disk
+ * neither blocks the UI thread nor the other sessions. The data is copied
+ * into pooled blocks of SFTPWRITEBEHIND_BLOCK_SIZE bytes and every block is
+ * written with a single write at its own offset once it is full, so the
+writes do not depend on the file position. A file has at most
+ * SFTPWRITEBEHIND_MAX_BLOCKS blocks, the caller keeps its reads within
+ * sftpwritebehind_space(), so a full queue throttles the download instead
+ * of growing.
+ *
+ * The callback runs on the UI thread, from the handle wait of the main
+ * loop, whenever the writer thread has written a block or closed the file.
+ */
+
+#define SFTPWRITEBEHIND_BLOCK_SIZE (1024*1024)
+#define SFTPWRITEBEHIND_MAX_BLOCKS 16
+#define SFTPWRITEBEHIND_POOL_BLOCKS 16
+
+typedef struct WFile WFile;
+typedef struct SftpWriteBehind SftpWriteBehind;
+typedef void (*SftpWriteBehindCallback)(void *ctx);
+
+/* Takes over the file, it is closed by the writer thread. The data is
+   written from offset on. */
+SftpWriteBehind *sftpwritebehind_new(WFile *file, uint64_t offset, SftpWriteBehindCallback callback, void *ctx);
+/* Bytes which can be written without waiting for the writer thread. */
+size_t sftpwritebehind_space(SftpWriteBehind *wb);
+/* Queues a copy of the data, waiting for the writer thread only if the
+   caller wrote more than the space. Returns false once a write failed. */
+bool sftpwritebehind_write(SftpWriteBehind *wb, const void *data, size_t len);
+/* Sets the modification and access times of the file once the last block
+   is written, before it is closed. */
+void sftpwritebehind_set_times(SftpWriteBehind *wb, unsigned long mtime, unsigned long atime);
+/* The file has disk space reserved up to its expected size, see
+   reserve_file_space(). The space beyond the data written is given back
+   before the file is closed, a short or failed transfer keeps none. */
+void sftpwritebehind_set_reserved(SftpWriteBehind *wb);
+/* Queues the last partial block and closes the file after it. */
+void sftpwritebehind_close(SftpWriteBehind *wb);
+bool sftpwritebehind_closed(SftpWriteBehind *wb);
+/* Bytes the writer thread has written to the file so far, in order from
+   the offset given. */
+uint64_t sftpwritebehind_written(SftpWriteBehind *wb);
+bool sftpwritebehind_failed(SftpWriteBehind *wb);
+/* Frees a closed writer. A writer still running drops the data not written
+   yet and the file is closed in the background. */
+void sftpwritebehind_free(SftpWriteBehind *wb);
+
+#endif
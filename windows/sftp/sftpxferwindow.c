@@ -0,0 +1,167 @@
+#include "sftpxferwindow.h"
+#include "putty.h"
+
+void xfer_limits_init(SftpXferLimits *limits)
+{
+    limits->max_window = XFER_DEFAULT_MAX_WINDOW;
+    limits->max_read = XFER_DEFAULT_CHUNK;
+    limits->max_write = XFER_DEFAULT_CHUNK;
+    limits->pin_window = 0;
+    limits->pin_chunk = 0;
+    limits->ceiling_read = XFER_MAX_CHUNK;
+    limits->ceiling_write = XFER_MAX_CHUNK;
+}
+
+/* A WRITE carries its handle and offset besides the data, OpenSSH leaves
+   this much of the packet to them. */
+#define XFER_WRITE_OVERHEAD 1024
+
+static int ceiling(uint64_t max)
+{
+    if (max == 0 || max > XFER_MAX_CHUNK) {
+        return XFER_MAX_CHUNK;
+    }
+    return (max < XFER_MIN_CHUNK ? XFER_MIN_CHUNK : (int)max);
+}
+
+void xfer_limits_set_server(SftpXferLimits *limits, const SftpServerLimits *server)
+{
+    uint64_t max_write = server->max_write;
+    if (server->max_packet > XFER_WRITE_OVERHEAD && (max_write == 0 || max_write > server->max_packet - XFER_WRITE_OVERHEAD)) {
+        max_write = server->max_packet - XFER_WRITE_OVERHEAD;
+    }
+    limits->ceiling_read = ceiling(server->max_read);
+    limits->ceiling_write = ceiling(max_write);
+    limits->max_read = limits->ceiling_read;
+    limits->max_write = limits->ceiling_write;
+}
+
+static void set_chunk(SftpXferWindow *w)
+{
+    if (w->pinned) {
+        return;
+    }
+    w->chunk = w->window / 16;
+    if (w->chunk < XFER_DEFAULT_CHUNK) {
+        w->chunk = XFER_DEFAULT_CHUNK;
+    }
+    if (w->chunk > w->max_chunk) {
+        w->chunk = w->max_chunk;
+    }
+}
+
+void xfer_window_init(SftpXferWindow *w, const SftpXferLimits *limits, bool upload)
+{
+    memset(w, 0, sizeof(SftpXferWindow));
+    if (limits->pin_window) {
+        w->pinned = true;
+        w->window = w->max_window = limits->pin_window;
+        w->chunk = w->max_chunk = limits->pin_chunk;
+        return;
+    }
+    w->max_window = limits->max_window;
+    w->max_chunk = (upload ? limits->max_write : limits->max_read);
+    w->window = XFER_DEFAULT_WINDOW;
+    if (w->window > w->max_window) {
+        w->window = w->max_window;
+    }
+    set_chunk(w);
+}
+
+uint64_t xfer_window_now(void)
+{
+    static LARGE_INTEGER freq;
+    if (!freq.QuadPart) {
+        QueryPerformanceFrequency(&freq);
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000 + (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+}
+
+void xfer_window_start_at(SftpXferWindow *w, uint64_t now)
+{
+    w->timing = false;
+    w->interval_time = now;
+    w->interval_bytes = 0;
+}
+
+void xfer_window_start(SftpXferWindow *w)
+{
+    xfer_window_start_at(w, xfer_window_now());
+}
+
+void xfer_window_sent_at(SftpXferWindow *w, uint64_t offset, uint64_t now)
+{
+    if (!w->timing) {
+        w->timing = true;
+        w->timed_offset = offset;
+        w->timed_time = now;
+    }
+}
+
+void xfer_window_sent(SftpXferWindow *w, uint64_t offset)
+{
+    if (!w->timing) {
+        xfer_window_sent_at(w, offset, xfer_window_now());
+    }
+}
+
+static void adapt(SftpXferWindow *w)
+{
+    uint64_t target = 2 * w->rate * w->min_rtt / 1000000;
+    uint64_t window = w->window;
+    if (target > window) {
+        window = (target < 2 * window ? target : 2 * window);
+    } else {
+        window = (target > window * 3 / 4 ? target : window * 3 / 4);
+    }
+    if (window < XFER_MIN_WINDOW) {
+        window = XFER_MIN_WINDOW;
+    }
+    if (window > w->max_window) {
+        window = w->max_window;
+    }
+    w->window = (int)window;
+    set_chunk(w);
+}
+
+void xfer_window_acked_at(SftpXferWindow *w, uint64_t offset, int len, uint64_t now)
+{
+    if (len > 0) {
+        w->interval_bytes += len;
+    }
+    if (!w->timing || offset != w->timed_offset) {
+        return;
+    }
+    w->timing = false;
+
+    uint64_t rtt = now - w->timed_time;
+    if (rtt < XFER_WINDOW_MIN_RTT) {
+        rtt = XFER_WINDOW_MIN_RTT;
+    }
+    w->srtt = (w->srtt ? (7 * w->srtt + rtt) / 8 : rtt);
+    if (!w->min_rtt || rtt < w->min_rtt) {
+        w->min_rtt = rtt;
+    }
+
+    uint64_t elapsed = now - w->interval_time;
+    if (elapsed < XFER_WINDOW_MIN_INTERVAL) {
+        return;
+    }
+    w->rate = w->interval_bytes * 1000000 / elapsed;
+    w->interval_time = now;
+    w->interval_bytes = 0;
+    if (!w->pinned) {
+        adapt(w);
+    }
+}
+
+void xfer_window_acked(SftpXferWindow *w, uint64_t offset, int len)
+{
+    if (w->timing && offset == w->timed_offset) {
+        xfer_window_acked_at(w, offset, len, xfer_window_now());
+    } else if (len > 0) {
+        w->interval_bytes += len;
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef SFTPXFERWINDOW_H
+#define SFTPXFERWINDOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Sizes the READs and WRITEs a transfer keeps outstanding. Once per round
+ * trip (but at most every XFER_WINDOW_MIN_INTERVAL) the delivered
+ * rate is measured and the window moves towards twice the bandwidth-delay
+ * product, rate * lowest round trip time. While the window is the limit the
+ * rate grows with it and the window doubles; once the link is the limit the
+ * round trip time grows instead, and the window settles where the requests
+ * queue for about one round trip. The round trips are timed in
+ * microseconds with QueryPerformanceCounter(), a LAN's are well below the
+ * tick of GetTickCount().
+ */
+
+/* PuTTY's fixed budget, used until the first measurement. */
+#define XFER_DEFAULT_WINDOW (1024*1024)
+#define XFER_DEFAULT_MAX_WINDOW (16*1024*1024)
+#define XFER_MIN_WINDOW (64*1024)
+#define XFER_MAX_WINDOW (256*1024*1024)
+
+/* Every server handles requests of 32 KiB, bigger ones have to be allowed
+   by raising the ceilings. OpenSSH serves reads up to 255 KiB. */
+#define XFER_DEFAULT_CHUNK 32768
+#define XFER_MIN_CHUNK 1024
+#define XFER_MAX_CHUNK (255*1024)
+
+/* Microseconds. A round trip is never taken as shorter than
+   XFER_WINDOW_MIN_RTT, nor the bandwidth-delay product as smaller. */
+#define XFER_WINDOW_MIN_INTERVAL 100000
+#define XFER_WINDOW_MIN_RTT 100
+
+/* Per session settings, a pinned window and chunk of 0 let them adapt. The
+   request sizes can be set up to the ceilings, XFER_MAX_CHUNK unless the
+   server told its limits. */
+typedef struct SftpXferLimits {
+    int max_window;
+    int max_read;
+    int max_write;
+    int pin_window;
+    int pin_chunk;
+    int ceiling_read;
+    int ceiling_write;
+} SftpXferLimits;
+
+/* The reply to limits@openssh.com, 0 where the server has no limit. */
+typedef struct SftpServerLimits {
+    uint64_t max_packet;
+    uint64_t max_read;
+    uint64_t max_write;
+    uint64_t max_handles;
+} SftpServerLimits;
+
+typedef struct SftpXferWindow {
+    int window;             /* bytes of requests kept outstanding */
+    int chunk;              /* bytes per request */
+    int max_window;
+    int max_chunk;
+    bool pinned;
+
+    uint64_t srtt;          /* microseconds, 0 until measured */
+    uint64_t min_rtt;
+    uint64_t rate;          /* bytes per second of the last interval */
+
+    bool timing;
+    uint64_t timed_offset;
+    uint64_t timed_time;    /* microseconds, see xfer_window_now() */
+    uint64_t interval_time;
+    uint64_t interval_bytes;
+} SftpXferWindow;
+
+void xfer_limits_init(SftpXferLimits *limits);
+/* Sets the ceilings to what the server accepts, within XFER_MIN_CHUNK and
+   XFER_MAX_CHUNK, and the request sizes up to them. */
+void xfer_limits_set_server(SftpXferLimits *limits, const SftpServerLimits *server);
+
+void xfer_window_init(SftpXferWindow *w, const SftpXferLimits *limits, bool upload);
+/* Starts a transfer. What was learned about the link is kept. */
+void xfer_window_start(SftpXferWindow *w);
+void xfer_window_sent(SftpXferWindow *w, uint64_t offset);
+void xfer_window_acked(SftpXferWindow *w, uint64_t offset, int len);
+
+/* The same at a given time in microseconds, for the tests. */
+uint64_t xfer_window_now(void);
+void xfer_window_start_at(SftpXferWindow *w, uint64_t now);
+void xfer_window_sent_at(SftpXferWindow *w, uint64_t offset, uint64_t now);
+void xfer_window_acked_at(SftpXferWindow *w, uint64_t offset, int len, uint64_t now);
+
+#endif
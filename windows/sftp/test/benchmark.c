@@ -0,0 +1,206 @@
+/*
+ * Measures the client side cost of an upload per GiB. A local file is put
+ * to the in-process test server with pinned request sizes, so the time is
+ * spent reading the local file, building the WRITE packets and decoding
+ * them in the test server, which does not store the data. Reading the file
+ * alone is measured as a baseline.
+ *
+ * Also measures the replies per second the pending request lookup handles
+ * with 1k and 10k requests in flight: a reply finds and removes the oldest
+ * request and a new one is added, with the request table and with the
+ * first fit tree234 of PuTTY's sftp.c.
+ *
+ * Usage: sftpbench.exe [ <file size in MiB> ]
+ */
+
+#include "testassert.h"
+#include "testlocal.h"
+#include "psftp.h"
+#include "sftpreqtable.h"
+#include "tree234.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_FILE "bench.bin"
+
+DEFINE_ASSERT_FAIL_COUNTER;
+
+void free_reverse_mappings();
+
+void console_print_error_msg(const char *prefix, const char *msg)
+{
+    fputs(prefix, stderr);
+    fputs(": ", stderr);
+    fputs(msg, stderr);
+    fputc('\n', stderr);
+    fflush(stderr);
+}
+
+void cleanup_exit(int code)
+{
+    exit(code);
+}
+
+static double seconds()
+{
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / freq.QuadPart;
+}
+
+static void print_result(const char *what, int size, double elapsed, uint64_t bytes)
+{
+    printf("%-6s %7d byte blocks: %8.3f s/GiB\n", what, size, elapsed * 1073741824.0 / bytes);
+}
+
+static void bench_read(int blocksize, uint64_t size)
+{
+    RFile *f = open_existing_file(BENCH_FILE, NULL, NULL, NULL, NULL);
+    ASSERT_TRUE(f != NULL);
+    if (!f) {
+        return;
+    }
+    char *buffer = snewn(blocksize, char);
+    uint64_t total = 0;
+    int len;
+    double start = seconds();
+    while ((len = read_from_file(f, buffer, blocksize)) > 0) {
+        total += len;
+    }
+    double elapsed = seconds() - start;
+    close_rfile(f);
+    sfree(buffer);
+    ASSERT_TRUE(total == size);
+    print_result("read", blocksize, elapsed, size);
+}
+
+static void bench_put(TestLocal *tl, TestRemote *tr, int chunk, uint64_t size)
+{
+    char command[64];
+    sprintf(command, "xfer pin 1m %d", chunk);
+    testlocal_execute(tl, command);
+
+    double start = seconds();
+    testlocal_execute(tl, "put " BENCH_FILE);
+    testremote_process(tr);
+    double elapsed = seconds() - start;
+    ASSERT_TRUE(testremote_check_size(tr, BENCH_FILE) == size);
+    testlocal_clear_output(tl);
+    print_result("put", chunk, elapsed, size);
+}
+
+#define BENCH_REPLIES 2000000
+
+typedef struct BenchReq {
+    unsigned id;
+} BenchReq;
+
+static int bench_reqcmp(void *av, void *bv)
+{
+    BenchReq *a = (BenchReq *)av, *b = (BenchReq *)bv;
+    return (a->id < b->id ? -1 : a->id > b->id ? 1 : 0);
+}
+
+static int bench_reqfind(void *av, void *bv)
+{
+    unsigned id = *(unsigned *)av;
+    BenchReq *b = (BenchReq *)bv;
+    return (id < b->id ? -1 : id > b->id ? 1 : 0);
+}
+
+/* sftp_alloc_request() */
+static BenchReq *tree_alloc(tree234 *requests)
+{
+    int low = -1, high = count234(requests);
+    while (high - low > 1) {
+        int mid = (high + low) / 2;
+        BenchReq *r = index234(requests, mid);
+        if (r->id == (unsigned)mid) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    BenchReq *r = snew(BenchReq);
+    r->id = low + 1;
+    add234(requests, r);
+    return r;
+}
+
+static void bench_tree(int inflight)
+{
+    tree234 *requests = newtree234(bench_reqcmp);
+    unsigned *ids = snewn(inflight, unsigned);
+    for (int i = 0; i < inflight; i++) {
+        ids[i] = tree_alloc(requests)->id;
+    }
+    double start = seconds();
+    for (int i = 0; i < BENCH_REPLIES; i++) {
+        unsigned *id = &ids[i % inflight];
+        BenchReq *r = find234(requests, id, bench_reqfind);
+        ASSERT_TRUE(r != NULL);
+        del234(requests, r);
+        sfree(r);
+        *id = tree_alloc(requests)->id;
+    }
+    double elapsed = seconds() - start;
+    BenchReq *r;
+    while ((r = delpos234(requests, 0)) != NULL) {
+        sfree(r);
+    }
+    freetree234(requests);
+    sfree(ids);
+    printf("tree234  %5d in flight: %8.2f M replies/s\n", inflight, BENCH_REPLIES / elapsed / 1e6);
+}
+
+static void bench_table(int inflight)
+{
+    SftpReqTable requests;
+    sftpreqtable_init(&requests);
+    BenchReq *reqs = snewn(inflight, BenchReq);
+    for (int i = 0; i < inflight; i++) {
+        reqs[i].id = sftpreqtable_add(&requests, &reqs[i]);
+    }
+    double start = seconds();
+    for (int i = 0; i < BENCH_REPLIES; i++) {
+        BenchReq *r = sftpreqtable_del(&requests, reqs[i % inflight].id);
+        ASSERT_TRUE(r == &reqs[i % inflight]);
+        r->id = sftpreqtable_add(&requests, r);
+    }
+    double elapsed = seconds() - start;
+    sftpreqtable_uninit(&requests);
+    sfree(reqs);
+    printf("reqtable %5d in flight: %8.2f M replies/s\n", inflight, BENCH_REPLIES / elapsed / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t size = (uint64_t)(argc > 1 ? atoi(argv[1]) : 256) * 1048576;
+    static const int read_sizes[] = {4096, 32768, 262144, 1048576};
+    static const int put_sizes[] = {4096, 32768, 65536, 261120};
+    static const int inflight[] = {1000, 10000};
+
+    TestRemote tr;
+    TestLocal tl;
+    testremote_init(&tr);
+    testlocal_init(&tl, &tr, "UTF-8");
+    testlocal_add_file(&tl, BENCH_FILE, size);
+
+    for (size_t i = 0; i < lenof(read_sizes); i++) {
+        bench_read(read_sizes[i], size);
+    }
+    for (size_t i = 0; i < lenof(put_sizes); i++) {
+        bench_put(&tl, &tr, put_sizes[i], size);
+    }
+    for (size_t i = 0; i < lenof(inflight); i++) {
+        bench_tree(inflight[i]);
+        bench_table(inflight[i]);
+    }
+
+    testlocal_uninit(&tl);
+    testremote_uninit(&tr);
+    free_reverse_mappings();
+    ASSERT_CHECK_FAIL_COUNT();
+    return 0;
+}
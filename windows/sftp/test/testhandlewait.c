@@ -0,0 +1,55 @@
+#include "testhandlewait.h"
+#include "putty.h"
+
+#define TESTHANDLEWAIT_TIMEOUT 10000
+
+struct HandleWait {
+    HANDLE handle;
+    handle_wait_callback_fn_t callback;
+    void *callback_ctx;
+    HandleWait *next;
+};
+
+static HandleWait *waits = NULL;
+
+HandleWait *add_handle_wait(HANDLE h, handle_wait_callback_fn_t callback, void *callback_ctx)
+{
+    HandleWait *hw = snew(HandleWait);
+    hw->handle = h;
+    hw->callback = callback;
+    hw->callback_ctx = callback_ctx;
+    hw->next = waits;
+    waits = hw;
+    return hw;
+}
+
+void delete_handle_wait(HandleWait *hw)
+{
+    HandleWait **prev = &waits;
+    while (*prev != hw) {
+        prev = &(*prev)->next;
+    }
+    *prev = hw->next;
+    sfree(hw);
+}
+
+bool testhandlewait_run()
+{
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    HandleWait *hws[MAXIMUM_WAIT_OBJECTS];
+    DWORD n = 0;
+    for (HandleWait *hw = waits; hw && n < MAXIMUM_WAIT_OBJECTS; hw = hw->next) {
+        hws[n] = hw;
+        handles[n++] = hw->handle;
+    }
+    if (n == 0) {
+        return false;
+    }
+    DWORD ret = WaitForMultipleObjects(n, handles, FALSE, TESTHANDLEWAIT_TIMEOUT);
+    if (ret >= WAIT_OBJECT_0 + n) {
+        return false;
+    }
+    HandleWait *hw = hws[ret - WAIT_OBJECT_0];
+    hw->callback(hw->callback_ctx);
+    return true;
+}
@@ -0,0 +1,11 @@
+#ifndef TESTHANDLEWAIT_H
+#define TESTHANDLEWAIT_H
+
+#include <stdbool.h>
+
+/* The handle waits of the main loop for the tests. Waits until one of the
+   registered handles is signalled and calls its callback. Returns false if
+   no handle was registered or none was signalled in time. */
+bool testhandlewait_run();
+
+#endif
@@ -1,12 +1,9 @@
 #include "testlocal.h"
-#include "psftp.h"
+#include "psftpext.h"
 
 extern const BackendVtable sftp_backend;
 static const SeatVtable testseat_vt;
 
-void delete_file(const char *name);
-void delete_directory(const char *name);
-
 static void delete_directory_recurse(const char *name)
 {
     const char *errmsg;
@@ -84,17 +81,22 @@ void testlocal_init(TestLocal *tl, TestRemote *tr, const char *line_codepage)
     tl->called_seat_function = SF_NONE;
     tl->allow_cli_output = false;
 
+    /* the dummy SSH backend finds the TestRemote by the host */
+    char host[32];
+    sprintf(host, "%p", (void *)tr);
     Conf *conf = conf_new();
     conf_set_int(conf, CONF_sshprot, 2);
     conf_set_str(conf, CONF_line_codepage, line_codepage);
     backend_init(&sftp_backend, &tl->testseat, &tl->sftp, NULL, conf,
-                 (const char *)tr, 0, NULL, 0, false);
+                 host, 0, NULL, 0, false);
     conf_free(conf);
     backend_size(tl->sftp, 80, 1);
 
     testremote_startsession(tr);
-    testremote_process_request(tr, testremote_get_request(tr)); // SSH_FXP_INIT
-    testremote_process_request(tr, testremote_get_request(tr)); // SSH_FXP_REALPATH
+    struct sftp_packet *req;
+    while ((req = testremote_get_request(tr)) != NULL) { // SSH_FXP_INIT, limits, SSH_FXP_REALPATH
+        testremote_process_request(tr, req);
+    }
 }
 
 void testlocal_uninit(TestLocal *tl)
@@ -273,7 +275,7 @@ static const SeatVtable testseat_vt = {
     .sent = NULL,
     .banner = NULL,
     .get_userpass_input = NULL,
-    .notify_session_started = NULL,
+    .notify_session_started = nullseat_notify_session_started,
     .notify_remote_exit = testseat_notify_remote_exit,
     .notify_remote_disconnect = NULL,
     .connection_fatal = testseat_connection_fatal,
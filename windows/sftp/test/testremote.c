@@ -1,12 +1,15 @@
 #include "testremote.h"
+#include "testhandlewait.h"
+#include "ssh.h"
+
+#define PERMS_REGULAR 0100000
 
-void sftp_clear_sending_backend();
 
 struct TestRemoteFile {
     TestRemoteFile *parent;
     const char *name;
     struct fxp_attrs attrs;
-    size_t size;
+    uint64_t size;
     bool is_dir;
     TestRemoteFile **dir_content;
     size_t capacity;
@@ -164,8 +167,8 @@ static struct fxp_attrs get_attrs(TestRemoteFile *file)
     struct fxp_attrs attrs = file->attrs;
     attrs.flags |= SSH_FILEXFER_ATTR_SIZE;
     attrs.size = file->size;
-    if (file->is_dir && (attrs.flags&SSH_FILEXFER_ATTR_PERMISSIONS)) {
-        attrs.permissions |= PERMS_DIRECTORY;
+    if (attrs.flags&SSH_FILEXFER_ATTR_PERMISSIONS) {
+        attrs.permissions |= (file->is_dir ? PERMS_DIRECTORY : PERMS_REGULAR);
     }
     return attrs;
 }
@@ -173,7 +176,11 @@ static struct fxp_attrs get_attrs(TestRemoteFile *file)
 static void set_attrs(TestRemote *tr, TestRemoteFile *file, struct fxp_attrs attrs)
 {
     if (attrs.flags&SSH_FILEXFER_ATTR_PERMISSIONS) {
-        PUT_PERMISSIONS(file->attrs, attrs.permissions);
+        PUT_PERMISSIONS(file->attrs, attrs.permissions & 07777);
+    }
+    if ((attrs.flags&SSH_FILEXFER_ATTR_SIZE) && !file->is_dir) {
+        file->size = attrs.size;
+        file->create_size = attrs.size;
     }
     tr->is_dirty = true;
 }
@@ -184,7 +191,6 @@ void testremote_init(TestRemote *tr)
 {
     tr->srv.vt = &srv_vt;
     bufchain_init(&tr->received_data);
-    sftp_clear_sending_backend();
     tr->root = snew(TestRemoteFile);
     tr->root->parent = NULL;
     tr->root->name = NULL;
@@ -201,15 +207,26 @@ void testremote_init(TestRemote *tr)
     tr->is_dirty = false;
     tr->fail_request_type = 0;
     tr->fail_request_skip = 0;
+    tr->reply_order = TESTREMOTE_REPLY_FIFO;
+    tr->reply_split = 0;
+    tr->reply_batch = NULL;
+    tr->nrequests = 0;
+    tr->copy_data = true;
+    tr->client_seat = NULL;
+    tr->nconns = 0;
 }
 
 void testremote_uninit(TestRemote *tr)
 {
     free_file(tr->root);
     testremote_drop_requests(tr);
+    testremote_set_reply_batch(tr, false);
+    for (size_t i = 0; i < tr->nconns; i++) {
+        bufchain_clear(&tr->conns[i].received_data);
+    }
 }
 
-void testremote_add_file(TestRemote *tr, const char *name, size_t size)
+void testremote_add_file(TestRemote *tr, const char *name, uint64_t size)
 {
     TestRemoteFile *file = find_file(tr, get_find_parent(tr, name), name, true);
     if (file->is_dir) {
@@ -296,53 +313,247 @@ void testremote_drop_requests(TestRemote *tr)
     bufchain_clear(&tr->received_data);
 }
 
-struct sftp_packet *testremote_get_request(TestRemote *tr)
+static struct sftp_packet *get_request(bufchain *received_data)
 {
     char x[4];
-    if (!bufchain_try_fetch_consume(&tr->received_data, x, 4)) {
+    if (!bufchain_try_fetch_consume(received_data, x, 4)) {
         return NULL;
     }
     unsigned pktlen = GET_32BIT_MSB_FIRST(x);
     struct sftp_packet *pkt = sftp_recv_prepare(pktlen);
-    if (bufchain_fetch_consume_up_to(&tr->received_data, pkt->data, pkt->length) != pkt->length) {
+    if (bufchain_fetch_consume_up_to(received_data, pkt->data, pkt->length) != pkt->length) {
         sftp_pkt_free(pkt);
         return NULL;
     }
     sftp_recv_finish(pkt);
-    sftp_clear_sending_backend();
     return pkt;
 }
 
-void testremote_process_request(TestRemote *tr, struct sftp_packet *req)
+struct sftp_packet *testremote_get_request(TestRemote *tr)
+{
+    return get_request(&tr->received_data);
+}
+
+static struct sftp_packet *status_reply(unsigned id, unsigned status, const char *message)
+{
+    struct sftp_packet *reply = sftp_pkt_init(SSH_FXP_STATUS);
+    put_uint32(reply, id);
+    put_uint32(reply, status);
+    put_stringz(reply, message);
+    return reply;
+}
+
+static struct sftp_packet *version_reply(TestRemote *tr)
+{
+    struct sftp_packet *reply = sftp_pkt_init(SSH_FXP_VERSION);
+    put_uint32(reply, SFTP_PROTO_VERSION);
+    put_stringz(reply, "copy-data");
+    put_stringz(reply, "1");
+    put_stringz(reply, "check-file");
+    put_stringz(reply, "sha256");
+    put_stringz(reply, "limits@openssh.com");
+    put_stringz(reply, "1");
+    return reply;
+}
+
+/* The limits of OpenSSH, the reads are served from a 255k buffer. */
+static struct sftp_packet *limits_reply(unsigned id)
+{
+    struct sftp_packet *reply = sftp_pkt_init(SSH_FXP_EXTENDED_REPLY);
+    put_uint32(reply, id);
+    put_uint64(reply, 256*1024);
+    put_uint64(reply, 255*1024);
+    put_uint64(reply, 255*1024);
+    put_uint64(reply, 0);
+    return reply;
+}
+
+/* check-file-handle: handle, algorithms, offset, length (0 up to the end),
+   block size. One SHA-256 of the range, which holds zeros. */
+static struct sftp_packet *check_file_reply(unsigned id, struct sftp_packet *req)
+{
+    ptrlen handle = get_string(req);
+    get_string(req);
+    uint64_t offset = get_uint64(req);
+    uint64_t length = get_uint64(req);
+    get_uint32(req);
+    if (get_err(req) || handle.len != sizeof(TestRemoteFile *)) {
+        return status_reply(id, SSH_FX_BAD_MESSAGE, "malformed check-file-handle request");
+    }
+    TestRemoteFile *file = *((TestRemoteFile **)handle.ptr);
+    uint64_t avail = (offset < file->size ? file->size - offset : 0);
+    if (length == 0 || length > avail) {
+        length = avail;
+    }
+    static const unsigned char zeros[32768] = {0};
+    ssh_hash *h = ssh_hash_new(&ssh_sha256);
+    while (length > 0) {
+        size_t len = (length < sizeof(zeros) ? (size_t)length : sizeof(zeros));
+        put_data(h, zeros, len);
+        length -= len;
+    }
+    unsigned char digest[32];
+    ssh_hash_final(h, digest);
+    struct sftp_packet *reply = sftp_pkt_init(SSH_FXP_EXTENDED_REPLY);
+    put_uint32(reply, id);
+    put_stringz(reply, "check-file");
+    put_stringz(reply, "sha256");
+    put_data(reply, digest, sizeof(digest));
+    return reply;
+}
+
+/* limits@openssh.com, check-file-handle, and copy-data: from handle, offset, length (0 up to
+   the end), to handle, offset. The files hold no data, only the size is
+   copied. */
+static struct sftp_packet *extended_reply(TestRemote *tr, struct sftp_packet *req)
+{
+    unsigned id = get_uint32(req);
+    ptrlen name = get_string(req);
+    if (ptrlen_eq_string(name, "limits@openssh.com")) {
+        return limits_reply(id);
+    }
+    if (ptrlen_eq_string(name, "check-file-handle")) {
+        return check_file_reply(id, req);
+    }
+    if (!ptrlen_eq_string(name, "copy-data") || !tr->copy_data) {
+        return status_reply(id, SSH_FX_OP_UNSUPPORTED, "unsupported extended request");
+    }
+    ptrlen from = get_string(req);
+    uint64_t from_offset = get_uint64(req);
+    uint64_t length = get_uint64(req);
+    ptrlen to = get_string(req);
+    uint64_t to_offset = get_uint64(req);
+    if (get_err(req) || from.len != sizeof(TestRemoteFile *) || to.len != sizeof(TestRemoteFile *)) {
+        return status_reply(id, SSH_FX_BAD_MESSAGE, "malformed copy-data request");
+    }
+    TestRemoteFile *src = *((TestRemoteFile **)from.ptr);
+    TestRemoteFile *dst = *((TestRemoteFile **)to.ptr);
+    uint64_t avail = (from_offset < src->size ? src->size - from_offset : 0);
+    if (length == 0 || length > avail) {
+        length = avail;
+    }
+    if (length > 0 && to_offset + length > dst->size) {
+        dst->size = to_offset + length;
+    }
+    tr->is_dirty = true;
+    return status_reply(id, SSH_FX_OK, "");
+}
+
+/* Serves a request of the connection whose client is seat. */
+static void serve(TestRemote *tr, Seat *seat, struct sftp_packet *req)
 {
     struct sftp_packet *reply = NULL;
 
+    tr->nrequests++;
     if (req->type == tr->fail_request_type) {
         if (tr->fail_request_skip == 0) {
-            reply = sftp_pkt_init(SSH_FXP_STATUS);
-            put_uint32(reply, GET_32BIT_MSB_FIRST(req->data + 1));
-            put_uint32(reply, SSH_FX_PERMISSION_DENIED);
-            put_stringz(reply, "synthetic permission denied");
+            reply = status_reply(GET_32BIT_MSB_FIRST(req->data + 1), SSH_FX_PERMISSION_DENIED, "synthetic permission denied");
             tr->fail_request_type = 0;
         } else {
             tr->fail_request_skip--;
         }
     }
+    if (!reply && req->type == SSH_FXP_INIT) {
+        reply = version_reply(tr);
+    } else if (!reply && req->type == SSH_FXP_EXTENDED) {
+        reply = extended_reply(tr, req);
+    }
     if (!reply) {
         reply = sftp_handle_request(&tr->srv, req);
     }
     sftp_pkt_free(req);
     sftp_send_prepare(reply);
-    seat_output(tr->client_seat, SEAT_OUTPUT_STDOUT, reply->data, reply->length);
+    if (tr->reply_batch && seat == tr->client_seat) {
+        put_data(tr->reply_batch, reply->data, reply->length);
+        sftp_pkt_free(reply);
+        return;
+    }
+    size_t pos = 0;
+    while (pos < reply->length) {
+        size_t len = reply->length - pos;
+        if (tr->reply_split && len > tr->reply_split) {
+            len = tr->reply_split;
+        }
+        seat_output(seat, SEAT_OUTPUT_STDOUT, reply->data + pos, len);
+        pos += len;
+    }
     sftp_pkt_free(reply);
 }
 
-void testremote_process(TestRemote *tr)
+void testremote_process_request(TestRemote *tr, struct sftp_packet *req)
+{
+    serve(tr, tr->client_seat, req);
+}
+
+static void output_reply_batch(TestRemote *tr)
+{
+    if (tr->reply_batch && tr->reply_batch->len > 0) {
+        strbuf *batch = tr->reply_batch;
+        tr->reply_batch = strbuf_new();
+        seat_output(tr->client_seat, SEAT_OUTPUT_STDOUT, batch->s, batch->len);
+        strbuf_free(batch);
+    }
+}
+
+static void process_requests(TestRemote *tr)
 {
     struct sftp_packet *req;
-    while ((req = testremote_get_request(tr)) != NULL) {
-        testremote_process_request(tr, req);
+    if (tr->reply_order == TESTREMOTE_REPLY_FIFO) {
+        while ((req = testremote_get_request(tr)) != NULL) {
+            testremote_process_request(tr, req);
+        }
+        output_reply_batch(tr);
+        return;
     }
+
+    struct sftp_packet **reqs = NULL;
+    size_t nreqs = 0, reqsize = 0;
+    do {
+        while ((req = testremote_get_request(tr)) != NULL) {
+            sgrowarray(reqs, reqsize, nreqs);
+            reqs[nreqs++] = req;
+        }
+        while (nreqs > 0) {
+            testremote_process_request(tr, reqs[--nreqs]);
+        }
+    } while (bufchain_size(&tr->received_data) > 0);
+    sfree(reqs);
+    output_reply_batch(tr);
+}
+
+/* Starts the sessions of the extra connections and serves their requests
+   in order. Returns false if there was nothing to do. */
+static bool process_conns(TestRemote *tr)
+{
+    bool busy = false;
+    for (size_t i = 0; i < tr->nconns; i++) {
+        TestRemoteConn *c = &tr->conns[i];
+        if (c->lost) {
+            continue;
+        }
+        if (!c->started) {
+            c->started = true;
+            seat_notify_session_started(c->client_seat);
+            busy = true;
+        }
+        struct sftp_packet *req;
+        while (!c->lost && (req = get_request(&c->received_data)) != NULL) {
+            c->nrequests++;
+            serve(tr, c->client_seat, req);
+            busy = true;
+        }
+    }
+    return busy;
+}
+
+/* Also runs the local events the client waits for, until both are idle. */
+void testremote_process(TestRemote *tr)
+{
+    do {
+        do {
+            process_requests(tr);
+        } while (process_conns(tr));
+    } while (testhandlewait_run());
 }
 
 void testremote_connection_fatal(TestRemote *tr)
@@ -350,6 +561,14 @@ void testremote_connection_fatal(TestRemote *tr)
     seat_connection_fatal(tr->client_seat, "test connection fatal");
 }
 
+void testremote_conn_fatal(TestRemote *tr, size_t i)
+{
+    TestRemoteConn *c = &tr->conns[i];
+    c->lost = true;
+    bufchain_clear(&c->received_data);
+    seat_connection_fatal(c->client_seat, "test connection fatal");
+}
+
 bool testremote_is_dirty(TestRemote *tr)
 {
     return tr->is_dirty;
@@ -366,6 +585,31 @@ void testremote_fail_request(TestRemote *tr, int type, int skip)
     tr->fail_request_skip = skip;
 }
 
+void testremote_set_reply_order(TestRemote *tr, TestRemoteReplyOrder order)
+{
+    tr->reply_order = order;
+}
+
+void testremote_set_reply_batch(TestRemote *tr, bool batch)
+{
+    if (batch && !tr->reply_batch) {
+        tr->reply_batch = strbuf_new();
+    } else if (!batch && tr->reply_batch) {
+        strbuf_free(tr->reply_batch);
+        tr->reply_batch = NULL;
+    }
+}
+
+void testremote_set_reply_split(TestRemote *tr, size_t size)
+{
+    tr->reply_split = size;
+}
+
+void testremote_set_copy_data(TestRemote *tr, bool enabled)
+{
+    tr->copy_data = enabled;
+}
+
 static void srv_realpath(SftpServer *srv, SftpReplyBuilder *reply, ptrlen path)
 {
     TestRemote *tr = container_of(srv, TestRemote, srv);
@@ -604,7 +848,7 @@ static void srv_read(SftpServer *srv, SftpReplyBuilder *reply, ptrlen handle, ui
       fxp_reply_error(reply, SSH_FX_EOF, "");
       return;
     }
-    static const unsigned char buffer[32768] = {0};
+    static const unsigned char buffer[255*1024] = {0};
     ptrlen data = {&buffer, min(length, file->size-offset)};
     assert(data.len <= sizeof(buffer));
     fxp_reply_data(reply, data);
@@ -678,12 +922,35 @@ const struct SftpServerVtable srv_vt = {
     .readdir = srv_readdir
 };
 
+extern const BackendVtable dummyconn_backend;
+
+/* The host is the address of the TestRemote, see testlocal_init(). The
+   first backend is the main connection, the next ones are extra
+   connections. */
 static char *dummyssh_init(const BackendVtable *vt, Seat *seat,
                       Backend **backend_handle, LogContext *logctx,
                       Conf *conf, const char *host, int port,
                                 char **realhost, bool nodelay, bool keepalive)
 {
-    TestRemote *tr = (TestRemote *)host;
+    TestRemote *tr;
+    if (sscanf(host, "%p", (void **)&tr) != 1) {
+        return dupstr("bad test host");
+    }
+    if (tr->client_seat) {
+        if (tr->nconns == TESTREMOTE_MAX_CONNS) {
+            return dupstr("too many test connections");
+        }
+        TestRemoteConn *c = &tr->conns[tr->nconns++];
+        c->dummyssh.vt = &dummyconn_backend;
+        c->dummyssh.interactor = NULL;
+        c->client_seat = seat;
+        bufchain_init(&c->received_data);
+        c->started = false;
+        c->lost = false;
+        c->nrequests = 0;
+        *backend_handle = &c->dummyssh;
+        return NULL;
+    }
     tr->client_seat = seat;
     tr->dummyssh.vt = vt;
     tr->dummyssh.interactor = NULL;
@@ -734,3 +1001,48 @@ const BackendVtable ssh_backend = {
     .protocol = PROT_SSH,
     .default_port = 0,
 };
+
+/* The client is gone, its seat must not be used any more. */
+static void dummyconn_free(Backend *be)
+{
+    TestRemoteConn *c = container_of(be, TestRemoteConn, dummyssh);
+    c->lost = true;
+    bufchain_clear(&c->received_data);
+}
+
+static void dummyconn_send(Backend *be, const char *buf, size_t len)
+{
+    TestRemoteConn *c = container_of(be, TestRemoteConn, dummyssh);
+    if (!c->lost) {
+        bufchain_add(&c->received_data, buf, len);
+    }
+}
+
+static size_t dummyconn_sendbuffer(Backend *be)
+{
+    TestRemoteConn *c = container_of(be, TestRemoteConn, dummyssh);
+    return bufchain_size(&c->received_data);
+}
+
+const BackendVtable dummyconn_backend = {
+    .init = NULL,
+    .free = dummyconn_free,
+    .reconfig = NULL,
+    .send = dummyconn_send,
+    .sendbuffer = dummyconn_sendbuffer,
+    .size = NULL,
+    .special = NULL,
+    .get_specials = NULL,
+    .connected = dummyssh_connected,
+    .exitcode = NULL,
+    .sendok = NULL,
+    .ldisc_option_state = NULL,
+    .provide_ldisc = NULL,
+    .unthrottle = NULL,
+    .cfg_info = NULL,
+    .id = "dummyconn",
+    .displayname_tc = "DummyConn",
+    .displayname_lc = "DummyConn",
+    .protocol = PROT_SSH,
+    .default_port = 0,
+};
@@ -6,6 +6,24 @@
 
 typedef struct TestRemoteFile TestRemoteFile;
 
+typedef enum {
+  TESTREMOTE_REPLY_FIFO,
+  TESTREMOTE_REPLY_REVERSE /* answer the queued requests last to first */
+} TestRemoteReplyOrder;
+
+#define TESTREMOTE_MAX_CONNS 8
+
+/* An extra connection the client opened to the same server, see
+   sftpconn.h. */
+typedef struct TestRemoteConn {
+  Backend dummyssh;
+  Seat *client_seat;
+  bufchain received_data;
+  bool started;
+  bool lost;
+  size_t nrequests; /* requests processed on this connection */
+} TestRemoteConn;
+
 typedef struct TestRemote {
   SftpServer srv;
   Backend dummyssh;
@@ -19,12 +37,21 @@ typedef struct TestRemote {
 
   int fail_request_type;
   int fail_request_skip;
+
+  TestRemoteReplyOrder reply_order;
+  size_t reply_split; /* replies are output in pieces of this size, 0: whole */
+  strbuf *reply_batch; /* the replies of a testremote_process() pass, output at once */
+  size_t nrequests; /* requests processed so far */
+  bool copy_data; /* copy-data requests are served, it is always announced */
+
+  TestRemoteConn conns[TESTREMOTE_MAX_CONNS];
+  size_t nconns;
 } TestRemote;
 
 void testremote_init(TestRemote *tr);
 void testremote_uninit(TestRemote *tr);
 
-void testremote_add_file(TestRemote *tr, const char *name, size_t size);
+void testremote_add_file(TestRemote *tr, const char *name, uint64_t size);
 void testremote_add_dir(TestRemote *tr, const char *name);
 bool testremote_check_file(TestRemote *tr, const char *name);
 bool testremote_check_dir(TestRemote *tr, const char *name);
@@ -43,9 +70,16 @@ void testremote_process_request(TestRemote *tr, struct sftp_packet *req);
 void testremote_process(TestRemote *tr);
 
 void testremote_connection_fatal(TestRemote *tr);
+/* Loses the extra connection i, its requests are dropped. */
+void testremote_conn_fatal(TestRemote *tr, size_t i);
 
 bool testremote_is_dirty(TestRemote *tr);
 void testremote_set_clean(TestRemote *tr);
 
 void testremote_fail_request(TestRemote *tr, int type, int skip);
+void testremote_set_reply_order(TestRemote *tr, TestRemoteReplyOrder order);
+void testremote_set_reply_split(TestRemote *tr, size_t size);
+/* Outputs the replies to the requests queued at once as a single piece. */
+void testremote_set_reply_batch(TestRemote *tr, bool batch);
+void testremote_set_copy_data(TestRemote *tr, bool enabled);
 #endif
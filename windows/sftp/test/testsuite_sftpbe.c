@@ -4,6 +4,7 @@
 #include "testsuite.h"
 #include "psftp.h"
 #include "sftpcli.h"
+#include "sftplssort.h"
 
 static void tc_framework(TestLocal *tl, TestRemote *tr)
 {
@@ -313,6 +314,512 @@ static void tc_reget(TestLocal *tl, TestRemote *tr)
     ASSERT_TRUE(testlocal_check_create_size(tl, "test/1.txt", 100));
     ASSERT_TRUE(testlocal_check_create_size(tl, "test/2.txt", 100));
     ASSERT_TRUE(testlocal_check_create_size(tl, "test/3.txt", 50));
+
+    /* the space reserved for an interrupted download is not part of it */
+    testremote_add_file(tr, "big.bin", 3000000);
+    testremote_fail_request(tr, SSH_FXP_READ, 5);
+    testlocal_execute(tl, "get big.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "error while reading", false));
+    ASSERT_TRUE(testlocal_check_size(tl, "big.bin") < 3000000);
+    testlocal_execute(tl, "reget big.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "big.bin") == 3000000);
+}
+
+static void tc_reget_complete_files(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "test/1.txt", 100);
+    testremote_add_file(tr, "test/2.txt", 100);
+    testremote_add_file(tr, "test/3.txt", 100);
+    testremote_add_file(tr, "test/4.txt", 100);
+    testremote_add_file(tr, "test/5.txt", 100);
+
+    testlocal_add_dir(tl, "test");
+    testlocal_add_file(tl, "test/1.txt", 100);
+    testlocal_add_file(tl, "test/2.txt", 50);
+    testlocal_add_file(tl, "test/3.txt", 100);
+    testlocal_add_file(tl, "test/4.txt", 100);
+
+    testlocal_execute(tl, "reget -r -j 1 test");
+    testremote_process(tr);
+
+    /* resumes at 4.txt, the last existing file, which is complete */
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "1.txt =>", false));
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "2.txt =>", false));
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "3.txt =>", false));
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "4.txt =>", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "5.txt =>", false));
+    ASSERT_TRUE(testlocal_check_size(tl, "test/2.txt") == 50);
+    ASSERT_TRUE(testlocal_check_size(tl, "test/5.txt") == 100);
+
+    /* from the start, the complete files are skipped */
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "reget -r -j 8 test");
+    testremote_process(tr);
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "1.txt =>", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "would get: ", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "2.txt =>", false));
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "3.txt =>", false));
+    ASSERT_TRUE(testlocal_check_size(tl, "test/2.txt") == 100);
+    ASSERT_TRUE(testlocal_check_create_size(tl, "test/2.txt", 50));
+}
+
+static void tc_getput_jobs(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "a/1.txt", 100);
+    testremote_add_file(tr, "a/2.txt", 40000);
+    testremote_add_file(tr, "a/3.txt", 70000);
+    testremote_add_file(tr, "a/b/4.txt", 11);
+    testremote_add_file(tr, "a/b/5.txt", 40000);
+    testremote_set_reply_order(tr, TESTREMOTE_REPLY_REVERSE);
+
+    testlocal_execute(tl, "mget -r -j 3 a");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "a/1.txt") == 100);
+    ASSERT_TRUE(testlocal_check_size(tl, "a/2.txt") == 40000);
+    ASSERT_TRUE(testlocal_check_size(tl, "a/3.txt") == 70000);
+    ASSERT_TRUE(testlocal_check_size(tl, "a/b/4.txt") == 11);
+    ASSERT_TRUE(testlocal_check_size(tl, "a/b/5.txt") == 40000);
+
+    testlocal_execute(tl, "mput -r -j 3 a");
+    testremote_process(tr);
+    testlocal_execute(tl, "put -r -j 3 a c");
+    testremote_process(tr);
+    ASSERT_TRUE(testremote_check_size(tr, "c/1.txt") == 100);
+    ASSERT_TRUE(testremote_check_size(tr, "c/2.txt") == 40000);
+    ASSERT_TRUE(testremote_check_size(tr, "c/3.txt") == 70000);
+    ASSERT_TRUE(testremote_check_size(tr, "c/b/4.txt") == 11);
+    ASSERT_TRUE(testremote_check_size(tr, "c/b/5.txt") == 40000);
+
+    testremote_set_reply_order(tr, TESTREMOTE_REPLY_FIFO);
+    testremote_fail_request(tr, SSH_FXP_OPEN, 1);
+    testlocal_execute(tl, "get -r -j 2 a d");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "permission denied", false));
+    ASSERT_TRUE(testlocal_check_size(tl, "d/1.txt") == 100);
+
+    testlocal_execute(tl, "get -j 0 a/1.txt");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "option '-j' expects a number", false));
+}
+
+static void tc_getput_lookahead(TestLocal *tl, TestRemote *tr)
+{
+    char name[32];
+    for (int i = 0; i < 12; i++) {
+        sprintf(name, "a/%02d.txt", i);
+        testremote_add_file(tr, name, 100 + i);
+    }
+    testremote_set_reply_order(tr, TESTREMOTE_REPLY_REVERSE);
+
+    testlocal_execute(tl, "get -r -j 1 a");
+    testremote_process(tr);
+    for (int i = 0; i < 12; i++) {
+        sprintf(name, "a/%02d.txt", i);
+        ASSERT_TRUE(testlocal_check_size(tl, name) == 100 + i);
+    }
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "a/00.txt => local:", false));
+
+    testlocal_execute(tl, "put -r -j 1 a b");
+    testremote_process(tr);
+    for (int i = 0; i < 12; i++) {
+        sprintf(name, "b/%02d.txt", i);
+        ASSERT_TRUE(testremote_check_size(tr, name) == 100 + i);
+    }
+
+    /* The files opened ahead are truncated or created only when their
+       transfer starts. */
+    testremote_set_reply_order(tr, TESTREMOTE_REPLY_FIFO);
+    testremote_add_file(tr, "d/01.txt", 1000);
+    testremote_add_file(tr, "d/02.txt", 1000);
+    testlocal_execute(tl, "put -r -j 1 a d");
+    struct sftp_packet *req;
+    while ((req = testremote_get_request(tr)) != NULL && req->type != SSH_FXP_WRITE) {
+        testremote_process_request(tr, req);
+    }
+    ASSERT_TRUE(req != NULL);
+    ASSERT_TRUE(testremote_check_size(tr, "d/01.txt") == 1000);
+    ASSERT_FALSE(testremote_check_file(tr, "d/03.txt"));
+    testremote_process_request(tr, req);
+    testremote_process(tr);
+    for (int i = 0; i < 12; i++) {
+        sprintf(name, "d/%02d.txt", i);
+        ASSERT_TRUE(testremote_check_size(tr, name) == 100 + i);
+    }
+
+    testremote_fail_request(tr, SSH_FXP_CLOSE, 0);
+    testlocal_execute(tl, "put -r a c");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "close: permission denied", false));
+}
+
+static void tc_get_crawl(TestLocal *tl, TestRemote *tr)
+{
+    char name[32];
+    for (int i = 0; i < 10; i++) {
+        sprintf(name, "a/d%d/e/%d.txt", i, i);
+        testremote_add_file(tr, name, 10 + i);
+        sprintf(name, "a/d%d/f", i);
+        testremote_add_dir(tr, name);
+    }
+    testremote_add_file(tr, "a/1.txt", 10);
+    testremote_set_reply_order(tr, TESTREMOTE_REPLY_REVERSE);
+
+    testlocal_execute(tl, "get -r a");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "a/1.txt") == 10);
+    for (int i = 0; i < 10; i++) {
+        sprintf(name, "a/d%d/e/%d.txt", i, i);
+        ASSERT_TRUE(testlocal_check_size(tl, name) == 10 + i);
+        sprintf(name, "a/d%d/f", i);
+        ASSERT_TRUE(testlocal_check_dir(tl, name));
+    }
+
+    testremote_set_reply_order(tr, TESTREMOTE_REPLY_FIFO);
+    testremote_fail_request(tr, SSH_FXP_OPENDIR, 3);
+    testlocal_execute(tl, "get -r a b");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "unable to open directory: permission denied", false));
+}
+
+static void tc_sync(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "s/1.txt", 100);
+    testremote_add_file(tr, "s/2.txt", 200);
+    testremote_add_file(tr, "s/sub/3.txt", 300);
+    testlocal_add_dir(tl, "s");
+    testlocal_add_file(tl, "s/1.txt", 100);
+    testlocal_add_file(tl, "s/2.txt", 50);
+
+    /* the test server has no times, the sizes decide */
+    testlocal_execute(tl, "sync pull -n s");
+    testremote_process(tr);
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "1.txt =>", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "would get: ", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "2.txt =>", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "3.txt =>", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "sync: 2 to send (500 bytes), 1 unchanged (100 bytes)", true));
+    ASSERT_FALSE(testlocal_check_dir(tl, "s/sub"));
+    ASSERT_TRUE(testlocal_check_size(tl, "s/2.txt") == 50);
+
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "sync pull -j 2 s");
+    testremote_process(tr);
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "1.txt =>", false));
+    ASSERT_TRUE(testlocal_check_create_size(tl, "s/1.txt", 100));
+    ASSERT_TRUE(testlocal_check_size(tl, "s/2.txt") == 200);
+    ASSERT_TRUE(testlocal_check_size(tl, "s/sub/3.txt") == 300);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "sync: 2 sent (500 bytes), 1 unchanged (100 bytes)", true));
+
+    testlocal_add_file(tl, "s/4.txt", 400);
+    testlocal_add_dir(tl, "s/new");
+    testlocal_add_file(tl, "s/new/5.txt", 5);
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "sync push -n s");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "would put: ", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "4.txt =>", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "would create: ", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "5.txt =>", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "sync: 2 to send (405 bytes), 3 unchanged (600 bytes)", true));
+    ASSERT_FALSE(testremote_check_file(tr, "s/4.txt"));
+    ASSERT_FALSE(testremote_check_dir(tr, "s/new"));
+
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "sync push s");
+    testremote_process(tr);
+    ASSERT_TRUE(testremote_check_size(tr, "s/4.txt") == 400);
+    ASSERT_TRUE(testremote_check_size(tr, "s/new/5.txt") == 5);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "sync: 2 sent (405 bytes), 3 unchanged (600 bytes)", true));
+
+    /* both sides are the same now */
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "sync push s");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "sync: 0 sent (0 bytes), 5 unchanged (1005 bytes)", true));
+    testlocal_execute(tl, "sync pull s");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "sync: 0 sent (0 bytes), 5 unchanged (1005 bytes)", true));
+
+    testlocal_execute(tl, "sync s");
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "sync: expects push or pull", true));
+    testlocal_execute(tl, "sync pull -x s");
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "sync: unrecognised option '-x'", true));
+}
+
+static void tc_xfer_window(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "big.bin", 3000000);
+    testremote_add_file(tr, "odd.bin", 300001);
+
+    testlocal_execute(tl, "get big.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "big.bin") == 3000000);
+    testlocal_execute(tl, "put big.bin big2.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testremote_check_size(tr, "big2.bin") == 3000000);
+    testlocal_execute(tl, "xfer");
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "window: adaptive up to 16777216 bytes", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "last transfer: window", false));
+
+    testlocal_execute(tl, "xfer pin 96k 48k");
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "window: pinned to 98304 bytes, request size 49152 bytes", false));
+    testlocal_execute(tl, "get odd.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "odd.bin") == 300001);
+    testlocal_execute(tl, "put odd.bin odd2.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testremote_check_size(tr, "odd2.bin") == 300001);
+
+    testlocal_execute(tl, "xfer max 4m 255k 64k");
+    testlocal_execute(tl, "xfer auto");
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "request size up to 261120 bytes for reads and 65536 bytes for writes", false));
+    testlocal_execute(tl, "get -j 2 big.bin big3.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "big3.bin") == 3000000);
+
+    testlocal_execute(tl, "xfer pin 1k 2k");
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "xfer: the window is smaller than the request size", false));
+    testlocal_execute(tl, "xfer max 1x 32k 32k");
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "xfer: size '1x' is not between", false));
+    testlocal_execute(tl, "xfer fast");
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "xfer: expects", false));
+}
+
+/* A link of 100 MB/s with 200 us of latency, far below the tick of
+   GetTickCount(). The requests are pipelined, so a round of the window
+   takes as long as sending it or as the first reply, whichever is longer. */
+static void tc_xfer_window_fast_link(TestLocal *tl, TestRemote *tr)
+{
+    const uint64_t link = 100000000, latency = 200;
+    SftpXferLimits limits;
+    xfer_limits_init(&limits);
+    SftpXferWindow w;
+    xfer_window_init(&w, &limits, false);
+    uint64_t now = 1000000, offset = 0;
+    xfer_window_start_at(&w, now);
+    while (now < 6000000) {
+        uint64_t first = latency + (uint64_t)w.chunk * 1000000 / link;
+        uint64_t round = (uint64_t)w.window * 1000000 / link;
+        if (round < first) {
+            round = first;
+        }
+        xfer_window_sent_at(&w, offset, now);
+        xfer_window_acked_at(&w, offset, w.chunk, now + first);
+        xfer_window_acked_at(&w, offset + w.chunk, w.window - w.chunk, now + round);
+        offset += w.window;
+        now += round;
+    }
+    ASSERT_TRUE(w.min_rtt > 0 && w.min_rtt < 1000);
+    ASSERT_TRUE(w.window > XFER_MIN_WINDOW);
+    ASSERT_TRUE(w.rate >= link * 95 / 100);
+
+    /* a reply within the same microsecond counts as XFER_WINDOW_MIN_RTT */
+    xfer_window_init(&w, &limits, false);
+    xfer_window_start_at(&w, now);
+    xfer_window_sent_at(&w, offset, now);
+    xfer_window_acked_at(&w, offset, w.chunk, now);
+    ASSERT_TRUE(w.min_rtt == XFER_WINDOW_MIN_RTT);
+}
+
+static void tc_version(TestLocal *tl, TestRemote *tr)
+{
+    testlocal_execute(tl, "version");
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "SFTP protocol version 3", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "extension: copy-data \"1\"", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "server limits: packet 262144, read 261120, write 261120, open handles no limit", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "request size up to 261120 bytes for reads and 261120 bytes for writes, packets up to 1048576 bytes received", false));
+
+    /* the request sizes start at the server's limits */
+    testlocal_execute(tl, "xfer");
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "request size up to 261120 bytes for reads and 261120 bytes for writes", false));
+    testlocal_execute(tl, "xfer max 4m 256k 64k");
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "xfer: size '256k' is not between 1024 and 261120", false));
+
+    testremote_add_file(tr, "big.bin", 3000000);
+    testlocal_execute(tl, "get big.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "big.bin") == 3000000);
+    testlocal_execute(tl, "put big.bin big2.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testremote_check_size(tr, "big2.bin") == 3000000);
+}
+
+/* Far more than any disk holds, so reserving the space fails up front. */
+static void tc_get_no_space(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "huge.bin", (uint64_t)1 << 50);
+    testremote_add_file(tr, "small.bin", 1000);
+
+    testlocal_execute(tl, "get huge.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "local: not enough disk space for huge.bin", false));
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "=> local: huge.bin", false));
+    ASSERT_TRUE(testlocal_check_size(tl, "huge.bin") == 0);
+
+    testlocal_execute(tl, "get small.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "small.bin") == 1000);
+}
+
+static void tc_get_writebehind(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "huge.bin", 40000000);
+    testremote_add_file(tr, "w/1.bin", 5000000);
+    testremote_add_file(tr, "w/2.bin", 3000001);
+    testremote_add_file(tr, "w/3.bin", 0);
+
+    /* The window is larger than the write-behind space of a file. */
+    testlocal_execute(tl, "xfer pin 64m 255k");
+    testlocal_execute(tl, "get huge.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "huge.bin") == 40000000);
+
+    testlocal_execute(tl, "xfer auto");
+    testlocal_execute(tl, "mget -r -j 3 w");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "w/1.bin") == 5000000);
+    ASSERT_TRUE(testlocal_check_size(tl, "w/2.bin") == 3000001);
+    ASSERT_TRUE(testlocal_check_size(tl, "w/3.bin") == 0);
+}
+
+static void tc_get_segments(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "big.bin", 40000000);
+    testremote_add_file(tr, "small.bin", 1000000);
+
+    testlocal_execute(tl, "get -P 4 big.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "big.bin (4 segments)", false));
+    ASSERT_TRUE(testlocal_check_size(tl, "big.bin") == 40000000);
+    ASSERT_FALSE(testlocal_check_file(tl, "big.bin.psftp-segments"));
+
+    /* too small to be split */
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "get -P 4 small.bin");
+    testremote_process(tr);
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "segments)", false));
+    ASSERT_TRUE(testlocal_check_size(tl, "small.bin") == 1000000);
+
+    /* an interrupted download keeps its state, reget resumes every segment */
+    testlocal_clear_output(tl);
+    testremote_fail_request(tr, SSH_FXP_READ, 40);
+    testlocal_execute(tl, "get -P 4 big.bin copy.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "error while reading", false));
+    ASSERT_TRUE(testlocal_check_file(tl, "copy.bin.psftp-segments"));
+    testlocal_execute(tl, "reget big.bin copy.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "reget: restarting 4 segments", false));
+    ASSERT_TRUE(testlocal_check_size(tl, "copy.bin") == 40000000);
+    ASSERT_FALSE(testlocal_check_file(tl, "copy.bin.psftp-segments"));
+
+    testlocal_execute(tl, "get -P 17 big.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "option '-P' expects a number between 1 and 16", false));
+}
+
+static void tc_get_connections(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "big.bin", 40000000);
+    testremote_add_file(tr, "small.bin", 1000000);
+
+    testlocal_execute(tl, "connections");
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "connections: no extra connections", false));
+
+    /* a small file does not open them */
+    testlocal_execute(tl, "connections 2");
+    testlocal_execute(tl, "get small.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "small.bin") == 1000000);
+    ASSERT_TRUE(tr->nconns == 0);
+
+    testlocal_execute(tl, "get -P 4 big.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "big.bin") == 40000000);
+    ASSERT_FALSE(testlocal_check_file(tl, "big.bin.psftp-segments"));
+    ASSERT_TRUE(tr->nconns == 2);
+    ASSERT_TRUE(tr->conns[0].nrequests > 2);
+    ASSERT_TRUE(tr->conns[1].nrequests > 2);
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "connections");
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "connection 2: ready", false));
+
+    /* a lost connection fails the requests pending on it, the STAT and
+       the transfer on the main connection are served first */
+    testlocal_execute(tl, "get -P 4 big.bin copy.bin");
+    struct sftp_packet *req;
+    while ((req = testremote_get_request(tr)) != NULL) {
+        testremote_process_request(tr, req);
+    }
+    testremote_conn_fatal(tr, 0);
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "connection lost", false));
+    ASSERT_TRUE(testlocal_check_file(tl, "copy.bin.psftp-segments"));
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "connections");
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "connection 1: failed: test connection fatal", false));
+
+    /* setting the count again replaces the failed connection */
+    testlocal_execute(tl, "connections 2");
+    testlocal_execute(tl, "reget big.bin copy.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "copy.bin") == 40000000);
+    ASSERT_FALSE(testlocal_check_file(tl, "copy.bin.psftp-segments"));
+    ASSERT_TRUE(tr->nconns == 3);
+    ASSERT_TRUE(tr->conns[2].nrequests > 2);
+
+    testlocal_execute(tl, "connections 9");
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "connections: '9' is not a number between 0 and 8", false));
+}
+
+static void tc_split_replies(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "a.bin", 100000);
+    testremote_add_file(tr, "b.bin", 70000);
+
+    testremote_set_reply_split(tr, 3);
+    testlocal_execute(tl, "get a.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "a.bin") == 100000);
+    testremote_set_reply_split(tr, 1000);
+    testremote_set_reply_order(tr, TESTREMOTE_REPLY_REVERSE);
+    testlocal_execute(tl, "get b.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "b.bin") == 70000);
+    testlocal_execute(tl, "ls");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "b.bin", false));
+}
+
+static int pooled_packets(Sftp *sftp)
+{
+    int n = 0;
+    for (int c = 0; c < SFTPPKTPOOL_CLASSES; c++) {
+        n += sftp->pktpool.classes[c].n;
+    }
+    return n;
+}
+
+/* The packets of a transfer are reused while it runs and freed when it is
+   over. */
+static void tc_pktpool(TestLocal *tl, TestRemote *tr)
+{
+    Sftp *sftp = container_of(tl->sftp, Sftp, backend);
+    testremote_add_file(tr, "a.bin", 300000);
+
+    testlocal_execute(tl, "get a.bin");
+    ASSERT_TRUE(pooled_packets(sftp) == 0);
+    testremote_process_request(tr, testremote_get_request(tr)); // realpath
+    testremote_process_request(tr, testremote_get_request(tr)); // stat
+    testremote_process_request(tr, testremote_get_request(tr)); // open
+    testremote_process_request(tr, testremote_get_request(tr)); // read
+    testremote_process_request(tr, testremote_get_request(tr)); // read
+    ASSERT_TRUE(pooled_packets(sftp) > 0);
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "a.bin") == 300000);
+    ASSERT_TRUE(pooled_packets(sftp) == 0);
 }
 
 static void tc_mkdir(TestLocal *tl, TestRemote *tr)
@@ -393,6 +900,73 @@ static void tc_mv(TestLocal *tl, TestRemote *tr)
     ASSERT_TRUE(testlocal_find_output(&tl->error, "no such file or directory", false));
 }
 
+static void tc_getput_verify(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "a.bin", 1000000);
+    testremote_add_file(tr, "big.bin", 40000000);
+
+    testlocal_execute(tl, "get -c a.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_check_size(tl, "a.bin") == 1000000);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "verify: 1 verified, 0 differ, 0 not verified", false));
+
+    /* every segment is hashed by the server on its own */
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "get -c -P 4 big.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "verify: 4 verified, 0 differ, 0 not verified", false));
+
+    /* the remote files hold only zeros, the local one ends with a mark */
+    testlocal_clear_output(tl);
+    testlocal_add_file(tl, "b.bin", 100000);
+    testlocal_execute(tl, "put -c b.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testremote_check_size(tr, "b.bin") == 100000);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "b.bin: SHA-256 differs from the server's", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "verify: 0 verified, 1 differ, 0 not verified", false));
+}
+
+static void tc_cp(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "a.bin", 1048576);
+    testremote_add_dir(tr, "d");
+    size_t nrequests = tr->nrequests;
+    testlocal_execute(tl, "cp a.bin b.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testremote_check_size(tr, "b.bin") == 1048576);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "/sftp/a.bin -> /sftp/b.bin", false));
+    /* two STATs, two OPENs, copy-data and two CLOSEs */
+    ASSERT_TRUE(tr->nrequests - nrequests == 7);
+
+    /* refused copy-data, the data passes the client */
+    testremote_set_copy_data(tr, false);
+    nrequests = tr->nrequests;
+    testlocal_execute(tl, "cp a.bin d");
+    testremote_process(tr);
+    ASSERT_TRUE(testremote_check_size(tr, "d/a.bin") == 1048576);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "/sftp/a.bin -> /sftp/d/a.bin", false));
+    ASSERT_TRUE(tr->nrequests - nrequests > 2 * 1048576 / XFER_MAX_CHUNK);
+
+    testremote_add_file(tr, "e.bin", 0);
+    testlocal_execute(tl, "cp e.bin a.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testremote_check_file(tr, "a.bin"));
+    ASSERT_TRUE(testremote_check_size(tr, "a.bin") == 0);
+
+    testlocal_execute(tl, "cp d/a.bin /sftp/d");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "are the same file", false));
+
+    testlocal_execute(tl, "cp d b.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "/sftp/d is a directory", false));
+
+    testlocal_execute(tl, "cp c.bin b.bin");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "no such file or directory", false));
+    ASSERT_TRUE(testremote_check_size(tr, "b.bin") == 1048576);
+}
+
 static void tc_chmod(TestLocal *tl, TestRemote *tr)
 {
     testremote_add_file(tr, "a.jpg", 10);
@@ -412,6 +986,27 @@ static void tc_chmod(TestLocal *tl, TestRemote *tr)
     ASSERT_TRUE(testlocal_find_output(&tl->error, "no such file or directory", false));
 }
 
+/* The READ replies of a stopped get arrive in the same piece as the replies
+   of the next command, which still reach it. */
+static void tc_ctrlc_pending_replies(TestLocal *tl, TestRemote *tr)
+{
+    testremote_add_file(tr, "a.bin", 300000);
+    testlocal_execute(tl, "get a.bin");
+    testremote_process_request(tr, testremote_get_request(tr)); // realpath
+    testremote_process_request(tr, testremote_get_request(tr)); // stat
+    testremote_process_request(tr, testremote_get_request(tr)); // open
+    backend_send(tl->sftp, "\x03", 1);
+    testlocal_clear_output(tl);
+
+    testremote_set_reply_batch(tr, true);
+    testlocal_execute(tl, "ls");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "a.bin", false));
+    testlocal_execute(tl, "pwd");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "remote directory is /sftp", false));
+}
+
 static void tc_ctrlc(TestLocal *tl, TestRemote *tr)
 {
     Sftp *sftp = container_of(tl->sftp, Sftp, backend);
@@ -499,6 +1094,152 @@ static void completion_tab_open_paging(Sftp *sftp)
     backend_send(&sftp->backend, "\x09", 1);
 }
 
+static size_t output_index(TestOutput *o, const char *pattern)
+{
+    for (size_t i = 0; i < o->size; i++) {
+        if (strstr(o->lines[i], pattern)) {
+            return i;
+        }
+    }
+    return o->size;
+}
+
+static void tc_ls_sort(TestLocal *tl, TestRemote *tr)
+{
+    /* more lines than ls prints in one step, in reverse order */
+    char name[16];
+    for (int i = 2499; i >= 0; i--) {
+        sprintf(name, "f%04d", i);
+        testremote_add_file(tr, name, i);
+    }
+
+    testlocal_execute(tl, "ls");
+    testremote_process(tr);
+    ASSERT_TRUE(output_index(&tl->output, "f0000") < output_index(&tl->output, "f0001"));
+    ASSERT_TRUE(output_index(&tl->output, "f2498") < output_index(&tl->output, "f2499"));
+    ASSERT_TRUE(output_index(&tl->output, "f2499") < tl->output.size);
+
+    /* from the listing cache */
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "ls f24*");
+    testremote_process(tr);
+    ASSERT_TRUE(output_index(&tl->output, "f2400") < output_index(&tl->output, "f2499"));
+    ASSERT_TRUE(output_index(&tl->output, "f2499") < tl->output.size);
+    ASSERT_TRUE(output_index(&tl->output, "f2399") == tl->output.size);
+
+    /* -U streams in the order of the server */
+    testlocal_execute(tl, "rm f1000");
+    testremote_process(tr);
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "ls -lU");
+    testremote_process(tr);
+    ASSERT_TRUE(output_index(&tl->output, "f2499") < output_index(&tl->output, "f0000"));
+    ASSERT_TRUE(output_index(&tl->output, "f0000") < tl->output.size);
+    ASSERT_TRUE(output_index(&tl->output, "f1000") == tl->output.size);
+
+    testlocal_execute(tl, "ls -x");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->error, "ls: unrecognised option '-x'", true));
+
+    /* runs of a few records merged from the temporary file */
+    SftpLsSort *sort = sftplssort_new(64);
+    for (int i = 99; i >= 0; i--) {
+        sprintf(name, "n%02d", (i * 37) % 100);
+        ASSERT_TRUE(sftplssort_add(sort, name, name));
+    }
+    ASSERT_TRUE(sftplssort_finish(sort));
+    for (int i = 0; i < 100; i++) {
+        sprintf(name, "n%02d", i);
+        const char *line = sftplssort_next(sort);
+        ASSERT_TRUE(line && strcmp(line, name) == 0);
+    }
+    ASSERT_TRUE(sftplssort_next(sort) == NULL);
+    ASSERT_FALSE(sftplssort_failed(sort));
+    sftplssort_free(sort);
+}
+
+static void tc_completion_progressive(TestLocal *tl, TestRemote *tr)
+{
+    Sftp *sftp = container_of(tl->sftp, Sftp, backend);
+    testremote_add_file(tr, "alma", 10);
+    testremote_add_file(tr, "x1", 0);
+    testremote_add_file(tr, "x2", 0);
+    testremote_add_file(tr, "almafa", 20);
+    backend_size(tl->sftp, 80, 24);
+    testlocal_allow_cli_output(tl, true);
+
+    /* TAB again after the first READDIR reply completes from alma */
+    backend_send(&sftp->backend, "get alm\x09", 8);
+    testremote_process_request(tr, testremote_get_request(tr));
+    testremote_process_request(tr, testremote_get_request(tr));
+    testlocal_clear_output(tl);
+    backend_send(&sftp->backend, "\x09", 1);
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "sftp> get alma ", false));
+    completion_cancel_line(sftp);
+
+    /* the whole directory, then the cached listing filtered again */
+    testlocal_clear_output(tl);
+    completion_send(sftp, tr, "get x\x09", 6);
+    completion_tab_open_paging(sftp);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "x1  x2", true));
+    completion_cancel_line(sftp);
+    size_t nrequests = tr->nrequests;
+    testlocal_clear_output(tl);
+    completion_send(sftp, tr, "get alm\x09", 8);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "sftp> get alma", false));
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "sftp> get alma ", false));
+    ASSERT_TRUE(tr->nrequests == nrequests);
+    completion_cancel_line(sftp);
+}
+
+static void tc_listing_cache(TestLocal *tl, TestRemote *tr)
+{
+    Sftp *sftp = container_of(tl->sftp, Sftp, backend);
+    testremote_add_file(tr, "alma", 10);
+    testremote_add_file(tr, "apple", 20);
+    testremote_add_dir(tr, "korte");
+    backend_size(tl->sftp, 80, 24);
+    testlocal_allow_cli_output(tl, true);
+
+    testlocal_execute(tl, "ls");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "apple", false));
+
+    /* served from the listing of ls */
+    size_t nrequests = tr->nrequests;
+    testlocal_clear_output(tl);
+    completion_send(sftp, tr, "get al\x09", 7);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "sftp> get alma ", false));
+    completion_cancel_line(sftp);
+    testlocal_execute(tl, "ls /sftp/a*");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "alma", false));
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "korte", false));
+    ASSERT_TRUE(tr->nrequests == nrequests);
+
+    /* our own changes drop the listing */
+    testlocal_execute(tl, "rm alma");
+    testremote_process(tr);
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "ls");
+    testremote_process(tr);
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "apple", false));
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "alma", false));
+
+    /* the wildcard only needs the REALPATH */
+    nrequests = tr->nrequests;
+    testlocal_execute(tl, "rm ap*");
+    testremote_process(tr);
+    ASSERT_FALSE(testremote_check_file(tr, "apple"));
+    ASSERT_TRUE(tr->nrequests == nrequests + 2);
+    testlocal_clear_output(tl);
+    testlocal_execute(tl, "ls");
+    testremote_process(tr);
+    ASSERT_FALSE(testlocal_find_output(&tl->output, "apple", false));
+    ASSERT_TRUE(testlocal_find_output(&tl->output, "korte", false));
+}
+
 static void tc_completion(TestLocal *tl, TestRemote *tr)
 {
     Sftp *sftp = container_of(tl->sftp, Sftp, backend);
@@ -725,13 +1466,33 @@ void testsuite_sftpbe()
     ADD_TESTCASE(tc_get)
     ADD_TESTCASE(tc_mget)
     ADD_TESTCASE(tc_reget)
+    ADD_TESTCASE(tc_reget_complete_files)
+    ADD_TESTCASE(tc_getput_jobs)
+    ADD_TESTCASE(tc_getput_lookahead)
+    ADD_TESTCASE(tc_get_crawl)
+    ADD_TESTCASE(tc_sync)
+    ADD_TESTCASE(tc_xfer_window)
+    ADD_TESTCASE(tc_xfer_window_fast_link)
+    ADD_TESTCASE(tc_version)
+    ADD_TESTCASE(tc_get_writebehind)
+    ADD_TESTCASE(tc_get_no_space)
+    ADD_TESTCASE(tc_get_segments)
+    ADD_TESTCASE(tc_get_connections)
+    ADD_TESTCASE(tc_getput_verify)
+    ADD_TESTCASE(tc_split_replies)
+    ADD_TESTCASE(tc_pktpool)
+    ADD_TESTCASE(tc_listing_cache)
+    ADD_TESTCASE(tc_ls_sort)
+    ADD_TESTCASE(tc_completion_progressive)
     ADD_TESTCASE(tc_mkdir)
     ADD_TESTCASE(tc_rm)
     ADD_TESTCASE(tc_mv)
+    ADD_TESTCASE(tc_cp)
     ADD_TESTCASE(tc_chmod)
     ADD_TESTCASE(tc_lcd)
     ADD_TESTCASE(tc_bye)
     ADD_TESTCASE(tc_ctrlc)
+    ADD_TESTCASE(tc_ctrlc_pending_replies)
     ADD_TESTCASE(tc_connection_fatal)
     ADD_TESTCASE(tc_pwdline)
     ADD_TESTCASE(tc_completion)
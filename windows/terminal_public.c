@@ -3,6 +3,8 @@ typedef struct terminal_tag Terminal;
 static void set_erase_char(Terminal *term);
 
 #include "terminal.c"
+#include "ssh.h"
+#include "terminal_public.h"
 
 termline *term_lineptr(Terminal *term, int y) {
     return lineptr(y);
@@ -16,6 +18,107 @@ int term_sblines(Terminal *term) {
     return sblines(term);
 }
 
+/* The lines in the scrollback are compressed one by one by compressline(),
+   each with its own allocation and tree node. Hibernation moves them into a
+   single zlib stream of length-prefixed lines and empties the scrollback,
+   and drops the bidi caches do_paint() rebuilds on demand. The screens stay
+   as they are, so the backend output keeps going into the terminal; the
+   lines it scrolls off in the meantime are kept after the packed ones by
+   term_wake(). A hibernated terminal is shown at the bottom and without a
+   selection, and a clear of the scrollback by its output doesn't reach the
+   packed lines. */
+size_t term_hibernate(Terminal *term, TermHibernation *h)
+{
+    size_t freed = 0;
+    for (size_t i = 0; i < term->bidi_cache_size; i++) {
+        if (term->pre_bidi_cache[i].width > 0) {
+            freed += 2 * term->pre_bidi_cache[i].width * (sizeof(termchar) + sizeof(int));
+        }
+        sfree(term->pre_bidi_cache[i].chars);
+        sfree(term->post_bidi_cache[i].chars);
+        sfree(term->post_bidi_cache[i].forward);
+        sfree(term->post_bidi_cache[i].backward);
+    }
+    sfree(term->pre_bidi_cache);
+    sfree(term->post_bidi_cache);
+    term->pre_bidi_cache = term->post_bidi_cache = NULL;
+    term->bidi_cache_size = 0;
+
+    memset(h, 0, sizeof(*h));
+    h->lines = count234(term->scrollback);
+    if (h->lines == 0) {
+        return freed;
+    }
+    deselect(term);
+    term->disptop = 0;
+
+    strbuf *packed = strbuf_new_nm();
+    compressed_scrollback_line *cline;
+    while ((cline = delpos234(term->scrollback, 0)) != NULL) {
+        put_uint32(packed, cline->len);
+        put_data(packed, cline + 1, cline->len);
+        freed += sizeof(*cline) + cline->len;
+        sfree(cline);
+    }
+    h->tempsblines = term->tempsblines;
+    term->tempsblines = 0;
+
+    ssh_compressor *comp = ssh_compressor_new(&ssh_zlib);
+    ssh_compressor_compress(comp, packed->u, packed->len, &h->data, &h->len, 0);
+    ssh_compressor_free(comp);
+    strbuf_free(packed);
+    return freed > (size_t)h->len ? freed - h->len : 0;
+}
+
+void term_wake(Terminal *term, TermHibernation *h)
+{
+    if (!h->data) {
+        return;
+    }
+    unsigned char *packed;
+    int packed_len;
+    ssh_decompressor *decomp = ssh_decompressor_new(&ssh_zlib);
+    bool ok = ssh_decompressor_decompress(decomp, h->data, h->len, &packed, &packed_len);
+    ssh_decompressor_free(decomp);
+    term_hibernation_free(h);
+    if (!ok) {
+        return;
+    }
+
+    /* The lines scrolled off while hibernated are newer, the oldest packed
+       ones go if both together exceed the scrollback size. */
+    int added = count234(term->scrollback);
+    int skip = h->lines + added - term->savelines;
+    BinarySource src[1];
+    BinarySource_BARE_INIT(src, packed, packed_len);
+    for (int i = 0; i < h->lines; i++) {
+        size_t len = get_uint32(src);
+        ptrlen data = get_data(src, len);
+        if (get_err(src)) {
+            break;
+        }
+        if (i < skip) {
+            continue;
+        }
+        compressed_scrollback_line *cline = snew_plus(compressed_scrollback_line, len);
+        cline->len = len;
+        memcpy(snew_plus_get_aux(cline), data.ptr, len);
+        addpos234(term->scrollback, cline, count234(term->scrollback) - added);
+    }
+    term->tempsblines += h->tempsblines;
+    if (term->tempsblines > count234(term->scrollback)) {
+        term->tempsblines = count234(term->scrollback);
+    }
+    sfree(packed);
+}
+
+void term_hibernation_free(TermHibernation *h)
+{
+    sfree(h->data);
+    h->data = NULL;
+    h->len = 0;
+}
+
 static void set_erase_char(Terminal *term)
 {
     set_erase_char_original(term);
@@ -6,4 +6,17 @@ termline *term_lineptr(Terminal *term, int y);
 void term_unlineptr(termline *line);
 int term_sblines(Terminal *term);
 
+/* The scrollback of a hibernated terminal, packed into one zlib stream by
+   term_hibernate() and put back by term_wake(). */
+typedef struct TermHibernation {
+    unsigned char *data;
+    int len;
+    int lines;
+    int tempsblines;
+} TermHibernation;
+
+size_t term_hibernate(Terminal *term, TermHibernation *h);
+void term_wake(Terminal *term, TermHibernation *h);
+void term_hibernation_free(TermHibernation *h);
+
 #endif
@@ -0,0 +1,203 @@
+/*
+ * Measures the session registry against the pointer_array it replaced with
+ * the same open/close/reorder/lookup churn: a session is closed and opened
+ * again at a random position, moved to a random position, looked up by its
+ * id (its stored position for the pointer_array) and by a random position,
+ * in turn. The pointer_array below is the removed
+ * windows/pointerarray.c, with the callback writing the position into the
+ * session like the tab_index of the frontends was kept.
+ *
+ * Usage: frontendbench.exe [ <sessions> [ <operations> ] ]
+ */
+
+#include "sessionregistry.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct BenchSession {
+    int id;
+    int tab_index;
+} BenchSession;
+
+typedef void (*pointer_array_set_index)(void *p, int index);
+
+static struct PointerArray {
+    void **buffer;
+    int size;
+    int capacity;
+    pointer_array_set_index set_index_callback;
+} pointer_array = {NULL, 0, 0, NULL};
+
+static void move_left(int first, int last) {
+    for (int i=first; i<last; i++) {
+        pointer_array.buffer[i] = pointer_array.buffer[i+1];
+        pointer_array.set_index_callback(pointer_array.buffer[i], i);
+    }
+}
+
+static void move_right(int first, int last) {
+    for (int i=last; i>first; i--) {
+        pointer_array.buffer[i] = pointer_array.buffer[i-1];
+        pointer_array.set_index_callback(pointer_array.buffer[i], i);
+    }
+}
+
+static void pointer_array_reset(pointer_array_set_index set_index_callback) {
+    free(pointer_array.buffer);
+    pointer_array.buffer = NULL;
+    pointer_array.size = 0;
+    pointer_array.capacity = 0;
+    pointer_array.set_index_callback = set_index_callback;
+}
+
+static void *pointer_array_get(int index) {
+    assert(index >= 0 && index <= pointer_array.size);
+    return pointer_array.buffer[index];
+}
+
+static void pointer_array_insert(int index, void *p) {
+    assert(pointer_array.size <= pointer_array.capacity && index >= 0 && index <= pointer_array.size);
+
+    if (pointer_array.size == pointer_array.capacity) {
+        if (pointer_array.capacity == 0) {
+            pointer_array.capacity = 2;
+            pointer_array.buffer = malloc(sizeof(void*)*pointer_array.capacity);
+        } else {
+            pointer_array.capacity *= 2;
+            pointer_array.buffer = realloc(pointer_array.buffer, sizeof(void*)*pointer_array.capacity);
+        }
+    }
+    move_right(index, pointer_array.size);
+    pointer_array.buffer[index] = p;
+    pointer_array.set_index_callback(pointer_array.buffer[index], index);
+    pointer_array.size++;
+}
+
+static void *pointer_array_remove(int index) {
+    assert(pointer_array.size <= pointer_array.capacity && index >= 0 && index < pointer_array.size);
+    void* p = pointer_array.buffer[index];
+    move_left(index, pointer_array.size-1);
+    pointer_array.size--;
+    return p;
+}
+
+static void pointer_array_exchange(int index, int new_index) {
+    assert(pointer_array.size <= pointer_array.capacity &&
+           index >= 0 && index < pointer_array.size &&
+           new_index >= 0 && new_index < pointer_array.size);
+    if (index == new_index) {
+        return;
+    }
+    void* p = pointer_array.buffer[index];
+    if (index < new_index) {
+        move_left(index, new_index);
+    } else {
+        move_right(new_index, index);
+    }
+    pointer_array.buffer[new_index] = p;
+    pointer_array.set_index_callback(pointer_array.buffer[new_index], new_index);
+}
+
+static void set_tab_index(void *p, int index)
+{
+    ((BenchSession *)p)->tab_index = index;
+}
+
+static void print_result(const char *what, int sessions, int operations, double elapsed)
+{
+    printf("%-16s %6d sessions, %8d operations: %8.3f s, %8.2f M operations/s\n",
+           what, sessions, operations, elapsed, operations / elapsed / 1e6);
+}
+
+static int bench_registry(BenchSession *s, int sessions, int operations)
+{
+    int failures = 0;
+    session_registry_reset();
+    srand(1);
+
+    clock_t start = clock();
+    for (int i = 0; i < sessions; i++) {
+        s[i].id = session_registry_add(&s[i], i);
+    }
+    for (int i = 0; i < operations; i++) {
+        int n = rand() % sessions;
+        switch (i % 4) {
+          case 0:
+            session_registry_remove(s[n].id);
+            s[n].id = session_registry_add(&s[n], rand() % sessions);
+            break;
+          case 1:
+            session_registry_move(s[n].id, rand() % sessions);
+            break;
+          case 2:
+            failures += (session_registry_get(s[n].id) != &s[n]);
+            break;
+          case 3:
+            failures += (session_registry_index_of(session_registry_id_at(n)) != n);
+            break;
+        }
+    }
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    failures += (session_registry_size() != sessions);
+    session_registry_reset();
+    print_result("session registry", sessions, operations, elapsed);
+    return failures;
+}
+
+static int bench_pointer_array(BenchSession *s, int sessions, int operations)
+{
+    int failures = 0;
+    pointer_array_reset(set_tab_index);
+    srand(1);
+
+    clock_t start = clock();
+    for (int i = 0; i < sessions; i++) {
+        pointer_array_insert(i, &s[i]);
+    }
+    for (int i = 0; i < operations; i++) {
+        int n = rand() % sessions;
+        switch (i % 4) {
+          case 0:
+            pointer_array_remove(s[n].tab_index);
+            pointer_array_insert(rand() % sessions, &s[n]);
+            break;
+          case 1:
+            pointer_array_exchange(s[n].tab_index, rand() % sessions);
+            break;
+          case 2:
+            failures += (pointer_array_get(s[n].tab_index) != &s[n]);
+            break;
+          case 3:
+            failures += (((BenchSession *)pointer_array_get(n))->tab_index != n);
+            break;
+        }
+    }
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    failures += (pointer_array.size != sessions);
+    pointer_array_reset(set_tab_index);
+    print_result("pointer_array", sessions, operations, elapsed);
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int sessions = (argc > 1 ? atoi(argv[1]) : 2000);
+    int operations = (argc > 2 ? atoi(argv[2]) : 200000);
+    if (sessions < 2 || operations < 1) {
+        fprintf(stderr, "usage: frontendbench.exe [ <sessions> [ <operations> ] ]\n");
+        return 1;
+    }
+    BenchSession *s = malloc(sizeof(BenchSession) * sessions);
+    int failures = 0;
+    failures += bench_registry(s, sessions, operations);
+    failures += bench_pointer_array(s, sessions, operations);
+    free(s);
+    if (failures) {
+        printf("%d lookup(s) failed\n", failures);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+#include "logwriterthread.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct LwLock {
+    pthread_mutex_t mutex;
+};
+
+struct LwEvent {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool manual_reset;
+    bool set;
+};
+
+typedef struct {
+    void (*func)(void *param);
+    void *param;
+} ThreadStart;
+
+LwLock *lw_lock_new(void)
+{
+    LwLock *l = malloc(sizeof(LwLock));
+    pthread_mutex_init(&l->mutex, NULL);
+    return l;
+}
+
+void lw_lock(LwLock *l)
+{
+    pthread_mutex_lock(&l->mutex);
+}
+
+void lw_unlock(LwLock *l)
+{
+    pthread_mutex_unlock(&l->mutex);
+}
+
+LwEvent *lw_event_new(bool manual_reset)
+{
+    LwEvent *e = malloc(sizeof(LwEvent));
+    pthread_mutex_init(&e->mutex, NULL);
+    pthread_cond_init(&e->cond, NULL);
+    e->manual_reset = manual_reset;
+    e->set = false;
+    return e;
+}
+
+void lw_event_free(LwEvent *e)
+{
+    pthread_cond_destroy(&e->cond);
+    pthread_mutex_destroy(&e->mutex);
+    free(e);
+}
+
+void lw_event_set(LwEvent *e)
+{
+    pthread_mutex_lock(&e->mutex);
+    e->set = true;
+    pthread_cond_broadcast(&e->cond);
+    pthread_mutex_unlock(&e->mutex);
+}
+
+bool lw_event_wait(LwEvent *e, int timeout_ms)
+{
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    if (timeout_ms >= 0) {
+        until.tv_sec += timeout_ms / 1000;
+        until.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+    }
+    pthread_mutex_lock(&e->mutex);
+    int err = 0;
+    while (!e->set && err != ETIMEDOUT) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&e->cond, &e->mutex);
+        } else {
+            err = pthread_cond_timedwait(&e->cond, &e->mutex, &until);
+        }
+    }
+    bool signalled = e->set;
+    if (!e->manual_reset) {
+        e->set = false;
+    }
+    pthread_mutex_unlock(&e->mutex);
+    return signalled;
+}
+
+static void *threadfunc(void *param)
+{
+    ThreadStart start = *(ThreadStart *)param;
+    free(param);
+    start.func(start.param);
+    return NULL;
+}
+
+void lw_thread_start(void (*func)(void *param), void *param)
+{
+    ThreadStart *start = malloc(sizeof(ThreadStart));
+    start->func = func;
+    start->param = param;
+    pthread_t thread;
+    pthread_create(&thread, NULL, threadfunc, start);
+    pthread_detach(thread);
+}
+
+void lw_sleep(int ms)
+{
+    struct timespec t = {ms / 1000, (long)(ms % 1000) * 1000000};
+    nanosleep(&t, NULL);
+}
+
+void lw_barrier(void)
+{
+    __sync_synchronize();
+}
+
+long lw_exchange(volatile long *p, long value)
+{
+    long old = __sync_lock_test_and_set(p, value);
+    __sync_synchronize();
+    return old;
+}
@@ -0,0 +1,16 @@
+#include <stdio.h>
+
+int test_sessionregistry();
+int test_glyphwidth();
+int test_logwriter();
+
+int main()
+{
+    int failures = 0;
+    failures += test_sessionregistry();
+    failures += test_glyphwidth();
+    failures += test_logwriter();
+
+    printf("\n=== Summary: %d test(s) failed ===\n", failures);
+    return failures ? 1 : 0;
+}
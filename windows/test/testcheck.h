@@ -0,0 +1,19 @@
+#ifndef TESTCHECK_H
+#define TESTCHECK_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Evaluates to 1 and reports the condition if it is false, to 0 if it
+   holds, so the tests add it up to their failure count. */
+#define CHECK(cond) test_check(cond, #cond, __FILE__, __LINE__)
+
+static inline int test_check(bool ok, const char *text, const char *file, int line)
+{
+    if (!ok) {
+        printf("FAIL %s:%d: %s\n", file, line, text);
+    }
+    return ok ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include "glyphwidth.h"
+#include "testcheck.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct {
+    int calls;
+    unsigned int last;
+} FakeMeasurer;
+
+static int fake_measure(void *ctx, unsigned int cp)
+{
+    FakeMeasurer *fm = (FakeMeasurer *)ctx;
+    fm->calls++;
+    fm->last = cp;
+    if (cp == 0xFFFF) {
+        return 0;
+    }
+    if (cp == 0xFFFE) {
+        return 1000;
+    }
+    return cp >= 0x1100 ? 2 : 1;
+}
+
+static int test_hit_miss()
+{
+    printf("\n--- hit/miss ---\n");
+    int failures = 0;
+    FakeMeasurer fm = {0, 0};
+    GlyphWidthTable t;
+    glyph_width_table_init(&t);
+
+    failures += CHECK(glyph_width_table_get(&t, 0x4E2D, fake_measure, &fm) == 2);
+    failures += CHECK(fm.calls == 1 && fm.last == 0x4E2D);
+    failures += CHECK(glyph_width_table_get(&t, 0x4E2D, fake_measure, &fm) == 2);
+    failures += CHECK(fm.calls == 1);
+    failures += CHECK(glyph_width_table_get(&t, 0x4E2E, fake_measure, &fm) == 2);
+    failures += CHECK(glyph_width_table_get(&t, 0x00E9, fake_measure, &fm) == 1);
+    failures += CHECK(glyph_width_table_get(&t, 0x1F600, fake_measure, &fm) == 2);
+    failures += CHECK(fm.calls == 4);
+    failures += CHECK(t.hits == 1 && t.misses == 4);
+
+    /* zero width is a valid result and is kept as well */
+    failures += CHECK(glyph_width_table_get(&t, 0xFFFF, fake_measure, &fm) == 0);
+    failures += CHECK(glyph_width_table_get(&t, 0xFFFF, fake_measure, &fm) == 0);
+    failures += CHECK(fm.calls == 5);
+
+    glyph_width_table_clear(&t);
+    failures += CHECK(t.hits == 0 && t.misses == 0);
+    failures += CHECK(glyph_width_table_get(&t, 0x4E2D, fake_measure, &fm) == 2);
+    failures += CHECK(fm.calls == 6);
+    glyph_width_table_clear(&t);
+    return failures;
+}
+
+static int test_uncacheable()
+{
+    printf("\n--- uncacheable ---\n");
+    int failures = 0;
+    FakeMeasurer fm = {0, 0};
+    GlyphWidthTable t;
+    glyph_width_table_init(&t);
+
+    failures += CHECK(glyph_width_table_get(&t, 0xFFFE, fake_measure, &fm) == 1000);
+    failures += CHECK(glyph_width_table_get(&t, 0xFFFE, fake_measure, &fm) == 1000);
+    failures += CHECK(fm.calls == 2);
+
+    failures += CHECK(glyph_width_table_get(&t, GLYPH_WIDTH_MAX, fake_measure, &fm) == 2);
+    failures += CHECK(glyph_width_table_get(&t, GLYPH_WIDTH_MAX, fake_measure, &fm) == 2);
+    failures += CHECK(fm.calls == 4);
+    failures += CHECK(t.hits == 0 && t.misses == 4);
+
+    glyph_width_table_clear(&t);
+    return failures;
+}
+
+int test_glyphwidth()
+{
+    int failures = 0;
+    failures += test_hit_miss();
+    failures += test_uncacheable();
+    return failures;
+}
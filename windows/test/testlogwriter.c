@@ -0,0 +1,146 @@
+#include "logwriter.h"
+#include "testcheck.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_FILE "testlogwriter.tmp"
+
+static char pattern(size_t i)
+{
+    return (char)(i * 7 + i / 251);
+}
+
+static void fill(char *buf, size_t from, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = pattern(from + i);
+    }
+}
+
+/* Whether the file holds len bytes of the pattern. */
+static bool check_file(size_t len)
+{
+    FILE *fp = fopen(TEST_FILE, "rb");
+    if (!fp) {
+        return false;
+    }
+    size_t i = 0;
+    int c;
+    while ((c = fgetc(fp)) != EOF) {
+        if (i >= len || (char)c != pattern(i)) {
+            fclose(fp);
+            return false;
+        }
+        i++;
+    }
+    fclose(fp);
+    return i == len;
+}
+
+/* Pieces of odd sizes wrap around the ring, the last one is larger than the
+   ring and has to wait for the writer thread. */
+static int test_block()
+{
+    printf("\n--- block ---\n");
+    int failures = 0;
+    size_t total = 3 * LOG_WRITER_RING_SIZE + 123;
+    char *buf = malloc(total);
+    FILE *fp = fopen(TEST_FILE, "wb");
+    LogWriter *w = log_writer_new(fp);
+    failures += CHECK(log_writer_find(fp) == w);
+
+    size_t pos = 0;
+    while (pos < LOG_WRITER_RING_SIZE) {
+        fill(buf, pos, 4097);
+        failures += CHECK(log_writer_write(w, buf, 4097, LOG_WRITER_BLOCK));
+        pos += 4097;
+    }
+    fill(buf, pos, total - pos);
+    failures += CHECK(log_writer_write(w, buf, total - pos, LOG_WRITER_BLOCK));
+
+    LogWriterStats stats;
+    failures += CHECK(log_writer_close(w, &stats));
+    failures += CHECK(log_writer_find(fp) == NULL);
+    fclose(fp);
+    failures += CHECK(stats.bytes_queued == total && stats.bytes_written == total);
+    failures += CHECK(stats.bytes_dropped == 0 && stats.max_spilled == 0);
+    failures += CHECK(stats.max_queue_depth <= LOG_WRITER_RING_SIZE);
+    failures += CHECK(stats.flushes >= 1);
+    failures += CHECK(check_file(total));
+    free(buf);
+    return failures;
+}
+
+static int test_drop()
+{
+    printf("\n--- drop ---\n");
+    int failures = 0;
+    size_t total = LOG_WRITER_RING_SIZE + 100;
+    char *buf = malloc(total);
+    fill(buf, 0, total);
+    FILE *fp = fopen(TEST_FILE, "wb");
+    LogWriter *w = log_writer_new(fp);
+
+    log_writer_pause(true);
+    failures += CHECK(log_writer_write(w, buf, LOG_WRITER_RING_SIZE, LOG_WRITER_DROP));
+    failures += CHECK(log_writer_write(w, buf + LOG_WRITER_RING_SIZE, 100, LOG_WRITER_DROP));
+    LogWriterStats all;
+    log_writer_get_stats(&all);
+    failures += CHECK(all.queue_depth == LOG_WRITER_RING_SIZE && all.spilled == 0);
+    log_writer_pause(false);
+
+    LogWriterStats stats;
+    failures += CHECK(log_writer_close(w, &stats));
+    fclose(fp);
+    failures += CHECK(stats.bytes_queued == total);
+    failures += CHECK(stats.bytes_written == LOG_WRITER_RING_SIZE);
+    failures += CHECK(stats.bytes_dropped == 100);
+    failures += CHECK(check_file(LOG_WRITER_RING_SIZE));
+    free(buf);
+    return failures;
+}
+
+/* The spilled data is written after the ring, in order, also when more is
+   written while some is still spilled. */
+static int test_spill()
+{
+    printf("\n--- spill ---\n");
+    int failures = 0;
+    size_t total = LOG_WRITER_RING_SIZE + 300;
+    char *buf = malloc(total);
+    fill(buf, 0, total);
+    FILE *fp = fopen(TEST_FILE, "wb");
+    LogWriter *w = log_writer_new(fp);
+
+    log_writer_pause(true);
+    failures += CHECK(log_writer_write(w, buf, LOG_WRITER_RING_SIZE - 50, LOG_WRITER_SPILL));
+    failures += CHECK(log_writer_write(w, buf + LOG_WRITER_RING_SIZE - 50, 150, LOG_WRITER_SPILL));
+    failures += CHECK(log_writer_write(w, buf + LOG_WRITER_RING_SIZE + 100, 200, LOG_WRITER_SPILL));
+    LogWriterStats all;
+    log_writer_get_stats(&all);
+    failures += CHECK(all.queue_depth == LOG_WRITER_RING_SIZE && all.spilled == 300);
+    log_writer_pause(false);
+
+    LogWriterStats stats;
+    failures += CHECK(log_writer_close(w, &stats));
+    fclose(fp);
+    failures += CHECK(stats.bytes_queued == total && stats.bytes_written == total);
+    failures += CHECK(stats.bytes_dropped == 0);
+    failures += CHECK(stats.max_spilled == 300);
+    failures += CHECK(stats.max_queue_depth == total);
+    failures += CHECK(check_file(total));
+    free(buf);
+    return failures;
+}
+
+int test_logwriter()
+{
+    int failures = 0;
+    failures += test_block();
+    failures += test_drop();
+    failures += test_spill();
+    remove(TEST_FILE);
+    return failures;
+}
@@ -0,0 +1,208 @@
+#include "sessionregistry.h"
+#include "testcheck.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int check_order(const int *ids, int count)
+{
+    int failures = CHECK(session_registry_size() == count);
+    for (int i = 0; i < count && !failures; i++) {
+        failures += CHECK(session_registry_id_at(i) == ids[i]);
+        failures += CHECK(session_registry_index_of(ids[i]) == i);
+    }
+    return failures;
+}
+
+static int test_add_remove()
+{
+    printf("\n--- add/remove ---\n");
+    int failures = 0;
+    int values[4];
+    session_registry_reset();
+
+    int a = session_registry_add(&values[0], 0);
+    int c = session_registry_add(&values[2], 1);
+    int b = session_registry_add(&values[1], 1);
+    int d = session_registry_add(&values[3], 0);
+    failures += check_order((int[]){d, a, b, c}, 4);
+    failures += CHECK(session_registry_get(b) == &values[1]);
+    failures += CHECK(session_registry_at(0) == &values[3]);
+
+    failures += CHECK(session_registry_remove(a) == &values[0]);
+    failures += CHECK(session_registry_get(a) == NULL);
+    failures += check_order((int[]){d, b, c}, 3);
+
+    int e = session_registry_add(&values[0], 3);
+    failures += CHECK(e != a);
+    failures += CHECK(session_registry_get(a) == NULL);
+    failures += CHECK(session_registry_get(e) == &values[0]);
+    failures += check_order((int[]){d, b, c, e}, 4);
+
+    session_registry_remove(d);
+    session_registry_remove(e);
+    failures += check_order((int[]){b, c}, 2);
+    session_registry_remove(b);
+    session_registry_remove(c);
+    failures += CHECK(session_registry_size() == 0);
+    failures += CHECK(session_registry_get(0) == NULL);
+    failures += CHECK(session_registry_get(-1) == NULL);
+
+    session_registry_reset();
+    return failures;
+}
+
+static int test_move()
+{
+    printf("\n--- move ---\n");
+    int failures = 0;
+    int values[5];
+    int ids[5];
+    session_registry_reset();
+    for (int i = 0; i < 5; i++) {
+        ids[i] = session_registry_add(&values[i], i);
+    }
+
+    session_registry_move(ids[0], 3);
+    failures += check_order((int[]){ids[1], ids[2], ids[3], ids[0], ids[4]}, 5);
+    session_registry_move(ids[4], 0);
+    failures += check_order((int[]){ids[4], ids[1], ids[2], ids[3], ids[0]}, 5);
+    session_registry_move(ids[4], 4);
+    failures += check_order((int[]){ids[1], ids[2], ids[3], ids[0], ids[4]}, 5);
+    session_registry_move(ids[1], 0);
+    failures += check_order((int[]){ids[1], ids[2], ids[3], ids[0], ids[4]}, 5);
+    session_registry_move(ids[2], 2);
+    failures += check_order((int[]){ids[1], ids[3], ids[2], ids[0], ids[4]}, 5);
+
+    session_registry_reset();
+    return failures;
+}
+
+typedef struct {
+    int *ids;
+    int visited[8];
+    int count;
+} IterationContext;
+
+static bool remove_while_iterating(void *p, void *vctx)
+{
+    IterationContext *ctx = (IterationContext *)vctx;
+    int value = *(int *)p;
+    ctx->visited[ctx->count++] = value;
+    if (value == 1) {
+        session_registry_remove(ctx->ids[1]);
+        session_registry_remove(ctx->ids[2]);
+    }
+    if (value == 4) {
+        session_registry_remove(ctx->ids[4]);
+        return false;
+    }
+    return true;
+}
+
+static int test_foreach()
+{
+    printf("\n--- foreach ---\n");
+    int failures = 0;
+    int values[6] = {0, 1, 2, 3, 4, 5};
+    int ids[6];
+    session_registry_reset();
+    for (int i = 0; i < 6; i++) {
+        ids[i] = session_registry_add(&values[i], i);
+    }
+
+    IterationContext ctx = {ids, {0}, 0};
+    session_registry_foreach(remove_while_iterating, &ctx);
+    failures += CHECK(ctx.count == 4);
+    failures += CHECK(ctx.visited[0] == 0 && ctx.visited[1] == 1 &&
+                      ctx.visited[2] == 3 && ctx.visited[3] == 4);
+    failures += check_order((int[]){ids[0], ids[3], ids[5]}, 3);
+
+    int id = session_registry_add(&values[1], 1);
+    failures += CHECK(id != ids[1] && id != ids[2] && id != ids[4]);
+    failures += CHECK(session_registry_get(ids[2]) == NULL);
+    failures += check_order((int[]){ids[0], id, ids[3], ids[5]}, 4);
+
+    session_registry_reset();
+    return failures;
+}
+
+/* A short random churn, benchmark.c runs a longer one and times it. */
+static int test_churn()
+{
+    printf("\n--- churn ---\n");
+    enum { SESSIONS = 50, OPERATIONS = 5000 };
+    int failures = 0;
+    static int values[SESSIONS];
+    static int ids[SESSIONS];
+    int count = 0;
+    session_registry_reset();
+    srand(1);
+
+    for (; count < SESSIONS; count++) {
+        values[count] = count;
+        ids[count] = session_registry_add(&values[count], count);
+    }
+    for (int i = 0; i < OPERATIONS; i++) {
+        int n = rand() % count;
+        switch (i % 4) {
+          case 0:
+            session_registry_remove(ids[n]);
+            ids[n] = session_registry_add(&values[n], rand() % count);
+            break;
+          case 1:
+            session_registry_move(ids[n], rand() % count);
+            break;
+          case 2:
+            failures += CHECK(session_registry_get(ids[n]) == &values[n]);
+            break;
+          case 3:
+            failures += CHECK(session_registry_id_at(session_registry_index_of(ids[n])) == ids[n]);
+            break;
+        }
+        if (failures) {
+            break;
+        }
+    }
+    failures += CHECK(session_registry_size() == SESSIONS);
+
+    session_registry_reset();
+    return failures;
+}
+
+/* A slot reused until its generation is used up is retired, none of its
+   ids come back. */
+static int test_retire()
+{
+    printf("\n--- retire ---\n");
+    int failures = 0;
+    int value;
+    session_registry_reset();
+
+    int first = session_registry_add(&value, 0);
+    session_registry_remove(first);
+    int last = first;
+    for (int i = 0; i < 0x8000 && !failures; i++) {
+        int id = session_registry_add(&value, 0);
+        failures += CHECK(id > 0 && id != first && id != last);
+        failures += CHECK(session_registry_get(first) == NULL);
+        session_registry_remove(id);
+        last = id;
+    }
+    failures += CHECK(session_registry_size() == 0);
+
+    session_registry_reset();
+    return failures;
+}
+
+int test_sessionregistry()
+{
+    int failures = 0;
+    failures += test_add_remove();
+    failures += test_move();
+    failures += test_foreach();
+    failures += test_churn();
+    failures += test_retire();
+    return failures;
+}
@@ -21,6 +21,7 @@
 #include "security-api.h"
 #include "win-gui-seat.h"
 #include "tree234.h"
+#include "terminal_public.h"
 
 #ifdef NO_MULTIMON
 #include <multimon.h>
@@ -57,6 +58,7 @@
 #define IDM_FIND      0x01C0
 #define IDM_SPECIALSEP 0x0200
 #define IDM_DUPSESS_SFTP 0x0210
+#define IDM_SAVEDFOLDER 0x0220
 
 #define IDM_SPECIAL_MIN 0x0400
 #define IDM_SPECIAL_MAX 0x0800
@@ -66,6 +68,9 @@
 #define MENU_SAVED_STEP 16
 /* Maximum number of sessions on saved-session submenu */
 #define MENU_SAVED_MAX ((IDM_SAVED_MAX-IDM_SAVED_MIN) / MENU_SAVED_STEP)
+#define IDM_SAVEDFOLDER_MIN 0x5000
+#define IDM_SAVEDFOLDER_MAX 0x6000
+#define MENU_SAVEDFOLDER_MAX ((IDM_SAVEDFOLDER_MAX-IDM_SAVEDFOLDER_MIN) / MENU_SAVED_STEP)
 
 #define WM_IGNORE_CLIP (WM_APP + 2)
 #define WM_FULLSCR_ON_MAX (WM_APP + 3)
@@ -147,6 +152,9 @@ static HMENU savedsess_menu;
 static void conf_cache_data(WinGuiFrontend *);
 
 static struct sesslist sesslist;       /* for saved-session menu */
+static char **savedsess_folders;
+static int n_savedsess_folders;
+static size_t savedsess_folders_size;
 
 #define FONT_NORMAL 0
 #define FONT_BOLD 1
@@ -254,7 +262,7 @@ struct WinGuiFrontend {
     bool remote_closed;
     bool delete_session;
     int remote_exitcode;
-    int tab_index;
+    int registry_id;
     bool cursor_visible;
     bool cursor_forced_visible;
     struct {
@@ -264,6 +272,11 @@ struct WinGuiFrontend {
     } resize_either;
     bool term_palette_init;
     int font_dpi;
+    struct FontCacheEntry *font_cache;
+    struct BulkLaunch *bulk_launch;
+    bool hibernated;
+    unsigned long last_visible;
+    TermHibernation hibernation;
     struct {
       wchar_t *pattern;
       int pattern_buffer_len;
@@ -281,7 +294,8 @@ static bool confirm_paste = true;
 
 #include "frame.h"
 #include "tabbar.h"
-#include "pointerarray.h"
+#include "sessionregistry.h"
+#include "glyphwidth.h"
 #include "pastedlg.h"
 #include "finddlg.h"
 #include "find/find.h"
@@ -359,6 +373,7 @@ static size_t win_seat_output(
     Seat *seat, SeatOutputType type, const void *, size_t);
 static bool win_seat_eof(Seat *seat);
 static SeatPromptResult win_seat_get_userpass_input(Seat *seat, prompts_t *p);
+static void win_seat_notify_session_started(Seat *seat);
 static void win_seat_notify_remote_exit(Seat *seat);
 static void win_seat_connection_fatal(Seat *seat, const char *msg);
 static void win_seat_update_specials_menu(Seat *seat);
@@ -396,7 +411,7 @@ static const SeatVtable win_seat_vt = {
     .sent = nullseat_sent,
     .banner = nullseat_banner_to_stderr,
     .get_userpass_input = win_seat_get_userpass_input,
-    .notify_session_started = nullseat_notify_session_started,
+    .notify_session_started = win_seat_notify_session_started,
     .notify_remote_exit = win_seat_notify_remote_exit,
     .notify_remote_disconnect = nullseat_notify_remote_disconnect,
     .connection_fatal = win_seat_connection_fatal,
@@ -562,9 +577,20 @@ static void stop_backend(WinGuiFrontend *wgf)
     }
 }
 
-static void frontend_set_tab_index(void *p, int index) {
+static int frontend_tab_index(WinGuiFrontend *wgf) {
+    return session_registry_index_of(wgf->registry_id);
+}
+
+static bool close_frontend(void *p, void *) {
     WinGuiFrontend *wgf = (WinGuiFrontend *)p;
-    wgf->tab_index = index;
+    if (wgf->backend) {
+        stop_backend(wgf);
+    }
+    if (wgf->remote_closed) {
+        delete_callbacks_for_context(wgf);
+    }
+    destroy_frontend(wgf);
+    return true;
 }
 
 static bool is_session_deletable(WinGuiFrontend *wgf) {
@@ -588,11 +614,12 @@ static void remote_close(WinGuiFrontend *wgf, int exitcode, const char *msg) {
     queue_toplevel_callback(remote_close_callback, wgf);
     wgf->remote_closed = true;
     wgf->remote_exitcode = exitcode;
+    bulk_launch_session_done(wgf, false);
 
     if (is_session_deletable(wgf)) {
         return;
     }
-    tab_bar_set_tab_unusable(wgf->tab_index, true);
+    tab_bar_set_tab_unusable(frontend_tab_index(wgf), true);
     add_error_message_to_term(wgf, msg);
 }
 
@@ -630,6 +657,9 @@ HINSTANCE hinst;
 static const char *term_class_name = "TermWindow";
 
 extern const char *cmdline_session_name;
+extern char **cmdline_bulk_sessions;
+extern int cmdline_bulk_count;
+extern int cmdline_hibernate_minutes;
 extern const BackendVtable conpty_backend;
 extern const BackendVtable sftp_backend;
 extern BackendVtable conpty_backend_puttypp;
@@ -760,12 +790,12 @@ int WINAPI WinMain(HINSTANCE inst, HINSTANCE prev, LPSTR cmdline, int show)
         create_tab_bar();
         add_session_tab(conf_get_int(conf, CONF_protocol), cmdline_session_name, 0);
         tab_bar_set_measurement(get_dpi_aware_tab_bar_font());
-        pointer_array_reset(frontend_set_tab_index);
+        session_registry_reset();
     }
 
     wgf_active = create_frontend(conf, cmdline_session_name);
     WinGuiFrontend *wgf = wgf_active;
-    pointer_array_insert(0, wgf);
+    wgf->registry_id = session_registry_add(wgf, 0);
 
     /*
      * Correct the guesses for extra_{width,height}.
@@ -858,6 +888,13 @@ int WINAPI WinMain(HINSTANCE inst, HINSTANCE prev, LPSTR cmdline, int show)
 
     winselgui_set_hwnd(frame_hwnd);
     start_backend(wgf);
+    if (cmdline_bulk_count > 0) {
+        bulk_launch(cmdline_bulk_sessions, cmdline_bulk_count, false);
+        free_bulk_session_list(cmdline_bulk_sessions, cmdline_bulk_count);
+        cmdline_bulk_sessions = NULL;
+        cmdline_bulk_count = 0;
+    }
+    start_hibernate_timer();
 
     /*
      * Set up the initial input locale.
@@ -1095,6 +1132,36 @@ static void update_savedsess_menu(void)
                    sesslist.sessions[i]);
     if (sesslist.nsessions <= 1)
         AppendMenu(savedsess_menu, MF_GRAYED, IDM_SAVED_MIN, "(No sessions)");
+
+    /* "folder/name" sessions can be opened together with their folder */
+    for (i = 0; i < n_savedsess_folders; i++)
+        sfree(savedsess_folders[i]);
+    n_savedsess_folders = 0;
+    for (i = 1; i < sesslist.nsessions &&
+                n_savedsess_folders < MENU_SAVEDFOLDER_MAX; i++) {
+        const char *slash = strchr(sesslist.sessions[i], '/');
+        int j;
+        if (!slash)
+            continue;
+        char *folder = dupprintf("%.*s", (int)(slash - sesslist.sessions[i] + 1),
+                                 sesslist.sessions[i]);
+        for (j = 0; j < n_savedsess_folders; j++)
+            if (!strcmp(savedsess_folders[j], folder))
+                break;
+        if (j < n_savedsess_folders) {
+            sfree(folder);
+            continue;
+        }
+        if (n_savedsess_folders == 0)
+            AppendMenu(savedsess_menu, MF_SEPARATOR, 0, 0);
+        char *title = dupprintf("Open All in %s", folder);
+        AppendMenu(savedsess_menu, MF_ENABLED,
+                   IDM_SAVEDFOLDER_MIN + n_savedsess_folders*MENU_SAVED_STEP,
+                   title);
+        sfree(title);
+        sgrowarray(savedsess_folders, savedsess_folders_size, n_savedsess_folders);
+        savedsess_folders[n_savedsess_folders++] = folder;
+    }
 }
 
 static bool win_seat_is_utf8(Seat *seat)
@@ -1481,7 +1548,7 @@ static void init_dpi_info(void)
  *
  * - find a trust sigil icon that will look OK with the chosen font.
  */
-static void init_fonts(WinGuiFrontend *wgf, int pick_width, int pick_height)
+static void create_fonts(WinGuiFrontend *wgf, int pick_width, int pick_height)
 {
     Conf *conf = wgf->conf;
     TEXTMETRIC tm;
@@ -1672,6 +1739,152 @@ static void init_fonts(WinGuiFrontend *wgf, int pick_width, int pick_height)
     wgf->fontflag[0] = true;
     wgf->fontflag[1] = true;
     wgf->fontflag[2] = true;
+}
+
+/*
+ * Sessions using the same font spec, quality and bold style at the same DPI
+ * and cell size share their fonts, the trust sigil icon and the character
+ * width table through a reference counted cache entry.
+ */
+typedef struct FontCacheEntry FontCacheEntry;
+struct FontCacheEntry {
+    char *name;
+    int charset;
+    int height;
+    bool isbold;
+    int quality;
+    int bold_style;
+    int dpi;
+    int pick_width;
+    int pick_height;
+
+    int refcount;
+    HFONT fonts[FONT_MAXNO];
+    bool fontflag[FONT_MAXNO];
+    LOGFONT lfont;
+    int bold_font_mode;
+    int und_mode;
+    int descent;
+    int font_strikethrough_y;
+    int font_width;
+    int font_height;
+    bool font_dualwidth;
+    bool font_varpitch;
+    int font_codepage;
+    bool dbcs_screenfont;
+    HICON trust_icon;
+    GlyphWidthTable widths;
+    FontCacheEntry *next;
+};
+
+static FontCacheEntry *font_cache = NULL;
+
+static FontCacheEntry *font_cache_find(Conf *conf, int pick_width, int pick_height)
+{
+    FontSpec *font = conf_get_fontspec(conf, CONF_font);
+    int quality = conf_get_int(conf, CONF_font_quality);
+    int bold_style = conf_get_int(conf, CONF_bold_style);
+    for (FontCacheEntry *fce = font_cache; fce; fce = fce->next) {
+        if (!strcmp(fce->name, font->name) && fce->charset == font->charset &&
+            fce->height == font->height && fce->isbold == font->isbold &&
+            fce->quality == quality && fce->bold_style == bold_style &&
+            fce->dpi == dpi_info.y && fce->pick_width == pick_width &&
+            fce->pick_height == pick_height) {
+            return fce;
+        }
+    }
+    return NULL;
+}
+
+static FontCacheEntry *font_cache_add(WinGuiFrontend *wgf, int pick_width, int pick_height)
+{
+    Conf *conf = wgf->conf;
+    FontSpec *font = conf_get_fontspec(conf, CONF_font);
+    FontCacheEntry *fce = snew(FontCacheEntry);
+    fce->name = dupstr(font->name);
+    fce->charset = font->charset;
+    fce->height = font->height;
+    fce->isbold = font->isbold;
+    fce->quality = conf_get_int(conf, CONF_font_quality);
+    fce->bold_style = conf_get_int(conf, CONF_bold_style);
+    fce->dpi = dpi_info.y;
+    fce->pick_width = pick_width;
+    fce->pick_height = pick_height;
+
+    fce->refcount = 1;
+    memcpy(fce->fonts, wgf->fonts, sizeof(fce->fonts));
+    memcpy(fce->fontflag, wgf->fontflag, sizeof(fce->fontflag));
+    fce->lfont = wgf->lfont;
+    fce->bold_font_mode = wgf->bold_font_mode;
+    fce->und_mode = wgf->und_mode;
+    fce->descent = wgf->descent;
+    fce->font_strikethrough_y = wgf->font_strikethrough_y;
+    fce->font_width = wgf->font_width;
+    fce->font_height = wgf->font_height;
+    fce->font_dualwidth = wgf->font_dualwidth;
+    fce->font_varpitch = wgf->font_varpitch;
+    fce->font_codepage = wgf->ucsdata.font_codepage;
+    fce->dbcs_screenfont = wgf->ucsdata.dbcs_screenfont;
+    fce->trust_icon = wgf->trust_icon;
+    glyph_width_table_init(&fce->widths);
+    fce->next = font_cache;
+    font_cache = fce;
+    return fce;
+}
+
+static void font_cache_load(WinGuiFrontend *wgf, FontCacheEntry *fce)
+{
+    memcpy(wgf->fonts, fce->fonts, sizeof(wgf->fonts));
+    memcpy(wgf->fontflag, fce->fontflag, sizeof(wgf->fontflag));
+    wgf->lfont = fce->lfont;
+    wgf->bold_font_mode = fce->bold_font_mode;
+    wgf->bold_colours = fce->bold_style & 2 ? true : false;
+    wgf->und_mode = fce->und_mode;
+    wgf->descent = fce->descent;
+    wgf->font_strikethrough_y = fce->font_strikethrough_y;
+    wgf->font_width = fce->font_width;
+    wgf->font_height = fce->font_height;
+    wgf->font_dualwidth = fce->font_dualwidth;
+    wgf->font_varpitch = fce->font_varpitch;
+    wgf->ucsdata.font_codepage = fce->font_codepage;
+    wgf->ucsdata.dbcs_screenfont = fce->dbcs_screenfont;
+    wgf->trust_icon = fce->trust_icon;
+}
+
+static void font_cache_release(FontCacheEntry *fce)
+{
+    if (--fce->refcount > 0) {
+        return;
+    }
+    FontCacheEntry **prev = &font_cache;
+    while (*prev != fce) {
+        prev = &(*prev)->next;
+    }
+    *prev = fce->next;
+    for (int i = 0; i < FONT_MAXNO; i++) {
+        if (fce->fonts[i])
+            DeleteObject(fce->fonts[i]);
+    }
+    if (fce->trust_icon != INVALID_HANDLE_VALUE) {
+        DestroyIcon(fce->trust_icon);
+    }
+    glyph_width_table_clear(&fce->widths);
+    sfree(fce->name);
+    sfree(fce);
+}
+
+static void init_fonts(WinGuiFrontend *wgf, int pick_width, int pick_height)
+{
+    Conf *conf = wgf->conf;
+    FontCacheEntry *fce = font_cache_find(conf, pick_width, pick_height);
+    if (fce) {
+        fce->refcount++;
+        font_cache_load(wgf, fce);
+    } else {
+        create_fonts(wgf, pick_width, pick_height);
+        fce = font_cache_add(wgf, pick_width, pick_height);
+    }
+    wgf->font_cache = fce;
 
     const char *line_codepage_backup = NULL;
     if (backend_vt_from_conf(conf)->protocol == PROT_SFTP) {
@@ -1703,6 +1916,12 @@ static void another_font(WinGuiFrontend *wgf, int fontno)
     if (fontno < 0 || fontno >= FONT_MAXNO || wgf->fontflag[fontno])
         return;
 
+    if (wgf->font_cache->fontflag[fontno]) {
+        wgf->fonts[fontno] = wgf->font_cache->fonts[fontno];
+        wgf->fontflag[fontno] = true;
+        return;
+    }
+
     basefont = (fontno & ~(FONT_BOLDUND));
     if (basefont != fontno && !wgf->fontflag[basefont])
         another_font(wgf, basefont);
@@ -1743,22 +1962,23 @@ static void another_font(WinGuiFrontend *wgf, int fontno)
                    DEFAULT_PITCH | FF_DONTCARE, s);
 
     wgf->fontflag[fontno] = true;
+    wgf->font_cache->fonts[fontno] = wgf->fonts[fontno];
+    wgf->font_cache->fontflag[fontno] = true;
 }
 
 static void deinit_fonts(WinGuiFrontend *wgf)
 {
     int i;
     for (i = 0; i < FONT_MAXNO; i++) {
-        if (wgf->fonts[i])
-            DeleteObject(wgf->fonts[i]);
         wgf->fonts[i] = 0;
         wgf->fontflag[i] = false;
     }
+    wgf->trust_icon = INVALID_HANDLE_VALUE;
 
-    if (wgf->trust_icon != INVALID_HANDLE_VALUE) {
-        DestroyIcon(wgf->trust_icon);
+    if (wgf->font_cache) {
+        font_cache_release(wgf->font_cache);
+        wgf->font_cache = NULL;
     }
-    wgf->trust_icon = INVALID_HANDLE_VALUE;
 }
 
 static void wintw_request_resize(TermWin *tw, int w, int h)
@@ -2221,6 +2441,12 @@ static void exit_callback(void *vctx)
     }
 }
 
+static void win_seat_notify_session_started(Seat *seat)
+{
+    WinGuiFrontend *wgf = container_of(seat, WinGuiFrontend, seat);
+    bulk_launch_session_done(wgf, true);
+}
+
 static void win_seat_notify_remote_exit(Seat *seat)
 {
     queue_toplevel_callback(exit_callback, seat);
@@ -2371,16 +2597,7 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT message,
             return 0;
         }
         SetFocus(NULL);
-        for (int i=0; i<pointer_array_size(); i++) {
-            WinGuiFrontend *wgf = (WinGuiFrontend *)pointer_array_get(i);
-            if (wgf->backend) {
-                stop_backend(wgf);
-            }
-            if (wgf->remote_closed) {
-                delete_callbacks_for_context(wgf);
-            }
-            destroy_frontend(wgf);
-        }
+        session_registry_foreach(close_frontend, NULL);
         wgf_active = NULL;
         DestroyWindow(hwnd);
         return 0;
@@ -2392,7 +2609,7 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT message,
         DestroyWindow(term_hwnd);
         destroy_tab_bar();
         finddlg_destroy();
-        pointer_array_reset(NULL);
+        session_registry_reset();
         find_match_mask_free(&find_match_mask);
         PostQuitMessage(0);
         return 0;
@@ -2459,7 +2676,7 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT message,
             nmhdr._hdr.hwndFrom = hwnd;
             nmhdr._hdr.code = TCN_TABDELETE;
             nmhdr._hdr.idFrom = 0;
-            nmhdr._tabOrigin = wgf->tab_index;
+            nmhdr._tabOrigin = frontend_tab_index(wgf);
             SendMessage(hwnd, WM_NOTIFY, 0, (LPARAM)(&nmhdr));
             break;
           }
@@ -2480,21 +2697,21 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT message,
             Conf *conf = NULL;
             const char *session_name = NULL;
             if (create_conf(NULL, &conf, &session_name)) {
-                add_session(conf, session_name, pointer_array_size());
+                add_session(conf, session_name, session_registry_size());
             }
             break;
           }
           case IDM_DUPSESS: {
             Conf *conf = conf_copy(wgf->conf);
             const char *session_name = dupstr(wgf->session_name);
-            add_session(conf, session_name, wgf->tab_index+1);
+            add_session(conf, session_name, frontend_tab_index(wgf)+1);
             break;
           }
           case IDM_DUPSESS_SFTP: {
             Conf *conf = conf_copy(wgf->conf);
             conf_set_int(conf, CONF_protocol, PROT_SFTP);
             const char *session_name = dupstr(wgf->session_name);
-            add_session(conf, session_name, wgf->tab_index+1);
+            add_session(conf, session_name, frontend_tab_index(wgf)+1);
             break;
           }
           case IDM_SAVEDSESS: {
@@ -2505,10 +2722,21 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT message,
             Conf *conf = NULL;
             const char *session_name = NULL;
             if (create_conf(sesslist.sessions[sessno], &conf, &session_name)) {
-                add_session(conf, session_name, pointer_array_size());
+                add_session(conf, session_name, session_registry_size());
             }
             break;
           }
+          case IDM_SAVEDFOLDER: {
+            unsigned int folderno = (lParam - IDM_SAVEDFOLDER_MIN) / MENU_SAVED_STEP;
+            if (folderno >= (unsigned)n_savedsess_folders) {
+                break;
+            }
+            int count;
+            char **names = expand_bulk_session_list(savedsess_folders[folderno], &count);
+            bulk_launch(names, count, true);
+            free_bulk_session_list(names, count);
+            break;
+          }
           case IDM_DUPSESS_NEW: {
             char b[2048];
             char *cl;
@@ -2580,7 +2808,7 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT message,
                 term_pwron(term, false);
                 start_backend(wgf);
                 if (wgf->backend) {
-                    tab_bar_set_tab_unusable(wgf->tab_index, false);
+                    tab_bar_set_tab_unusable(frontend_tab_index(wgf), false);
                 }
             }
 
@@ -2605,7 +2833,7 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT message,
                 sfree((char *)session_name);
             } else {
                 char *tab_title = create_tab_title(wgf->session_id, session_name);
-                tab_bar_set_tab_title(wgf->tab_index, tab_title);
+                tab_bar_set_tab_title(frontend_tab_index(wgf), tab_title);
                 sfree(tab_title);
                 sfree((char *) wgf->session_name);
                 wgf->session_name = session_name;
@@ -2766,6 +2994,9 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT message,
             if (wParam >= IDM_SAVED_MIN && wParam < IDM_SAVED_MAX) {
                 SendMessage(hwnd, WM_SYSCOMMAND, IDM_SAVEDSESS, wParam);
             }
+            if (wParam >= IDM_SAVEDFOLDER_MIN && wParam < IDM_SAVEDFOLDER_MAX) {
+                SendMessage(hwnd, WM_SYSCOMMAND, IDM_SAVEDFOLDER, wParam);
+            }
             if (wParam >= IDM_SPECIAL_MIN && wParam <= IDM_SPECIAL_MAX) {
                 int i = (wParam - IDM_SPECIAL_MIN) / 0x10;
                 /*
@@ -4379,30 +4610,16 @@ static void wintw_draw_trust_sigil(TermWin *tw, int x, int y)
                0, NULL, DI_NORMAL);
 }
 
-/* This function gets the actual width of a character in the normal font.
+/* Measures the width of an already translated character in the normal
+ * font, the result is kept in the width table of the shared font.
  */
-static int wintw_char_width(TermWin *tw, int uc)
+static int measure_char_width(void *ctx, unsigned int cp)
 {
-    WinGuiFrontend *wgf = container_of(tw, WinGuiFrontend, wintw);
+    WinGuiFrontend *wgf = (WinGuiFrontend *)ctx;
     HDC wintw_hdc = wgf->wintw_hdc;
+    int uc = cp;
     int ibuf = 0;
 
-    /* If the font max is the same as the font ave width then this
-     * function is a no-op.
-     */
-    if (!wgf->font_dualwidth) return 1;
-
-    switch (uc & CSET_MASK) {
-      case CSET_ASCII:
-        uc = wgf->ucsdata.unitab_line[uc & 0xFF];
-        break;
-      case CSET_LINEDRW:
-        uc = wgf->ucsdata.unitab_xterm[uc & 0xFF];
-        break;
-      case CSET_SCOACS:
-        uc = wgf->ucsdata.unitab_scoacs[uc & 0xFF];
-        break;
-    }
     if (DIRECT_FONT(uc)) {
         if (wgf->ucsdata.dbcs_screenfont) return 1;
 
@@ -4444,6 +4661,34 @@ static int wintw_char_width(TermWin *tw, int uc)
     return ibuf;
 }
 
+/* This function gets the actual width of a character in the normal font.
+ */
+static int wintw_char_width(TermWin *tw, int uc)
+{
+    WinGuiFrontend *wgf = container_of(tw, WinGuiFrontend, wintw);
+
+    /* If the font max is the same as the font ave width then this
+     * function is a no-op.
+     */
+    if (!wgf->font_dualwidth) return 1;
+
+    switch (uc & CSET_MASK) {
+      case CSET_ASCII:
+        uc = wgf->ucsdata.unitab_line[uc & 0xFF];
+        break;
+      case CSET_LINEDRW:
+        uc = wgf->ucsdata.unitab_xterm[uc & 0xFF];
+        break;
+      case CSET_SCOACS:
+        uc = wgf->ucsdata.unitab_scoacs[uc & 0xFF];
+        break;
+    }
+    if (!wgf->wintw_hdc) {
+        return measure_char_width(wgf, uc);
+    }
+    return glyph_width_table_get(&wgf->font_cache->widths, uc, measure_char_width, wgf);
+}
+
 DECL_WINDOWS_FUNCTION(static, BOOL, FlashWindowEx, (PFLASHWINFO));
 DECL_WINDOWS_FUNCTION(static, BOOL, ToUnicodeEx,
                       (UINT, UINT, const BYTE *, LPWSTR, int, UINT, HKL));
@@ -6190,7 +6435,7 @@ static size_t win_seat_output(Seat *seat, SeatOutputType type,
                 wgf->find.data_arrived = true;
             }
         } else {
-        tab_bar_set_tab_notified(wgf->tab_index);
+        tab_bar_set_tab_notified(frontend_tab_index(wgf));
     }
     }
     return term_data(term, data, len);